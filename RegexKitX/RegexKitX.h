@@ -67,6 +67,90 @@ typedef NS_OPTIONS(NSUInteger, RKXMatchOptions) {
     RKXWithoutAnchoringBounds  = NSMatchingWithoutAnchoringBounds
 };
 
+/** The worst-case complexity of matching a regular expression with a backtracking engine such as ICU, as estimated by @c -regexComplexityWithOptions:hazards:riskScore:error:. */
+typedef NS_ENUM(NSInteger, RKXRegexComplexity) {
+    /** The pattern is invalid or uses syntax the analysis does not model, such as @c RKXIgnoreWhitespace or @c \\Q...\\E quoting. */
+    RKXRegexComplexityUnknown       = 0,
+    /** Matching time grows in proportion to the length of the text. */
+    RKXRegexComplexityLinear,
+    /** Matching time can grow with a power of the length of the text. */
+    RKXRegexComplexityPolynomial,
+    /** Matching time can double with each additional character of a text that fails to match. */
+    RKXRegexComplexityExponential
+};
+
+/** The constructs that can make a backtracking engine take super-linear time. The values can be combined using the C-bitwise @c OR operator. */
+typedef NS_OPTIONS(NSUInteger, RKXRegexHazards) {
+    /** No hazards were found. */
+    RKXRegexHazardNone                      = 0,
+    /** A repetition whose iterations can trade text with a quantifier inside it, as in @c (a+)+ or @c (.*,){10}. */
+    RKXRegexHazardNestedQuantifier          = 1 << 0,
+    /** A repeated alternation whose branches can match the same text, as in @c (a|aa)+ or @c (\\w|\\d)+. */
+    RKXRegexHazardAmbiguousAlternation      = 1 << 1,
+    /** Adjacent unbounded quantifiers that can match the same text, as in @c \\d+\\d+ or @c .*x.*y. */
+    RKXRegexHazardOverlappingQuantifiers    = 1 << 2,
+    /** Lookaround containing an unbounded quantifier that is retried at every position, as in @c (?=.*\\d). */
+    RKXRegexHazardUnboundedLookaround       = 1 << 3,
+    /** An unbounded quantifier in an unanchored pattern that is rescanned from each start position when what follows it fails, as in @c \\s+$. */
+    RKXRegexHazardUnanchoredQuantifier      = 1 << 4
+};
+
+/** The options for line-oriented search with @c -linesMatchedByRegex:range:options:lineOptions:limit:linesBefore:linesAfter:error:. The values can be combined using the C-bitwise @c OR operator. */
+typedef NS_OPTIONS(NSUInteger, RKXLineOptions) {
+    /** Select the lines that contain a match. */
+    RKXLineNoOptions        = kNilOptions,
+    /** Select the lines that do not contain a match, like @c grep @c -v. */
+    RKXLineInvertMatch      = 1 << 0
+};
+
+/** The results a @c RKXQuery computes from one run of its pattern. The values can be combined using the C-bitwise @c OR operator. */
+typedef NS_OPTIONS(NSUInteger, RKXQueryOutputs) {
+    /** The range of the first match, as returned by @c -rangeOfRegex:. */
+    RKXQueryFirstRange          = 1 << 0,
+    /** The substrings matched by each capture group in the first match, as returned by @c -captureSubstringsMatchedByRegex:. */
+    RKXQueryCaptureSubstrings   = 1 << 1,
+    /** The substrings matched by the named capture groups in the first match, as returned by @c -dictionaryWithNamedCaptureKeysMatchedByRegex:. */
+    RKXQueryNamedCaptures       = 1 << 2,
+    /** The number of matches, as returned by @c -countOfRegex:. */
+    RKXQueryCount               = 1 << 3,
+    /** The ranges of each capture group of every match, as returned by @c -rangesOfRegex:. */
+    RKXQueryRanges              = 1 << 4,
+    /** The substrings of every match, as returned by @c -substringsMatchedByRegex:. */
+    RKXQuerySubstrings          = 1 << 5
+};
+
+/** A token found by a @c RKXLexer. */
+typedef struct {
+    /** The index of the token pattern that matched, in the order the patterns were given to the lexer. */
+    NSUInteger kind;
+    /** The range of the token in the string that was tokenized. */
+    NSRange range;
+} RKXToken;
+
+/** How a @c RKXRewriteRuleSet applies its rules. */
+typedef NS_ENUM(NSUInteger, RKXRewriteMode) {
+    /** All rules are matched together in one left-to-right pass, and each piece of the text is rewritten by at most one rule. */
+    RKXRewriteSinglePass    = 0,
+    /** Each rule is applied in turn to the text the rules before it produced, as a chain of replacement calls would. */
+    RKXRewriteSequential    = 1
+};
+
+/** The state of the current thread's match cache, as returned by @c +matchCacheStatistics. */
+typedef struct {
+    /** The number of calls answered from the cache. */
+    NSUInteger hits;
+    /** The number of calls the cache had no results for, which searched and stored what they found. */
+    NSUInteger misses;
+    /** The number of results dropped because the mutable string they were found in had changed since. Each is also counted as a miss. */
+    NSUInteger invalidations;
+    /** The number of results dropped to keep the cache within its byte limit. */
+    NSUInteger evictions;
+    /** The number of results in the cache. */
+    NSUInteger count;
+    /** The approximate number of bytes the results in the cache hold, including the strings they keep alive. */
+    NSUInteger bytes;
+} RKXMatchCacheStatistics;
+
 #pragma mark - Constants
 
 /**
@@ -79,6 +163,71 @@ extern const NSErrorDomain RKXMatchingTimeoutErrorDomain;
  */
 extern const NSInteger RKXMatchingTimeoutError;
 
+/**
+ The error domain indicating the linear-time engine declined a matching operation.
+ */
+extern const NSErrorDomain RKXLinearTimeMatchingErrorDomain;
+
+/**
+ The error code indicating the pattern, match options or search range cannot be handled by the linear-time engine. The reason is given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXLinearTimeMatchingUnsupportedError;
+
+/**
+ The error domain indicating a regular expression was rejected by complexity analysis.
+ */
+extern const NSErrorDomain RKXRegexComplexityErrorDomain;
+
+/**
+ The error code indicating the pattern can make a backtracking engine take super-linear time. The hazards found and the risk score are given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXRegexHazardError;
+
+/**
+ The error domain indicating an extraction schema could not be created.
+ */
+extern const NSErrorDomain RKXExtractionSchemaErrorDomain;
+
+/**
+ The error code indicating the keys and captures of an extraction schema do not fit its pattern: there are none, their counts differ, or a capture index is greater than the number of capture groups. The reason is given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXExtractionSchemaInvalidCaptureError;
+
+/**
+ The error domain indicating a match cursor could not be resumed.
+ */
+extern const NSErrorDomain RKXMatchCursorErrorDomain;
+
+/**
+ The error code indicating a resume token is damaged, or was not made for the string it is resumed on. The reason is given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXMatchCursorInvalidTokenError;
+
+/**
+ The error domain indicating a rewrite rule set could not be created.
+ */
+extern const NSErrorDomain RKXRewriteRuleSetErrorDomain;
+
+/**
+ The error code indicating a rule cannot be matched together with the other rules of a single-pass rule set. The rule is given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXRewriteRuleSetIncompatibleRuleError;
+
+/**
+ The error domain indicating a lexer could not be created or could not tokenize its input.
+ */
+extern const NSErrorDomain RKXLexerErrorDomain;
+
+/**
+ The error code indicating a token pattern cannot be matched together with the other token patterns of a lexer. The pattern is given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXLexerIncompatibleTokenError;
+
+/**
+ The error code indicating no token pattern matches the input at some location. The location is given under @c NSLocalizedFailureReasonErrorKey.
+ */
+extern const NSInteger RKXLexerUnexpectedInputError;
+
 /**
  The empty string, represented by @@"".
  */
@@ -106,6 +255,685 @@ extern NSString *const RKXEmptyStringKey;
 
 #pragma mark -
 
+/**
+ @c RKXMatchBuffer is a reusable, caller-owned store for the ranges of a set of matches and of their capture groups. The @c -getMatchesOfRegex:buffer: methods of @c NSString fill it instead of returning new @c NSTextCheckingResult objects and arrays.
+
+ @discussion The ranges are kept inline in one flat block of storage, @c rangesPerMatch consecutive ranges per match: the whole match first, then each capture group, with @c {NSNotFound, @c 0} for groups that did not participate. Filling the buffer resets it, but its storage only ever grows, so once it has held the largest result of a loop, refilling it does not allocate. The buffer also remembers the regex it was last filled with, which skips the regex cache lookup when the same pattern is used again.
+
+ @discussion Capture-free patterns that the linear-time engine can run are matched without any heap allocation per call once the buffer and the engine's caches have warmed up. Other patterns still go through @c NSRegularExpression, which creates a transient result for each match it finds, but no arrays or boxed ranges are built.
+
+ @discussion Thread Safety: A buffer must only be filled and read on one thread at a time.
+ */
+@interface RKXMatchBuffer : NSObject
+
+/**
+ The number of matches in the buffer.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ The number of ranges stored for each match: one for the whole match, plus one for each capture group of the pattern the buffer was last filled with.
+ */
+@property (nonatomic, readonly) NSUInteger rangesPerMatch;
+
+/**
+ Creates an empty buffer with room for @c capacity ranges before its storage has to grow.
+
+ @param capacity The number of ranges to allocate storage for up front.
+ @return A new, empty buffer.
+ */
+- (instancetype)initWithCapacity:(NSUInteger)capacity NS_DESIGNATED_INITIALIZER;
+
+/**
+ Returns the range of the whole match at @c index.
+
+ @param index The index of the match. Must be less than @c count.
+ @return The range of the match in the string that was searched.
+ */
+- (NSRange)rangeOfMatchAtIndex:(NSUInteger)index;
+
+/**
+ Returns the range of capture group @c captureIndex of the match at @c index. Capture group 0 is the whole match.
+
+ @param index The index of the match. Must be less than @c count.
+ @param captureIndex The index of the capture group. Must be less than @c rangesPerMatch.
+ @return The range of the capture group, or @c {NSNotFound, @c 0} if it did not participate in the match.
+ */
+- (NSRange)rangeOfMatchAtIndex:(NSUInteger)index captureIndex:(NSUInteger)captureIndex;
+
+/**
+ Returns the @c rangesPerMatch ranges of the match at @c index, stored one after the other.
+
+ @param index The index of the match. Must be less than @c count.
+ @return A pointer into the buffer's storage, which stays valid until the buffer is next filled or emptied.
+ */
+- (const NSRange *)rangesOfMatchAtIndex:(NSUInteger)index NS_RETURNS_INNER_POINTER;
+
+/**
+ Removes all matches from the buffer and keeps its storage for reuse.
+ */
+- (void)removeAllMatches;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXLineMatch describes one line reported by @c -linesMatchedByRegex:range:options:lineOptions:limit:linesBefore:linesAfter:error:, either a selected line or a line of context around one.
+ */
+@interface RKXLineMatch : NSObject
+
+/**
+ The number of the line, counting from @c 1 for the line that the search range starts in.
+ */
+@property (nonatomic, readonly) NSUInteger lineNumber;
+
+/**
+ The range of the line in the string that was searched, without its line terminator.
+ */
+@property (nonatomic, readonly) NSRange lineRange;
+
+/**
+ The ranges of the matches of the pattern in the line, in order. Empty for context lines and for lines selected with @c RKXLineInvertMatch.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSValue *> *matchRanges;
+
+/**
+ @c YES if the line is only reported as context before or after a selected line.
+ */
+@property (nonatomic, readonly, getter=isContextLine) BOOL contextLine;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXExtractionSchema is a compiled mapping from keys to the capture groups of a regular expression. It does the work the @c withKeysAndCaptures: and @c withKeys:forCaptures: methods of @c NSString repeat on every call once, up front: the pattern is compiled, the keys and captures are checked against its capture groups and kept in flat arrays.
+
+ @discussion Each extraction matches the pattern once and builds every key's value from that match. Records can also be filled into a @c RKXMatchBuffer, one range per key in key order, so that a parser can read its fields by index without any dictionary or substring being created.
+
+ @discussion Thread Safety: A schema is immutable and can be used from any number of threads at once.
+ */
+@interface RKXExtractionSchema : NSObject
+
+/**
+ The regular expression the schema extracts with.
+ */
+@property (nonatomic, readonly, copy) NSString *pattern;
+
+/**
+ The regex options the pattern is compiled with.
+ */
+@property (nonatomic, readonly) RKXRegexOptions options;
+
+/**
+ The keys of the schema, in the order their ranges are stored in a record.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSString *> *keys;
+
+/**
+ The capture group of each key, at the same index as the key. Capture group 0 is the whole match.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSNumber *> *captures;
+
+/**
+ Creates a schema for @c pattern from a list of keys and captures.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @param firstKey The first key of the schema, followed with the @c capture for @c firstKey, then a @c nil-terminated list of alternating keys and captures. Captures are specified using @c NSUInteger values.
+ @return A new schema, or @c nil if @c pattern is invalid or does not have the captures, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
++ (instancetype)schemaWithRegex:(NSString *)pattern options:(RKXRegexOptions)options error:(NSError **)error keysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION;
+
+/**
+ Creates a schema for @c pattern that maps each of @c keys to the capture group at the same index of @c captures.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param keys The keys of the schema.
+ @param captures The capture group of each key. Must have as many elements as @c keys.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new schema, or @c nil if @c pattern is invalid or does not have the captures, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options keys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Returns a dictionary of the substrings of @c string matched by the captures of the schema in the first match of its pattern.
+
+ @param string The string to search.
+ @return A @c NSDictionary with a substring for each key. Keys whose capture group did not match, and all keys if the pattern fails to match, map to @c RKXEmptyStringKey.
+ */
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedInString:(NSString *)string;
+
+/**
+ Returns a dictionary of the substrings of @c string matched by the captures of the schema in the first match of its pattern within @c searchRange, using @c matchOptions.
+
+ @param string The string to search.
+ @param searchRange The range of @c string to search.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSDictionary with a substring for each key. Keys whose capture group did not match, and all keys if the pattern fails to match, map to @c RKXEmptyStringKey.
+ */
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+/**
+ Returns a dictionary for every match of the pattern of the schema in @c string.
+
+ @param string The string to search.
+ @return A @c NSArray with a @c NSDictionary for each match, built like the one returned by @c -dictionaryMatchedInString:. Returns an empty array if the pattern fails to match.
+ */
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesMatchedInString:(NSString *)string;
+
+/**
+ Returns a dictionary for every match of the pattern of the schema within @c searchRange of @c string, using @c matchOptions.
+
+ @param string The string to search.
+ @param searchRange The range of @c string to search.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSArray with a @c NSDictionary for each match. Returns an empty array if the pattern fails to match.
+ @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesMatchedInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+/**
+ Fills @c buffer with a record for every match of the pattern of the schema within @c searchRange of @c string, using @c matchOptions.
+
+ @discussion Each record holds one range per key, in the order of @c keys, so @c buffer.rangesPerMatch is @c keys.count and @c -rangeOfMatchAtIndex:captureIndex: takes the index of a key. A capture group that did not participate in a match is stored as @c {NSNotFound, @c 0}. The matches are found like with @c -getMatchesOfRegex:range:options:matchOptions:buffer:error: of @c NSString.
+ @param string The string to search.
+ @param searchRange The range of @c string to search.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param buffer The buffer to fill. Any records it held before are removed.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return The number of records in @c buffer, or @c NSNotFound if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSUInteger)getRecordsInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer error:(NSError **)error;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXInternTable hands out one shared @c NSString instance for each distinct run of characters it is asked for. The @c internTable: methods of @c NSString use it so that equal matches share a string instead of each getting a new one.
+
+ @discussion The characters of a substring are read straight from the string's storage when it exposes them, or otherwise copied into scratch storage the table reuses, and hashed and compared there. A new @c NSString is only created the first time a run of characters is seen, so for results with few distinct values, like log levels or status codes, both the allocations and the memory held by the results drop to the number of distinct values.
+
+ @discussion Every distinct string stays in the table until it is emptied or released, so a table is best kept for fields with few distinct values.
+
+ @discussion Thread Safety: A table must only be used on one thread at a time.
+ */
+@interface RKXInternTable : NSObject
+
+/**
+ The number of distinct strings in the table.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Returns the shared string equal to the characters of @c string in @c range, adding it to the table if it is not there yet.
+
+ @param string The string to take the characters from.
+ @param range The range of the characters in @c string.
+ @return A string equal to @c [string @c substringWithRange:range]. The same instance is returned for every run of equal characters until the table is emptied.
+ */
+- (NSString *)internedSubstringOfString:(NSString *)string range:(NSRange)range;
+
+/**
+ Removes all strings from the table.
+ */
+- (void)removeAllStrings;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXQueryResult holds the results a @c RKXQuery computed from one search of a string. Results that were not asked for by the query's @c outputs are @c nil, @c NSNotFound or @c {NSNotFound, @c 0}.
+ */
+@interface RKXQueryResult : NSObject
+
+/**
+ @c YES if the pattern matched at least once.
+ */
+@property (nonatomic, readonly, getter=isMatched) BOOL matched;
+
+/**
+ The range of the first match for @c RKXQueryFirstRange, or @c {NSNotFound, @c 0} if there is none.
+ */
+@property (nonatomic, readonly) NSRange firstRange;
+
+/**
+ The substrings matched by each capture group in the first match for @c RKXQueryCaptureSubstrings. Capture groups that did not match give @c RKXEmptyStringKey, and the array is empty if there is no match.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSString *> *captureSubstrings;
+
+/**
+ The substrings matched by the named capture groups in the first match for @c RKXQueryNamedCaptures, keyed by name. Named capture groups that did not match are left out.
+ */
+@property (nonatomic, readonly, copy) NSDictionary<NSString *, NSString *> *namedCaptures;
+
+/**
+ The number of matches for @c RKXQueryCount.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ The ranges of each capture group of every match for @c RKXQueryRanges, in order, with @c numberOfCaptureGroups @c + @c 1 ranges for each match.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSValue *> *ranges;
+
+/**
+ The substrings of every match for @c RKXQuerySubstrings, in order.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSString *> *substrings;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXQuery computes several results for a regular expression from a single run of the matching engine. Each @c NSString method that returns one of these results searches the string again; a query is told up front which results are wanted and fills all of them from the same matches.
+
+ @discussion A query that only asks for results of the first match stops the search at it. Counts and ranges of the whole match are found without building capture groups when the linear-time engine can run the pattern, as @c -countOfRegex: does.
+
+ @discussion Thread Safety: A query is immutable and can be used from any number of threads at once.
+ */
+@interface RKXQuery : NSObject
+
+/**
+ The regular expression the query searches with.
+ */
+@property (nonatomic, readonly, copy) NSString *pattern;
+
+/**
+ The regex options the pattern is compiled with.
+ */
+@property (nonatomic, readonly) RKXRegexOptions options;
+
+/**
+ The results the query computes.
+ */
+@property (nonatomic, readonly) RKXQueryOutputs outputs;
+
+/**
+ Creates a query for @c pattern that computes @c outputs.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param outputs The results to compute. See @c RKXQueryOutputs for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new query, or @c nil if @c pattern is invalid, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
++ (instancetype)queryWithRegex:(NSString *)pattern options:(RKXRegexOptions)options outputs:(RKXQueryOutputs)outputs error:(NSError **)error;
+
+/**
+ Creates a query for @c pattern that computes @c outputs.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param outputs The results to compute. See @c RKXQueryOutputs for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new query, or @c nil if @c pattern is invalid, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options outputs:(RKXQueryOutputs)outputs error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Searches @c string and returns the results of the query.
+
+ @param string The string to search.
+ @return A @c RKXQueryResult with the results asked for by @c outputs.
+ */
+- (RKXQueryResult *)resultInString:(NSString *)string;
+
+/**
+ Searches @c searchRange of @c string using @c matchOptions and returns the results of the query.
+
+ @param string The string to search.
+ @param searchRange The range of @c string to search.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c RKXQueryResult with the results asked for by @c outputs.
+ @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (RKXQueryResult *)resultInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXMatchCursor walks the matches of a regular expression in a string on demand. It keeps only the position its next search starts from, so the memory and time each page of matches takes do not grow with how many matches came before it.
+
+ @discussion Every search resumes where the previous match ended and sees the whole search range, so anchors, word boundaries and lookbehind give the same matches as one search over the range. If the search range is only part of the string, its characters are copied once when the cursor is created.
+
+ @discussion The position of a cursor can be saved with @c resumeToken and a new cursor created from it later for the same string, for instance to serve the next page of a paginated request.
+
+ @discussion Fast enumeration returns the remaining matches, fetching them a batch at a time. Breaking out of a @c for-in loop leaves the cursor after the last batch fetched, so use @c -nextMatches: when the position has to be exact.
+
+ @discussion Thread Safety: A cursor must only be used on one thread at a time.
+ */
+@interface RKXMatchCursor : NSObject <NSFastEnumeration>
+
+/**
+ The regular expression the cursor searches with.
+ */
+@property (nonatomic, readonly, copy) NSString *pattern;
+
+/**
+ The regex options the pattern is compiled with.
+ */
+@property (nonatomic, readonly) RKXRegexOptions options;
+
+/**
+ The matching options each search uses.
+ */
+@property (nonatomic, readonly) RKXMatchOptions matchOptions;
+
+/**
+ The string the cursor searches.
+ */
+@property (nonatomic, readonly, copy) NSString *string;
+
+/**
+ The range of @c string the cursor searches.
+ */
+@property (nonatomic, readonly) NSRange searchRange;
+
+/**
+ The location in @c string where the next search starts.
+ */
+@property (nonatomic, readonly) NSUInteger location;
+
+/**
+ The number of matches the cursor has returned.
+ */
+@property (nonatomic, readonly) NSUInteger matchCount;
+
+/**
+ @c YES once a search of the cursor has found no further matches.
+ */
+@property (nonatomic, readonly, getter=isFinished) BOOL finished;
+
+/**
+ A compact token that holds the pattern, options, search range and position of the cursor. Pass it to @c -initWithResumeToken:string:error: to continue from the same match later.
+ */
+@property (nonatomic, readonly, copy) NSData *resumeToken;
+
+/**
+ Creates a cursor over the matches of @c pattern in @c string.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param string The string to search.
+ @return A new cursor, or @c nil if @c pattern is invalid.
+ */
++ (instancetype)cursorWithRegex:(NSString *)pattern inString:(NSString *)string;
+
+/**
+ Creates a cursor over the matches of @c pattern within @c searchRange of @c string using @c options and @c matchOptions.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param string The string to search.
+ @param searchRange The range of @c string to search.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new cursor, or @c nil if @c pattern is invalid, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options string:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+/**
+ Creates a cursor that continues from the position saved in @c token.
+
+ @discussion The token records the length of the string it was made for and a checksum of all its characters, so a token made for a different string is refused. Checking the checksum reads the whole string.
+ @param token A token returned by @c resumeToken.
+ @param string The string the token was made for.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new cursor, or @c nil if @c token is damaged or was made for another string, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (instancetype)initWithResumeToken:(NSData *)token string:(NSString *)string error:(NSError **)error;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Returns the next match and moves the cursor past it.
+
+ @return The next @c NSTextCheckingResult, or @c nil if there are no more matches.
+ */
+- (NSTextCheckingResult *)nextMatch;
+
+/**
+ Returns up to @c count of the next matches and moves the cursor past them.
+
+ @param count The largest number of matches to return.
+ @return A @c NSArray of up to @c count @c NSTextCheckingResult objects, in order. Returns an empty array if there are no more matches.
+ */
+- (NSArray<NSTextCheckingResult *> *)nextMatches:(NSUInteger)count;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXRewriteRule pairs a regular expression with the template or block that rewrites its matches, for use in a @c RKXRewriteRuleSet.
+ */
+@interface RKXRewriteRule : NSObject
+
+/**
+ The regular expression the rule matches.
+ */
+@property (nonatomic, readonly, copy) NSString *pattern;
+
+/**
+ The replacement template, or @c nil if the rule rewrites with a block. It can contain references to the capture groups of @c pattern as in @c -stringByReplacingOccurrencesOfRegex:withTemplate:.
+ */
+@property (nonatomic, readonly, copy) NSString *templ;
+
+/**
+ The block that returns the replacement for each match, or @c nil if the rule rewrites with a template.
+ */
+@property (nonatomic, readonly, copy) NSString *(^block)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop);
+
+/**
+ Creates a rule that replaces the matches of @c pattern with @c templ.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param templ A @c NSString containing a string template. Can use capture groups variables.
+ @return A new rule.
+ */
++ (instancetype)ruleWithRegex:(NSString *)pattern template:(NSString *)templ;
+
+/**
+ Creates a rule that replaces the matches of @c pattern with the string @c block returns for them.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param block The block that is executed for each match of @c pattern. The block takes three arguments:
+ @param &nbsp;&nbsp;capturedStrings A @c NSArray containing the substrings matched by each capture group present in @c pattern.
+ @param &nbsp;&nbsp;capturedRanges A @c NSArray containing the ranges matched by each capture group present in @c pattern.
+ @param &nbsp;&nbsp;stop A reference to a Boolean value. Setting the value to @c YES within the block stops the rewrite once its replacement is made. In @c RKXRewriteSinglePass mode the text after the match is left as it is; in @c RKXRewriteSequential mode the matches of the rule before this one, which are replaced from the last to the first, and all later rules are.
+ @return A new rule.
+ */
++ (instancetype)ruleWithRegex:(NSString *)pattern usingBlock:(NSString *(^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+@end
+
+/**
+ @c RKXRewriteRuleSet applies an ordered list of rewrite rules to a string, such as the many replacement steps of a normalization pass.
+
+ @discussion In @c RKXRewriteSinglePass mode, the rules are compiled into one regular expression that tries them in order, and the text is rewritten in one left-to-right pass that writes the result once. At each point, the match that starts first wins, and of the rules that match at the same point, the one that comes first in the list wins. The text a rule writes is not matched again. This gives the same result as @c RKXRewriteSequential when the matches of different rules never overlap and no rule matches text another rule writes, as with most rules that normalize separate characters or words.
+
+ @discussion Rules that use backreferences, or capture group names that another rule also uses, cannot be matched together; a single-pass rule set reports them as an error when it is created.
+
+ @discussion In @c RKXRewriteSequential mode, each rule is applied in turn to the result of the rules before it, exactly as a chain of @c -stringByReplacingOccurrencesOfRegex:withTemplate: and @c -stringByReplacingOccurrencesOfRegex:usingBlock: calls would be, but in one mutable string instead of a new string for every rule.
+
+ @discussion Thread Safety: A rule set can be used on several threads at once if the blocks of its rules can.
+ */
+@interface RKXRewriteRuleSet : NSObject
+
+/**
+ The rules of the set, in order of priority.
+ */
+@property (nonatomic, readonly, copy) NSArray<RKXRewriteRule *> *rules;
+
+/**
+ The regex options every rule is compiled with.
+ */
+@property (nonatomic, readonly) RKXRegexOptions options;
+
+/**
+ How the rules are applied.
+ */
+@property (nonatomic, readonly) RKXRewriteMode mode;
+
+/**
+ Creates a rule set of @c rules applied in @c mode.
+
+ @param rules The rules, in order of priority.
+ @param options The regex options to use for every rule. See @c RKXRegexOptions for possible values.
+ @param mode How the rules are applied. See @c RKXRewriteMode for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new rule set, or @c nil if a pattern is invalid or cannot be matched together with the other rules, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
++ (instancetype)ruleSetWithRules:(NSArray<RKXRewriteRule *> *)rules options:(RKXRegexOptions)options mode:(RKXRewriteMode)mode error:(NSError **)error;
+
+/**
+ Creates a rule set of @c rules applied in @c mode.
+
+ @param rules The rules, in order of priority.
+ @param options The regex options to use for every rule. See @c RKXRegexOptions for possible values.
+ @param mode How the rules are applied. See @c RKXRewriteMode for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new rule set, or @c nil if a pattern is invalid or cannot be matched together with the other rules, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (instancetype)initWithRules:(NSArray<RKXRewriteRule *> *)rules options:(RKXRegexOptions)options mode:(RKXRewriteMode)mode error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Returns @c string rewritten by the rules of the set.
+
+ @param string The string to rewrite.
+ @return A @c NSString with the matches of the rules replaced.
+ */
+- (NSString *)stringByRewritingString:(NSString *)string;
+
+/**
+ Returns @c string with the text within @c searchRange rewritten by the rules of the set, using @c matchOptions.
+
+ @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation fails to match because of a very slow match operation, a @c NSError object is returned indicating a timeout error.
+
+ @param string The string to rewrite.
+ @param searchRange The range of @c string to rewrite. The text outside it is copied as it is.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSString with the matches of the rules replaced, or @c nil if an error occurs, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSString *)stringByRewritingString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+@end
+
+#pragma mark -
+
+/**
+ @c RKXLexer splits a string into tokens described by an ordered list of named token patterns, such as the sections, keys, values and comments of a configuration file.
+
+ @discussion The patterns are compiled into one regular expression that tries them in order and only matches where the previous token ended, so the whole input is tokenized in one run of the engine rather than with a separate search for each token. At each point, the first pattern in the list that matches wins. Tokenizing stops where no pattern matches. Patterns that match the empty string never produce a token, and patterns that use backreferences cannot be matched together and are reported as an error when the lexer is created.
+
+ @discussion Tokens are reported as @c RKXToken records that hold the index of the pattern and the range of the token, so no substring is created unless the caller asks for one. Tokens of the kinds named in @c skippedTokenNames, such as whitespace and comments, are consumed but not reported.
+
+ @discussion For input that arrives in pieces, tokenize what has arrived with @c final set to @c NO. Tokens that might grow or change with more input are then held back, and @c nextLocation tells where to continue once more has been appended.
+
+ @discussion Thread Safety: A lexer can be used on several threads at once.
+ */
+@interface RKXLexer : NSObject
+
+/**
+ The names of the token kinds, at the index that is their @c kind.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSString *> *tokenNames;
+
+/**
+ The pattern of each token kind, at the same index as its name.
+ */
+@property (nonatomic, readonly, copy) NSArray<NSString *> *tokenPatterns;
+
+/**
+ The names of the token kinds that are consumed but not reported.
+ */
+@property (nonatomic, readonly, copy) NSSet<NSString *> *skippedTokenNames;
+
+/**
+ The regex options every token pattern is compiled with.
+ */
+@property (nonatomic, readonly) RKXRegexOptions options;
+
+/**
+ Creates a lexer for the token kinds named in @c names that reports every token.
+
+ @param names The names of the token kinds.
+ @param patterns The pattern of each token kind, at the same index as its name. Must have as many elements as @c names.
+ @param options The regex options to use for every pattern. See @c RKXRegexOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new lexer, or @c nil if a pattern is invalid or cannot be matched together with the others, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
++ (instancetype)lexerWithTokenNames:(NSArray<NSString *> *)names patterns:(NSArray<NSString *> *)patterns options:(RKXRegexOptions)options error:(NSError **)error;
+
+/**
+ Creates a lexer for the token kinds named in @c names that consumes but does not report the kinds named in @c skippedNames.
+
+ @param names The names of the token kinds.
+ @param patterns The pattern of each token kind, at the same index as its name. Must have as many elements as @c names.
+ @param skippedNames The names of the token kinds not to report, or @c nil to report every token.
+ @param options The regex options to use for every pattern. See @c RKXRegexOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A new lexer, or @c nil if a pattern is invalid or cannot be matched together with the others, and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (instancetype)initWithTokenNames:(NSArray<NSString *> *)names patterns:(NSArray<NSString *> *)patterns skippingTokenNames:(NSSet<NSString *> *)skippedNames options:(RKXRegexOptions)options error:(NSError **)error NS_DESIGNATED_INITIALIZER;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Tokenizes @c searchRange of @c string, storing up to @c maxCount tokens in @c tokens.
+
+ @discussion Tokenizing stops when @c maxCount tokens have been stored, where no pattern matches, or at the end of @c searchRange. Call again from @c nextLocation to continue. The text before and after @c searchRange is seen by lookbehind, lookahead and anchors, so a string tokenized piece by piece gives the same tokens as one tokenized in one go.
+ @param tokens The records to store the tokens in.
+ @param maxCount The number of records @c tokens has room for.
+ @param string The string to tokenize.
+ @param searchRange The range of @c string to tokenize.
+ @param final @c NO if more input will be appended to @c string, in which case a token that reaches the end of @c searchRange is held back since more input could change it.
+ @param nextLocation On return, the location in @c string after the last token consumed. If it is less than the end of @c searchRange although fewer than @c maxCount tokens were stored, no pattern matches there, or, if @c final is @c NO, more input is needed.
+ @return The number of tokens stored in @c tokens.
+ */
+- (NSUInteger)getTokens:(RKXToken *)tokens maxCount:(NSUInteger)maxCount inString:(NSString *)string range:(NSRange)searchRange final:(BOOL)final nextLocation:(NSUInteger *)nextLocation;
+
+/**
+ Tokenizes @c searchRange of @c string and executes @c block for each token.
+
+ @param string The string to tokenize.
+ @param searchRange The range of @c string to tokenize.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @param block The block that is executed for each token. The block takes two arguments:
+ @param &nbsp;&nbsp;token The kind and range of the token.
+ @param &nbsp;&nbsp;stop A reference to a Boolean value. Setting the value to @c YES within the block stops tokenizing.
+ @return Returns @c YES if all of @c searchRange was tokenized or @c block stopped tokenizing, otherwise returns @c NO and indirectly returns a @c NSError object with the code @c RKXLexerUnexpectedInputError if @c error is not @c NULL.
+ */
+- (BOOL)enumerateTokensInString:(NSString *)string range:(NSRange)searchRange error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(RKXToken token, BOOL *stop))block;
+
+@end
+
+#pragma mark -
+
 /**
  @c NSString (RegexKitX) provides a comprehensive Objective-C wrapper around @c NSRegularExpression using ICU regex syntax.
 
@@ -251,6 +1079,7 @@ extern NSString *const RKXEmptyStringKey;
  Returns an array containing all the matches in the receiver that were matched by the regular expression @c pattern within @c searchRange using @c options and @c matchOptions. Each match result consists of a dictionary containing the matched substrings constructed from the specified set of @c keys and @c captures.
 
  @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation fails to match because of a very slow match operation, a @c NSError object is returned indicating a timeout error.
+ @discussion The @c keys and @c captures are compiled into a @c RKXExtractionSchema, which builds each dictionary from the ranges of its match, without matching @c pattern again, and reports a capture beyond the capture groups of @c pattern as an error. When the same keys are used over and over, create the schema once and extract with it directly.
 
  @param pattern A @c NSString containing a regular expression.
  @param searchRange The range of the receiver to search.
@@ -348,6 +1177,23 @@ extern NSString *const RKXEmptyStringKey;
  */
 - (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
 
+/**
+ Returns an array containing the substrings matched by each capture group present in @c pattern for the first match of @c pattern within @c searchRange of the receiver using @c options and @c matchOptions, taking each substring from @c internTable.
+
+ @discussion Equal substrings share one instance from @c internTable instead of each being a new string. Passing the same table to a series of calls, for example one per line of a log, lets the fields of all of them share their strings.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param internTable The table to take the substrings from. Use @c nil for a table that only lives for this call.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSArray containing the substrings matched by each capture group present in pattern for the first match of @c pattern. Array index @c 0 represents all of the text matched by @c pattern and subsequent array indexes contain the text matched by their respective capture group.
+ @return Returns an empty array if @c pattern fails to match in @c searchRange.
+ @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions internTable:(RKXInternTable *)internTable error:(NSError **)error;
+
 #pragma mark - dictionaryMatchedByRegex:
 
 /**
@@ -421,6 +1267,7 @@ extern NSString *const RKXEmptyStringKey;
  Creates and returns a dictionary containing the matches constructed from the specified set of @c keys and @c captures for the first match of @c pattern within @c searchRange of the receiver using @c options and @c matchOptions.
 
  @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation fails to match because of a very slow match operation, a @c NSError object is returned indicating a timeout error.
+ @discussion The @c keys and @c captures are compiled into a @c RKXExtractionSchema, which matches @c pattern once for each dictionary and reports a capture beyond the capture groups of @c pattern as an error. When the same keys are used over and over, create the schema once and extract with it directly.
 
  @param pattern A @c NSString containing a regular expression.
  @param searchRange The range of the receiver to search.
@@ -562,10 +1409,41 @@ extern NSString *const RKXEmptyStringKey;
  Returns a @c BOOL value that indicates whether the regular expression contained in the receiver is valid using @c options.
 
  @param options The regex options to use. See @c RKXRegexOptions for possible values.
- @param error The optional error parameter, if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
- @return Returns a @c YES if the regex is valid; @c NO otherwise and indirectly returns a @c NSError object if @c error is not @c NULL.
+ @param error The optional error parameter, if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return Returns a @c YES if the regex is valid; @c NO otherwise and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (BOOL)isRegexValidWithOptions:(RKXRegexOptions)options error:(NSError **)error;
+
+/**
+ Returns a @c BOOL value that indicates whether the regular expression contained in the receiver can be run by the linear-time engine using @c options.
+
+ @discussion The linear-time engine is a Pike VM that finds the same matches and captures as @c NSRegularExpression in time proportional to the length of the search range. Backreferences, lookaround, atomic groups, possessive quantifiers, Unicode property classes, @c RKXIgnoreWhitespace, @c RKXDotAll, @c RKXUseUnixLineSeparators and @c RKXUnicodeWordBoundaries keep a pattern on ICU. Eligible patterns that @c -regexComplexityWithOptions:hazards:riskScore:error: scores 50 or more, such as @c (a+)+b, are always matched by the linear-time engine; other eligible patterns stay on ICU, and a match with @c RKXReportProgress that times out there still returns the timeout error. Call @c -linearTimeMatchesOfRegex:range:options:matchOptions:error: to match such a pattern with the linear-time engine instead.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @return Returns a @c YES if the regex is valid and eligible; @c NO otherwise.
+ */
+- (BOOL)isRegexLinearTimeEligibleWithOptions:(RKXRegexOptions)options;
+
+/**
+ Returns the worst-case complexity of matching the regular expression contained in the receiver with a backtracking engine such as ICU, using @c options.
+
+ @discussion The analysis works on the parsed pattern and looks for nested quantifiers that trade text between iterations, alternations in a loop whose branches overlap, adjacent unbounded quantifiers over the same characters, unbounded lookaround and unanchored quantifiers that are rescanned after a failure. It is conservative: it can flag a pattern that is never slow in practice, and treats non-ASCII characters as overlapping. The result is computed once and kept with the cached regex.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param hazards An optional pointer that receives the hazards found. See @c RKXRegexHazards for possible values. This may be set to @c NULL.
+ @param riskScore An optional pointer that receives a score from 0 (no hazards) to 100 (exponential backtracking). Patterns that cannot be analyzed score 100. This may be set to @c NULL.
+ @param error The optional error parameter, if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return Returns the complexity class of the pattern, or @c RKXRegexComplexityUnknown if the pattern cannot be analyzed or is invalid, in which case it indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (RKXRegexComplexity)regexComplexityWithOptions:(RKXRegexOptions)options hazards:(RKXRegexHazards *)hazards riskScore:(NSUInteger *)riskScore error:(NSError **)error;
+
+/**
+ Returns a @c BOOL value that indicates whether the regular expression contained in the receiver can be accepted from an untrusted source using @c options.
+
+ @discussion A pattern is safe if it is valid and either scores below 50 in @c -regexComplexityWithOptions:hazards:riskScore:error:, or is always matched by the linear-time engine whatever the text. Patterns that cannot be analyzed are not safe. Risky patterns the linear-time engine runs are only protected when the matching methods are used without @c RKXAnchored, @c RKXWithTransparentBounds or @c RKXWithoutAnchoringBounds.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param error The optional error parameter, if set and an error occurs, will contain a @c NSError object that describes the problem. An unsafe pattern gives an error in @c RKXRegexComplexityErrorDomain. This may be set to @c NULL if information about any errors is not required.
+ @return Returns a @c YES if the regex is valid and safe; @c NO otherwise and indirectly returns a @c NSError object if @c error is not @c NULL.
  */
-- (BOOL)isRegexValidWithOptions:(RKXRegexOptions)options error:(NSError **)error;
+- (BOOL)isRegexSafeWithOptions:(RKXRegexOptions)options error:(NSError **)error;
 
 #pragma mark - rangeOfRegex:
 
@@ -809,6 +1687,23 @@ extern NSString *const RKXEmptyStringKey;
  */
 - (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
 
+/**
+ Returns a string created from the characters within @c searchRange of the receiver in which all matches of the regular expression @c pattern using @c options and @c matchOptions are replaced with the contents of @c templ after performing capture group substitutions, using the processing defined by @c enumOpts.
+
+ @discussion If @c enumOpts contains @c NSEnumerationConcurrent, a large @c searchRange is split at line terminators into pieces that are matched and replaced on separate threads and then joined with a single copy. The result is the same as that of @c -stringByReplacingOccurrencesOfRegex:withTemplate:range:options:matchOptions:error:. Patterns whose matches can contain a line terminator or use @c \\G, and @c matchOptions containing @c RKXReportProgress, @c RKXAnchored, @c RKXWithTransparentBounds or @c RKXWithoutAnchoringBounds, are replaced serially.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param templ A @c NSString containing a string template. Can use capture group variables.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param enumOpts Use @c NSEnumerationConcurrent to replace concurrently. Other options are ignored.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSString created from the characters within @c searchRange of the receiver in which all matches of the regular expression @c pattern using @c options and @c matchOptions are replaced with the contents of the @c templ string after performing capture group substitutions. Returns the characters within @c searchRange as if @c substringWithRange: had been sent to the receiver if the substring is not matched by @c pattern.
+ @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error;
+
 #pragma mark - stringMatchedByRegex:
 
 /**
@@ -1045,6 +1940,35 @@ extern NSString *const RKXEmptyStringKey;
  */
 - (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
 
+/**
+ Returns an array containing all the substrings from the receiver that were matched by the regular expression @c pattern, with equal substrings sharing one instance from @c internTable.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param internTable The table to take the substrings from. Use @c nil for a table that only lives for this call.
+ @return A @c NSArray containing all the substrings from the receiver that were matched by @c pattern.
+ @return Returns an empty array if @c pattern fails to match.
+ @return Will return @c nil if an error occurs.
+ */
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern internTable:(RKXInternTable *)internTable;
+
+/**
+ Returns an array containing all the substrings from the receiver that were matched by capture number @c capture from the regular expression @c pattern within @c searchRange using @c options and @c matchOptions, with equal substrings sharing one instance from @c internTable.
+
+ @discussion The matches are collected as ranges, like with @c -getMatchesOfRegex:range:options:matchOptions:buffer:error:, and each substring is taken from @c internTable without a new string being created for it, so only the distinct values are allocated.
+ @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation times out, the substrings of the matches found until then are returned and a @c NSError object is returned indicating a timeout error.
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param capture The capture group number @c capture from @c pattern to return. Use @c 0 for the entire string that @c pattern matched.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param internTable The table to take the substrings from. Use @c nil for a table that only lives for this call.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSArray containing all the substrings from the receiver that were matched by @c capture from @c pattern within @c searchRange. Matches in which @c capture did not participate give @c RKXEmptyStringKey.
+ @return Returns an empty array if @c pattern fails to match in @c searchRange.
+ @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions internTable:(RKXInternTable *)internTable error:(NSError **)error;
+
 #pragma mark - substringsSeparatedByRegex:
 
 /**
@@ -1133,6 +2057,7 @@ extern NSString *const RKXEmptyStringKey;
 /**
  Returns the number of times the regular expression @c pattern matches within @c searchRange of the receiver using @c options and @c matchOptions.
 
+ @discussion Only the whole matches are looked for. When @c NSRegularExpression runs the pattern, it runs a copy whose capture groups are non-capturing unless a backreference refers to them, so no group positions are recorded. @c -isMatchedByRegex:, @c -substringsMatchedByRegex: and @c -substringsSeparatedByRegex: do the same.
  @param pattern A @c NSString containing a regular expression.
  @param searchRange The range of the receiver to search.
  @param options The regex options to use. See @c RKXRegexOptions for possible values.
@@ -1182,6 +2107,166 @@ extern NSString *const RKXEmptyStringKey;
  */
 - (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
 
+#pragma mark - lastMatchOfRegex:
+
+/**
+ Returns the last @c NSTextCheckingResult for a match of @c pattern in the receiver.
+
+ @param pattern A @c NSString containing a regular expression.
+ @return The last @c NSTextCheckingResult matched by @c pattern, or @c nil if no match.
+ */
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern;
+
+/**
+ Returns the last @c NSTextCheckingResult for a match of @c pattern within @c searchRange of the receiver.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @return The last @c NSTextCheckingResult matched by @c pattern, or @c nil if no match.
+ */
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange;
+
+/**
+ Returns the last @c NSTextCheckingResult for a match of @c pattern in the receiver using @c options.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @return The last @c NSTextCheckingResult matched by @c pattern, or @c nil if no match.
+ */
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern options:(RKXRegexOptions)options;
+
+/**
+ Returns the last @c NSTextCheckingResult for a match of @c pattern within @c searchRange of the receiver using @c options and @c matchOptions.
+
+ @discussion The result is always the last element of @c -matchesInString:options:range: of @c NSRegularExpression. When no match of @c pattern can contain a line terminator, @c searchRange is searched from its end in windows that start at a line and double in size, and the search stops at the first window with a match, so the time taken grows with the distance of the last match from the end rather than with the length of @c searchRange. Patterns that use @c \\A, @c ^ without @c RKXMultiline, @c \\G, or a lookbehind that can reach across a line, and @c matchOptions containing @c RKXReportProgress, @c RKXAnchored, @c RKXWithTransparentBounds or @c RKXWithoutAnchoringBounds, are searched forward over the whole range.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return The last @c NSTextCheckingResult matched by @c pattern, or @c nil if no match or an error occurs.
+ */
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+#pragma mark - lastRangeOfRegex:
+
+/**
+ Returns the range of the last match of @c pattern in the receiver.
+
+ @param pattern A @c NSString containing a regular expression.
+ @return A @c NSRange structure giving the location and length of the last match of @c pattern in the receiver. Returns @c {NSNotFound, @c 0} if the receiver is not matched by @c pattern.
+ */
+- (NSRange)lastRangeOfRegex:(NSString *)pattern;
+
+/**
+ Returns the range of the last match of @c pattern within @c searchRange of the receiver.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @return A @c NSRange structure giving the location and length of the last match of @c pattern within @c searchRange of the receiver. Returns @c {NSNotFound, @c 0} if the receiver is not matched by @c pattern within @c searchRange.
+ */
+- (NSRange)lastRangeOfRegex:(NSString *)pattern range:(NSRange)searchRange;
+
+/**
+ Returns the range of the last match of @c pattern in the receiver using @c options.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @return A @c NSRange structure giving the location and length of the last match of @c pattern in the receiver. Returns @c {NSNotFound, @c 0} if the receiver is not matched by @c pattern.
+ */
+- (NSRange)lastRangeOfRegex:(NSString *)pattern options:(RKXRegexOptions)options;
+
+/**
+ Returns the range of capture number @c capture for the last match of @c pattern within @c searchRange of the receiver using @c options and @c matchOptions. The last match is found as by @c -lastMatchOfRegex:range:options:matchOptions:error:.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param capture The matching range of the capture number from @c pattern to return. Use @c 0 for the entire range that @c pattern matched.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSRange structure giving the location and length of @c capture for the last match of @c pattern within @c searchRange of the receiver. Returns @c {NSNotFound, @c 0} if the receiver is not matched by @c pattern within @c searchRange or an error occurs.
+ */
+- (NSRange)lastRangeOfRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+#pragma mark - linearTimeMatchesOfRegex:
+
+/**
+ Returns the matches of @c pattern within @c searchRange of the receiver found by the linear-time engine, without falling back to @c NSRegularExpression.
+
+ @discussion Patterns using @c \\w, @c \\d, @c \\s or @c \\b are only run on search ranges that contain nothing but ASCII, and patterns with @c RKXCaseless letters on search ranges without the non-ASCII characters that fold to ASCII letters, such as the sharp s, the long s and the Kelvin sign. @c RKXAnchored, @c RKXWithTransparentBounds and @c RKXWithoutAnchoringBounds are not supported. See @c -isRegexLinearTimeEligibleWithOptions: for the patterns that are.
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. If the linear-time engine declines, the error is in @c RKXLinearTimeMatchingErrorDomain.
+ @return An array of @c NSTextCheckingResult objects identical to those @c NSRegularExpression would return, or @c nil if the pattern is invalid or the linear-time engine declines.
+ */
+- (NSArray<NSTextCheckingResult *> *)linearTimeMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error;
+
+#pragma mark - getMatchesOfRegex:buffer:
+
+/**
+ Fills @c buffer with the ranges of every match of @c pattern in the receiver and of their capture groups.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param buffer The buffer to fill. Any matches it held before are removed.
+ @return The number of matches found, or @c NSNotFound if an error occurs.
+ */
+- (NSUInteger)getMatchesOfRegex:(NSString *)pattern buffer:(RKXMatchBuffer *)buffer;
+
+/**
+ Fills @c buffer with the ranges of every match of @c pattern within @c searchRange of the receiver and of their capture groups, using @c options and @c matchOptions.
+
+ @discussion The matches and capture ranges are the ones @c -matchesInString:options:range: of @c NSRegularExpression would return, and the same patterns are routed to the linear-time engine as for the other matching methods. See @c RKXMatchBuffer for when the call allocates.
+ @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation times out, @c buffer holds the matches found until then and a @c NSError object is returned indicating a timeout error.
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchOptions for possible values.
+ @param buffer The buffer to fill. Any matches it held before are removed.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return The number of matches found, or @c NSNotFound if @c pattern is invalid and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSUInteger)getMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer error:(NSError **)error;
+
+#pragma mark - linesMatchedByRegex:
+
+/**
+ Returns the lines of the receiver that contain a match of @c pattern, like @c grep.
+
+ @param pattern A @c NSString containing a regular expression.
+ @return A @c NSArray of @c RKXLineMatch objects, one for each matching line, in order.
+ */
+- (NSArray<RKXLineMatch *> *)linesMatchedByRegex:(NSString *)pattern;
+
+/**
+ Returns the lines of the receiver that contain a match of @c pattern using @c options, like @c grep.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @return A @c NSArray of @c RKXLineMatch objects, one for each matching line, in order.
+ */
+- (NSArray<RKXLineMatch *> *)linesMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options;
+
+/**
+ Returns the lines within @c searchRange of the receiver selected by @c pattern, with the line numbers and match ranges a line filter needs and optional context, like @c grep with @c -n, @c -v, @c -m, @c -B and @c -A.
+
+ @discussion Each line is matched on its own, as if it were the whole string, so @c ^ and @c $ match at its ends and no match spans two lines. Lines end at the line terminators @c RKXMultiline uses: @c \n, @c \r, @c \r\n, @c \v, @c \f, @c U+0085, @c U+2028 and @c U+2029, or only @c \n with @c RKXUseUnixLineSeparators. A terminator at the end of the search range does not start another line.
+ @discussion The lines are found with a vectorized scan for line terminators and matched in batches that run in parallel on large search ranges. Capture-free patterns that the linear-time engine can run are matched by its lazy DFA or literal search. Patterns that @c -regexComplexityWithOptions:hazards:riskScore:error: scores 50 or more are matched by the linear-time engine whenever it can run them.
+ @param pattern A @c NSString containing a regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param lineOptions The line options to use. See @c RKXLineOptions for possible values.
+ @param limit The maximum number of lines to select. The context after the last of them is still reported. Use @c 0 for unlimited.
+ @param linesBefore The number of lines of context to report before each selected line.
+ @param linesAfter The number of lines of context to report after each selected line.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return A @c NSArray of @c RKXLineMatch objects for the selected lines and their context, in order, with each line reported once. Returns @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSArray<RKXLineMatch *> *)linesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options lineOptions:(RKXLineOptions)lineOptions limit:(NSUInteger)limit linesBefore:(NSUInteger)linesBefore linesAfter:(NSUInteger)linesAfter error:(NSError **)error;
+
 #pragma mark - Regex Cache Management
 
 /**
@@ -1196,6 +2281,49 @@ extern NSString *const RKXEmptyStringKey;
  */
 + (NSUInteger)regexCacheCount;
 
+/**
+ Returns the number of @c NSRegularExpression objects the current thread has compiled for its cache.
+
+ @discussion A pattern is only compiled when the cache has no regex for it, so this counts cache misses. The count is not reset by @c +clearRegexCache; a pattern compiled again after the cache was cleared counts again.
+
+ @return The number of regexes compiled on the current thread.
+ */
++ (NSUInteger)regexCompileCount;
+
+/**
+ Sets the number of bytes of match results that each thread's match cache may hold. A limit above 0 turns the cache on for every thread. The cache is off by default.
+
+ @discussion While the cache is on, these calls are answered from the whole-match ranges that an earlier call on the same thread found:
+ @c -isMatchedByRegex:, @c -countOfRegex:, @c -rangeOfRegex: and @c -substringsMatchedByRegex: for the whole match, and @c -rangesOfRegex: for patterns without capture groups.
+ A result is only reused when the string, pattern, options, match options and search range are all the same.
+ @discussion When the cache has no results for a call, the call finds every match in the range and stores their ranges. So the first call of a series, such as @c -isMatchedByRegex:, can take longer than it would without the cache. Calls with @c RKXReportProgress always search.
+ @discussion An immutable string is identified by its instance. The cache keeps the string alive while it holds results for it.
+ @discussion For a mutable string, the cache keeps a copy of its contents when it stores a result. Results for a string whose contents have changed since are dropped.
+ @discussion The strings and copies the cache keeps count towards the limit, so results for a string longer than the limit are not stored. The least recently used results are dropped once the limit is reached.
+ @param byteLimit The number of bytes each thread's cache may hold. Lowering the limit drops results from every thread's cache until it fits. Use @c 0 to turn the cache off and empty them all.
+ */
++ (void)setMatchCacheByteLimit:(NSUInteger)byteLimit;
+
+/**
+ Returns the number of bytes of match results each thread's match cache may hold, or @c 0 if the cache is off.
+
+ @return The byte limit set by @c +setMatchCacheByteLimit:.
+ */
++ (NSUInteger)matchCacheByteLimit;
+
+/**
+ Removes all results from the current thread's match cache and resets its statistics.
+ */
++ (void)clearMatchCache;
+
+/**
+ Returns the hits, misses and memory use of the current thread's match cache since it was last cleared.
+
+ @discussion The hit rate is @c hits divided by the sum of @c hits and @c misses.
+ @return The statistics of the current thread's match cache. All fields are @c 0 if the thread has not used the cache.
+ */
++ (RKXMatchCacheStatistics)matchCacheStatistics;
+
 #pragma mark - regexValidationError
 
 /**
@@ -1371,11 +2499,13 @@ extern NSString *const RKXEmptyStringKey;
 
  @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation fails to match because of a very slow match operation, a @c NSError object is returned indicating a timeout error.
 
+ @discussion If @c enumOpts contains @c NSEnumerationConcurrent, the matches are found on the calling thread and handed in batches to @c block, which is executed on several threads at once while the next matches are found, and must be safe to run concurrently. Setting @c stop finishes the batch of the match it was set for and starts no more batches, so @c block has been executed for every match before the first one it stopped at, and possibly for a few after it. The method returns once every execution of @c block has finished.
+
  @param pattern A @c NSString containing a valid regular expression.
  @param searchRange The range of the receiver to search.
  @param options The regex options to use. See @c RKXRegexOptions for possible values.
  @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
- @param enumOpts Options for block enumeration operations. Use @c kNilOptions for serial forward operations (best with left-to-right languages). Use @c NSEnumerationReverse for right-to-left languages. Behavior is undefined for @c NSEnumerationConcurrent.
+ @param enumOpts Options for block enumeration operations. Use @c kNilOptions for serial forward operations (best with left-to-right languages). Use @c NSEnumerationReverse for right-to-left languages. Use @c NSEnumerationConcurrent to execute @c block concurrently, in which case @c NSEnumerationReverse is ignored.
  @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
  @param block The block that is executed for each match of @c pattern in the receiver. The block takes three arguments:
  @param &nbsp;&nbsp;capturedStrings A @c NSArray containing the substrings matched by each capture group present in @c pattern. If a capture group did not match anything, it will contain a pointer to an empty string that is equal to @c @@"".
@@ -1432,11 +2562,13 @@ extern NSString *const RKXEmptyStringKey;
 
  @discussion NOTE: If @c RKXReportProgress is passed as an option of @c matchOptions and the matching operation fails to match because of a very slow match operation, a @c NSError object is returned indicating a timeout error.
 
+ @discussion If @c enumOpts contains @c NSEnumerationConcurrent, the divided strings are found on the calling thread in the direction set by the other options and handed in batches to @c block, which is executed on several threads at once and must be safe to run concurrently. @c stop behaves as it does for @c -enumerateStringsMatchedByRegex:range:options:matchOptions:enumerationOptions:error:usingBlock:.
+
  @param pattern A @c NSString containing a valid regular expression.
  @param searchRange The range of the receiver to search.
  @param options The regex options to use. See @c RKXRegexOptions for possible values.
  @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
- @param enumOpts Options for block enumeration operations. Use @c kNilOptions for serial forward operations (best with left-to-right languages). Use @c NSEnumerationReverse for right-to-left languages. Behavior is undefined for @c NSEnumerationConcurrent.
+ @param enumOpts Options for block enumeration operations. Use @c kNilOptions for serial forward operations (best with left-to-right languages). Use @c NSEnumerationReverse for right-to-left languages. Use @c NSEnumerationConcurrent to execute @c block concurrently.
  @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
  @param block The block that is executed for each divided string between the matches of @c pattern in the receiver. The block takes three arguments:
  @param &nbsp;&nbsp;capturedStrings A @c NSArray containing the substrings matched by each capture group present in @c pattern. If a capture group did not match anything, it will contain a pointer to an empty string that is equal to @c @@"".
@@ -1510,6 +2642,26 @@ extern NSString *const RKXEmptyStringKey;
  */
 - (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block;
 
+/**
+ Enumerates the matches in the receiver by the regular expression @c pattern within @c searchRange using @c options and @c matchOptions, executes @c block for each match found using the processing defined by @c enumOpts, and returns a string created by replacing the characters that were matched with the contents of the string returned by @c block.
+
+ @discussion If @c enumOpts contains @c NSEnumerationConcurrent, a large @c searchRange is split at line terminators into pieces that are matched and replaced on separate threads and then joined with a single copy, under the same conditions as @c -stringByReplacingOccurrencesOfRegex:withTemplate:range:options:matchOptions:enumerationOptions:error:. @c block must then be safe to run concurrently. Within each piece it is executed from the last match to the first, as @c -stringByReplacingOccurrencesOfRegex:range:options:matchOptions:error:usingBlock: does over the whole range, and the result is the one that method returns: if @c block sets @c stop, every match before the last one it stopped at keeps its text, even though @c block may already have been executed for some of them.
+
+ @param pattern A @c NSString containing a valid regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param enumOpts Use @c NSEnumerationConcurrent to replace concurrently. Other options are ignored.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @param block The block that is executed for each match of @c pattern in the receiver. The block takes three arguments:
+ @param &nbsp;&nbsp;capturedStrings A @c NSArray containing the substrings matched by each capture group present in @c pattern. If a capture group did not match anything, it will contain a pointer to an empty string that is equal to @c @@"".
+ @param &nbsp;&nbsp;capturedRanges A @c NSArray containing the ranges matched by each capture group present in @c pattern. If a capture group did not match anything, it will contain a @c NSRange equal to @c {NSNotFound, @c 0}.
+ @param &nbsp;&nbsp;stop A reference to a Boolean value. Setting the value to @c YES within the block stops further replacement of the matches before the current one.
+ @return A @c NSString created from the characters within @c searchRange of the receiver in which all matches of the regular expression @c pattern using @c options are replaced with the contents of the @c NSString returned by @c block. Returns the characters within @c searchRange as if @c substringWithRange: had been sent to the receiver if the substring is not matched by @c pattern.
+ @return Returns @c nil if there was an error and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block;
+
 #pragma mark - stringByReplacingOccurrencesOfRegex:usingBlockWithNamedCaptures:
 
 /**
@@ -1556,6 +2708,88 @@ extern NSString *const RKXEmptyStringKey;
  */
 - (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block;
 
+#pragma mark - Asynchronous API
+
+/*
+ The asynchronous methods below snapshot the receiver, run the match on @c queue and call @c completionHandler on @c queue when the scan ends. Each returns a @c NSProgress object that is not attached to the current progress tree:
+
+ - Send it @c -cancel to stop the scan. The engine checks for cancellation at every match and at every ICU progress callback, so even a pathological pattern stops promptly. A cancelled operation completes with a @c nil result and a @c NSUserCancelledError error in @c NSCocoaErrorDomain.
+ - Its @c fractionCompleted is the fraction of @c searchRange scanned so far. It advances at the end of each match and reaches @c 1.0 when the scan finishes.
+
+ The @c RKXTimeoutInterval timeout still applies only when @c RKXReportProgress is passed in @c matchOptions; a timed-out operation completes with a @c nil result and the timeout error.
+ */
+
+/**
+ Asynchronously returns the ranges of all matches and captures of the regular expression @c pattern within @c searchRange of the receiver, in the same layout as @c -rangesOfRegex:range:options:matchOptions:error:.
+
+ @param pattern A @c NSString containing a valid regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param queue The dispatch queue that runs the match and the completion handler.
+ @param completionHandler The block called on @c queue with the ranges, or with @c nil and a @c NSError object if the pattern is invalid, the operation was cancelled or it timed out.
+ @return A @c NSProgress object reporting the scanned fraction of @c searchRange. Cancel it to stop the operation.
+ */
+- (NSProgress *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSArray<NSValue *> *ranges, NSError *error))completionHandler;
+
+/**
+ Asynchronously returns the substrings matched by @c capture of the regular expression @c pattern within @c searchRange of the receiver. Captures that did not participate in a match are returned as an empty string.
+
+ @param pattern A @c NSString containing a valid regular expression.
+ @param searchRange The range of the receiver to search.
+ @param capture The capture group to return. Use @c 0 for the entire match.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param queue The dispatch queue that runs the match and the completion handler.
+ @param completionHandler The block called on @c queue with the substrings, or with @c nil and a @c NSError object if the pattern is invalid, the operation was cancelled or it timed out.
+ @return A @c NSProgress object reporting the scanned fraction of @c searchRange. Cancel it to stop the operation.
+ */
+- (NSProgress *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSArray<NSString *> *substrings, NSError *error))completionHandler;
+
+/**
+ Asynchronously counts the matches of the regular expression @c pattern within @c searchRange of the receiver.
+
+ @param pattern A @c NSString containing a valid regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param queue The dispatch queue that runs the match and the completion handler.
+ @param completionHandler The block called on @c queue with the number of matches, or with @c 0 and a @c NSError object if the pattern is invalid, the operation was cancelled or it timed out.
+ @return A @c NSProgress object reporting the scanned fraction of @c searchRange. Cancel it to stop the operation.
+ */
+- (NSProgress *)countOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSUInteger count, NSError *error))completionHandler;
+
+/**
+ Asynchronously replaces the matches of the regular expression @c pattern within @c searchRange of the receiver with @c templ, with the same result as @c -stringByReplacingOccurrencesOfRegex:withTemplate:range:options:matchOptions:error:, including @c ${name} references. No replacement is made unless the whole scan completes.
+
+ @param pattern A @c NSString containing a valid regular expression.
+ @param templ A @c NSString containing a string template. Can use capture references such as @c $1 or named references such as @c ${name}.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param queue The dispatch queue that runs the match and the completion handler.
+ @param completionHandler The block called on @c queue with the new string, or with @c nil and a @c NSError object if the pattern is invalid, the operation was cancelled or it timed out.
+ @return A @c NSProgress object reporting the scanned fraction of @c searchRange. Cancel it to stop the operation.
+ */
+- (NSProgress *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSString *result, NSError *error))completionHandler;
+
+/**
+ Asynchronously enumerates the matches of the regular expression @c pattern within @c searchRange of the receiver, executing @c block on @c queue for each match as soon as it is found.
+
+ @param pattern A @c NSString containing a valid regular expression.
+ @param searchRange The range of the receiver to search.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param matchOptions The matching options to use. See @c RKXMatchingOptions for possible values.
+ @param queue The dispatch queue that runs the match, @c block and the completion handler.
+ @param block The block that is executed for each match of @c pattern in the receiver. The block takes three arguments:
+ @param &nbsp;&nbsp;capturedStrings A @c NSArray containing the substrings matched by each capture group present in @c pattern. If a capture group did not match anything, it will contain a pointer to an empty string that is equal to @c @@"".
+ @param &nbsp;&nbsp;capturedRanges A @c NSArray containing the ranges matched by each capture group present in @c pattern. If a capture group did not match anything, it will contain a @c NSRange equal to @c {NSNotFound, @c 0}.
+ @param &nbsp;&nbsp;stop A reference to a Boolean value. Setting the value to @c YES within the block stops the scan without an error.
+ @param completionHandler The block called on @c queue after the last match, with @c nil or a @c NSError object if the pattern is invalid, the operation was cancelled or it timed out.
+ @return A @c NSProgress object reporting the scanned fraction of @c searchRange. Cancel it to stop the operation.
+ */
+- (NSProgress *)enumerateStringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue usingBlock:(void (^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block completionHandler:(void (^)(NSError *error))completionHandler;
+
 #pragma clang diagnostic pop
 
 @end
@@ -1716,6 +2950,8 @@ extern NSString *const RKXEmptyStringKey;
 /**
  Returns a new attributed string with all matches of @c pattern replaced by @c templ, preserving attributes of non-matched regions.
 
+ @discussion The result is built in one forward pass, so the cost is linear in the length of the receiver no matter how many matches there are. Each replacement inherits the attributes of the first character it replaces. A replacement for an empty match inherits the attributes of the character in front of it.
+
  @param pattern A @c NSString containing a regular expression.
  @param templ A @c NSString containing a replacement template.
  @return A new @c NSAttributedString with replacements applied.
@@ -1796,3 +3032,60 @@ extern NSString *const RKXEmptyStringKey;
 - (void)addAttributes:(NSDictionary<NSAttributedStringKey, id> *)attrs forMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error;
 
 @end
+
+#pragma mark -
+
+/**
+ @c RKXIncrementalHighlighter keeps an ordered set of regex-to-attributes rules bound to a @c NSMutableAttributedString (typically a @c NSTextStorage) and keeps the attributes up to date as the text is edited.
+
+ @discussion After an edit, only the lines touched by the edit are rescanned for rules whose matches can never span a line terminator. Rules that can span lines (or that depend on the absolute end of the text) are rescanned over the whole string. In both cases, the old and new match ranges are diffed and attributes are only touched where the matches actually changed, inside a single @c beginEditing / @c endEditing transaction.
+
+ @discussion The highlighter owns every attribute key used by its rules: inside a changed range, those keys are removed before the rules are re-applied. Rules are applied in the order they were added, so later rules win where they overlap.
+
+ @discussion Thread Safety: A highlighter must only be used on the thread that edits its attributed string.
+ */
+@interface RKXIncrementalHighlighter : NSObject
+
+/**
+ The attributed string the highlighter is bound to.
+ */
+@property (nonatomic, readonly, strong) NSMutableAttributedString *attributedString;
+
+/**
+ Creates a highlighter bound to @c attributedString. No attributes are applied until a rule is added.
+
+ @param attributedString The mutable attributed string to keep highlighted.
+ @return A new highlighter.
+ */
+- (instancetype)initWithAttributedString:(NSMutableAttributedString *)attributedString;
+
+/**
+ Adds a rule that applies @c attrs to every match of @c pattern using @c options, and highlights the whole string for the new rule.
+
+ @param pattern A @c NSString containing a regular expression.
+ @param options The regex options to use. See @c RKXRegexOptions for possible values.
+ @param attrs The attributes to apply to each match.
+ @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+ @return Returns @c YES if the rule was added, otherwise returns @c NO and indirectly returns a @c NSError object if @c error is not @c NULL.
+ */
+- (BOOL)addRuleForRegex:(NSString *)pattern options:(RKXRegexOptions)options attributes:(NSDictionary<NSAttributedStringKey, id> *)attrs error:(NSError **)error;
+
+/**
+ Removes every rule and the attributes the rules applied.
+ */
+- (void)removeAllRules;
+
+/**
+ Rescans the whole string for every rule and applies the differences. Call this after the attributed string was replaced wholesale outside of the highlighter's knowledge.
+ */
+- (void)rehighlight;
+
+/**
+ Informs the highlighter that the characters in @c editedRange were changed. Call this from @c -textStorage:didProcessEditing:range:changeInLength: or after any character edit of the attributed string.
+
+ @param editedRange The range of the edited characters, in post-edit coordinates.
+ @param delta The change in length caused by the edit.
+ */
+- (void)processEditInRange:(NSRange)editedRange changeInLength:(NSInteger)delta;
+
+@end
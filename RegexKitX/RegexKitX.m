@@ -30,6 +30,8 @@
 */
 
 #import "RegexKitX.h"
+#import <objc/runtime.h>
+#import <stdatomic.h>
 
 #define RKX_EXPECTED(cond, expect) __builtin_expect((long)(cond), (expect))
 
@@ -41,7 +43,26 @@ NSString *const RKXNamedReferencePattern = @"\\{(\\w+)\\}";
 NSString *const RKXEmptyStringKey = @"";
 NSErrorDomain const RKXMatchingTimeoutErrorDomain = @"RegexKitX Matching Timeout Error";
 NSInteger const RKXMatchingTimeoutError = -2857;
+NSErrorDomain const RKXLinearTimeMatchingErrorDomain = @"RegexKitX Linear-Time Matching Error";
+NSInteger const RKXLinearTimeMatchingUnsupportedError = -2858;
+NSErrorDomain const RKXRegexComplexityErrorDomain = @"RegexKitX Regex Complexity Error";
+NSInteger const RKXRegexHazardError = -2859;
+NSErrorDomain const RKXExtractionSchemaErrorDomain = @"RegexKitX Extraction Schema Error";
+NSInteger const RKXExtractionSchemaInvalidCaptureError = -2860;
+NSErrorDomain const RKXMatchCursorErrorDomain = @"RegexKitX Match Cursor Error";
+NSInteger const RKXMatchCursorInvalidTokenError = -2861;
+NSErrorDomain const RKXRewriteRuleSetErrorDomain = @"RegexKitX Rewrite Rule Set Error";
+NSInteger const RKXRewriteRuleSetIncompatibleRuleError = -2862;
+NSErrorDomain const RKXLexerErrorDomain = @"RegexKitX Lexer Error";
+NSInteger const RKXLexerIncompatibleTokenError = -2863;
+NSInteger const RKXLexerUnexpectedInputError = -2864;
 static NSTimeInterval const RKXTimeoutInterval = 1.0;
+static NSUInteger const RKXLineBlockLength = 1 << 16;   // characters copied at a time to find line terminators
+static NSUInteger const RKXLineBatchLength = 1 << 16;   // characters of lines matched together on one thread
+static NSUInteger const RKXReplacementPartitionLength = 1 << 18;   // characters replaced together on one thread
+static NSUInteger const RKXBackwardWindowLength = 1 << 12;   // characters in the first window of a backward search
+static NSUInteger const RKXEnumerationBatchLength = 64;   // items handed to a concurrent enumeration block together on one thread
+static NSUInteger const RKXLexerTokenBatchCount = 256;   // tokens stored at a time when a lexer reports them to a block
 
 static inline BOOL OptionsHasValue(NSUInteger options, NSUInteger value) {
     return ((options & value) == value);
@@ -68,6 +89,7 @@ static inline BOOL OptionsHasValue(NSUInteger options, NSUInteger value) {
 #pragma mark -
 @interface NSTextCheckingResult (RangeMechanics)
 @property (nonatomic, readonly, copy) NSArray<NSValue *> *ranges;
+- (NSArray<NSValue *> *)rangesWithOffset:(NSUInteger)offset;
 - (NSArray<NSString *> *)substringsFromString:(NSString *)string;
 @end
 
@@ -84,6 +106,19 @@ static inline BOOL OptionsHasValue(NSUInteger options, NSUInteger value) {
     return [ranges copy];
 }
 
+- (NSArray<NSValue *> *)rangesWithOffset:(NSUInteger)offset
+{
+    NSMutableArray *ranges = [NSMutableArray arrayWithCapacity:self.numberOfRanges];
+
+    for (NSUInteger i = 0; i < self.numberOfRanges; i++) {
+        NSRange range = [self rangeAtIndex:i];
+        if (range.location != NSNotFound) { range.location += offset; }
+        [ranges addRange:range];
+    }
+
+    return [ranges copy];
+}
+
 - (NSArray<NSString *> *)substringsFromString:(NSString *)string
 {
     NSMutableArray *substringArray = [NSMutableArray array];
@@ -142,1354 +177,7519 @@ static inline BOOL OptionsHasValue(NSUInteger options, NSUInteger value) {
 
 @end
 
-#pragma mark -
-@implementation NSString (RegexKitX)
+#pragma mark - Pattern Syntax Tree
+
+// A pattern is parsed once into a flat array of nodes that the linear-time engine compiles from and that
+// pattern analysis can walk. Constructs the engines do not model (backreferences, lookaround, atomic groups,
+// property classes...) still get nodes so the shape of the pattern is known, and are flagged in features.
+
+#define RKXNoNode ((int32_t)-1)
+#define RKXRepeatUnbounded UINT32_MAX
+
+static const NSUInteger RKXMaxSyntaxDepth = 200;
+static const uint32_t RKXMaxSyntaxNodes = 1U << 20;
+static const uint32_t RKXMaxProgramLength = 20000;
+static const uint32_t RKXMaxCodePoint = 0x10FFFF;
+
+typedef NS_ENUM(uint8_t, RKXNodeKind) {
+    RKXNodeEmpty,
+    RKXNodeLiteral,         // value: code point (lowercased if RKXNodeCaseless)
+    RKXNodeClass,           // value: index into classes (unused if RKXNodeOpaque)
+    RKXNodeDot,
+    RKXNodeAssertion,       // value: RKXAssertionKind
+    RKXNodeConcat,          // child: first item, linked through next
+    RKXNodeAlternation,     // child: first branch, linked through next
+    RKXNodeRepeat,          // child: body, min/max
+    RKXNodeCapture,         // child: body, value: group number
+    RKXNodeLookaround,      // child: body, value: RKXLookaroundKind
+    RKXNodeAtomic,          // child: body
+    RKXNodeBackreference,   // value: group number (0 if named)
+};
+
+typedef NS_OPTIONS(uint8_t, RKXNodeFlags) {
+    RKXNodeCaseless     = 1 << 0,
+    RKXNodeLazy         = 1 << 1,
+    RKXNodePossessive   = 1 << 2,
+    RKXNodeDotAll       = 1 << 3,
+    RKXNodeOpaque       = 1 << 4,
+};
+
+typedef NS_ENUM(uint8_t, RKXAssertionKind) {
+    RKXAssertStartOfText,           // \A, or ^ without RKXMultiline
+    RKXAssertStartOfLine,           // ^ with RKXMultiline
+    RKXAssertEndOfText,             // \z
+    RKXAssertEndOfTextOrFinalLine,  // \Z, or $ without RKXMultiline
+    RKXAssertEndOfLine,             // $ with RKXMultiline
+    RKXAssertWordBoundary,          // \b
+    RKXAssertNotWordBoundary,       // \B
+    RKXAssertOther,                 // \G
+};
+
+typedef NS_ENUM(uint8_t, RKXLookaroundKind) {
+    RKXLookahead,
+    RKXNegativeLookahead,
+    RKXLookbehind,
+    RKXNegativeLookbehind,
+};
+
+typedef NS_OPTIONS(uint32_t, RKXSyntaxFeatures) {
+    RKXSyntaxBackreference      = 1 << 0,
+    RKXSyntaxLookaround         = 1 << 1,
+    RKXSyntaxAtomic             = 1 << 2,   // atomic groups and possessive quantifiers
+    RKXSyntaxOpaqueClass        = 1 << 3,   // \p, set operations, \X, \R, ...
+    RKXSyntaxDotAll             = 1 << 4,   // a . that also matches line terminators
+    RKXSyntaxUnixLines          = 1 << 5,   // a ., ^ or $ under RKXUseUnixLineSeparators
+    RKXSyntaxUnicodeWords       = 1 << 6,   // \b or \B under RKXUnicodeWordBoundaries
+    RKXSyntaxCaselessFolding    = 1 << 7,   // caseless matching that needs more than ASCII case pairs
+    RKXSyntaxOtherAssertion     = 1 << 8,   // \G
+    RKXSyntaxASCIIInput         = 1 << 9,   // \w, \d, \s or \b, modelled for ASCII input only
+    RKXSyntaxCaselessASCII      = 1 << 10,  // caseless ASCII letters, modelled for input without the characters that fold to them
+};
+
+typedef struct {
+    RKXNodeKind kind;
+    RKXNodeFlags flags;
+    uint32_t value;
+    uint32_t min;
+    uint32_t max;
+    int32_t child;
+    int32_t next;
+} RKXNode;
+
+typedef struct {
+    UTF32Char first;
+    UTF32Char last;
+} RKXCodePointRange;
+
+typedef struct {
+    uint32_t location;
+    uint32_t count;
+    uint32_t ascii[4];
+} RKXCharClass;
+
+typedef struct {
+    RKXNode *nodes;
+    uint32_t nodeCount;
+    uint32_t nodeCapacity;
+    RKXCodePointRange *ranges;
+    uint32_t rangeCount;
+    uint32_t rangeCapacity;
+    RKXCharClass *classes;
+    uint32_t classCount;
+    uint32_t classCapacity;
+    int32_t root;
+    uint32_t captureCount;
+    NSRange *captureOpeners;    // where each group's "(" or "(?<name>" is in the pattern, by group number - 1
+    uint32_t captureOpenerCapacity;
+    RKXSyntaxFeatures features;
+} RKXSyntax;
+
+typedef NS_OPTIONS(uint8_t, RKXParseFlags) {
+    RKXParseCaseless        = 1 << 0,
+    RKXParseMultiline       = 1 << 1,
+    RKXParseDotAll          = 1 << 2,
+    RKXParseUnixLines       = 1 << 3,
+    RKXParseUnicodeWords    = 1 << 4,
+};
+
+typedef struct {
+    RKXSyntax *syntax;
+    const unichar *chars;
+    NSUInteger length;
+    NSUInteger index;
+    NSUInteger depth;
+    BOOL failed;
+} RKXParser;
+
+typedef struct {
+    RKXCodePointRange *items;
+    uint32_t count;
+    uint32_t capacity;
+} RKXRangeBuffer;
+
+static BOOL RKXGrow(void **buffer, uint32_t *capacity, uint32_t needed, size_t itemSize)
+{
+    if (needed <= *capacity) { return YES; }
+    uint32_t newCapacity = (*capacity) ? *capacity : 16U;
+    while (newCapacity < needed) { newCapacity *= 2U; }
+    void *grown = realloc(*buffer, newCapacity * itemSize);
+    if (!grown) { return NO; }
+    *buffer = grown;
+    *capacity = newCapacity;
+    return YES;
+}
 
-#pragma mark - Caching Methods
+static void RKXSyntaxFree(RKXSyntax *syntax)
+{
+    free(syntax->nodes);
+    free(syntax->ranges);
+    free(syntax->classes);
+    free(syntax->captureOpeners);
+    memset(syntax, 0, sizeof(*syntax));
+}
 
-/**
- Returns a key string to be used to access the stored @c NSRegularExpression object.
+static inline BOOL RKXIsASCIILetter(UTF32Char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+static inline BOOL RKXIsASCIIDigit(UTF32Char c) { return (c >= '0' && c <= '9'); }
+static inline BOOL RKXIsASCIIWord(UTF32Char c) { return RKXIsASCIILetter(c) || RKXIsASCIIDigit(c) || c == '_'; }
+static inline BOOL RKXIsShorthandClass(UTF32Char c) { return c == 'd' || c == 'D' || c == 'w' || c == 'W' || c == 's' || c == 'S'; }
+static inline BOOL RKXIsLineTerminator(UTF32Char c) { return (c >= 0x0A && c <= 0x0D) || c == 0x85 || c == 0x2028 || c == 0x2029; }
 
- @param pattern The pattern to match.
- @param options The options used for the @c NSRegularExpression.
- @return The cache key representation of the regex pattern with options.
- */
-+ (NSString *)cacheKeyForRegex:(NSString *)pattern options:(RKXRegexOptions)options
+/// YES for the characters outside ASCII that caseless matching equates with ASCII letters: the Kelvin sign, long s,
+/// dotted and dotless i, and those that fold to a string of letters, such as the sharp s and the Latin ligatures.
+static inline BOOL RKXFoldsToASCIILetter(UTF32Char c)
 {
-    NSString *key = [NSString stringWithFormat:@"%@_%lu", pattern, options];
-    return key;
+    return c == 0xDF || c == 0x130 || c == 0x131 || c == 0x149 || c == 0x17F || c == 0x1F0 || (c >= 0x1E96 && c <= 0x1E9E) || c == 0x212A || (c >= 0xFB00 && c <= 0xFB06);
 }
 
-/**
- Creates and/or returns the canonical @c NSRegularExpression object from the current thread dictionary for a given pattern. This is utilized to cut down on excessive @c NSRegularExpression object creation for each API call.
-
- @param pattern The regex pattern to be matched against.
- @param options The regex options used for matching.
- @param error The error object indirectly returned if instantiation of the @c NSRegularExpression fails.
- @return The @c NSRegularExpression object created and stored in the current thread's dictionary.
- */
-+ (NSRegularExpression *)cachedRegexForPattern:(NSString *)pattern options:(RKXRegexOptions)options error:(NSError **)error
+static inline UTF32Char RKXCodePointAt(const unichar *chars, NSUInteger length, NSUInteger index, NSUInteger *width)
 {
-    NSString *patternKey = [NSString cacheKeyForRegex:pattern options:options];
-    NSRegularExpression *regex = NSThread.currentThread.threadDictionary[patternKey];
+    unichar c = chars[index];
+    if (CFStringIsSurrogateHighCharacter(c) && index + 1 < length && CFStringIsSurrogateLowCharacter(chars[index + 1])) {
+        *width = 2;
+        return CFStringGetLongCharacterForSurrogatePair(c, chars[index + 1]);
+    }
+    *width = 1;
+    return c;
+}
 
-    if (!regex) {
-        NSRegularExpressionOptions regexOptions = (NSRegularExpressionOptions)options;
-        regex = [NSRegularExpression regularExpressionWithPattern:pattern options:regexOptions error:error];
-        if (!regex) { return nil; }
-        NSThread.currentThread.threadDictionary[patternKey] = regex;
+static int32_t RKXAddNode(RKXParser *ps, RKXNodeKind kind, RKXNodeFlags flags, uint32_t value, int32_t child)
+{
+    RKXSyntax *syntax = ps->syntax;
+    if (ps->failed) { return RKXNoNode; }
+    if (syntax->nodeCount >= RKXMaxSyntaxNodes || !RKXGrow((void **)&syntax->nodes, &syntax->nodeCapacity, syntax->nodeCount + 1, sizeof(RKXNode))) {
+        ps->failed = YES;
+        return RKXNoNode;
     }
-    
-    return regex;
+    syntax->nodes[syntax->nodeCount] = (RKXNode){ .kind = kind, .flags = flags, .value = value, .min = 0, .max = 0, .child = child, .next = RKXNoNode };
+    return (int32_t)syntax->nodeCount++;
 }
 
-#pragma mark - DRY Utility Methods
+#pragma mark Character classes
 
-/// The fundamental matching method of RegexKitX. It invokes @c -enumerateMatchesInString:options:range:usingBlock: or @c -matchesInString:options:range: on @c NSRegularExpression. The default timeout interval is 1.0 seconds.
-/// @discussion If a timeout occurs and @c error is not @c NULL, a @c NSError object is returned with the timeout information.
-/// @discussion If something deeper-in-the-weeds regarding the use of @c -enumerateMatchesInString:options:range:usingBlock: comes up, it is *strongly* recommended that the developer use THAT API DIRECTLY or consider changing her course of matching action.
-/// @param pattern A @c NSString containing a regular expression.
-/// @param searchRange The range of the receiver to search.
-/// @param options A bit mask that specifies the options for regular expression matching. See @c RKXRegexOptions for details. Either @c 0 or @c RKXNoOptions may be used if no options are required.
-/// @param matchOptions A bit mask that specifies the options for reporting, completion, and matching rules. See @c RKXMatchOptions for details.
-/// @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
-/// @return Returns an array of @c NSTextCheckingResult objects indicating where matches occurred.
-/// @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
-- (NSArray<NSTextCheckingResult *> *)_matchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+static BOOL RKXRangeBufferAdd(RKXRangeBuffer *buffer, UTF32Char first, UTF32Char last)
 {
-    NSCParameterAssert(pattern);
-    NSCAssert(searchRange.length <= self.length, @"searchRange.length (%lu) is greater than string length (%lu)", searchRange.length, self.length);
-    NSCAssert(searchRange.location <= (self.length - 1), @"searchRange.location (%lu) is invalid and past the string length", searchRange.location);
-    
-    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
-    if (!regex) { return nil; }
-    NSMatchingOptions matchOpts = (NSMatchingOptions)matchOptions;
+    if (!RKXGrow((void **)&buffer->items, &buffer->capacity, buffer->count + 1, sizeof(RKXCodePointRange))) { return NO; }
+    buffer->items[buffer->count++] = (RKXCodePointRange){ .first = first, .last = last };
+    return YES;
+}
 
-    if (OptionsHasValue(matchOpts, NSMatchingReportProgress)) {
-        NSMutableArray *matches = [NSMutableArray array];
-        NSDate *start = [NSDate date];
-        __block NSTimeInterval delta = 0.0;
+static int RKXCompareRanges(const void *a, const void *b)
+{
+    UTF32Char first = ((const RKXCodePointRange *)a)->first;
+    UTF32Char second = ((const RKXCodePointRange *)b)->first;
+    return (first < second) ? -1 : (first > second) ? 1 : 0;
+}
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-parameter"
-        [regex enumerateMatchesInString:self options:matchOpts range:searchRange usingBlock:^(NSTextCheckingResult * _Nullable result, NSMatchingFlags flags, BOOL * _Nonnull stop) {
-            NSDate *now = [NSDate date];
-            delta = [now timeIntervalSinceDate:start];
-            if (result && ![matches containsObject:result]) { [matches addObject:result]; }
-            if (delta > RKXTimeoutInterval) { *stop = YES; }
-        }];
-#pragma clang diagostic pop
+/// Sorts the ranges and merges the ones that overlap or touch.
+static void RKXRangeBufferNormalize(RKXRangeBuffer *buffer)
+{
+    if (buffer->count < 2) { return; }
+    qsort(buffer->items, buffer->count, sizeof(RKXCodePointRange), RKXCompareRanges);
+    uint32_t kept = 0;
 
-        if (error != NULL && delta > RKXTimeoutInterval) {
-            *error = NSRegularExpression.timeoutError;
+    for (uint32_t i = 1; i < buffer->count; i++) {
+        RKXCodePointRange *last = &buffer->items[kept];
+        RKXCodePointRange range = buffer->items[i];
+        if (range.first <= last->last + 1) {
+            if (range.last > last->last) { last->last = range.last; }
+        }
+        else {
+            buffer->items[++kept] = range;
         }
-
-        return [matches copy];
     }
 
-    NSArray *matches = [regex matchesInString:self options:matchOpts range:searchRange];
-    return matches;
+    buffer->count = kept + 1;
 }
 
-- (NSArray<NSString *> *)_captureNamesWithMetaPattern:(NSString *)metaPattern
+/// Replaces normalized ranges with their complement over all code points.
+static BOOL RKXRangeBufferNegate(RKXRangeBuffer *buffer)
 {
-    NSArray *nameCaptureMatches = [self _matchesForRegex:metaPattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-    if (!nameCaptureMatches || !nameCaptureMatches.count) { return nil; }
-    NSMutableArray *nameMatchesM = [NSMutableArray array];
+    RKXRangeBuffer negated = { NULL, 0, 0 };
+    UTF32Char next = 0;
+    BOOL ok = YES;
 
-    for (NSTextCheckingResult *match in nameCaptureMatches) {
-        NSRange nameRange = [match rangeAtIndex:1];
-        NSString *name = [self substringWithRange:nameRange];
-        [nameMatchesM addObject:name];
+    for (uint32_t i = 0; i < buffer->count && ok; i++) {
+        if (buffer->items[i].first > next) { ok = RKXRangeBufferAdd(&negated, next, buffer->items[i].first - 1); }
+        next = buffer->items[i].last + 1;
     }
 
-    return [nameMatchesM copy];
-}
-
-#pragma mark - arrayOfCaptureSubstringsMatchedByRegex:
+    if (ok && next <= RKXMaxCodePoint) { ok = RKXRangeBufferAdd(&negated, next, RKXMaxCodePoint); }
+    free(buffer->items);
+    *buffer = negated;
+    return ok;
+}
+
+/// Adds the ranges of \\d, \\w or \\s (or their negations for an uppercase letter). Only their ASCII members are
+/// modelled, which is why patterns using them are flagged RKXSyntaxASCIIInput.
+static BOOL RKXRangeBufferAddShorthand(RKXRangeBuffer *buffer, unichar letter)
+{
+    RKXRangeBuffer set = { NULL, 0, 0 };
+    BOOL ok = YES;
+
+    switch (letter | 0x20) {
+        case 'd':
+            ok = RKXRangeBufferAdd(&set, '0', '9');
+            break;
+        case 'w':
+            ok = RKXRangeBufferAdd(&set, '0', '9') && RKXRangeBufferAdd(&set, 'A', 'Z') && RKXRangeBufferAdd(&set, '_', '_') && RKXRangeBufferAdd(&set, 'a', 'z');
+            break;
+        default:
+            ok = RKXRangeBufferAdd(&set, '\t', '\r') && RKXRangeBufferAdd(&set, ' ', ' ');
+            break;
+    }
 
-- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern
-{
-    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (ok && letter < 'a') { ok = RKXRangeBufferNegate(&set); }
+    for (uint32_t i = 0; i < set.count && ok; i++) { ok = RKXRangeBufferAdd(buffer, set.items[i].first, set.items[i].last); }
+    free(set.items);
+    return ok;
 }
 
-- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+/// Adds the other case of every ASCII letter in the buffer.
+static BOOL RKXRangeBufferAddASCIICases(RKXRangeBuffer *buffer)
 {
-    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    uint32_t count = buffer->count;
+    BOOL ok = YES;
+
+    for (uint32_t i = 0; i < count && ok; i++) {
+        RKXCodePointRange range = buffer->items[i];
+        UTF32Char upperFirst = MAX(range.first, (UTF32Char)'A'), upperLast = MIN(range.last, (UTF32Char)'Z');
+        UTF32Char lowerFirst = MAX(range.first, (UTF32Char)'a'), lowerLast = MIN(range.last, (UTF32Char)'z');
+        if (upperFirst <= upperLast) { ok = RKXRangeBufferAdd(buffer, upperFirst + 0x20, upperLast + 0x20); }
+        if (ok && lowerFirst <= lowerLast) { ok = RKXRangeBufferAdd(buffer, lowerFirst - 0x20, lowerLast - 0x20); }
+    }
+
+    return ok;
 }
 
-- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+static BOOL RKXRangeBufferHasASCIILetter(const RKXRangeBuffer *buffer)
 {
-    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    for (uint32_t i = 0; i < buffer->count; i++) {
+        RKXCodePointRange range = buffer->items[i];
+        if ((range.first <= 'Z' && range.last >= 'A') || (range.first <= 'z' && range.last >= 'a')) { return YES; }
+    }
+
+    return NO;
 }
 
-- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+/// Moves normalized ranges into the syntax and returns the new class index.
+static int32_t RKXSyntaxAddClass(RKXParser *ps, const RKXRangeBuffer *buffer)
 {
-    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    RKXSyntax *syntax = ps->syntax;
+    if (!RKXGrow((void **)&syntax->ranges, &syntax->rangeCapacity, syntax->rangeCount + buffer->count, sizeof(RKXCodePointRange))
+        || !RKXGrow((void **)&syntax->classes, &syntax->classCapacity, syntax->classCount + 1, sizeof(RKXCharClass))) {
+        ps->failed = YES;
+        return RKXNoNode;
+    }
+
+    RKXCharClass cls = { .location = syntax->rangeCount, .count = buffer->count, .ascii = { 0, 0, 0, 0 } };
+    if (buffer->count) { memcpy(syntax->ranges + syntax->rangeCount, buffer->items, buffer->count * sizeof(RKXCodePointRange)); }
+    syntax->rangeCount += buffer->count;
+
+    for (uint32_t i = 0; i < buffer->count; i++) {
+        for (UTF32Char c = buffer->items[i].first; c <= buffer->items[i].last && c < 128; c++) {
+            cls.ascii[c >> 5] |= (1U << (c & 31));
+        }
+    }
+
+    syntax->classes[syntax->classCount] = cls;
+    return (int32_t)syntax->classCount++;
 }
 
-- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+static inline BOOL RKXClassContains(const RKXSyntax *syntax, const RKXCharClass *cls, UTF32Char c)
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return @[]; }
-    NSMutableArray *matchCaptures = [NSMutableArray array];
+    if (c < 128) { return ((cls->ascii[c >> 5] >> (c & 31)) & 1U) != 0; }
+    const RKXCodePointRange *ranges = syntax->ranges + cls->location;
+    uint32_t low = 0, high = cls->count;
 
-    for (NSTextCheckingResult *match in matches) {
-        [matchCaptures addObject:[match substringsFromString:self]];
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (c < ranges[mid].first) { high = mid; }
+        else if (c > ranges[mid].last) { low = mid + 1; }
+        else { return YES; }
     }
 
-    return [matchCaptures copy];
+    return NO;
 }
 
-#pragma mark - arrayOfDictionariesMatchedByRegex:
+#pragma mark Parser
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
-{
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-    return dictArray;
-}
+static int32_t RKXParseAlternation(RKXParser *ps, RKXParseFlags flags);
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+static BOOL RKXParseHexDigits(RKXParser *ps, NSUInteger minDigits, NSUInteger maxDigits, UTF32Char *value)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-    return dictArray;
-}
+    UTF32Char result = 0;
+    NSUInteger digits = 0;
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
-{
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:NULL];
-    return dictArray;
+    while (digits < maxDigits && ps->index < ps->length) {
+        unichar c = ps->chars[ps->index];
+        UTF32Char digit;
+        if (c >= '0' && c <= '9') { digit = (UTF32Char)(c - '0'); }
+        else if (c >= 'a' && c <= 'f') { digit = (UTF32Char)(c - 'a' + 10); }
+        else if (c >= 'A' && c <= 'F') { digit = (UTF32Char)(c - 'A' + 10); }
+        else { break; }
+        result = (result << 4) | digit;
+        ps->index++;
+        digits++;
+    }
+
+    if (digits < minDigits || result > RKXMaxCodePoint) { ps->failed = YES; return NO; }
+    *value = result;
+    return YES;
 }
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
-{
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:error];
-    return dictArray;
+/// Parses the code point named by an escape, with ps->index just past the backslash. Fails for escapes that
+/// are not a single code point.
+static BOOL RKXParseEscapedCodePoint(RKXParser *ps, UTF32Char *value)
+{
+    if (ps->index >= ps->length) { ps->failed = YES; return NO; }
+    unichar c = ps->chars[ps->index];
+
+    switch (c) {
+        case 't': ps->index++; *value = '\t'; return YES;
+        case 'n': ps->index++; *value = '\n'; return YES;
+        case 'r': ps->index++; *value = '\r'; return YES;
+        case 'f': ps->index++; *value = '\f'; return YES;
+        case 'a': ps->index++; *value = 0x07; return YES;
+        case 'e': ps->index++; *value = 0x1B; return YES;
+        case 'u': ps->index++; return RKXParseHexDigits(ps, 4, 4, value);
+        case 'U': ps->index++; return RKXParseHexDigits(ps, 8, 8, value);
+        case 'x':
+            ps->index++;
+            if (ps->index < ps->length && ps->chars[ps->index] == '{') {
+                ps->index++;
+                if (!RKXParseHexDigits(ps, 1, 6, value)) { return NO; }
+                if (ps->index >= ps->length || ps->chars[ps->index] != '}') { ps->failed = YES; return NO; }
+                ps->index++;
+                return YES;
+            }
+            return RKXParseHexDigits(ps, 2, 2, value);
+        case '0': {
+            ps->index++;
+            UTF32Char result = 0;
+            NSUInteger digits = 0;
+            while (digits < 3 && ps->index < ps->length && ps->chars[ps->index] >= '0' && ps->chars[ps->index] <= '7') {
+                result = result * 8 + (UTF32Char)(ps->chars[ps->index++] - '0');
+                digits++;
+            }
+            if (!digits) { ps->failed = YES; return NO; }
+            *value = result;
+            return YES;
+        }
+        default: {
+            if (RKXIsASCIILetter(c) || RKXIsASCIIDigit(c)) { ps->failed = YES; return NO; }
+            NSUInteger width;
+            *value = RKXCodePointAt(ps->chars, ps->length, ps->index, &width);
+            ps->index += width;
+            return YES;
+        }
+    }
 }
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+/// Skips the rest of a bracket expression the tree does not model, with ps->index inside the outermost set.
+static void RKXSkipBracketExpression(RKXParser *ps)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:matchOptions error:error];
-    return dictArray;
+    NSUInteger depth = 1;
+
+    while (ps->index < ps->length && depth) {
+        unichar c = ps->chars[ps->index++];
+        if (c == '\\') { ps->index++; }
+        else if (c == '[') { depth++; }
+        else if (c == ']') { depth--; }
+    }
+
+    if (depth) { ps->failed = YES; }
 }
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options error:(NSError **)error
+static int32_t RKXAddOpaqueClass(RKXParser *ps)
 {
-    return [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:keys forCaptures:captures options:options matchOptions:kNilOptions error:error];
+    ps->syntax->features |= RKXSyntaxOpaqueClass;
+    return RKXAddNode(ps, RKXNodeClass, RKXNodeOpaque, 0, RKXNoNode);
 }
 
-- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError * __autoreleasing *)error
+static int32_t RKXParseClass(RKXParser *ps, RKXParseFlags flags)
 {
-    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
-    if (!regex) { return nil; }
-    NSMutableArray *dictArray = [NSMutableArray array];
+    RKXRangeBuffer buffer = { NULL, 0, 0 };
+    BOOL negated = NO, first = YES, opaque = NO, nonASCII = NO, ok = YES;
+    ps->index++;
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-parameter"
-    [self enumerateStringsMatchedByRegex:pattern range:searchRange options:options matchOptions:matchOptions enumerationOptions:kNilOptions error:error usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
-        NSString *mainString = capturedStrings[0];
-        NSDictionary *dict = [mainString dictionaryMatchedByRegex:pattern range:mainString.stringRange withKeys:keys forCaptures:captures options:options matchOptions:matchOptions error:error];
-        [dictArray addObject:dict];
-    }];
-#pragma clang diagnostic pop
+    if (ps->index < ps->length && ps->chars[ps->index] == '^') {
+        negated = YES;
+        ps->index++;
+    }
 
-    return [dictArray copy];
-}
+    while (ok && !ps->failed) {
+        if (ps->index >= ps->length) { ps->failed = YES; break; }
+        unichar c = ps->chars[ps->index];
+        unichar next = (ps->index + 1 < ps->length) ? ps->chars[ps->index + 1] : 0;
 
-#pragma mark - captureCount:
+        if (c == ']') {
+            if (first) { ps->failed = YES; break; }
+            ps->index++;
+            break;
+        }
 
-- (NSUInteger)captureCount
-{
-    NSError *error;
-    return [self captureCountWithOptions:RKXNoOptions error:&error];
+        if (c == '[' || (c == '&' && next == '&') || (c == '-' && next == '-') || (c == '\\' && (next == 'p' || next == 'P'))) {
+            opaque = YES;
+            RKXSkipBracketExpression(ps);
+            break;
+        }
+
+        first = NO;
+        UTF32Char low, high;
+
+        if (c == '\\' && RKXIsShorthandClass(next)) {
+            ps->index += 2;
+            ps->syntax->features |= RKXSyntaxASCIIInput;
+            ok = RKXRangeBufferAddShorthand(&buffer, next);
+            continue;
+        }
+
+        if (c == '\\') {
+            ps->index++;
+            if (!RKXParseEscapedCodePoint(ps, &low)) { break; }
+        }
+        else {
+            NSUInteger width;
+            low = RKXCodePointAt(ps->chars, ps->length, ps->index, &width);
+            ps->index += width;
+        }
+
+        high = low;
+
+        if (ps->index + 1 < ps->length && ps->chars[ps->index] == '-' && ps->chars[ps->index + 1] != ']') {
+            ps->index++;
+            c = ps->chars[ps->index];
+
+            if (c == '[') { ps->failed = YES; break; }
+            else if (c == '\\') {
+                ps->index++;
+                if (!RKXParseEscapedCodePoint(ps, &high)) { break; }
+            }
+            else {
+                NSUInteger width;
+                high = RKXCodePointAt(ps->chars, ps->length, ps->index, &width);
+                ps->index += width;
+            }
+
+            if (high < low) { ps->failed = YES; break; }
+        }
+
+        if (high >= 128) { nonASCII = YES; }
+        ok = RKXRangeBufferAdd(&buffer, low, high);
+    }
+
+    if (!ok) { ps->failed = YES; }
+    if (ps->failed) { free(buffer.items); return RKXNoNode; }
+    if (opaque) { free(buffer.items); return RKXAddOpaqueClass(ps); }
+
+    BOOL hasLetters = RKXRangeBufferHasASCIILetter(&buffer);
+
+    if ((flags & RKXParseCaseless) && hasLetters) {
+        ps->syntax->features |= RKXSyntaxCaselessASCII;
+        ok = RKXRangeBufferAddASCIICases(&buffer);
+    }
+
+    // ICU closes caseless sets over full Unicode case folding, which only ASCII case pairs model, and how that
+    // closure combines with negation only matters once letters are involved.
+    if ((flags & RKXParseCaseless) && (nonASCII || (negated && hasLetters))) { ps->syntax->features |= RKXSyntaxCaselessFolding; }
+    RKXRangeBufferNormalize(&buffer);
+    if (ok && negated) { ok = RKXRangeBufferNegate(&buffer); }
+    if (!ok) { free(buffer.items); ps->failed = YES; return RKXNoNode; }
+
+    int32_t cls = RKXSyntaxAddClass(ps, &buffer);
+    free(buffer.items);
+    if (cls == RKXNoNode) { return RKXNoNode; }
+    return RKXAddNode(ps, RKXNodeClass, 0, (uint32_t)cls, RKXNoNode);
 }
 
-- (NSUInteger)captureCountWithOptions:(RKXRegexOptions)options error:(NSError **)error
+static int32_t RKXAddLiteral(RKXParser *ps, UTF32Char c, RKXParseFlags flags)
 {
-    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:error];
-    if (!regex) { return NSNotFound; }
-    return regex.numberOfCaptureGroups;
-}
+    RKXNodeFlags nodeFlags = 0;
 
-#pragma mark - captureSubstringsMatchedByRegex:
+    if (flags & RKXParseCaseless) {
+        if (c >= 128) { ps->syntax->features |= RKXSyntaxCaselessFolding; }
+        else if (RKXIsASCIILetter(c)) {
+            ps->syntax->features |= RKXSyntaxCaselessASCII;
+            nodeFlags = RKXNodeCaseless;
+            c |= 0x20;
+        }
+    }
 
-- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern
-{
-    return [self captureSubstringsMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return RKXAddNode(ps, RKXNodeLiteral, nodeFlags, c, RKXNoNode);
+}
+
+static int32_t RKXAddAssertion(RKXParser *ps, RKXAssertionKind kind, RKXParseFlags flags)
+{
+    RKXSyntax *syntax = ps->syntax;
+
+    switch (kind) {
+        case RKXAssertStartOfLine:
+        case RKXAssertEndOfLine:
+        case RKXAssertEndOfTextOrFinalLine:
+            if (flags & RKXParseUnixLines) { syntax->features |= RKXSyntaxUnixLines; }
+            break;
+        case RKXAssertWordBoundary:
+        case RKXAssertNotWordBoundary:
+            syntax->features |= RKXSyntaxASCIIInput;
+            if (flags & RKXParseUnicodeWords) { syntax->features |= RKXSyntaxUnicodeWords; }
+            break;
+        case RKXAssertOther:
+            syntax->features |= RKXSyntaxOtherAssertion;
+            break;
+        default:
+            break;
+    }
+
+    return RKXAddNode(ps, RKXNodeAssertion, 0, kind, RKXNoNode);
 }
 
-- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+static int32_t RKXParseEscape(RKXParser *ps, RKXParseFlags flags)
 {
-    return [self captureSubstringsMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    ps->index++;
+    if (ps->index >= ps->length) { ps->failed = YES; return RKXNoNode; }
+    unichar c = ps->chars[ps->index];
+
+    switch (c) {
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S': {
+            RKXRangeBuffer buffer = { NULL, 0, 0 };
+            ps->index++;
+            ps->syntax->features |= RKXSyntaxASCIIInput;
+            if (!RKXRangeBufferAddShorthand(&buffer, c)) { free(buffer.items); ps->failed = YES; return RKXNoNode; }
+            RKXRangeBufferNormalize(&buffer);
+            int32_t cls = RKXSyntaxAddClass(ps, &buffer);
+            free(buffer.items);
+            if (cls == RKXNoNode) { return RKXNoNode; }
+            return RKXAddNode(ps, RKXNodeClass, 0, (uint32_t)cls, RKXNoNode);
+        }
+        case 'b': ps->index++; return RKXAddAssertion(ps, RKXAssertWordBoundary, flags);
+        case 'B': ps->index++; return RKXAddAssertion(ps, RKXAssertNotWordBoundary, flags);
+        case 'A': ps->index++; return RKXAddAssertion(ps, RKXAssertStartOfText, flags);
+        case 'z': ps->index++; return RKXAddAssertion(ps, RKXAssertEndOfText, flags);
+        case 'Z': ps->index++; return RKXAddAssertion(ps, RKXAssertEndOfTextOrFinalLine, flags);
+        case 'G': ps->index++; return RKXAddAssertion(ps, RKXAssertOther, flags);
+        case 'k': {
+            NSUInteger close = ps->index + 1;
+            if (close >= ps->length || ps->chars[close] != '<') { ps->failed = YES; return RKXNoNode; }
+            while (close < ps->length && ps->chars[close] != '>') { close++; }
+            if (close >= ps->length) { ps->failed = YES; return RKXNoNode; }
+            ps->index = close + 1;
+            ps->syntax->features |= RKXSyntaxBackreference;
+            return RKXAddNode(ps, RKXNodeBackreference, 0, 0, RKXNoNode);
+        }
+        case 'p': case 'P': case 'N': {
+            ps->index++;
+            if (ps->index < ps->length && ps->chars[ps->index] == '{') {
+                while (ps->index < ps->length && ps->chars[ps->index] != '}') { ps->index++; }
+                if (ps->index >= ps->length) { ps->failed = YES; return RKXNoNode; }
+            }
+            ps->index++;
+            return RKXAddOpaqueClass(ps);
+        }
+        case 'X': case 'R': case 'h': case 'H': case 'v': case 'V':
+            ps->index++;
+            return RKXAddOpaqueClass(ps);
+        default:
+            break;
+    }
+
+    if (c >= '1' && c <= '9') {
+        uint32_t group = (uint32_t)(c - '0');
+        ps->index++;
+        while (ps->index < ps->length && RKXIsASCIIDigit(ps->chars[ps->index]) && group * 10 + (uint32_t)(ps->chars[ps->index] - '0') <= ps->syntax->captureCount) {
+            group = group * 10 + (uint32_t)(ps->chars[ps->index++] - '0');
+        }
+        ps->syntax->features |= RKXSyntaxBackreference;
+        return RKXAddNode(ps, RKXNodeBackreference, 0, group, RKXNoNode);
+    }
+
+    UTF32Char value;
+    if (!RKXParseEscapedCodePoint(ps, &value)) { return RKXNoNode; }
+    return RKXAddLiteral(ps, value, flags);
 }
 
-- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+static BOOL RKXExpectCloseParen(RKXParser *ps)
 {
-    return [self captureSubstringsMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    if (ps->index >= ps->length || ps->chars[ps->index] != ')') { ps->failed = YES; return NO; }
+    ps->index++;
+    return YES;
 }
 
-- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+/// Numbers a new capture group whose opener runs from @c start to the current index.
+static uint32_t RKXAddCaptureGroup(RKXParser *ps, NSUInteger start)
 {
-    return [self captureSubstringsMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    RKXSyntax *syntax = ps->syntax;
+    if (!RKXGrow((void **)&syntax->captureOpeners, &syntax->captureOpenerCapacity, syntax->captureCount + 1, sizeof(NSRange))) { ps->failed = YES; }
+    else { syntax->captureOpeners[syntax->captureCount] = NSMakeRange(start, ps->index - start); }
+    return ++syntax->captureCount;
 }
 
-- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+/// Parses a parenthesized construct. Returns RKXNoNode without failing for comments and for (?flags), which
+/// update flags in place and set changedFlags.
+static int32_t RKXParseGroup(RKXParser *ps, RKXParseFlags *flags, BOOL *changedFlags)
 {
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return @[]; }
-    return [matches.firstObject substringsFromString:self];
+    NSUInteger start = ps->index++;
+
+    if (ps->index >= ps->length || ps->chars[ps->index] != '?') {
+        uint32_t group = RKXAddCaptureGroup(ps, start);
+        if (ps->failed) { return RKXNoNode; }
+        int32_t body = RKXParseAlternation(ps, *flags);
+        if (!RKXExpectCloseParen(ps)) { return RKXNoNode; }
+        return RKXAddNode(ps, RKXNodeCapture, 0, group, body);
+    }
+
+    ps->index++;
+    if (ps->index >= ps->length) { ps->failed = YES; return RKXNoNode; }
+    unichar c = ps->chars[ps->index];
+    RKXNodeKind kind = RKXNodeEmpty;
+    uint32_t value = 0;
+
+    switch (c) {
+        case ':':
+            ps->index++;
+            break;
+        case '=':
+        case '!':
+            ps->index++;
+            kind = RKXNodeLookaround;
+            value = (c == '=') ? RKXLookahead : RKXNegativeLookahead;
+            break;
+        case '>':
+            ps->index++;
+            kind = RKXNodeAtomic;
+            break;
+        case '#':
+            while (ps->index < ps->length && ps->chars[ps->index] != ')') { ps->index++; }
+            RKXExpectCloseParen(ps);
+            return RKXNoNode;
+        case '<':
+            ps->index++;
+            if (ps->index < ps->length && (ps->chars[ps->index] == '=' || ps->chars[ps->index] == '!')) {
+                kind = RKXNodeLookaround;
+                value = (ps->chars[ps->index] == '=') ? RKXLookbehind : RKXNegativeLookbehind;
+                ps->index++;
+            }
+            else {
+                NSUInteger nameStart = ps->index;
+                while (ps->index < ps->length && ps->chars[ps->index] < 128 && (RKXIsASCIILetter(ps->chars[ps->index]) || RKXIsASCIIDigit(ps->chars[ps->index]))) { ps->index++; }
+                if (ps->index == nameStart || ps->index >= ps->length || ps->chars[ps->index] != '>') { ps->failed = YES; return RKXNoNode; }
+                ps->index++;
+                kind = RKXNodeCapture;
+                value = RKXAddCaptureGroup(ps, start);
+                if (ps->failed) { return RKXNoNode; }
+            }
+            break;
+        default: {
+            RKXParseFlags scoped = *flags;
+            BOOL on = YES;
+
+            while (ps->index < ps->length && ps->chars[ps->index] != ':' && ps->chars[ps->index] != ')') {
+                RKXParseFlags bit;
+                switch (ps->chars[ps->index]) {
+                    case '-': on = NO; ps->index++; continue;
+                    case 'i': bit = RKXParseCaseless; break;
+                    case 'm': bit = RKXParseMultiline; break;
+                    case 's': bit = RKXParseDotAll; break;
+                    case 'w': bit = RKXParseUnicodeWords; break;
+                    default: ps->failed = YES; return RKXNoNode;
+                }
+                scoped = on ? (RKXParseFlags)(scoped | bit) : (RKXParseFlags)(scoped & ~bit);
+                ps->index++;
+            }
+
+            if (ps->index >= ps->length) { ps->failed = YES; return RKXNoNode; }
+
+            if (ps->chars[ps->index] == ')') {
+                ps->index++;
+                *flags = scoped;
+                *changedFlags = YES;
+                return RKXNoNode;
+            }
+
+            ps->index++;
+            int32_t body = RKXParseAlternation(ps, scoped);
+            if (!RKXExpectCloseParen(ps)) { return RKXNoNode; }
+            return body;
+        }
+    }
+
+    if (kind == RKXNodeLookaround) { ps->syntax->features |= RKXSyntaxLookaround; }
+    if (kind == RKXNodeAtomic) { ps->syntax->features |= RKXSyntaxAtomic; }
+    int32_t body = RKXParseAlternation(ps, *flags);
+    if (!RKXExpectCloseParen(ps)) { return RKXNoNode; }
+    return (kind == RKXNodeEmpty) ? body : RKXAddNode(ps, kind, 0, value, body);
 }
 
-#pragma mark - dictionaryMatchedByRegex:
+static BOOL RKXParseCount(RKXParser *ps, uint32_t *value)
+{
+    NSUInteger start = ps->index;
+    uint64_t result = 0;
 
-- (NSArray *)_keysForVarArgsList:(va_list)varArgsList withFirstKey:(id)firstKey indexes:(NSArray **)captureIndexes
+    while (ps->index < ps->length && RKXIsASCIIDigit(ps->chars[ps->index])) {
+        result = result * 10 + (uint64_t)(ps->chars[ps->index++] - '0');
+        if (result >= RKXRepeatUnbounded) { ps->failed = YES; return NO; }
+    }
+
+    if (ps->index == start) { ps->failed = YES; return NO; }
+    *value = (uint32_t)result;
+    return YES;
+}
+
+static int32_t RKXParseQuantifier(RKXParser *ps, int32_t atom)
 {
-    NSMutableArray *captureKeys = [NSMutableArray array];
-    NSMutableArray *captureKeyIndexes = [NSMutableArray array];
-    NSUInteger captureKeysCount = 0UL;
+    if (ps->failed || ps->index >= ps->length) { return atom; }
+    uint32_t min, max;
 
-    if (varArgsList != NULL) {
-        while (captureKeysCount < 32UL) {
-            id  thisCaptureKey = (captureKeysCount == 0) ? firstKey : va_arg(varArgsList, id);
-            if (RKX_EXPECTED(thisCaptureKey == NULL, 0L)) { break; }
-            int thisCaptureKeyIndex = va_arg(varArgsList, int);
-            [captureKeys addObject:thisCaptureKey];
-            [captureKeyIndexes addObject:@(thisCaptureKeyIndex)];
-            captureKeysCount++;
-        }
+    switch (ps->chars[ps->index]) {
+        case '*': min = 0; max = RKXRepeatUnbounded; ps->index++; break;
+        case '+': min = 1; max = RKXRepeatUnbounded; ps->index++; break;
+        case '?': min = 0; max = 1; ps->index++; break;
+        case '{':
+            ps->index++;
+            if (!RKXParseCount(ps, &min)) { return RKXNoNode; }
+            max = min;
+            if (ps->index < ps->length && ps->chars[ps->index] == ',') {
+                ps->index++;
+                max = RKXRepeatUnbounded;
+                if (ps->index < ps->length && ps->chars[ps->index] != '}' && !RKXParseCount(ps, &max)) { return RKXNoNode; }
+            }
+            if (ps->index >= ps->length || ps->chars[ps->index] != '}' || max < min) { ps->failed = YES; return RKXNoNode; }
+            ps->index++;
+            break;
+        default:
+            return atom;
     }
 
-    *captureIndexes = [captureKeyIndexes copy];
-    return [captureKeys copy];
+    RKXNodeFlags flags = 0;
+
+    if (ps->index < ps->length && ps->chars[ps->index] == '?') {
+        flags = RKXNodeLazy;
+        ps->index++;
+    }
+    else if (ps->index < ps->length && ps->chars[ps->index] == '+') {
+        flags = RKXNodePossessive;
+        ps->syntax->features |= RKXSyntaxAtomic;
+        ps->index++;
+    }
+
+    // Stacked quantifiers such as a{2}{3} are not modelled.
+    unichar following = (ps->index < ps->length) ? ps->chars[ps->index] : 0;
+    if (following == '*' || following == '+' || following == '?' || following == '{') {
+        ps->failed = YES;
+        return RKXNoNode;
+    }
+
+    int32_t node = RKXAddNode(ps, RKXNodeRepeat, flags, 0, atom);
+    if (node == RKXNoNode) { return RKXNoNode; }
+    ps->syntax->nodes[node].min = min;
+    ps->syntax->nodes[node].max = max;
+    return node;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+static int32_t RKXParseAtom(RKXParser *ps, RKXParseFlags *flags, BOOL *changedFlags)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL ];
-    return dict;
+    unichar c = ps->chars[ps->index];
+
+    switch (c) {
+        case '(': {
+            if (++ps->depth > RKXMaxSyntaxDepth) { ps->failed = YES; return RKXNoNode; }
+            int32_t group = RKXParseGroup(ps, flags, changedFlags);
+            ps->depth--;
+            return group;
+        }
+        case '[':
+            return RKXParseClass(ps, *flags);
+        case '\\':
+            return RKXParseEscape(ps, *flags);
+        case '.':
+            ps->index++;
+            if (*flags & RKXParseDotAll) { ps->syntax->features |= RKXSyntaxDotAll; }
+            if (*flags & RKXParseUnixLines) { ps->syntax->features |= RKXSyntaxUnixLines; }
+            return RKXAddNode(ps, RKXNodeDot, (*flags & RKXParseDotAll) ? RKXNodeDotAll : 0, 0, RKXNoNode);
+        case '^':
+            ps->index++;
+            return RKXAddAssertion(ps, (*flags & RKXParseMultiline) ? RKXAssertStartOfLine : RKXAssertStartOfText, *flags);
+        case '$':
+            ps->index++;
+            return RKXAddAssertion(ps, (*flags & RKXParseMultiline) ? RKXAssertEndOfLine : RKXAssertEndOfTextOrFinalLine, *flags);
+        case '*': case '+': case '?': case '{':
+            ps->failed = YES;
+            return RKXNoNode;
+        default: {
+            NSUInteger width;
+            UTF32Char value = RKXCodePointAt(ps->chars, ps->length, ps->index, &width);
+            ps->index += width;
+            return RKXAddLiteral(ps, value, *flags);
+        }
+    }
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+/// Appends item to the Concat or Alternation list that starts at head and ends at tail.
+static void RKXAppendChild(RKXParser *ps, int32_t *head, int32_t *tail, int32_t item)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *keys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern  range:searchRange withKeys:keys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-    return dict;
+    if (*head == RKXNoNode) { *head = item; }
+    else { ps->syntax->nodes[*tail].next = item; }
+    *tail = item;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+static int32_t RKXParseConcat(RKXParser *ps, RKXParseFlags *flags, BOOL *changedFlags)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:NULL];
-    return dict;
+    int32_t head = RKXNoNode, tail = RKXNoNode;
+    uint32_t count = 0;
+
+    while (!ps->failed && ps->index < ps->length) {
+        unichar c = ps->chars[ps->index];
+        if (c == '|' || c == ')') { break; }
+        int32_t atom = RKXParseAtom(ps, flags, changedFlags);
+        if (ps->failed) { return RKXNoNode; }
+        if (atom == RKXNoNode) { continue; }
+        atom = RKXParseQuantifier(ps, atom);
+        if (ps->failed) { return RKXNoNode; }
+        RKXAppendChild(ps, &head, &tail, atom);
+        count++;
+    }
+
+    if (count == 0) { return RKXAddNode(ps, RKXNodeEmpty, 0, 0, RKXNoNode); }
+    if (count == 1) { return head; }
+    return RKXAddNode(ps, RKXNodeConcat, 0, count, head);
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+static int32_t RKXParseAlternation(RKXParser *ps, RKXParseFlags flags)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:error];
-    return dict;
+    BOOL changedFlags = NO;
+    int32_t head = RKXNoNode, tail = RKXNoNode;
+    uint32_t count = 0;
+
+    for (;;) {
+        int32_t branch = RKXParseConcat(ps, &flags, &changedFlags);
+        if (ps->failed) { return RKXNoNode; }
+        RKXAppendChild(ps, &head, &tail, branch);
+        count++;
+        if (ps->index >= ps->length || ps->chars[ps->index] != '|') { break; }
+        // How an unscoped (?i) carries into the following branches is not modelled.
+        if (changedFlags) { ps->failed = YES; return RKXNoNode; }
+        ps->index++;
+    }
+
+    if (count == 1) { return head; }
+    return RKXAddNode(ps, RKXNodeAlternation, 0, count, head);
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+/// Parses pattern, in ICU syntax, into syntax. Returns NO if the pattern uses syntax the tree cannot represent.
+static BOOL RKXSyntaxParse(RKXSyntax *syntax, const unichar *chars, NSUInteger length, RKXRegexOptions options)
 {
-    va_list varArgsList;
-    va_start(varArgsList, firstKey);
-    NSArray *captureKeyIndexes;
-    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
-    va_end(varArgsList);
-    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:matchOptions error:error];
-    return dict;
+    memset(syntax, 0, sizeof(*syntax));
+    syntax->root = RKXNoNode;
+    if (OptionsHasValue(options, RKXIgnoreWhitespace)) { return NO; }
+
+    RKXParser ps = { .syntax = syntax, .chars = chars, .length = length, .index = 0, .depth = 0, .failed = NO };
+    RKXParseFlags flags = 0;
+    if (OptionsHasValue(options, RKXCaseless)) { flags |= RKXParseCaseless; }
+    if (OptionsHasValue(options, RKXMultiline)) { flags |= RKXParseMultiline; }
+    if (OptionsHasValue(options, RKXDotAll)) { flags |= RKXParseDotAll; }
+    if (OptionsHasValue(options, RKXUseUnixLineSeparators)) { flags |= RKXParseUnixLines; }
+    if (OptionsHasValue(options, RKXUnicodeWordBoundaries)) { flags |= RKXParseUnicodeWords; }
+
+    if (OptionsHasValue(options, RKXIgnoreMetacharacters)) {
+        int32_t head = RKXNoNode, tail = RKXNoNode;
+        uint32_t count = 0;
+
+        while (!ps.failed && ps.index < length) {
+            NSUInteger width;
+            UTF32Char value = RKXCodePointAt(chars, length, ps.index, &width);
+            ps.index += width;
+            int32_t literal = RKXAddLiteral(&ps, value, flags);
+            if (literal != RKXNoNode) { RKXAppendChild(&ps, &head, &tail, literal); count++; }
+        }
+
+        syntax->root = (count == 0) ? RKXAddNode(&ps, RKXNodeEmpty, 0, 0, RKXNoNode) : (count == 1) ? head : RKXAddNode(&ps, RKXNodeConcat, 0, count, head);
+    }
+    else {
+        syntax->root = RKXParseAlternation(&ps, flags);
+        if (ps.index < length) { ps.failed = YES; }
+    }
+
+    if (ps.failed || syntax->root == RKXNoNode) {
+        RKXSyntaxFree(syntax);
+        return NO;
+    }
+
+    return YES;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options error:(NSError **)error
+static BOOL RKXNodeIsNullable(const RKXSyntax *syntax, int32_t index)
 {
-    return [self dictionaryMatchedByRegex:pattern range:searchRange withKeys:keys forCaptures:captures options:options matchOptions:kNilOptions error:error];
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeLiteral:
+        case RKXNodeClass:
+        case RKXNodeDot:
+            return NO;
+        case RKXNodeConcat:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (!RKXNodeIsNullable(syntax, child)) { return NO; }
+            }
+            return YES;
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeIsNullable(syntax, child)) { return YES; }
+            }
+            return NO;
+        case RKXNodeRepeat:
+            return node->min == 0 || RKXNodeIsNullable(syntax, node->child);
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeIsNullable(syntax, node->child);
+        default:
+            return YES;
+    }
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+/// YES if a repetition that can run more than once has a body that can match the empty string. Backtracking
+/// engines special-case empty iterations, which the linear-time engine does not reproduce.
+static BOOL RKXNodeHasNullableLoop(const RKXSyntax *syntax, int32_t index)
+{
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeRepeat:
+            if (node->max > 1 && RKXNodeIsNullable(syntax, node->child)) { return YES; }
+            return RKXNodeHasNullableLoop(syntax, node->child);
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+        case RKXNodeLookaround:
+            return RKXNodeHasNullableLoop(syntax, node->child);
+        case RKXNodeConcat:
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeHasNullableLoop(syntax, child)) { return YES; }
+            }
+            return NO;
+        default:
+            return NO;
+    }
+}
+
+#pragma mark - Pattern Analysis
+
+// Rates how hard a pattern can make a backtracking engine work. Every node is first summarized by the text it
+// can match: which code points, which of them can start or end a non-empty match, and how long it can be. The
+// hazard rules then compare those summaries between quantifiers that compete for the same characters. Sets are
+// exact for ASCII and fold everything else into one bit, so overlap between non-ASCII characters is assumed.
+
+static const NSUInteger RKXLinearEngineRiskScore = 50;
+static const NSUInteger RKXUnknownRiskScore = 100;
+
+typedef struct {
+    uint32_t ascii[4];
+    BOOL nonASCII;
+} RKXCharSet;
+
+typedef struct {
+    RKXCharSet chars;       // every code point the node can consume
+    RKXCharSet first;       // code points a non-empty match can start with
+    RKXCharSet last;        // code points a non-empty match can end with
+    uint32_t minLength;
+    uint32_t maxLength;     // RKXRepeatUnbounded if there is no limit
+} RKXNodeSummary;
+
+typedef struct {
+    const RKXSyntax *syntax;
+    RKXNodeSummary *summaries;
+    RKXRegexHazards hazards;
+    uint32_t nestedDegree;      // largest count of a bounded repetition around a quantifier it trades text with
+    uint32_t overlapDegree;     // longest run of adjacent quantifiers that can match the same text
+    BOOL exponential;
+    BOOL anchored;
+} RKXAnalyzer;
+
+static inline void RKXCharSetAdd(RKXCharSet *set, UTF32Char c)
 {
-    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
-    if (!regex) { return nil; }
-    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    if (c < 128) { set->ascii[c >> 5] |= 1U << (c & 31); }
+    else { set->nonASCII = YES; }
+}
+
+static inline void RKXCharSetUnion(RKXCharSet *set, const RKXCharSet *other)
+{
+    for (NSUInteger i = 0; i < 4; i++) { set->ascii[i] |= other->ascii[i]; }
+    set->nonASCII = set->nonASCII || other->nonASCII;
+}
 
-    for (NSUInteger i = 0; i < keys.count; i++) {
-        NSString *key = keys[i];
-        NSUInteger capture = captures[i].unsignedIntegerValue;
-        NSRange captureRange = [self rangeOfRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:matchOptions error:error];
-        dict[key] = (captureRange.length > 0) ? [self substringWithRange:captureRange] : RKXEmptyStringKey;
+static inline BOOL RKXCharSetIntersects(const RKXCharSet *a, const RKXCharSet *b)
+{
+    for (NSUInteger i = 0; i < 4; i++) {
+        if (a->ascii[i] & b->ascii[i]) { return YES; }
     }
+    return a->nonASCII && b->nonASCII;
+}
 
-    return [dict copy];
+static inline BOOL RKXCharSetContains(const RKXCharSet *set, unichar unit)
+{
+    return (unit < 128) ? ((set->ascii[unit >> 5] >> (unit & 31)) & 1U) != 0 : set->nonASCII;
 }
 
-#pragma mark - dictionaryWithNamedCaptureKeysMatchedByRegex:
+static inline BOOL RKXCharSetIsSubset(const RKXCharSet *a, const RKXCharSet *b)
+{
+    for (NSUInteger i = 0; i < 4; i++) {
+        if (a->ascii[i] & ~b->ascii[i]) { return NO; }
+    }
+    return !a->nonASCII || b->nonASCII;
+}
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern
+static inline RKXCharSet RKXCharSetAll(BOOL lineTerminators)
 {
-    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    RKXCharSet set = { .ascii = { UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX }, .nonASCII = YES };
+    if (!lineTerminators) { set.ascii[0] &= ~((1U << 0x0A) | (1U << 0x0B) | (1U << 0x0C) | (1U << 0x0D)); }
+    return set;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+static inline uint32_t RKXLengthAdd(uint32_t a, uint32_t b)
 {
-    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (a == RKXRepeatUnbounded || b == RKXRepeatUnbounded) { return RKXRepeatUnbounded; }
+    uint64_t sum = (uint64_t)a + b;
+    return (sum >= RKXRepeatUnbounded) ? RKXRepeatUnbounded : (uint32_t)sum;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+static inline uint32_t RKXLengthMultiply(uint32_t a, uint32_t b)
 {
-    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    if (a == 0 || b == 0) { return 0; }
+    if (a == RKXRepeatUnbounded || b == RKXRepeatUnbounded) { return RKXRepeatUnbounded; }
+    uint64_t product = (uint64_t)a * b;
+    return (product >= RKXRepeatUnbounded) ? RKXRepeatUnbounded : (uint32_t)product;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+static void RKXSummarizeNode(RKXAnalyzer *analyzer, int32_t index)
 {
-    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    const RKXSyntax *syntax = analyzer->syntax;
+    const RKXNode *node = &syntax->nodes[index];
+    RKXNodeSummary *summary = &analyzer->summaries[index];
+
+    switch (node->kind) {
+        case RKXNodeLiteral:
+            RKXCharSetAdd(&summary->chars, node->value);
+            if (node->flags & RKXNodeCaseless) { RKXCharSetAdd(&summary->chars, node->value & ~0x20U); }
+            summary->minLength = summary->maxLength = 1;
+            break;
+        case RKXNodeClass:
+            if (node->flags & RKXNodeOpaque) { summary->chars = RKXCharSetAll(YES); }
+            else {
+                const RKXCharClass *cls = &syntax->classes[node->value];
+                memcpy(summary->chars.ascii, cls->ascii, sizeof(cls->ascii));
+                for (uint32_t i = 0; i < cls->count; i++) {
+                    if (syntax->ranges[cls->location + i].last >= 128) { summary->chars.nonASCII = YES; break; }
+                }
+            }
+            summary->minLength = summary->maxLength = 1;
+            break;
+        case RKXNodeDot:
+            summary->chars = RKXCharSetAll((node->flags & RKXNodeDotAll) != 0);
+            summary->minLength = summary->maxLength = 1;
+            break;
+        case RKXNodeBackreference:
+            summary->chars = RKXCharSetAll(YES);
+            summary->maxLength = RKXRepeatUnbounded;
+            break;
+        case RKXNodeConcat:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                RKXSummarizeNode(analyzer, child);
+                const RKXNodeSummary *item = &analyzer->summaries[child];
+                RKXCharSetUnion(&summary->chars, &item->chars);
+                if (summary->minLength == 0) { RKXCharSetUnion(&summary->first, &item->first); }
+                if (item->minLength > 0) { summary->last = item->last; }
+                else { RKXCharSetUnion(&summary->last, &item->last); }
+                summary->minLength = RKXLengthAdd(summary->minLength, item->minLength);
+                summary->maxLength = RKXLengthAdd(summary->maxLength, item->maxLength);
+            }
+            return;
+        case RKXNodeAlternation:
+            summary->minLength = RKXRepeatUnbounded;
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                RKXSummarizeNode(analyzer, child);
+                const RKXNodeSummary *branch = &analyzer->summaries[child];
+                RKXCharSetUnion(&summary->chars, &branch->chars);
+                RKXCharSetUnion(&summary->first, &branch->first);
+                RKXCharSetUnion(&summary->last, &branch->last);
+                summary->minLength = MIN(summary->minLength, branch->minLength);
+                summary->maxLength = MAX(summary->maxLength, branch->maxLength);
+            }
+            return;
+        case RKXNodeRepeat:
+            RKXSummarizeNode(analyzer, node->child);
+            if (node->max > 0) {
+                *summary = analyzer->summaries[node->child];
+                summary->minLength = RKXLengthMultiply(summary->minLength, node->min);
+                summary->maxLength = RKXLengthMultiply(summary->maxLength, node->max);
+            }
+            return;
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            RKXSummarizeNode(analyzer, node->child);
+            *summary = analyzer->summaries[node->child];
+            return;
+        case RKXNodeLookaround:
+            RKXSummarizeNode(analyzer, node->child);
+            return;
+        default:
+            return;
+    }
+
+    summary->first = summary->last = summary->chars;
 }
 
-- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+/// YES if every match of index has to start at the start of the text or of a line, so a search only tries it
+/// from a limited number of positions.
+static BOOL RKXNodeIsStartAnchored(const RKXSyntax *syntax, int32_t index)
 {
-    if (![pattern isRegexValidWithOptions:options error:error]) { return nil; }
-    NSRange captureNameRange = NSNotFoundRange;
-    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
-    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    const RKXNode *node = &syntax->nodes[index];
 
-    for (NSString *captureName in captureNames) {
-        captureNameRange = [self rangeOfRegex:pattern range:searchRange capture:NSNotFound namedCapture:captureName options:options matchOptions:matchOptions error:error];
-        if (NSEqualRanges(captureNameRange, NSNotFoundRange)) { continue; }
-        NSString *outcome = [self substringWithRange:captureNameRange];
-        dict[captureName] = outcome;
+    switch (node->kind) {
+        case RKXNodeAssertion:
+            return node->value == RKXAssertStartOfText || node->value == RKXAssertStartOfLine || node->value == RKXAssertOther;
+        case RKXNodeConcat:
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeIsStartAnchored(syntax, node->child);
+        case RKXNodeRepeat:
+            return node->min > 0 && RKXNodeIsStartAnchored(syntax, node->child);
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (!RKXNodeIsStartAnchored(syntax, child)) { return NO; }
+            }
+            return YES;
+        default:
+            return NO;
     }
+}
+
+/// YES if every match of index has to end at the end of the text or of a line.
+static BOOL RKXNodeIsEndAnchored(const RKXSyntax *syntax, int32_t index)
+{
+    const RKXNode *node = &syntax->nodes[index];
 
-    return [dict copy];
+    switch (node->kind) {
+        case RKXNodeAssertion:
+            return node->value == RKXAssertEndOfText || node->value == RKXAssertEndOfTextOrFinalLine || node->value == RKXAssertEndOfLine;
+        case RKXNodeConcat: {
+            int32_t last = node->child;
+            while (last != RKXNoNode && syntax->nodes[last].next != RKXNoNode) { last = syntax->nodes[last].next; }
+            return last != RKXNoNode && RKXNodeIsEndAnchored(syntax, last);
+        }
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeIsEndAnchored(syntax, node->child);
+        case RKXNodeRepeat:
+            return node->min > 0 && RKXNodeIsEndAnchored(syntax, node->child);
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (!RKXNodeIsEndAnchored(syntax, child)) { return NO; }
+            }
+            return YES;
+        default:
+            return NO;
+    }
 }
 
-#pragma mark - isMatchedByRegex:
+/// YES if index can fail where it is tried, sending the search back to try again from somewhere else.
+static BOOL RKXNodeCanFail(const RKXAnalyzer *analyzer, int32_t index)
+{
+    const RKXSyntax *syntax = analyzer->syntax;
+    const RKXNode *node = &syntax->nodes[index];
+    if (analyzer->summaries[index].minLength > 0) { return YES; }
 
-- (BOOL)isMatchedByRegex:(NSString *)pattern
+    switch (node->kind) {
+        case RKXNodeAssertion:
+        case RKXNodeLookaround:
+        case RKXNodeBackreference:
+            return YES;
+        case RKXNodeConcat:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeCanFail(analyzer, child)) { return YES; }
+            }
+            return NO;
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (!RKXNodeCanFail(analyzer, child)) { return NO; }
+            }
+            return YES;
+        case RKXNodeRepeat:
+            return node->min > 0 && RKXNodeCanFail(analyzer, node->child);
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeCanFail(analyzer, node->child);
+        default:
+            return NO;
+    }
+}
+
+/// YES if a quantifier whose match length varies sits at the start (atStart) or end of index with nothing
+/// non-empty in between, and can match code points in set. With unboundedOnly, only quantifiers without an
+/// upper limit count. Possessive quantifiers and atomic groups never give back what they matched.
+static BOOL RKXNodeHasEdgeQuantifier(const RKXAnalyzer *analyzer, int32_t index, const RKXCharSet *set, BOOL atStart, BOOL unboundedOnly)
 {
-    return [self isMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    const RKXSyntax *syntax = analyzer->syntax;
+    const RKXNode *node = &syntax->nodes[index];
+    const RKXNodeSummary *summary = &analyzer->summaries[index];
+
+    switch (node->kind) {
+        case RKXNodeRepeat: {
+            if (node->flags & RKXNodePossessive) { return NO; }
+            // An optional item can only hand over all of what it matched, which starts or ends like it does.
+            const RKXCharSet *traded = (node->max > 1) ? &summary->chars : (atStart) ? &summary->last : &summary->first;
+            if (summary->minLength != summary->maxLength && (!unboundedOnly || summary->maxLength == RKXRepeatUnbounded) && RKXCharSetIntersects(traded, set)) { return YES; }
+            return RKXNodeHasEdgeQuantifier(analyzer, node->child, set, atStart, unboundedOnly);
+        }
+        case RKXNodeCapture:
+            return RKXNodeHasEdgeQuantifier(analyzer, node->child, set, atStart, unboundedOnly);
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeHasEdgeQuantifier(analyzer, child, set, atStart, unboundedOnly)) { return YES; }
+            }
+            return NO;
+        case RKXNodeConcat: {
+            // Searching from the end, the items from the last one that cannot match empty onward are at the edge.
+            int32_t lastRequired = RKXNoNode;
+
+            if (!atStart) {
+                for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                    if (analyzer->summaries[child].minLength > 0) { lastRequired = child; }
+                }
+            }
+
+            BOOL atEdge = atStart || lastRequired == RKXNoNode;
+
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (child == lastRequired) { atEdge = YES; }
+                if (atEdge && RKXNodeHasEdgeQuantifier(analyzer, child, set, atStart, unboundedOnly)) { return YES; }
+                if (atStart && analyzer->summaries[child].minLength > 0) { return NO; }
+            }
+
+            return NO;
+        }
+        default:
+            return NO;
+    }
 }
 
-- (BOOL)isMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+/// YES if the body of a loop is an alternation with two branches that can match the same text, as in (a|a)+,
+/// (\\w|\\d)+ or (a|aa)+, so a run of text can be split into iterations in exponentially many ways.
+static BOOL RKXAlternationIsAmbiguous(const RKXAnalyzer *analyzer, int32_t index)
 {
-    return [self isMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    const RKXSyntax *syntax = analyzer->syntax;
+    while (syntax->nodes[index].kind == RKXNodeCapture) { index = syntax->nodes[index].child; }
+    const RKXNode *node = &syntax->nodes[index];
+    if (node->kind != RKXNodeAlternation) { return NO; }
+
+    for (int32_t a = node->child; a != RKXNoNode; a = syntax->nodes[a].next) {
+        for (int32_t b = syntax->nodes[a].next; b != RKXNoNode; b = syntax->nodes[b].next) {
+            const RKXNodeSummary *x = &analyzer->summaries[a], *y = &analyzer->summaries[b];
+            if (!RKXCharSetIntersects(&x->first, &y->first)) { continue; }
+            BOOL xSingle = (x->minLength == 1 && x->maxLength == 1), ySingle = (y->minLength == 1 && y->maxLength == 1);
+            if (xSingle && ySingle) { return YES; }
+            if (xSingle && RKXCharSetIsSubset(&y->chars, &x->chars)) { return YES; }
+            if (ySingle && RKXCharSetIsSubset(&x->chars, &y->chars)) { return YES; }
+        }
+    }
+
+    return NO;
 }
 
-- (BOOL)isMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+static void RKXAnalyzeNode(RKXAnalyzer *analyzer, int32_t index, BOOL inLoop)
 {
-    return [self isMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    const RKXSyntax *syntax = analyzer->syntax;
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeRepeat: {
+            if (node->max > 1 && !(node->flags & RKXNodePossessive)) {
+                const RKXNodeSummary *body = &analyzer->summaries[node->child];
+                BOOL unbounded = (node->max == RKXRepeatUnbounded);
+
+                // An iteration that can end by handing characters to the next one, or start by taking them from
+                // the previous one, as in (a+)+, (\w+\s?)+ or (.*,)+.
+                if (RKXNodeHasEdgeQuantifier(analyzer, node->child, &body->first, NO, !unbounded) || RKXNodeHasEdgeQuantifier(analyzer, node->child, &body->last, YES, !unbounded)) {
+                    analyzer->hazards |= RKXRegexHazardNestedQuantifier;
+                    if (unbounded) { analyzer->exponential = YES; }
+                    else { analyzer->nestedDegree = MAX(analyzer->nestedDegree, node->max); }
+                }
+
+                if (unbounded && RKXAlternationIsAmbiguous(analyzer, node->child)) {
+                    analyzer->hazards |= RKXRegexHazardAmbiguousAlternation;
+                    analyzer->exponential = YES;
+                }
+            }
+
+            RKXAnalyzeNode(analyzer, node->child, inLoop || node->max > 1);
+            return;
+        }
+        case RKXNodeLookaround:
+            // Run again at every position the search or an enclosing loop tries, each time reading up to the
+            // rest of the text.
+            if (analyzer->summaries[node->child].maxLength == RKXRepeatUnbounded && (inLoop || !analyzer->anchored)) {
+                analyzer->hazards |= RKXRegexHazardUnboundedLookaround;
+            }
+            RKXAnalyzeNode(analyzer, node->child, inLoop);
+            return;
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            RKXAnalyzeNode(analyzer, node->child, inLoop);
+            return;
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                RKXAnalyzeNode(analyzer, child, inLoop);
+            }
+            return;
+        case RKXNodeConcat:
+            break;
+        default:
+            return;
+    }
+
+    // Unbounded quantifiers in a row that can match the same code points, with nothing between them that only
+    // one of them could match, can split a run of text between them in polynomially many ways, as in .*x.*y.
+    RKXCharSet open = { .ascii = { 0, 0, 0, 0 }, .nonASCII = NO };
+    BOOL isOpen = NO, passedUnbounded = NO;
+    uint32_t run = 0;
+
+    for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+        const RKXNode *item = &syntax->nodes[child];
+        const RKXNodeSummary *summary = &analyzer->summaries[child];
+        BOOL backtracks = !(item->kind == RKXNodeAtomic || (item->kind == RKXNodeRepeat && (item->flags & RKXNodePossessive)));
+
+        // Without an anchor the search starts over after each failure, so every unbounded quantifier followed
+        // by something that can fail is run again from each position of the text it already read.
+        if (passedUnbounded && !analyzer->anchored && RKXNodeCanFail(analyzer, child)) { analyzer->hazards |= RKXRegexHazardUnanchoredQuantifier; }
+
+        if (summary->maxLength == RKXRepeatUnbounded && backtracks) {
+            if (isOpen && RKXCharSetIntersects(&open, &summary->first)) {
+                run++;
+                analyzer->hazards |= RKXRegexHazardOverlappingQuantifiers;
+                analyzer->overlapDegree = MAX(analyzer->overlapDegree, run);
+            }
+            else { run = 1; }
+            open = summary->chars;
+            isOpen = passedUnbounded = YES;
+        }
+        else if (summary->minLength > 0 && (!backtracks || !RKXCharSetIsSubset(&summary->chars, &open))) {
+            isOpen = NO;
+            run = 0;
+        }
+
+        RKXAnalyzeNode(analyzer, child, inLoop);
+    }
 }
 
-- (BOOL)isMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+/// Analyzes syntax and stores its worst-case complexity, hazards and risk score. Leaves them untouched if
+/// memory runs out.
+static void RKXAnalyzeSyntax(const RKXSyntax *syntax, RKXRegexComplexity *complexity, RKXRegexHazards *hazards, NSUInteger *riskScore)
 {
-    return [self isMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    RKXAnalyzer analyzer = { .syntax = syntax, .summaries = calloc(MAX(syntax->nodeCount, 1U), sizeof(RKXNodeSummary)) };
+    if (!analyzer.summaries) { return; }
+    RKXSummarizeNode(&analyzer, syntax->root);
+    analyzer.anchored = RKXNodeIsStartAnchored(syntax, syntax->root);
+    RKXAnalyzeNode(&analyzer, syntax->root, NO);
+    free(analyzer.summaries);
+
+    RKXRegexHazards found = analyzer.hazards;
+    NSUInteger score = 0, count = 0;
+
+    if (found & RKXRegexHazardUnanchoredQuantifier) { score = MAX(score, 20UL); count++; }
+    if (found & RKXRegexHazardUnboundedLookaround) { score = MAX(score, 35UL); count++; }
+    if (found & RKXRegexHazardOverlappingQuantifiers) { score = MAX(score, MIN(30UL + 10UL * (analyzer.overlapDegree - 2U) + (analyzer.anchored ? 0UL : 10UL), 80UL)); count++; }
+    if (found & RKXRegexHazardNestedQuantifier) { score = MAX(score, 40UL + 5UL * MIN(analyzer.nestedDegree, 8U)); count++; }
+    if (found & RKXRegexHazardAmbiguousAlternation) { count++; }
+    if (analyzer.exponential) { score = MAX(score, 95UL); }
+    if (count > 1) { score = MIN(score + 5UL * (count - 1), 100UL); }
+
+    *complexity = (analyzer.exponential) ? RKXRegexComplexityExponential : (found) ? RKXRegexComplexityPolynomial : RKXRegexComplexityLinear;
+    *hazards = found;
+    *riskScore = score;
 }
 
-- (BOOL)isMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+/// Sets summary to that of the whole pattern. Returns NO if memory runs out.
+static BOOL RKXSummarizeSyntax(const RKXSyntax *syntax, RKXNodeSummary *summary)
 {
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches || matches.count == 0) { return NO; }
+    RKXAnalyzer analyzer = { .syntax = syntax, .summaries = calloc(MAX(syntax->nodeCount, 1U), sizeof(RKXNodeSummary)) };
+    if (!analyzer.summaries) { return NO; }
+    RKXSummarizeNode(&analyzer, syntax->root);
+    *summary = analyzer.summaries[syntax->root];
+    free(analyzer.summaries);
     return YES;
 }
 
-#pragma mark - isRegexValid
+/// YES if a match of index can contain a line terminator or depends on where the search started (\\G), so the
+/// text cannot be split at line boundaries and searched in pieces. Lookaround bodies consume nothing and are
+/// skipped; backreferences and classes the tree cannot see into are assumed to cross.
+static BOOL RKXNodeCanSpanLines(const RKXSyntax *syntax, int32_t index)
+{
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeLiteral:
+            return RKXIsLineTerminator(node->value);
+        case RKXNodeClass:
+            if (node->flags & RKXNodeOpaque) { return YES; }
+            else {
+                const RKXCharClass *cls = &syntax->classes[node->value];
+                for (uint32_t i = 0; i < cls->count; i++) {
+                    RKXCodePointRange range = syntax->ranges[cls->location + i];
+                    if (range.first <= 0x0D && range.last >= 0x0A) { return YES; }
+                    if (range.first <= 0x85 && range.last >= 0x85) { return YES; }
+                    if (range.first <= 0x2029 && range.last >= 0x2028) { return YES; }
+                }
+                return NO;
+            }
+        case RKXNodeDot:
+            return (node->flags & RKXNodeDotAll) != 0;
+        case RKXNodeAssertion:
+            return node->value == RKXAssertOther;
+        case RKXNodeBackreference:
+            return YES;
+        case RKXNodeRepeat:
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeCanSpanLines(syntax, node->child);
+        case RKXNodeConcat:
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeCanSpanLines(syntax, child)) { return YES; }
+            }
+            return NO;
+        default:
+            return NO;
+    }
+}
+
+/// YES if a match of index can depend on text before the line it starts in: \\A, ^ without RKXMultiline, \\G, or a
+/// lookbehind that can reach back across a line terminator. Otherwise a search that starts at a line, with the
+/// text before it hidden, finds the same matches from there on as a search that starts further back.
+static BOOL RKXNodeLooksBeforeLine(const RKXSyntax *syntax, int32_t index)
+{
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeAssertion:
+            return node->value == RKXAssertStartOfText || node->value == RKXAssertOther;
+        case RKXNodeLookaround:
+            if ((node->value == RKXLookbehind || node->value == RKXNegativeLookbehind) && RKXNodeCanSpanLines(syntax, node->child)) { return YES; }
+            return RKXNodeLooksBeforeLine(syntax, node->child);
+        case RKXNodeRepeat:
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeLooksBeforeLine(syntax, node->child);
+        case RKXNodeConcat:
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeLooksBeforeLine(syntax, child)) { return YES; }
+            }
+            return NO;
+        default:
+            return NO;
+    }
+}
+
+/// YES if a match of index can depend on text after the line it ends in: \z, \Z, $ without RKXMultiline, or a
+/// lookahead that can reach across a line terminator. The counterpart of RKXNodeLooksBeforeLine.
+static BOOL RKXNodeLooksAfterLine(const RKXSyntax *syntax, int32_t index)
+{
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeAssertion:
+            return node->value == RKXAssertEndOfText || node->value == RKXAssertEndOfTextOrFinalLine;
+        case RKXNodeLookaround:
+            if ((node->value == RKXLookahead || node->value == RKXNegativeLookahead) && RKXNodeCanSpanLines(syntax, node->child)) { return YES; }
+            return RKXNodeLooksAfterLine(syntax, node->child);
+        case RKXNodeRepeat:
+        case RKXNodeCapture:
+        case RKXNodeAtomic:
+            return RKXNodeLooksAfterLine(syntax, node->child);
+        case RKXNodeConcat:
+        case RKXNodeAlternation:
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (RKXNodeLooksAfterLine(syntax, child)) { return YES; }
+            }
+            return NO;
+        default:
+            return NO;
+    }
+}
+
+#pragma mark - Linear-Time Engine
+
+// A Pike VM: the pattern is compiled to a small instruction program that is run over the input one code point
+// at a time, with every live thread advanced in lockstep. Threads are kept in priority order and a thread that
+// reaches an instruction already claimed at the same position is dropped, which gives ICU's leftmost-first
+// results and captures in O(program length * input length) time.
+
+typedef NS_ENUM(uint8_t, RKXOpcode) {
+    RKXOpChar,          // x: code point
+    RKXOpCharFold,      // x: lowercase ASCII letter, matches either case
+    RKXOpClass,         // x: class index
+    RKXOpAny,           // any code point but a line terminator
+    RKXOpAssert,        // arg: RKXAssertionKind
+    RKXOpSplit,         // x: preferred branch, y: other branch
+    RKXOpJump,          // x: target
+    RKXOpSave,          // x: capture slot
+    RKXOpMatch,
+};
+
+typedef struct {
+    RKXOpcode op;
+    uint8_t arg;
+    uint32_t x;
+    uint32_t y;
+} RKXInst;
+
+#define RKXMaxFirstRanges 4
+
+typedef struct {
+    const RKXSyntax *syntax;
+    RKXInst *insts;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t slotCount;
+    BOOL reversed;
+    BOOL failed;
+    // Set for forward programs whose matches all start at the start of the text or of a line. If they also all
+    // run to the end of that line, only lines between minLineLength and maxLineLength code points long are tried.
+    BOOL lineAnchored;
+    BOOL lineBounded;
+    uint32_t minLineLength;
+    uint32_t maxLineLength;
+    // Set for forward programs whose matches all contain one of these literals, with at most maxPrefixLength
+    // code points from prefixChars before it, so a search can jump to the run of those before the next one.
+    struct RKXLiteralSet *requiredLiterals;
+    RKXCharSet prefixChars;
+    uint32_t maxPrefixLength;
+    // Set for forward programs that cannot match the empty string and whose matches start with one of a few
+    // code points, so a search can jump to the next of those. The ASCII ones also form firstRangeCount ranges,
+    // with non-ASCII code points as one more, to be scanned for a vector at a time; 0 if there are too many.
+    BOOL firstCharsKnown;
+    RKXCharSet firstChars;
+    uint32_t firstRangeCount;
+    unichar firstLows[RKXMaxFirstRanges];
+    unichar firstHighs[RKXMaxFirstRanges];
+    // Any of the above.
+    BOOL skipsAhead;
+} RKXProgram;
+
+static uint32_t RKXEmit(RKXProgram *program, RKXOpcode op, uint8_t arg, uint32_t x, uint32_t y)
+{
+    if (program->failed) { return 0; }
+    if (program->count >= RKXMaxProgramLength || !RKXGrow((void **)&program->insts, &program->capacity, program->count + 1, sizeof(RKXInst))) {
+        program->failed = YES;
+        return 0;
+    }
+    program->insts[program->count] = (RKXInst){ .op = op, .arg = arg, .x = x, .y = y };
+    return program->count++;
+}
+
+static void RKXCompileNode(RKXProgram *program, int32_t index);
+
+static void RKXCompileRepeat(RKXProgram *program, const RKXNode *node)
+{
+    uint32_t min = node->min, max = node->max;
+    BOOL lazy = (node->flags & RKXNodeLazy) != 0;
+    int32_t body = node->child;
+
+    if ((uint64_t)min + ((max == RKXRepeatUnbounded) ? 0 : max - min) > RKXMaxProgramLength) {
+        program->failed = YES;
+        return;
+    }
+
+    for (uint32_t i = 0; i < min && !program->failed; i++) {
+        uint32_t start = program->count;
+        RKXCompileNode(program, body);
+
+        if (max == RKXRepeatUnbounded && i + 1 == min) {
+            // x+ loops back over its last mandatory copy.
+            uint32_t after = program->count + 1;
+            RKXEmit(program, RKXOpSplit, 0, lazy ? after : start, lazy ? start : after);
+            return;
+        }
+    }
+
+    if (max == RKXRepeatUnbounded) {
+        uint32_t split = RKXEmit(program, RKXOpSplit, 0, 0, 0);
+        RKXCompileNode(program, body);
+        RKXEmit(program, RKXOpJump, 0, split, 0);
+        if (program->failed) { return; }
+        program->insts[split].x = lazy ? program->count : split + 1;
+        program->insts[split].y = lazy ? split + 1 : program->count;
+        return;
+    }
+
+    // x{0,2} compiles as (x(x)?)?, so each optional copy skips straight to the end.
+    uint32_t optional = max - min;
+    if (!optional) { return; }
+    uint32_t *splits = malloc(optional * sizeof(uint32_t));
+    if (!splits) { program->failed = YES; return; }
+
+    for (uint32_t i = 0; i < optional && !program->failed; i++) {
+        splits[i] = RKXEmit(program, RKXOpSplit, 0, 0, 0);
+        RKXCompileNode(program, body);
+    }
+
+    if (!program->failed) {
+        for (uint32_t i = 0; i < optional; i++) {
+            program->insts[splits[i]].x = lazy ? program->count : splits[i] + 1;
+            program->insts[splits[i]].y = lazy ? splits[i] + 1 : program->count;
+        }
+    }
+
+    free(splits);
+}
+
+static void RKXCompileNode(RKXProgram *program, int32_t index)
+{
+    if (program->failed) { return; }
+    const RKXSyntax *syntax = program->syntax;
+    const RKXNode *node = &syntax->nodes[index];
+
+    switch (node->kind) {
+        case RKXNodeEmpty:
+            break;
+        case RKXNodeLiteral:
+            RKXEmit(program, (node->flags & RKXNodeCaseless) ? RKXOpCharFold : RKXOpChar, 0, node->value, 0);
+            break;
+        case RKXNodeClass:
+            if (node->flags & RKXNodeOpaque) { program->failed = YES; break; }
+            RKXEmit(program, RKXOpClass, 0, node->value, 0);
+            break;
+        case RKXNodeDot:
+            if (node->flags & RKXNodeDotAll) { program->failed = YES; break; }
+            RKXEmit(program, RKXOpAny, 0, 0, 0);
+            break;
+        case RKXNodeAssertion:
+            if (node->value == RKXAssertOther) { program->failed = YES; break; }
+            RKXEmit(program, RKXOpAssert, (uint8_t)node->value, 0, 0);
+            break;
+        case RKXNodeConcat: {
+            if (!program->reversed) {
+                for (int32_t child = node->child; child != RKXNoNode && !program->failed; child = syntax->nodes[child].next) {
+                    RKXCompileNode(program, child);
+                }
+                break;
+            }
+
+            // A reversed program matches the reversed text, so its sequences run back to front. Assertions
+            // still test the same text positions and need no mirroring.
+            uint32_t count = 0, capacity = 0;
+            int32_t *children = NULL;
+
+            for (int32_t child = node->child; child != RKXNoNode; child = syntax->nodes[child].next) {
+                if (!RKXGrow((void **)&children, &capacity, count + 1, sizeof(int32_t))) { program->failed = YES; break; }
+                children[count++] = child;
+            }
+
+            while (count && !program->failed) { RKXCompileNode(program, children[--count]); }
+            free(children);
+            break;
+        }
+        case RKXNodeAlternation: {
+            // Each branch but the last is split off; the jumps out of the branches are chained through x
+            // and patched once the end is known.
+            uint32_t jumps = UINT32_MAX;
+
+            for (int32_t child = node->child; child != RKXNoNode && !program->failed; child = syntax->nodes[child].next) {
+                if (syntax->nodes[child].next == RKXNoNode) {
+                    RKXCompileNode(program, child);
+                    break;
+                }
+
+                uint32_t split = RKXEmit(program, RKXOpSplit, 0, 0, 0);
+                RKXCompileNode(program, child);
+                jumps = RKXEmit(program, RKXOpJump, 0, jumps, 0);
+                if (program->failed) { break; }
+                program->insts[split].x = split + 1;
+                program->insts[split].y = program->count;
+            }
+
+            while (!program->failed && jumps != UINT32_MAX) {
+                uint32_t previous = program->insts[jumps].x;
+                program->insts[jumps].x = program->count;
+                jumps = previous;
+            }
+            break;
+        }
+        case RKXNodeRepeat:
+            if (node->flags & RKXNodePossessive) { program->failed = YES; break; }
+            RKXCompileRepeat(program, node);
+            break;
+        case RKXNodeCapture:
+            RKXEmit(program, RKXOpSave, 0, node->value * 2, 0);
+            RKXCompileNode(program, node->child);
+            RKXEmit(program, RKXOpSave, 0, node->value * 2 + 1, 0);
+            break;
+        default:
+            program->failed = YES;
+            break;
+    }
+}
+
+static const RKXSyntaxFeatures RKXLinearUnsupportedFeatures = RKXSyntaxBackreference | RKXSyntaxLookaround | RKXSyntaxAtomic | RKXSyntaxOpaqueClass | RKXSyntaxDotAll | RKXSyntaxUnixLines | RKXSyntaxUnicodeWords | RKXSyntaxCaselessFolding | RKXSyntaxOtherAssertion;
+
+/// Compiles syntax for the Pike VM, or for the lazy DFA to run backwards if reversed is YES. Returns NO if the
+/// pattern is not eligible for linear-time matching.
+static BOOL RKXProgramCompile(RKXProgram *program, const RKXSyntax *syntax, BOOL reversed)
+{
+    memset(program, 0, sizeof(*program));
+    program->syntax = syntax;
+    program->reversed = reversed;
+    if (syntax->features & RKXLinearUnsupportedFeatures) { return NO; }
+    if (RKXNodeHasNullableLoop(syntax, syntax->root)) { return NO; }
+
+    program->slotCount = (syntax->captureCount + 1) * 2;
+    RKXEmit(program, RKXOpSave, 0, 0, 0);
+    RKXCompileNode(program, syntax->root);
+    RKXEmit(program, RKXOpSave, 0, 1, 0);
+    RKXEmit(program, RKXOpMatch, 0, 0, 0);
+
+    // The VM keeps a full set of capture slots for every instruction in each of its two thread lists.
+    if ((uint64_t)program->count * program->slotCount > (uint64_t)RKXMaxProgramLength * 16) { program->failed = YES; }
+
+    if (program->failed) {
+        free(program->insts);
+        memset(program, 0, sizeof(*program));
+        return NO;
+    }
+
+    RKXNodeSummary summary;
+    if (reversed || !RKXSummarizeSyntax(syntax, &summary)) { return YES; }
+
+    if (RKXNodeIsStartAnchored(syntax, syntax->root)) {
+        program->lineAnchored = YES;
+        program->lineBounded = RKXNodeIsEndAnchored(syntax, syntax->root) && !RKXNodeCanSpanLines(syntax, syntax->root);
+        program->minLineLength = summary.minLength;
+        program->maxLineLength = summary.maxLength;
+    }
+
+    // Scanning for the first code points only pays while they are rarer than the rest, so at most half of ASCII.
+    uint32_t firstASCIICount = 0;
+    for (NSUInteger i = 0; i < 4; i++) { firstASCIICount += (uint32_t)__builtin_popcount(summary.first.ascii[i]); }
+
+    if (summary.minLength > 0 && firstASCIICount <= 64) {
+        program->firstCharsKnown = YES;
+        program->firstChars = summary.first;
+
+        for (unichar c = 0; c < 128 && program->firstRangeCount <= RKXMaxFirstRanges; c++) {
+            if (!RKXCharSetContains(&summary.first, c)) { continue; }
+            if (program->firstRangeCount && program->firstHighs[program->firstRangeCount - 1] + 1 == c) { program->firstHighs[program->firstRangeCount - 1] = c; continue; }
+            if (program->firstRangeCount < RKXMaxFirstRanges) { program->firstLows[program->firstRangeCount] = program->firstHighs[program->firstRangeCount] = c; }
+            program->firstRangeCount++;
+        }
+
+        if (summary.first.nonASCII && program->firstRangeCount < RKXMaxFirstRanges) {
+            program->firstLows[program->firstRangeCount] = 0x80;
+            program->firstHighs[program->firstRangeCount++] = 0xFFFF;
+        }
+        else if (summary.first.nonASCII || program->firstRangeCount > RKXMaxFirstRanges) {
+            program->firstRangeCount = 0;
+        }
+    }
+
+    program->skipsAhead = program->lineAnchored || program->firstCharsKnown;
+    return YES;
+}
+
+static BOOL RKXAssertionHolds(RKXAssertionKind kind, const unichar *chars, NSUInteger length, NSUInteger pos)
+{
+    // These mirror ICU's anchoring-bounds behavior for the search range, including its CR/LF handling.
+    switch (kind) {
+        case RKXAssertStartOfText:
+            return pos == 0;
+        case RKXAssertStartOfLine:
+            return pos == 0 || (pos < length && RKXIsLineTerminator(chars[pos - 1]));
+        case RKXAssertEndOfText:
+            return pos >= length;
+        case RKXAssertEndOfTextOrFinalLine:
+            if (pos >= length) { return YES; }
+            if (pos + 1 == length && RKXIsLineTerminator(chars[pos])) { return !(chars[pos] == '\n' && pos > 0 && chars[pos - 1] == '\r'); }
+            return pos + 2 == length && chars[pos] == '\r' && chars[pos + 1] == '\n';
+        case RKXAssertEndOfLine:
+            if (pos >= length) { return YES; }
+            return RKXIsLineTerminator(chars[pos]) && !(chars[pos] == '\n' && pos > 0 && chars[pos - 1] == '\r');
+        case RKXAssertWordBoundary:
+        case RKXAssertNotWordBoundary: {
+            BOOL before = pos > 0 && RKXIsASCIIWord(chars[pos - 1]);
+            BOOL after = pos < length && RKXIsASCIIWord(chars[pos]);
+            return (before != after) == (kind == RKXAssertWordBoundary);
+        }
+        default:
+            return NO;
+    }
+}
+
+/// YES if pos falls between the \r and \n of a CR/LF pair. ICU's find() steps over that position when it looks
+/// for the start of a line, so a line-anchored match never starts there, even though ^ holds there in the middle
+/// of a match.
+static inline BOOL RKXIsInsideCRLF(const unichar *chars, NSUInteger length, NSUInteger pos)
+{
+    return pos > 0 && pos < length && chars[pos - 1] == '\r' && chars[pos] == '\n';
+}
+
+/// YES if inst is a consuming instruction that accepts c.
+static inline BOOL RKXInstMatches(const RKXSyntax *syntax, const RKXInst *inst, UTF32Char c)
+{
+    switch (inst->op) {
+        case RKXOpChar:
+            return c == inst->x;
+        case RKXOpCharFold:
+            return c < 128 && (c | 0x20) == inst->x;
+        case RKXOpClass:
+            return RKXClassContains(syntax, &syntax->classes[inst->x], c);
+        case RKXOpAny:
+            return !RKXIsLineTerminator(c);
+        default:
+            return NO;
+    }
+}
+
+typedef struct {
+    uint32_t *dense;
+    uint32_t *sparse;
+    uint32_t count;
+    NSUInteger *slots;
+} RKXThreadList;
+
+typedef struct {
+    uint32_t index;
+    BOOL restore;
+    NSUInteger value;
+} RKXThreadFrame;
+
+typedef struct {
+    const RKXProgram *program;
+    const unichar *chars;
+    NSUInteger length;
+    RKXThreadList lists[2];
+    RKXThreadFrame *frames;
+    NSUInteger *scratch;
+} RKXPikeVM;
+
+static BOOL RKXPikeVMInit(RKXPikeVM *vm, const RKXProgram *program, const unichar *chars, NSUInteger length)
+{
+    memset(vm, 0, sizeof(*vm));
+    vm->program = program;
+    vm->chars = chars;
+    vm->length = length;
+    size_t count = program->count, slots = program->slotCount;
+
+    for (NSUInteger i = 0; i < 2; i++) {
+        vm->lists[i].dense = calloc(count, sizeof(uint32_t));
+        vm->lists[i].sparse = calloc(count, sizeof(uint32_t));
+        vm->lists[i].slots = calloc(count * slots, sizeof(NSUInteger));
+        if (!vm->lists[i].dense || !vm->lists[i].sparse || !vm->lists[i].slots) { return NO; }
+    }
+
+    vm->frames = calloc(count + 1, sizeof(RKXThreadFrame));
+    vm->scratch = calloc(slots, sizeof(NSUInteger));
+    return vm->frames && vm->scratch;
+}
+
+static void RKXPikeVMFree(RKXPikeVM *vm)
+{
+    for (NSUInteger i = 0; i < 2; i++) {
+        free(vm->lists[i].dense);
+        free(vm->lists[i].sparse);
+        free(vm->lists[i].slots);
+    }
+
+    free(vm->frames);
+    free(vm->scratch);
+}
+
+/// Follows the empty-width instructions from pc at pos in priority order, adding each thread that reaches a
+/// consuming instruction (or Match) to list with a copy of the capture slots it carried.
+static void RKXPikeVMAddThread(RKXPikeVM *vm, RKXThreadList *list, uint32_t pc, NSUInteger pos)
+{
+    const RKXProgram *program = vm->program;
+    NSUInteger *scratch = vm->scratch;
+    RKXThreadFrame *frames = vm->frames;
+    NSUInteger top = 0;
+    frames[top++] = (RKXThreadFrame){ .index = pc, .restore = NO, .value = 0 };
+
+    while (top) {
+        RKXThreadFrame frame = frames[--top];
+        if (frame.restore) { scratch[frame.index] = frame.value; continue; }
+        pc = frame.index;
+
+        for (;;) {
+            uint32_t dense = list->sparse[pc];
+            if (dense < list->count && list->dense[dense] == pc) { break; }
+            list->sparse[pc] = list->count;
+            list->dense[list->count++] = pc;
+            const RKXInst *inst = &program->insts[pc];
+
+            if (inst->op == RKXOpJump) { pc = inst->x; continue; }
+
+            if (inst->op == RKXOpSplit) {
+                frames[top++] = (RKXThreadFrame){ .index = inst->y, .restore = NO, .value = 0 };
+                pc = inst->x;
+                continue;
+            }
+
+            if (inst->op == RKXOpSave) {
+                frames[top++] = (RKXThreadFrame){ .index = inst->x, .restore = YES, .value = scratch[inst->x] };
+                scratch[inst->x] = pos;
+                pc++;
+                continue;
+            }
+
+            if (inst->op == RKXOpAssert) {
+                if (RKXAssertionHolds((RKXAssertionKind)inst->arg, vm->chars, vm->length, pos)) { pc++; continue; }
+                break;
+            }
+
+            memcpy(list->slots + (size_t)pc * program->slotCount, scratch, program->slotCount * sizeof(NSUInteger));
+            break;
+        }
+    }
+}
+
+static NSUInteger RKXProgramNextStart(const RKXProgram *program, const unichar *chars, NSUInteger length, NSUInteger pos, NSRange *run);
+
+/// Finds the leftmost-first match starting at or after start. On success, slots holds the capture positions.
+static BOOL RKXPikeVMFind(RKXPikeVM *vm, NSUInteger start, NSUInteger *slots)
+{
+    const RKXProgram *program = vm->program;
+    const RKXSyntax *syntax = program->syntax;
+    const unichar *chars = vm->chars;
+    NSUInteger length = vm->length, slotCount = program->slotCount;
+    RKXThreadList *current = &vm->lists[0], *next = &vm->lists[1];
+    NSRange run = NSNotFoundRange;
+    BOOL matched = NO;
+    current->count = 0;
+
+    for (NSUInteger pos = start; ; ) {
+        if (!matched && !(program->lineAnchored && RKXIsInsideCRLF(chars, length, pos))) {
+            for (NSUInteger i = 0; i < slotCount; i++) { vm->scratch[i] = (NSUInteger)NSNotFound; }
+            RKXPikeVMAddThread(vm, current, 0, pos);
+        }
+
+        NSUInteger width = 0;
+        BOOL hasChar = pos < length;
+        UTF32Char c = hasChar ? RKXCodePointAt(chars, length, pos, &width) : 0;
+
+        if (!current->count) {
+            if (matched || !hasChar) { break; }
+            pos += width;
+            if (program->skipsAhead && (pos = RKXProgramNextStart(program, chars, length, pos, &run)) == NSNotFound) { break; }
+            continue;
+        }
+
+        next->count = 0;
+
+        for (uint32_t i = 0; i < current->count; i++) {
+            uint32_t pc = current->dense[i];
+            const RKXInst *inst = &program->insts[pc];
+            NSUInteger *threadSlots = current->slots + (size_t)pc * slotCount;
+
+            if (inst->op == RKXOpMatch) {
+                memcpy(slots, threadSlots, slotCount * sizeof(NSUInteger));
+                matched = YES;
+                break;  // lower-priority threads are cut off
+            }
+
+            if (hasChar && RKXInstMatches(syntax, inst, c)) {
+                memcpy(vm->scratch, threadSlots, slotCount * sizeof(NSUInteger));
+                RKXPikeVMAddThread(vm, next, pc + 1, pos + width);
+            }
+        }
+
+        RKXThreadList *swap = current;
+        current = next;
+        next = swap;
+        if (!hasChar || (matched && !current->count)) { break; }
+        pos += width;
+    }
+
+    return matched;
+}
+
+/// Finds the next match at or after *start, following ICU's rules for advancing past an empty match, and
+/// moves *start past it. Returns NO when there are no more matches.
+static BOOL RKXPikeVMNextMatch(RKXPikeVM *vm, NSUInteger *start, NSUInteger *slots)
+{
+    if (*start > vm->length || !RKXPikeVMFind(vm, *start, slots)) { return NO; }
+
+    if (slots[1] == slots[0]) {
+        NSUInteger width = 1;
+        if (slots[1] < vm->length) { RKXCodePointAt(vm->chars, vm->length, slots[1], &width); }
+        *start = slots[1] + width;
+    }
+    else {
+        *start = slots[1];
+    }
+
+    return YES;
+}
+
+#pragma mark - Lazy DFA
+
+// Queries that only need match boundaries do not need the Pike VM's capture slots, and without them the VM's
+// ordered thread list at each position is a pure function of the list before it and the next code point. The
+// lazy DFA caches exactly that: each state is such a list, built the first time a scan reaches it, with its
+// transitions filled in as they are taken. Because the list keeps the VM's priority order, a forward scan
+// finds the same leftmost-first match end; a second DFA running the reversed program back from that end then
+// finds the leftmost start. The number of states can grow exponentially with the pattern, so each cache has a
+// fixed memory budget and a scan that would exceed it gives up, leaving the match to the Pike VM or ICU.
+
+static const size_t RKXLazyDFAMemoryLimit = 1U << 21;
+static const int32_t RKXLazyDFAUnknown = -1;
+static const int32_t RKXLazyDFADeadState = 0;
+static const int32_t RKXLazyDFAStartState = 1;
+
+typedef struct {
+    uint32_t location;  // into pcs
+    uint32_t count;
+    BOOL searching;     // forward: no match yet, so a new thread still starts here; reverse: the anchored start
+} RKXLazyDFAState;
+
+typedef struct {
+    const RKXProgram *program;
+    BOOL longest;
+    // Code points are grouped into classes that every consuming instruction treats alike. Class classCount
+    // stands for the end of the text, and the assertions the program tests at a position form its context.
+    UTF32Char *boundaries;
+    uint32_t boundaryCount;
+    uint32_t classCount;
+    uint32_t asciiClasses[128];
+    RKXAssertionKind contextKinds[RKXAssertOther];
+    uint8_t contextBits[RKXAssertOther];
+    uint32_t contextKindCount;
+    // Set for the forward DFA of a line-anchored program. The context then has one more bit, above those of
+    // contextKinds, for a position inside a CR/LF pair, where no new thread starts.
+    BOOL guardsCRLF;
+    uint32_t stride;
+    RKXLazyDFAState *states;
+    uint32_t stateCount;
+    uint32_t stateCapacity;
+    uint32_t *pcs;
+    uint32_t pcCount;
+    uint32_t pcCapacity;
+    int32_t *transitions;   // stride entries per state: (state << 1) | matched, or RKXLazyDFAUnknown
+    uint32_t transitionCapacity;
+    uint32_t *table;        // open addressing over state index + 1
+    uint32_t tableSize;
+    size_t memory;
+    // Scratch space for computing a transition.
+    uint32_t *visitedDense;
+    uint32_t *visitedSparse;
+    uint32_t visitedCount;
+    uint32_t *stack;
+    uint32_t *closure;
+    uint32_t *kernel;
+} RKXLazyDFA;
+
+static int RKXCompareCodePoints(const void *a, const void *b)
+{
+    UTF32Char x = *(const UTF32Char *)a, y = *(const UTF32Char *)b;
+    return (x > y) - (x < y);
+}
+
+static int RKXComparePCs(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static BOOL RKXLazyDFAAddBoundaries(RKXLazyDFA *dfa, uint32_t *capacity, UTF32Char first, UTF32Char last)
+{
+    if (!RKXGrow((void **)&dfa->boundaries, capacity, dfa->boundaryCount + 2, sizeof(UTF32Char))) { return NO; }
+    dfa->boundaries[dfa->boundaryCount++] = first;
+    if (last < RKXMaxCodePoint) { dfa->boundaries[dfa->boundaryCount++] = last + 1; }
+    return YES;
+}
+
+static uint32_t RKXLazyDFASearchClass(const RKXLazyDFA *dfa, UTF32Char c)
+{
+    uint32_t low = 0, high = dfa->boundaryCount;
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (dfa->boundaries[mid] <= c) { low = mid + 1; }
+        else { high = mid; }
+    }
+
+    return low;
+}
+
+static inline uint32_t RKXLazyDFAClassOf(const RKXLazyDFA *dfa, UTF32Char c)
+{
+    return (c < 128) ? dfa->asciiClasses[c] : RKXLazyDFASearchClass(dfa, c);
+}
+
+static void RKXLazyDFAFree(RKXLazyDFA *dfa)
+{
+    free(dfa->boundaries);
+    free(dfa->states);
+    free(dfa->pcs);
+    free(dfa->transitions);
+    free(dfa->table);
+    free(dfa->visitedDense);
+    free(dfa->visitedSparse);
+    free(dfa->stack);
+    free(dfa->closure);
+    free(dfa->kernel);
+    memset(dfa, 0, sizeof(*dfa));
+}
+
+static int32_t RKXLazyDFAAddState(RKXLazyDFA *dfa, const uint32_t *pcs, uint32_t count, BOOL searching);
+
+/// Drops every cached state but the dead and start states.
+static BOOL RKXLazyDFAReset(RKXLazyDFA *dfa)
+{
+    dfa->stateCount = 0;
+    dfa->pcCount = 0;
+    dfa->memory = 0;
+    if (dfa->table) { memset(dfa->table, 0, dfa->tableSize * sizeof(uint32_t)); }
+    return RKXLazyDFAAddState(dfa, NULL, 0, NO) == RKXLazyDFADeadState && RKXLazyDFAAddState(dfa, NULL, 0, YES) == RKXLazyDFAStartState;
+}
+
+/// Prepares a DFA for program. If longest is YES it finds the longest match anchored at the start of its scan
+/// instead of the leftmost-first one, which is what the reversed program needs. Returns NO if the DFA would not
+/// fit its memory budget.
+static BOOL RKXLazyDFAInit(RKXLazyDFA *dfa, const RKXProgram *program, BOOL longest)
+{
+    memset(dfa, 0, sizeof(*dfa));
+    dfa->program = program;
+    dfa->longest = longest;
+    const RKXSyntax *syntax = program->syntax;
+    uint32_t boundaryCapacity = 0;
+    BOOL ok = YES;
+    memset(dfa->contextBits, 0xFF, sizeof(dfa->contextBits));
+
+    for (uint32_t pc = 0; pc < program->count && ok; pc++) {
+        const RKXInst *inst = &program->insts[pc];
+
+        switch (inst->op) {
+            case RKXOpChar:
+                ok = RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, inst->x, inst->x);
+                break;
+            case RKXOpCharFold:
+                ok = RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, inst->x, inst->x) && RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, inst->x - 0x20, inst->x - 0x20);
+                break;
+            case RKXOpClass: {
+                const RKXCharClass *cls = &syntax->classes[inst->x];
+                for (uint32_t i = 0; i < cls->count && ok; i++) {
+                    ok = RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, syntax->ranges[cls->location + i].first, syntax->ranges[cls->location + i].last);
+                }
+                break;
+            }
+            case RKXOpAny:
+                ok = RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, 0x0A, 0x0D) && RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, 0x85, 0x85) && RKXLazyDFAAddBoundaries(dfa, &boundaryCapacity, 0x2028, 0x2029);
+                break;
+            case RKXOpAssert:
+                if (dfa->contextBits[inst->arg] == 0xFF) {
+                    dfa->contextBits[inst->arg] = (uint8_t)dfa->contextKindCount;
+                    dfa->contextKinds[dfa->contextKindCount++] = (RKXAssertionKind)inst->arg;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (ok && dfa->boundaryCount) {
+        qsort(dfa->boundaries, dfa->boundaryCount, sizeof(UTF32Char), RKXCompareCodePoints);
+        uint32_t unique = 1;
+
+        for (uint32_t i = 1; i < dfa->boundaryCount; i++) {
+            if (dfa->boundaries[i] != dfa->boundaries[unique - 1]) { dfa->boundaries[unique++] = dfa->boundaries[i]; }
+        }
+
+        dfa->boundaryCount = unique;
+    }
+
+    dfa->classCount = dfa->boundaryCount + 1;
+    for (UTF32Char c = 0; c < 128; c++) { dfa->asciiClasses[c] = RKXLazyDFASearchClass(dfa, c); }
+    dfa->guardsCRLF = !longest && program->lineAnchored;
+    dfa->stride = (dfa->classCount + 1) << (dfa->contextKindCount + dfa->guardsCRLF);
+
+    // A DFA whose states cannot be cached by the dozen is no faster than the Pike VM.
+    if ((size_t)dfa->stride * sizeof(int32_t) * 64 > RKXLazyDFAMemoryLimit) { ok = NO; }
+
+    if (ok) {
+        size_t count = program->count;
+        dfa->visitedDense = calloc(count, sizeof(uint32_t));
+        dfa->visitedSparse = calloc(count, sizeof(uint32_t));
+        dfa->stack = calloc(count + 1, sizeof(uint32_t));
+        dfa->closure = calloc(count, sizeof(uint32_t));
+        dfa->kernel = calloc(count, sizeof(uint32_t));
+        ok = dfa->visitedDense && dfa->visitedSparse && dfa->stack && dfa->closure && dfa->kernel && RKXLazyDFAReset(dfa);
+    }
+
+    if (!ok) { RKXLazyDFAFree(dfa); }
+    return ok;
+}
+
+static inline uint32_t RKXLazyDFAHash(const uint32_t *pcs, uint32_t count, BOOL searching)
+{
+    uint32_t hash = 2166136261U ^ (uint32_t)searching;
+    for (uint32_t i = 0; i < count; i++) { hash = (hash ^ pcs[i]) * 16777619U; }
+    return hash;
+}
+
+/// Returns the index of the state for pcs, adding it if it is new, or -1 if it does not fit the memory budget.
+static int32_t RKXLazyDFAAddState(RKXLazyDFA *dfa, const uint32_t *pcs, uint32_t count, BOOL searching)
+{
+    uint32_t mask = dfa->tableSize - 1, slot = 0;
+
+    if (dfa->tableSize) {
+        for (slot = RKXLazyDFAHash(pcs, count, searching) & mask; dfa->table[slot]; slot = (slot + 1) & mask) {
+            const RKXLazyDFAState *state = &dfa->states[dfa->table[slot] - 1];
+            if (state->count == count && state->searching == searching && (!count || !memcmp(dfa->pcs + state->location, pcs, count * sizeof(uint32_t)))) {
+                return (int32_t)(dfa->table[slot] - 1);
+            }
+        }
+    }
+
+    size_t cost = sizeof(RKXLazyDFAState) + (size_t)dfa->stride * sizeof(int32_t) + (count + 2) * sizeof(uint32_t);
+    if (dfa->memory + cost > RKXLazyDFAMemoryLimit) { return -1; }
+
+    if ((dfa->stateCount + 1) * 2 > dfa->tableSize) {
+        uint32_t size = (dfa->tableSize) ? dfa->tableSize * 2 : 64;
+        uint32_t *table = calloc(size, sizeof(uint32_t));
+        if (!table) { return -1; }
+
+        for (uint32_t i = 0; i < dfa->stateCount; i++) {
+            const RKXLazyDFAState *state = &dfa->states[i];
+            uint32_t j = RKXLazyDFAHash(dfa->pcs + state->location, state->count, state->searching) & (size - 1);
+            while (table[j]) { j = (j + 1) & (size - 1); }
+            table[j] = i + 1;
+        }
+
+        free(dfa->table);
+        dfa->table = table;
+        dfa->tableSize = size;
+        mask = size - 1;
+        for (slot = RKXLazyDFAHash(pcs, count, searching) & mask; dfa->table[slot]; slot = (slot + 1) & mask) {}
+    }
+
+    if (!RKXGrow((void **)&dfa->states, &dfa->stateCapacity, dfa->stateCount + 1, sizeof(RKXLazyDFAState))
+        || !RKXGrow((void **)&dfa->pcs, &dfa->pcCapacity, dfa->pcCount + count, sizeof(uint32_t))
+        || !RKXGrow((void **)&dfa->transitions, &dfa->transitionCapacity, dfa->stateCount + 1, dfa->stride * sizeof(int32_t))) {
+        return -1;
+    }
+
+    uint32_t index = dfa->stateCount++;
+    dfa->states[index] = (RKXLazyDFAState){ .location = dfa->pcCount, .count = count, .searching = searching };
+    if (count) { memcpy(dfa->pcs + dfa->pcCount, pcs, count * sizeof(uint32_t)); }
+    dfa->pcCount += count;
+    memset(dfa->transitions + (size_t)index * dfa->stride, 0xFF, dfa->stride * sizeof(int32_t));
+    dfa->table[slot] = index + 1;
+    dfa->memory += cost;
+    return (int32_t)index;
+}
+
+/// Follows the empty-width instructions from pc in the same order as RKXPikeVMAddThread, collecting the
+/// consuming instructions (and Match) it reaches. context has a bit set for each assertion that holds.
+static void RKXLazyDFAAddClosure(RKXLazyDFA *dfa, uint32_t pc, uint32_t context, uint32_t *closureCount)
+{
+    const RKXProgram *program = dfa->program;
+    uint32_t top = 0;
+    dfa->stack[top++] = pc;
+
+    while (top) {
+        pc = dfa->stack[--top];
+
+        for (;;) {
+            uint32_t dense = dfa->visitedSparse[pc];
+            if (dense < dfa->visitedCount && dfa->visitedDense[dense] == pc) { break; }
+            dfa->visitedSparse[pc] = dfa->visitedCount;
+            dfa->visitedDense[dfa->visitedCount++] = pc;
+            const RKXInst *inst = &program->insts[pc];
+
+            if (inst->op == RKXOpJump) { pc = inst->x; continue; }
+            if (inst->op == RKXOpSplit) { dfa->stack[top++] = inst->y; pc = inst->x; continue; }
+            if (inst->op == RKXOpSave) { pc++; continue; }
+
+            if (inst->op == RKXOpAssert) {
+                if ((context >> dfa->contextBits[inst->arg]) & 1U) { pc++; continue; }
+                break;
+            }
+
+            dfa->closure[(*closureCount)++] = pc;
+            break;
+        }
+    }
+}
+
+/// Computes and caches the transition out of state for a position with the given context whose code point is
+/// in cls. Returns the new entry, or -1 if the target state does not fit the memory budget.
+static int32_t RKXLazyDFAComputeTransition(RKXLazyDFA *dfa, int32_t stateIndex, uint32_t context, uint32_t cls)
+{
+    const RKXProgram *program = dfa->program;
+    RKXLazyDFAState state = dfa->states[stateIndex];
+    uint32_t closureCount = 0, kernelCount = 0;
+    dfa->visitedCount = 0;
+
+    for (uint32_t i = 0; i < state.count; i++) { RKXLazyDFAAddClosure(dfa, dfa->pcs[state.location + i], context, &closureCount); }
+    if (state.searching && !(dfa->guardsCRLF && ((context >> dfa->contextKindCount) & 1U))) { RKXLazyDFAAddClosure(dfa, 0, context, &closureCount); }
+
+    BOOL hasChar = cls < dfa->classCount, matched = NO;
+    UTF32Char c = (hasChar && cls) ? dfa->boundaries[cls - 1] : 0;
+
+    for (uint32_t i = 0; i < closureCount; i++) {
+        const RKXInst *inst = &program->insts[dfa->closure[i]];
+
+        if (inst->op == RKXOpMatch) {
+            matched = YES;
+            if (dfa->longest) { continue; }
+            break;  // lower-priority threads are cut off, as in the Pike VM
+        }
+
+        if (hasChar && RKXInstMatches(program->syntax, inst, c)) { dfa->kernel[kernelCount++] = dfa->closure[i] + 1; }
+    }
+
+    // Order only matters for priority, which a longest match ignores; sorting lets equivalent states merge.
+    if (dfa->longest && kernelCount > 1) { qsort(dfa->kernel, kernelCount, sizeof(uint32_t), RKXComparePCs); }
+    int32_t next = RKXLazyDFAAddState(dfa, dfa->kernel, kernelCount, state.searching && !matched && !dfa->longest);
+    if (next < 0) { return -1; }
+    int32_t entry = (int32_t)(((uint32_t)next << 1) | (uint32_t)matched);
+    dfa->transitions[(size_t)stateIndex * dfa->stride + context * (dfa->classCount + 1) + cls] = entry;
+    return entry;
+}
+
+static inline uint32_t RKXLazyDFAContext(const RKXLazyDFA *dfa, const unichar *chars, NSUInteger length, NSUInteger pos)
+{
+    uint32_t context = 0;
+
+    for (uint32_t i = 0; i < dfa->contextKindCount; i++) {
+        if (RKXAssertionHolds(dfa->contextKinds[i], chars, length, pos)) { context |= 1U << i; }
+    }
+
+    if (dfa->guardsCRLF && RKXIsInsideCRLF(chars, length, pos)) { context |= 1U << dfa->contextKindCount; }
+    return context;
+}
+
+/// Takes the transition out of *state for pos, computing it if needed. Returns NO if the cache is full.
+static inline BOOL RKXLazyDFAStep(RKXLazyDFA *dfa, int32_t *state, uint32_t cls, const unichar *chars, NSUInteger length, NSUInteger pos, BOOL *matched)
+{
+    uint32_t context = (dfa->contextKindCount || dfa->guardsCRLF) ? RKXLazyDFAContext(dfa, chars, length, pos) : 0;
+    int32_t entry = dfa->transitions[(size_t)*state * dfa->stride + context * (dfa->classCount + 1) + cls];
+    if (entry == RKXLazyDFAUnknown && (entry = RKXLazyDFAComputeTransition(dfa, *state, context, cls)) < 0) { return NO; }
+    *matched = (entry & 1) != 0;
+    *state = entry >> 1;
+    return YES;
+}
+
+/// Scans forward from start for the end of the leftmost-first match, or of the first match to end at all if
+/// earliest is YES. Returns 1 and sets *end if there is a match, 0 if there is none and -1 if the cache is full.
+static int RKXLazyDFAFindEnd(RKXLazyDFA *dfa, const unichar *chars, NSUInteger length, NSUInteger start, BOOL earliest, NSUInteger *end)
+{
+    int32_t state = RKXLazyDFAStartState;
+    int found = 0;
+    NSRange run = NSNotFoundRange;
+
+    for (NSUInteger pos = start; ; ) {
+        // No thread is alive in the start state, so the scan can jump to the next position a match can start from.
+        if (state == RKXLazyDFAStartState && dfa->program->skipsAhead && (pos = RKXProgramNextStart(dfa->program, chars, length, pos, &run)) == NSNotFound) { break; }
+        NSUInteger width = 0;
+        uint32_t cls = dfa->classCount;
+        BOOL matched = NO;
+        if (pos < length) { cls = RKXLazyDFAClassOf(dfa, RKXCodePointAt(chars, length, pos, &width)); }
+        if (!RKXLazyDFAStep(dfa, &state, cls, chars, length, pos, &matched)) { return -1; }
+
+        if (matched) {
+            *end = pos;
+            found = 1;
+            if (earliest) { break; }
+        }
+
+        if (pos >= length || state == RKXLazyDFADeadState) { break; }
+        pos += width;
+    }
+
+    return found;
+}
+
+/// Scans the reversed program's DFA back from end, no further than floor, for the leftmost start of a match
+/// that ends at end. A match of a line-anchored program does not start inside a CR/LF pair, as in the forward
+/// scan. Returns 1 and sets *start if there is one, 0 if there is none and -1 if the cache is full.
+static int RKXLazyDFAFindStart(RKXLazyDFA *dfa, BOOL lineAnchored, const unichar *chars, NSUInteger length, NSUInteger floor, NSUInteger end, NSUInteger *start)
+{
+    int32_t state = RKXLazyDFAStartState;
+    int found = 0;
+
+    for (NSUInteger pos = end; ; ) {
+        NSUInteger width = 0;
+        uint32_t cls = dfa->classCount;
+        BOOL matched = NO;
+
+        if (pos > floor) {
+            UTF32Char c = chars[pos - 1];
+            width = 1;
+
+            if (CFStringIsSurrogateLowCharacter(chars[pos - 1]) && pos - 1 > floor && CFStringIsSurrogateHighCharacter(chars[pos - 2])) {
+                c = CFStringGetLongCharacterForSurrogatePair(chars[pos - 2], chars[pos - 1]);
+                width = 2;
+            }
+
+            cls = RKXLazyDFAClassOf(dfa, c);
+        }
+
+        if (!RKXLazyDFAStep(dfa, &state, cls, chars, length, pos, &matched)) { return -1; }
+
+        if (matched && !(lineAnchored && RKXIsInsideCRLF(chars, length, pos))) {
+            *start = pos;
+            found = 1;
+        }
+
+        if (pos <= floor || state == RKXLazyDFADeadState) { break; }
+        pos -= width;
+    }
+
+    return found;
+}
+
+/// The lazy DFA counterpart of RKXPikeVMNextMatch. reverse may be NULL if the pattern cannot match the empty
+/// string and only the end of the match is needed, in which case range starts where the scan did. Returns 1
+/// and sets *range if there is a match, 0 if there is none and -1 if either cache is full.
+static int RKXLazyDFANextMatch(RKXLazyDFA *forward, RKXLazyDFA *reverse, const unichar *chars, NSUInteger length, NSUInteger *start, NSRange *range)
+{
+    NSUInteger end = 0, first = 0;
+    if (*start > length) { return 0; }
+    int found = RKXLazyDFAFindEnd(forward, chars, length, *start, NO, &end);
+    if (found <= 0) { return found; }
+
+    if (reverse) {
+        // The forward scan proved a match ends here, so a reverse scan that finds none means the two disagree.
+        if (RKXLazyDFAFindStart(reverse, forward->program->lineAnchored, chars, length, *start, end, &first) <= 0) { return -1; }
+    }
+    else {
+        first = *start;
+    }
+
+    *range = NSMakeRange(first, end - first);
+
+    if (reverse && first == end) {
+        NSUInteger width = 1;
+        if (end < length) { RKXCodePointAt(chars, length, end, &width); }
+        *start = end + width;
+    }
+    else {
+        *start = end;
+    }
+
+    return 1;
+}
+
+#pragma mark - Literal Search
+
+// A pattern that is a literal string, or an alternation of a few, needs neither automaton. The text is scanned
+// eight UTF-16 units at a time for a unit that can start a branch, and at each candidate the branches are tried
+// in order, which is the leftmost-first choice ICU makes. A caseless letter is stored in lowercase with a fold of
+// 0x20, so (unit | fold) == letter holds for the letter and its ASCII case partner only; text with any other
+// character that folds to an ASCII letter never gets here (see RKXFoldsToASCIILetter).
+
+#define RKXMaxLiteralBranches 8
+#define RKXMaxLiteralFirsts 4
+#define RKXMaxLiteralUnits 256
+#define RKXUnitVectorLanes 8
+
+typedef uint16_t RKXUnitVector __attribute__((vector_size(16)));
+typedef int16_t RKXUnitMask __attribute__((vector_size(16)));
+typedef uint64_t RKXUnitMaskHalves __attribute__((vector_size(16)));
+
+#define RKXByteVectorLanes 16
+
+typedef uint8_t RKXByteVector __attribute__((vector_size(16)));
+typedef int8_t RKXByteMask __attribute__((vector_size(16)));
+
+typedef struct RKXLiteralSet {
+    unichar units[RKXMaxLiteralUnits];      // the branches one after another, caseless letters in lowercase
+    unichar folds[RKXMaxLiteralUnits];      // 0x20 for caseless letters, 0 otherwise
+    uint32_t ends[RKXMaxLiteralBranches];   // branch i is units[ends[i - 1]] up to units[ends[i]]
+    uint32_t branchCount;
+    unichar firsts[RKXMaxLiteralFirsts];    // the distinct first units of the branches
+    unichar firstFolds[RKXMaxLiteralFirsts];
+    uint32_t firstCount;
+} RKXLiteralSet;
+
+static BOOL RKXLiteralSetAddUnit(RKXLiteralSet *set, uint32_t *unitCount, unichar unit, unichar fold)
+{
+    if (*unitCount >= RKXMaxLiteralUnits) { return NO; }
+    set->units[*unitCount] = unit;
+    set->folds[*unitCount] = fold;
+    (*unitCount)++;
+    return YES;
+}
+
+static BOOL RKXLiteralSetAddLiteral(RKXLiteralSet *set, uint32_t *unitCount, const RKXNode *node)
+{
+    if (node->kind != RKXNodeLiteral) { return NO; }
+    UTF32Char c = node->value;
+    if (c >= 0xD800 && c <= 0xDFFF) { return NO; }
+    if (c < 0x10000) { return RKXLiteralSetAddUnit(set, unitCount, (unichar)c, (node->flags & RKXNodeCaseless) ? 0x20 : 0); }
+    c -= 0x10000;
+    return RKXLiteralSetAddUnit(set, unitCount, (unichar)(0xD800 + (c >> 10)), 0) && RKXLiteralSetAddUnit(set, unitCount, (unichar)(0xDC00 + (c & 0x3FF)), 0);
+}
+
+/// Ends the branch whose units were added from units[start] up to units[unitCount].
+static BOOL RKXLiteralSetEndBranch(RKXLiteralSet *set, uint32_t start, uint32_t unitCount)
+{
+    // An empty branch would match everywhere, which is not worth a special case here.
+    if (unitCount == start || set->branchCount >= RKXMaxLiteralBranches) { return NO; }
+
+    uint32_t f = 0;
+    while (f < set->firstCount && (set->firsts[f] != set->units[start] || set->firstFolds[f] != set->folds[start])) { f++; }
+    if (f == set->firstCount) {
+        if (f >= RKXMaxLiteralFirsts) { return NO; }
+        set->firsts[f] = set->units[start];
+        set->firstFolds[f] = set->folds[start];
+        set->firstCount++;
+    }
+
+    set->ends[set->branchCount++] = unitCount;
+    return YES;
+}
+
+/// Appends the branch at index, a literal or a sequence of literals, to set.
+static BOOL RKXLiteralSetAddBranch(RKXLiteralSet *set, uint32_t *unitCount, const RKXSyntax *syntax, int32_t index)
+{
+    const RKXNode *node = &syntax->nodes[index];
+    uint32_t start = *unitCount;
+
+    if (node->kind == RKXNodeConcat) {
+        for (int32_t item = node->child; item != RKXNoNode; item = syntax->nodes[item].next) {
+            if (!RKXLiteralSetAddLiteral(set, unitCount, &syntax->nodes[item])) { return NO; }
+        }
+    }
+    else if (!RKXLiteralSetAddLiteral(set, unitCount, node)) { return NO; }
+
+    return RKXLiteralSetEndBranch(set, start, *unitCount);
+}
+
+/// Fills set from syntax if the pattern is a literal string or an alternation of them. Returns NO otherwise.
+static BOOL RKXLiteralSetInit(RKXLiteralSet *set, const RKXSyntax *syntax)
+{
+    memset(set, 0, sizeof(*set));
+    if (syntax->root == RKXNoNode || syntax->captureCount) { return NO; }
+    const RKXNode *root = &syntax->nodes[syntax->root];
+    uint32_t unitCount = 0;
+
+    if (root->kind != RKXNodeAlternation) { return RKXLiteralSetAddBranch(set, &unitCount, syntax, syntax->root); }
+
+    for (int32_t branch = root->child; branch != RKXNoNode; branch = syntax->nodes[branch].next) {
+        if (!RKXLiteralSetAddBranch(set, &unitCount, syntax, branch)) { return NO; }
+    }
+
+    return YES;
+}
+
+/// Fills set with a literal every match of syntax contains: for each branch of the pattern, the longest run of
+/// literals in its top-level sequence. prefixChars and maxPrefixLength are set to what the parts of the branches
+/// before their runs can consume. Returns NO if some branch has no run of at least two literals.
+static BOOL RKXRequiredLiteralsInit(RKXLiteralSet *set, const RKXSyntax *syntax, RKXCharSet *prefixChars, uint32_t *maxPrefixLength)
+{
+    memset(set, 0, sizeof(*set));
+    memset(prefixChars, 0, sizeof(*prefixChars));
+    *maxPrefixLength = 0;
+    if (syntax->root == RKXNoNode) { return NO; }
+    const RKXNode *nodes = syntax->nodes;
+    int32_t top = syntax->root;
+    while (nodes[top].kind == RKXNodeCapture) { top = nodes[top].child; }
+    BOOL alternation = (nodes[top].kind == RKXNodeAlternation);
+
+    RKXAnalyzer analyzer = { .syntax = syntax, .summaries = calloc(MAX(syntax->nodeCount, 1U), sizeof(RKXNodeSummary)) };
+    if (!analyzer.summaries) { return NO; }
+    RKXSummarizeNode(&analyzer, syntax->root);
+    uint32_t unitCount = 0;
+    BOOL ok = YES;
+
+    for (int32_t branch = (alternation) ? nodes[top].child : top; branch != RKXNoNode && ok; branch = (alternation) ? nodes[branch].next : RKXNoNode) {
+        int32_t index = branch;
+        while (nodes[index].kind == RKXNodeCapture) { index = nodes[index].child; }
+        BOOL sequence = (nodes[index].kind == RKXNodeConcat);
+        RKXCharSet chars = { 0 }, runChars = { 0 }, bestChars = { 0 };
+        uint32_t length = 0, runLength = 0, bestLength = 0, count = 0, bestCount = 0;
+        int32_t runStart = RKXNoNode, bestStart = RKXNoNode;
+
+        for (int32_t item = (sequence) ? nodes[index].child : index; item != RKXNoNode; item = (sequence) ? nodes[item].next : RKXNoNode) {
+            if (nodes[item].kind == RKXNodeLiteral) {
+                if (!count) { runStart = item; runChars = chars; runLength = length; }
+                if (++count > bestCount) { bestCount = count; bestStart = runStart; bestChars = runChars; bestLength = runLength; }
+            }
+            else {
+                count = 0;
+            }
+
+            RKXCharSetUnion(&chars, &analyzer.summaries[item].chars);
+            length = RKXLengthAdd(length, analyzer.summaries[item].maxLength);
+        }
+
+        uint32_t start = unitCount;
+        ok = (bestCount >= 2);
+
+        for (int32_t item = bestStart; ok && bestCount--; item = nodes[item].next) { ok = RKXLiteralSetAddLiteral(set, &unitCount, &nodes[item]); }
+        ok = ok && RKXLiteralSetEndBranch(set, start, unitCount);
+        RKXCharSetUnion(prefixChars, &bestChars);
+        *maxPrefixLength = MAX(*maxPrefixLength, bestLength);
+    }
+
+    free(analyzer.summaries);
+    return ok;
+}
+
+static inline RKXUnitVector RKXUnitVectorSplat(unichar unit) { return (RKXUnitVector){ unit, unit, unit, unit, unit, unit, unit, unit }; }
+
+/// Returns the index of the first unit at or after start that can begin a branch of set, or length if there is none.
+static NSUInteger RKXLiteralSetNextCandidate(const RKXLiteralSet *set, const unichar *chars, NSUInteger length, NSUInteger start)
+{
+    NSUInteger i = start;
+
+    if (length - i >= RKXUnitVectorLanes) {
+        RKXUnitVector firsts[RKXMaxLiteralFirsts], folds[RKXMaxLiteralFirsts];
+        for (uint32_t f = 0; f < set->firstCount; f++) {
+            firsts[f] = RKXUnitVectorSplat(set->firsts[f]);
+            folds[f] = RKXUnitVectorSplat(set->firstFolds[f]);
+        }
+
+        for (; length - i >= RKXUnitVectorLanes; i += RKXUnitVectorLanes) {
+            RKXUnitVector chunk;
+            memcpy(&chunk, chars + i, sizeof(chunk));
+            RKXUnitMask hits = ((chunk | folds[0]) == firsts[0]);
+            for (uint32_t f = 1; f < set->firstCount; f++) { hits |= ((chunk | folds[f]) == firsts[f]); }
+            RKXUnitMaskHalves halves = (RKXUnitMaskHalves)hits;
+            if (halves[0] | halves[1]) { break; }
+        }
+    }
+
+    // Pins down the candidate in the chunk that had one, and covers the units left over after the last chunk.
+    for (; i < length; i++) {
+        for (uint32_t f = 0; f < set->firstCount; f++) {
+            if ((chars[i] | set->firstFolds[f]) == set->firsts[f]) { return i; }
+        }
+    }
+
+    return length;
+}
+
+/// Finds the leftmost match of set in chars that starts at or after *start and moves *start past it.
+/// Returns YES and sets range if there is one.
+static BOOL RKXLiteralSetNextMatch(const RKXLiteralSet *set, const unichar *chars, NSUInteger length, NSUInteger *start, NSRange *range)
+{
+    for (NSUInteger i = *start; (i = RKXLiteralSetNextCandidate(set, chars, length, i)) < length; i++) {
+        uint32_t first = 0;
+
+        for (uint32_t branch = 0; branch < set->branchCount; first = set->ends[branch++]) {
+            uint32_t count = set->ends[branch] - first, k = 0;
+            if (count > length - i) { continue; }
+            while (k < count && (chars[i + k] | set->folds[first + k]) == set->units[first + k]) { k++; }
+            if (k < count) { continue; }
+
+            *range = NSMakeRange(i, count);
+            *start = i + count;
+            return YES;
+        }
+    }
+
+    *start = length;
+    return NO;
+}
+
+// The same search over a string that stores its characters as ASCII bytes, read in place without widening them
+// to UTF-16. A branch with a unit above 0x7F can never match ASCII text, so its first unit is left out of the
+// candidate scan, and (byte | fold) never equals such a unit when the branch is tried.
+
+static inline RKXByteVector RKXByteVectorSplat(uint8_t byte) { return (RKXByteVector){ byte, byte, byte, byte, byte, byte, byte, byte, byte, byte, byte, byte, byte, byte, byte, byte }; }
+
+/// Returns the index of the first byte at or after start that can begin a branch of set, or length if there is none.
+static NSUInteger RKXLiteralSetNextCandidateInASCII(const RKXLiteralSet *set, const uint8_t *bytes, NSUInteger length, NSUInteger start)
+{
+    RKXByteVector firsts[RKXMaxLiteralFirsts], folds[RKXMaxLiteralFirsts];
+    uint32_t firstCount = 0;
+
+    for (uint32_t f = 0; f < set->firstCount; f++) {
+        if (set->firsts[f] >= 0x80) { continue; }
+        firsts[firstCount] = RKXByteVectorSplat((uint8_t)set->firsts[f]);
+        folds[firstCount++] = RKXByteVectorSplat((uint8_t)set->firstFolds[f]);
+    }
+
+    if (!firstCount) { return length; }
+    NSUInteger i = start;
+
+    for (; length - i >= RKXByteVectorLanes; i += RKXByteVectorLanes) {
+        RKXByteVector chunk;
+        memcpy(&chunk, bytes + i, sizeof(chunk));
+        RKXByteMask hits = ((chunk | folds[0]) == firsts[0]);
+        for (uint32_t f = 1; f < firstCount; f++) { hits |= ((chunk | folds[f]) == firsts[f]); }
+        RKXUnitMaskHalves halves = (RKXUnitMaskHalves)hits;
+        if (halves[0] | halves[1]) { break; }
+    }
+
+    for (; i < length; i++) {
+        for (uint32_t f = 0; f < set->firstCount; f++) {
+            if ((bytes[i] | set->firstFolds[f]) == set->firsts[f]) { return i; }
+        }
+    }
+
+    return length;
+}
+
+/// The ASCII counterpart of RKXLiteralSetNextMatch().
+static BOOL RKXLiteralSetNextMatchInASCII(const RKXLiteralSet *set, const uint8_t *bytes, NSUInteger length, NSUInteger *start, NSRange *range)
+{
+    for (NSUInteger i = *start; (i = RKXLiteralSetNextCandidateInASCII(set, bytes, length, i)) < length; i++) {
+        uint32_t first = 0;
+
+        for (uint32_t branch = 0; branch < set->branchCount; first = set->ends[branch++]) {
+            uint32_t count = set->ends[branch] - first, k = 0;
+            if (count > length - i) { continue; }
+            while (k < count && (bytes[i + k] | set->folds[first + k]) == set->units[first + k]) { k++; }
+            if (k < count) { continue; }
+
+            *range = NSMakeRange(i, count);
+            *start = i + count;
+            return YES;
+        }
+    }
+
+    *start = length;
+    return NO;
+}
+
+#pragma mark String storage
+
+/// Returns the characters of string in place if it stores them as contiguous ASCII bytes, or NULL if it does not.
+/// CoreFoundation and Swift only keep a string in eight bits when every character is ASCII and record the fact with
+/// the string, so a non-NULL result also tells the string is ASCII without a scan, and asking again is as cheap.
+static inline const uint8_t *RKXASCIIStorageOfString(NSString *string)
+{
+    return (const uint8_t *)CFStringGetCStringPtr((__bridge CFStringRef)string, kCFStringEncodingASCII);
+}
+
+#pragma mark Line terminators
+
+/// Returns the index of the first line terminator at or after start, or length if there is none. Only \\n is one
+/// for unixLines; otherwise \\n, \\v, \\f, \\r, U+0085, U+2028 and U+2029 all are, as they are for ICU.
+static NSUInteger RKXNextLineTerminator(const unichar *chars, NSUInteger length, NSUInteger start, BOOL unixLines)
+{
+    const RKXUnitVector newline = RKXUnitVectorSplat('\n'), nextLine = RKXUnitVectorSplat(0x85), separators = RKXUnitVectorSplat(0x2028);
+    const RKXUnitVector controlCount = RKXUnitVectorSplat(4), separatorBit = RKXUnitVectorSplat(1);
+    NSUInteger i = start;
+
+    for (; length - i >= RKXUnitVectorLanes; i += RKXUnitVectorLanes) {
+        RKXUnitVector chunk;
+        memcpy(&chunk, chars + i, sizeof(chunk));
+        RKXUnitMask hits = (chunk == newline);
+        // \n through \r are the four units from 0x0A, and U+2028 and U+2029 differ only in their lowest bit.
+        if (!unixLines) { hits |= ((chunk - newline) < controlCount) | (chunk == nextLine) | ((chunk & ~separatorBit) == separators); }
+        RKXUnitMaskHalves halves = (RKXUnitMaskHalves)hits;
+        if (halves[0] | halves[1]) { break; }
+    }
+
+    for (; i < length; i++) {
+        if ((unixLines) ? chars[i] == '\n' : RKXIsLineTerminator(chars[i])) { return i; }
+    }
+
+    return length;
+}
+
+#pragma mark Match starts
+
+/// Returns the first position at or after pos where a match of the line-anchored program can start, or
+/// NSNotFound if there is none. Those are the start of the text and the start of each line, and of those only
+/// the lines a match could fill if it must run to the end of its line. A line of n UTF-16 units holds between
+/// (n + 1) / 2 and n code points. The linear engine does not run patterns under RKXUseUnixLineSeparators, so
+/// every line terminator ICU knows starts a line; a CR/LF pair starts one line, after its \n.
+static NSUInteger RKXNextLineStart(const RKXProgram *program, const unichar *chars, NSUInteger length, NSUInteger pos)
+{
+    for (;;) {
+        if (RKXIsInsideCRLF(chars, length, pos)) { pos++; }
+
+        if (pos > 0 && !(pos < length && RKXIsLineTerminator(chars[pos - 1]))) {
+            pos = RKXNextLineTerminator(chars, length, pos, NO) + 1;
+            if (pos >= length) { return NSNotFound; }
+            continue;
+        }
+
+        if (!program->lineBounded) { return pos; }
+        NSUInteger end = RKXNextLineTerminator(chars, length, pos, NO), units = end - pos;
+        if (units >= program->minLineLength && (units + 1) / 2 <= program->maxLineLength) { return pos; }
+        if (end >= length) { return NSNotFound; }
+        pos = end + 1;
+    }
+}
+
+/// Returns the first position at or after pos where a match of a program with required literals can start, or
+/// NSNotFound if there is none. A match starting at or after pos contains the next of the literals or a later
+/// one, and everything before that literal is from prefixChars, so it cannot start before the run of those that
+/// ends at the next literal. Non-ASCII units are all taken to be in prefixChars if any is, and a code point can
+/// take two units. run keeps the last run found, which holds for every later pos up to its end, so a scan that
+/// calls this again and again while it moves forward reads each unit a bounded number of times.
+static NSUInteger RKXNextPrefixStart(const RKXProgram *program, const unichar *chars, NSUInteger length, NSUInteger pos, NSRange *run)
+{
+    if (run->location == NSNotFound || NSMaxRange(*run) < pos) {
+        NSUInteger start = pos;
+        NSRange literal = NSNotFoundRange;
+        if (!RKXLiteralSetNextMatch(program->requiredLiterals, chars, length, &start, &literal)) { return NSNotFound; }
+        NSUInteger floor = pos, first = literal.location;
+
+        if (program->maxPrefixLength != RKXRepeatUnbounded && first - pos > 2 * (NSUInteger)program->maxPrefixLength) {
+            floor = first - 2 * (NSUInteger)program->maxPrefixLength;
+            // A match never starts between the units of a surrogate pair.
+            if (CFStringIsSurrogateLowCharacter(chars[floor]) && CFStringIsSurrogateHighCharacter(chars[floor - 1])) { floor--; }
+        }
+
+        while (first > floor && RKXCharSetContains(&program->prefixChars, chars[first - 1])) { first--; }
+        *run = NSMakeRange(first, literal.location - first);
+    }
+
+    return MAX(run->location, pos);
+}
+
+/// Returns the first position at or after pos whose unit can start a match of a program with known first code
+/// points, or NSNotFound if there is none. Up to RKXMaxFirstRanges ranges are compared eight units at a time;
+/// the ASCII bitmap pins down the unit and covers what is left. A surrogate is non-ASCII like the code point it
+/// is part of.
+static NSUInteger RKXNextFirstUnit(const RKXProgram *program, const unichar *chars, NSUInteger length, NSUInteger pos)
+{
+    NSUInteger i = pos;
+    uint32_t rangeCount = program->firstRangeCount;
+
+    if (rangeCount && length - i >= RKXUnitVectorLanes) {
+        RKXUnitVector lows[RKXMaxFirstRanges], widths[RKXMaxFirstRanges];
+        for (uint32_t r = 0; r < rangeCount; r++) {
+            lows[r] = RKXUnitVectorSplat(program->firstLows[r]);
+            widths[r] = RKXUnitVectorSplat((unichar)(program->firstHighs[r] - program->firstLows[r] + 1));
+        }
+
+        for (; length - i >= RKXUnitVectorLanes; i += RKXUnitVectorLanes) {
+            RKXUnitVector chunk;
+            memcpy(&chunk, chars + i, sizeof(chunk));
+            RKXUnitMask hits = ((chunk - lows[0]) < widths[0]);
+            for (uint32_t r = 1; r < rangeCount; r++) { hits |= ((chunk - lows[r]) < widths[r]); }
+            RKXUnitMaskHalves halves = (RKXUnitMaskHalves)hits;
+            if (halves[0] | halves[1]) { break; }
+        }
+    }
+
+    for (; i < length; i++) {
+        if (RKXCharSetContains(&program->firstChars, chars[i])) { return i; }
+    }
+
+    return NSNotFound;
+}
+
+/// Returns the first position at or after pos where a match of the program can start, or NSNotFound if there
+/// is none, as far as the line anchoring, the required literals and the first code points of the program tell.
+/// Each of them can only move the position forward, so they are applied in turn until none does. run must start
+/// out as NSNotFoundRange for each scan and is passed back unchanged on each call of the scan.
+static NSUInteger RKXProgramNextStart(const RKXProgram *program, const unichar *chars, NSUInteger length, NSUInteger pos, NSRange *run)
+{
+    for (;;) {
+        NSUInteger next = pos;
+        if (program->lineAnchored && (next = RKXNextLineStart(program, chars, length, next)) == NSNotFound) { return NSNotFound; }
+        if (program->requiredLiterals && (next = RKXNextPrefixStart(program, chars, length, next, run)) == NSNotFound) { return NSNotFound; }
+        if (program->firstCharsKnown && (next = RKXNextFirstUnit(program, chars, length, next)) == NSNotFound) { return NSNotFound; }
+        if (next == pos) { return pos; }
+        pos = next;
+    }
+}
+
+#pragma mark -
+
+static char RKXSyntaxTreeKey;
+static char RKXRegexAnalysisKey;
+static char RKXLinearProgramKey;
+static char RKXCaptureFreeRegexKey;
+
+/// Owns the parsed syntax of a regex. One is built on first use for each @c NSRegularExpression and kept with it.
+@interface RKXSyntaxTree : NSObject
+@property (nonatomic, readonly) const RKXSyntax *syntax;
++ (instancetype)syntaxTreeForRegex:(NSRegularExpression *)regex;
+@end
+
+@implementation RKXSyntaxTree
+{
+    RKXSyntax _syntax;
+}
+
++ (instancetype)syntaxTreeForRegex:(NSRegularExpression *)regex
+{
+    id tree = objc_getAssociatedObject(regex, &RKXSyntaxTreeKey);
+
+    if (!tree) {
+        tree = [[RKXSyntaxTree alloc] initWithPattern:regex.pattern options:(RKXRegexOptions)regex.options] ?: (id)NSNull.null;
+        objc_setAssociatedObject(regex, &RKXSyntaxTreeKey, tree, OBJC_ASSOCIATION_RETAIN);
+    }
+
+    return (tree == NSNull.null) ? nil : tree;
+}
+
+- (instancetype)initWithPattern:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    if ((self = [super init])) {
+        NSUInteger length = pattern.length;
+        unichar *chars = malloc(MAX(length, 1UL) * sizeof(unichar));
+        if (!chars) { return nil; }
+        [pattern getCharacters:chars range:pattern.stringRange];
+        BOOL parsed = RKXSyntaxParse(&_syntax, chars, length, options);
+        free(chars);
+        if (!parsed) { return nil; }
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    RKXSyntaxFree(&_syntax);
+}
+
+- (const RKXSyntax *)syntax
+{
+    return &_syntax;
+}
+
+@end
+
+/// The complexity analysis of a regex, made on first use from its syntax tree and kept with its
+/// @c NSRegularExpression. Patterns the tree cannot represent are rated @c RKXRegexComplexityUnknown.
+@interface RKXRegexAnalysis : NSObject
+@property (nonatomic, readonly) RKXRegexComplexity complexity;
+@property (nonatomic, readonly) RKXRegexHazards hazards;
+@property (nonatomic, readonly) NSUInteger riskScore;
++ (instancetype)analysisForRegex:(NSRegularExpression *)regex;
+@end
+
+@implementation RKXRegexAnalysis
+
++ (instancetype)analysisForRegex:(NSRegularExpression *)regex
+{
+    RKXRegexAnalysis *analysis = objc_getAssociatedObject(regex, &RKXRegexAnalysisKey);
+
+    if (!analysis) {
+        analysis = [[RKXRegexAnalysis alloc] initWithSyntaxTree:[RKXSyntaxTree syntaxTreeForRegex:regex]];
+        objc_setAssociatedObject(regex, &RKXRegexAnalysisKey, analysis, OBJC_ASSOCIATION_RETAIN);
+    }
+
+    return analysis;
+}
+
+- (instancetype)initWithSyntaxTree:(RKXSyntaxTree *)tree
+{
+    if ((self = [super init])) {
+        _complexity = RKXRegexComplexityUnknown;
+        _hazards = RKXRegexHazardNone;
+        _riskScore = RKXUnknownRiskScore;
+        if (tree) { RKXAnalyzeSyntax(tree.syntax, &_complexity, &_hazards, &_riskScore); }
+    }
+
+    return self;
+}
+
+@end
+
+/// Returns a copy of @c regex with every capture group made non-capturing, for callers that only read the range of each whole match, so that ICU does not record where the groups matched on every attempt. The copy is made on first use and kept with @c regex.
+/// @discussion @c regex itself is returned if it has no groups, if a backreference refers to one of them, or if its syntax tree cannot be built, since the groups could then not be found or not be safely removed.
+static NSRegularExpression *RKXCaptureFreeRegex(NSRegularExpression *regex)
+{
+    id captureFree = objc_getAssociatedObject(regex, &RKXCaptureFreeRegexKey);
+
+    if (!captureFree) {
+        RKXSyntaxTree *tree = (regex.numberOfCaptureGroups > 0) ? [RKXSyntaxTree syntaxTreeForRegex:regex] : nil;
+        const RKXSyntax *syntax = tree.syntax;
+
+        if (syntax && !(syntax->features & RKXSyntaxBackreference) && syntax->captureCount == regex.numberOfCaptureGroups) {
+            NSString *pattern = regex.pattern;
+            NSMutableString *pruned = [NSMutableString stringWithCapacity:pattern.length + 2 * syntax->captureCount];
+            NSUInteger pos = 0;
+
+            for (uint32_t i = 0; i < syntax->captureCount; i++) {
+                NSRange opener = syntax->captureOpeners[i];
+                [pruned appendString:[pattern substringWithRange:NSMakeRange(pos, opener.location - pos)]];
+                [pruned appendString:@"(?:"];
+                pos = NSMaxRange(opener);
+            }
+
+            [pruned appendString:[pattern substringFromIndex:pos]];
+            captureFree = [NSRegularExpression regularExpressionWithPattern:pruned options:regex.options error:NULL];
+        }
+
+        // The regex cannot hold on to itself, so a regex that is its own capture-free form is marked with NSNull.
+        objc_setAssociatedObject(regex, &RKXCaptureFreeRegexKey, captureFree ?: NSNull.null, OBJC_ASSOCIATION_RETAIN);
+    }
+
+    return (!captureFree || captureFree == NSNull.null) ? regex : captureFree;
+}
+
+static NSString *RKXDescriptionOfHazards(RKXRegexHazards hazards)
+{
+    NSMutableArray<NSString *> *names = [NSMutableArray array];
+    if (hazards & RKXRegexHazardNestedQuantifier) { [names addObject:@"nested quantifiers"]; }
+    if (hazards & RKXRegexHazardAmbiguousAlternation) { [names addObject:@"an ambiguous alternation in a loop"]; }
+    if (hazards & RKXRegexHazardOverlappingQuantifiers) { [names addObject:@"overlapping adjacent quantifiers"]; }
+    if (hazards & RKXRegexHazardUnboundedLookaround) { [names addObject:@"unbounded lookaround"]; }
+    if (hazards & RKXRegexHazardUnanchoredQuantifier) { [names addObject:@"an unanchored quantifier"]; }
+    return [names componentsJoinedByString:@", "];
+}
+
+@interface RKXMatchBuffer ()
+- (NSRegularExpression *)regexForPattern:(NSString *)pattern options:(RKXRegexOptions)options error:(NSError **)error;
+- (void)resetWithRangesPerMatch:(NSUInteger)rangesPerMatch;
+- (NSRange *)appendMatch;
+- (void)truncateToCount:(NSUInteger)count;
+- (BOOL)selectRangesAtIndexes:(const NSUInteger *)indexes count:(NSUInteger)count;
+- (unichar *)characterStorageOfLength:(NSUInteger)length;
+@end
+
+/// The compiled linear-time program for a regex, or nothing if the pattern is not eligible. Kept with its
+/// @c NSRegularExpression like the syntax tree it was compiled from.
+@interface RKXLinearProgram : NSObject
+@property (nonatomic, readonly) BOOL prefersLinearEngine;
+@property (nonatomic, readonly) BOOL requiresASCIIInput;
+@property (nonatomic, readonly) BOOL excludesCaselessFolds;
++ (instancetype)linearProgramForRegex:(NSRegularExpression *)regex;
+- (NSArray<NSTextCheckingResult *> *)matchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions regularExpression:(NSRegularExpression *)regex;
+- (NSUInteger)countOfMatchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions limit:(NSUInteger)limit ranges:(NSMutableArray<NSValue *> *)ranges;
+- (BOOL)getMatchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer;
+- (NSUInteger)countOfMatchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer;
+- (BOOL)countOfMatchesInLines:(const NSRange *)lines count:(NSUInteger)lineCount ofString:(NSString *)string limit:(NSUInteger)limit counts:(NSUInteger *)counts buffer:(RKXMatchBuffer *)buffer;
+@end
+
+@implementation RKXLinearProgram
+{
+    RKXSyntaxTree *_tree;
+    RKXProgram _program;
+    // The lazy DFAs are built on first use. Their caches change as they scan, so they are only used under
+    // @synchronized(self).
+    RKXProgram _reverseProgram;
+    RKXLazyDFA _forwardDFA;
+    RKXLazyDFA _reverseDFA;
+    BOOL _lazyDFAPrepared;
+    BOOL _lazyDFAAvailable;
+    // Set for patterns that are literal strings, which are searched for directly instead.
+    RKXLiteralSet *_literalSet;
+}
+
++ (instancetype)linearProgramForRegex:(NSRegularExpression *)regex
+{
+    id program = objc_getAssociatedObject(regex, &RKXLinearProgramKey);
+
+    if (!program) {
+        RKXSyntaxTree *tree = [RKXSyntaxTree syntaxTreeForRegex:regex];
+        program = (tree) ? [[RKXLinearProgram alloc] initWithSyntaxTree:tree analysis:[RKXRegexAnalysis analysisForRegex:regex]] : nil;
+        objc_setAssociatedObject(regex, &RKXLinearProgramKey, program ?: NSNull.null, OBJC_ASSOCIATION_RETAIN);
+    }
+
+    return (program == NSNull.null) ? nil : program;
+}
+
+- (instancetype)initWithSyntaxTree:(RKXSyntaxTree *)tree analysis:(RKXRegexAnalysis *)analysis
+{
+    if ((self = [super init])) {
+        if (!RKXProgramCompile(&_program, tree.syntax, NO)) { return nil; }
+        _tree = tree;
+        // Patterns the analysis rates as risky for a backtracking engine skip ICU altogether; everything else is
+        // only matched here when asked for directly or by the DFA queries.
+        _prefersLinearEngine = (analysis.riskScore >= RKXLinearEngineRiskScore);
+        _requiresASCIIInput = (tree.syntax->features & RKXSyntaxASCIIInput) != 0;
+        _excludesCaselessFolds = (tree.syntax->features & RKXSyntaxCaselessASCII) != 0;
+
+        _literalSet = malloc(sizeof(RKXLiteralSet));
+        if (_literalSet && !RKXLiteralSetInit(_literalSet, tree.syntax)) {
+            free(_literalSet);
+            _literalSet = NULL;
+        }
+
+        // Any other pattern with a literal that every match contains is searched from the runs that end in it.
+        if (!_literalSet) {
+            _program.requiredLiterals = malloc(sizeof(RKXLiteralSet));
+            if (_program.requiredLiterals && !RKXRequiredLiteralsInit(_program.requiredLiterals, tree.syntax, &_program.prefixChars, &_program.maxPrefixLength)) {
+                free(_program.requiredLiterals);
+                _program.requiredLiterals = NULL;
+            }
+            if (_program.requiredLiterals) { _program.skipsAhead = YES; }
+        }
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_lazyDFAAvailable) {
+        RKXLazyDFAFree(&_forwardDFA);
+        RKXLazyDFAFree(&_reverseDFA);
+    }
+
+    free(_literalSet);
+    free(_program.requiredLiterals);
+    free(_reverseProgram.insts);
+    free(_program.insts);
+}
+
+/// Copies the characters in @c searchRange of @c string to @c chars. Returns @c NO if @c matchOptions or the contents of @c searchRange are outside what the program models.
+- (BOOL)getCharacters:(unichar *)chars ofString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions
+{
+    if (matchOptions & (RKXAnchored | RKXWithTransparentBounds | RKXWithoutAnchoringBounds)) { return NO; }
+    NSUInteger length = searchRange.length;
+    const uint8_t *ascii = RKXASCIIStorageOfString(string);
+
+    // ASCII text is within what every program models, so it only needs widening.
+    if (ascii) {
+        ascii += searchRange.location;
+        for (NSUInteger i = 0; i < length; i++) { chars[i] = ascii[i]; }
+        return YES;
+    }
+
+    [string getCharacters:chars range:searchRange];
+
+    if (_requiresASCIIInput) {
+        for (NSUInteger i = 0; i < length; i++) {
+            if (chars[i] >= 128) { return NO; }
+        }
+    }
+    else if (_excludesCaselessFolds) {
+        for (NSUInteger i = 0; i < length; i++) {
+            if (chars[i] >= 0xDF && RKXFoldsToASCIILetter(chars[i])) { return NO; }
+        }
+    }
+
+    return YES;
+}
+
+/// Returns a buffer with the characters in @c searchRange of @c string that the caller must free, or @c NULL if @c matchOptions or the contents of @c searchRange are outside what the program models.
+- (unichar *)charactersOfString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions
+{
+    unichar *chars = malloc(MAX(searchRange.length, 1UL) * sizeof(unichar));
+    if (!chars) { return NULL; }
+    if (![self getCharacters:chars ofString:string range:searchRange matchOptions:matchOptions]) { free(chars); return NULL; }
+    return chars;
+}
+
+/// Runs the Pike VM over @c chars and hands @c block the capture slots of each match, relative to @c chars. @c block returns @c NO to stop. Returns @c NO if the VM could not be set up.
+- (BOOL)enumerateMatchesInCharacters:(const unichar *)chars length:(NSUInteger)length usingBlock:(BOOL (NS_NOESCAPE ^)(const NSUInteger *slots))block
+{
+    NSUInteger *slots = calloc(_program.slotCount, sizeof(NSUInteger)), start = 0;
+    if (!slots) { return NO; }
+    RKXPikeVM vm;
+    BOOL ready = RKXPikeVMInit(&vm, &_program, chars, length);
+
+    while (ready && RKXPikeVMNextMatch(&vm, &start, slots)) {
+        if (!block(slots)) { break; }
+    }
+
+    RKXPikeVMFree(&vm);
+    free(slots);
+    return ready;
+}
+
+static inline void RKXRangesFromSlots(const NSUInteger *slots, NSUInteger rangeCount, NSUInteger offset, NSRange *ranges)
+{
+    for (NSUInteger i = 0; i < rangeCount; i++) {
+        NSUInteger first = slots[i * 2], last = slots[i * 2 + 1];
+        BOOL participated = (first != (NSUInteger)NSNotFound && last != (NSUInteger)NSNotFound);
+        ranges[i] = (participated) ? NSMakeRange(offset + first, last - first) : NSNotFoundRange;
+    }
+}
+
+/// Returns the matches of the program in @c searchRange of @c string, built as results of @c regex, or @c nil if @c matchOptions or the contents of @c searchRange are outside what the program models.
+- (NSArray<NSTextCheckingResult *> *)matchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions regularExpression:(NSRegularExpression *)regex
+{
+    unichar *chars = [self charactersOfString:string range:searchRange matchOptions:matchOptions];
+    if (!chars) { return nil; }
+    NSMutableArray *matches = [NSMutableArray array];
+    NSUInteger rangeCount = _program.slotCount / 2;
+    NSRange *ranges = calloc(rangeCount, sizeof(NSRange));
+
+    BOOL ready = ranges && [self enumerateMatchesInCharacters:chars length:searchRange.length usingBlock:^BOOL(const NSUInteger *slots) {
+        RKXRangesFromSlots(slots, rangeCount, searchRange.location, ranges);
+        [matches addObject:[NSTextCheckingResult regularExpressionCheckingResultWithRanges:ranges count:rangeCount regularExpression:regex]];
+        return YES;
+    }];
+
+    free(ranges);
+    free(chars);
+    return (ready) ? [matches copy] : nil;
+}
+
+/// Appends the matches of the program in @c searchRange of @c string to @c buffer, staging the characters in the buffer's own storage. Returns @c NO and leaves @c buffer as it was if @c matchOptions or the contents of @c searchRange are outside what the program models.
+- (BOOL)getMatchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer
+{
+    NSCAssert(buffer.rangesPerMatch == _program.slotCount / 2, @"buffer holds %lu ranges per match, the program %u", buffer.rangesPerMatch, _program.slotCount / 2);
+    unichar *chars = [buffer characterStorageOfLength:searchRange.length];
+    if (!chars || ![self getCharacters:chars ofString:string range:searchRange matchOptions:matchOptions]) { return NO; }
+    NSUInteger rangeCount = _program.slotCount / 2, initialCount = buffer.count;
+    __block BOOL complete = YES;
+
+    BOOL ready = [self enumerateMatchesInCharacters:chars length:searchRange.length usingBlock:^BOOL(const NSUInteger *slots) {
+        NSRange *ranges = [buffer appendMatch];
+        if (!ranges) { complete = NO; return NO; }
+        RKXRangesFromSlots(slots, rangeCount, searchRange.location, ranges);
+        return YES;
+    }];
+
+    if (ready && complete) { return YES; }
+    [buffer truncateToCount:initialCount];
+    return NO;
+}
+
+/// Returns the ASCII bytes of @c string if the program searches for literals and can read them in place, or @c NULL if the characters have to be copied as UTF-16.
+- (const uint8_t *)literalASCIIOfString:(NSString *)string matchOptions:(RKXMatchOptions)matchOptions
+{
+    if (!_literalSet || (matchOptions & (RKXAnchored | RKXWithTransparentBounds | RKXWithoutAnchoringBounds))) { return NULL; }
+    return RKXASCIIStorageOfString(string);
+}
+
+/// Counts the matches of the literals of the program in @c bytes, stopping once @c limit have been found, and hands @c block the range of each match, relative to @c bytes, if @c block is not @c nil.
+- (NSUInteger)countOfLiteralsInASCII:(const uint8_t *)bytes length:(NSUInteger)length limit:(NSUInteger)limit usingBlock:(void (NS_NOESCAPE ^)(NSRange range))block
+{
+    NSUInteger count = 0, start = 0;
+    NSRange range = NSNotFoundRange;
+
+    for (; count < limit && RKXLiteralSetNextMatchInASCII(_literalSet, bytes, length, &start, &range); count++) {
+        if (block) { block(range); }
+    }
+
+    return count;
+}
+
+- (BOOL)prepareLazyDFA
+{
+    if (_lazyDFAPrepared) { return _lazyDFAAvailable; }
+    _lazyDFAPrepared = YES;
+    if (!RKXProgramCompile(&_reverseProgram, _tree.syntax, YES)) { return NO; }
+
+    if (!RKXLazyDFAInit(&_forwardDFA, &_program, NO)) { return NO; }
+    if (!RKXLazyDFAInit(&_reverseDFA, &_reverseProgram, YES)) {
+        RKXLazyDFAFree(&_forwardDFA);
+        return NO;
+    }
+
+    _lazyDFAAvailable = YES;
+    return YES;
+}
+
+/// The body of @c -countOfMatchesInCharacters:length:limit:usingBlock:. The lazy DFAs must only be used under @c @synchronized(self); literal search needs no lock.
+- (NSUInteger)unsynchronizedCountOfMatchesInCharacters:(const unichar *)chars length:(NSUInteger)length limit:(NSUInteger)limit usingBlock:(void (NS_NOESCAPE ^)(NSRange range))block
+{
+    NSUInteger count = NSNotFound, start = 0, end = 0;
+    NSRange range = NSNotFoundRange;
+
+    if (_literalSet) {
+        for (count = 0; count < limit && RKXLiteralSetNextMatch(_literalSet, chars, length, &start, &range); count++) {
+            if (block) { block(range); }
+        }
+
+        return count;
+    }
+
+    if (![self prepareLazyDFA]) { return NSNotFound; }
+    int result = 0;
+
+    if (limit == 1 && !block) {
+        // Any match at all means there is a leftmost one, so the scan can stop at the first match end.
+        result = RKXLazyDFAFindEnd(&_forwardDFA, chars, length, 0, YES, &end);
+        count = (result < 0) ? NSNotFound : (NSUInteger)result;
+    }
+    else {
+        // Without an empty match to step over or a range to report, the ends of the matches are enough.
+        BOOL needsStarts = (block != nil) || RKXNodeIsNullable(_tree.syntax, _tree.syntax->root);
+        count = 0;
+
+        while (count < limit && (result = RKXLazyDFANextMatch(&_forwardDFA, (needsStarts) ? &_reverseDFA : NULL, chars, length, &start, &range)) > 0) {
+            if (block) { block(range); }
+            count++;
+        }
+
+        if (result < 0) { count = NSNotFound; }
+    }
+
+    // Start over with empty caches next time rather than keep a budget's worth of states around.
+    if (result < 0 && !(RKXLazyDFAReset(&_forwardDFA) && RKXLazyDFAReset(&_reverseDFA))) {
+        RKXLazyDFAFree(&_forwardDFA);
+        RKXLazyDFAFree(&_reverseDFA);
+        _lazyDFAAvailable = NO;
+    }
+
+    return count;
+}
+
+/// Counts the matches of the program in @c chars with the lazy DFA, stopping once @c limit have been found, and hands @c block the range of each whole match, relative to @c chars, if @c block is not @c nil.
+/// @return The number of matches found, or @c NSNotFound if a DFA ran out of cache, in which case @c block may already have been called for some of the matches.
+- (NSUInteger)countOfMatchesInCharacters:(const unichar *)chars length:(NSUInteger)length limit:(NSUInteger)limit usingBlock:(void (NS_NOESCAPE ^)(NSRange range))block
+{
+    if (_literalSet) { return [self unsynchronizedCountOfMatchesInCharacters:chars length:length limit:limit usingBlock:block]; }
+
+    @synchronized (self) {
+        return [self unsynchronizedCountOfMatchesInCharacters:chars length:length limit:limit usingBlock:block];
+    }
+}
+
+/// Counts the matches in each of @c lineCount @c lines, stopping once @c limit have been found in a line, and appends their ranges to @c buffer unless @c limit is @c 1. @c chars holds the characters of the lines, the first of them at index @c offset of the string. Must be called under @c @synchronized(self) unless the program searches for literals.
+- (BOOL)unsynchronizedCountOfMatchesInLines:(const NSRange *)lines count:(NSUInteger)lineCount characters:(const unichar *)chars offset:(NSUInteger)offset limit:(NSUInteger)limit counts:(NSUInteger *)counts buffer:(RKXMatchBuffer *)buffer
+{
+    __block BOOL complete = YES;
+
+    for (NSUInteger i = 0; i < lineCount && complete; i++) {
+        NSUInteger lineOffset = lines[i].location;
+        counts[i] = [self unsynchronizedCountOfMatchesInCharacters:chars + (lineOffset - offset) length:lines[i].length limit:limit usingBlock:(limit == 1) ? nil : ^(NSRange range) {
+            NSRange *slot = [buffer appendMatch];
+            if (slot) { *slot = NSMakeRange(lineOffset + range.location, range.length); }
+            else { complete = NO; }
+        }];
+        if (counts[i] == NSNotFound) { complete = NO; }
+    }
+
+    return complete;
+}
+
+/// Counts the matches of the program in each of the @c lineCount @c lines of @c string, matching each line as if it were the whole string and stopping once @c limit have been found in it. Unless @c limit is @c 1, the range of each match is appended to the empty @c buffer, which must hold one range per match. The characters are staged in the buffer's own storage, and the DFA lock is taken once for all the lines.
+/// @return @c NO if the contents of the lines are outside what the program models or a DFA ran out of cache, in which case @c buffer is left empty and @c counts is undefined.
+- (BOOL)countOfMatchesInLines:(const NSRange *)lines count:(NSUInteger)lineCount ofString:(NSString *)string limit:(NSUInteger)limit counts:(NSUInteger *)counts buffer:(RKXMatchBuffer *)buffer
+{
+    NSCAssert(buffer.rangesPerMatch == 1 && buffer.count == 0, @"buffer holds %lu ranges per match and %lu matches", buffer.rangesPerMatch, buffer.count);
+    if (!lineCount) { return YES; }
+    NSRange span = NSMakeRange(lines[0].location, NSMaxRange(lines[lineCount - 1]) - lines[0].location);
+    unichar *chars = [buffer characterStorageOfLength:span.length];
+    if (!chars || ![self getCharacters:chars ofString:string range:span matchOptions:kNilOptions]) { return NO; }
+    BOOL complete;
+
+    if (_literalSet) {
+        complete = [self unsynchronizedCountOfMatchesInLines:lines count:lineCount characters:chars offset:span.location limit:limit counts:counts buffer:buffer];
+    }
+    else {
+        @synchronized (self) {
+            complete = [self unsynchronizedCountOfMatchesInLines:lines count:lineCount characters:chars offset:span.location limit:limit counts:counts buffer:buffer];
+        }
+    }
+
+    if (!complete) { [buffer removeAllMatches]; }
+    return complete;
+}
+
+/// Counts the matches of the program in @c searchRange of @c string with the lazy DFA, stopping once @c limit have been found, and adds the range of each whole match to @c ranges if it is not @c nil.
+/// @return The number of matches found, or @c NSNotFound if @c matchOptions or the contents of @c searchRange are outside what the program models or a DFA ran out of cache. @c ranges is left untouched in that case.
+- (NSUInteger)countOfMatchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions limit:(NSUInteger)limit ranges:(NSMutableArray<NSValue *> *)ranges
+{
+    if (!limit) { return 0; }
+    const uint8_t *ascii = [self literalASCIIOfString:string matchOptions:matchOptions];
+
+    if (ascii) {
+        return [self countOfLiteralsInASCII:ascii + searchRange.location length:searchRange.length limit:limit usingBlock:(ranges) ? ^(NSRange range) {
+            [ranges addObject:[NSValue valueWithRange:NSMakeRange(searchRange.location + range.location, range.length)]];
+        } : nil];
+    }
+
+    unichar *chars = [self charactersOfString:string range:searchRange matchOptions:matchOptions];
+    if (!chars) { return NSNotFound; }
+    NSMutableArray<NSValue *> *found = (ranges) ? [NSMutableArray array] : nil;
+
+    NSUInteger count = [self countOfMatchesInCharacters:chars length:searchRange.length limit:limit usingBlock:(ranges) ? ^(NSRange range) {
+        [found addObject:[NSValue valueWithRange:NSMakeRange(searchRange.location + range.location, range.length)]];
+    } : nil];
+
+    if (count != NSNotFound) { [ranges addObjectsFromArray:found]; }
+    free(chars);
+    return count;
+}
+
+/// Fills the empty @c buffer, which must hold one range per match, with the ranges of the matches of the program in @c searchRange of @c string found by the lazy DFA, staging the characters in the buffer's own storage.
+/// @return The number of matches found, or @c NSNotFound if @c matchOptions or the contents of @c searchRange are outside what the program models or a DFA ran out of cache. @c buffer is left empty in that case.
+- (NSUInteger)countOfMatchesInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer
+{
+    NSCAssert(buffer.rangesPerMatch == 1 && buffer.count == 0, @"buffer holds %lu ranges per match and %lu matches", buffer.rangesPerMatch, buffer.count);
+    const uint8_t *ascii = [self literalASCIIOfString:string matchOptions:matchOptions];
+    __block BOOL complete = YES;
+    void (^appendRange)(NSRange range) = ^(NSRange range) {
+        NSRange *slot = [buffer appendMatch];
+        if (slot) { *slot = NSMakeRange(searchRange.location + range.location, range.length); }
+        else { complete = NO; }
+    };
+    NSUInteger count;
+
+    if (ascii) {
+        count = [self countOfLiteralsInASCII:ascii + searchRange.location length:searchRange.length limit:NSUIntegerMax usingBlock:appendRange];
+    }
+    else {
+        unichar *chars = [buffer characterStorageOfLength:searchRange.length];
+        if (!chars || ![self getCharacters:chars ofString:string range:searchRange matchOptions:matchOptions]) { return NSNotFound; }
+        count = [self countOfMatchesInCharacters:chars length:searchRange.length limit:NSUIntegerMax usingBlock:appendRange];
+    }
+
+    if (count != NSNotFound && complete) { return count; }
+    [buffer removeAllMatches];
+    return NSNotFound;
+}
+
+@end
+
+#pragma mark -
+
+@interface RKXLineMatch ()
+- (instancetype)initWithLineNumber:(NSUInteger)lineNumber lineRange:(NSRange)lineRange matchRanges:(NSArray<NSValue *> *)matchRanges contextLine:(BOOL)contextLine;
+@end
+
+/// Runs one line-oriented search. The text is copied a block at a time and split into lines with a vectorized
+/// terminator scan. Lines are gathered into waves of batches of about @c RKXLineBatchLength characters; the
+/// batches of a wave are matched in parallel, each line on its own as if it were the whole string, and the wave is
+/// then reported in order, with the context lines and the limit applied as it goes.
+@interface RKXLineSearch : NSObject
+- (instancetype)initWithString:(NSString *)string regularExpression:(NSRegularExpression *)regex lineOptions:(RKXLineOptions)lineOptions limit:(NSUInteger)limit linesBefore:(NSUInteger)linesBefore linesAfter:(NSUInteger)linesAfter;
+- (NSArray<RKXLineMatch *> *)linesInRange:(NSRange)searchRange;
+@end
+
+@implementation RKXLineSearch
+{
+    NSString *_string;
+    NSRegularExpression *_regex;
+    RKXLinearProgram *_linearProgram;
+    BOOL _inverted;
+    BOOL _unixLines;
+    NSUInteger _limit;
+    NSUInteger _linesBefore;
+    NSUInteger _linesAfter;
+
+    // The lines of the current wave, the number of matches found in each and the buffers the batches keep their
+    // ranges in.
+    NSRange *_lines;
+    NSUInteger *_counts;
+    NSUInteger _lineCount;
+    NSUInteger _lineCapacity;
+    NSMutableArray<RKXMatchBuffer *> *_buffers;
+
+    // What has been reported so far. The last unreported lines are kept in a ring for the context before the next
+    // selected line.
+    NSMutableArray<RKXLineMatch *> *_results;
+    NSUInteger _lineNumber;
+    NSUInteger _selectedCount;
+    NSUInteger _pendingLinesAfter;
+    NSRange *_linesBeforeRing;
+    NSUInteger _ringCount;
+    NSUInteger _ringNext;
+    BOOL _finished;
+}
+
+- (instancetype)initWithString:(NSString *)string regularExpression:(NSRegularExpression *)regex lineOptions:(RKXLineOptions)lineOptions limit:(NSUInteger)limit linesBefore:(NSUInteger)linesBefore linesAfter:(NSUInteger)linesAfter
+{
+    if ((self = [super init])) {
+        _string = string;
+        _regex = regex;
+        _linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+        _inverted = OptionsHasValue(lineOptions, RKXLineInvertMatch);
+        _unixLines = OptionsHasValue(regex.options, NSRegularExpressionUseUnixLineSeparators);
+        _limit = limit;
+        _linesBefore = linesBefore;
+        _linesAfter = linesAfter;
+        _buffers = [NSMutableArray array];
+        _results = [NSMutableArray array];
+        if (linesBefore && !(_linesBeforeRing = malloc(linesBefore * sizeof(NSRange)))) { return nil; }
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_lines);
+    free(_counts);
+    free(_linesBeforeRing);
+}
+
+- (NSArray<RKXLineMatch *> *)linesInRange:(NSRange)searchRange
+{
+    unichar *chars = malloc(RKXLineBlockLength * sizeof(unichar));
+    if (!chars) { return nil; }
+    NSUInteger end = NSMaxRange(searchRange), lineStart = searchRange.location;
+    NSUInteger waveLength = RKXLineBatchLength * NSProcessInfo.processInfo.activeProcessorCount * 4;
+    BOOL ok = YES, endsWithCR = NO;
+
+    for (NSUInteger blockStart = searchRange.location; ok && !_finished && blockStart < end; blockStart += RKXLineBlockLength) {
+        NSUInteger blockLength = MIN(RKXLineBlockLength, end - blockStart), i = 0;
+        [_string getCharacters:chars range:NSMakeRange(blockStart, blockLength)];
+
+        // A \r\n split between two blocks is still one terminator.
+        if (endsWithCR && chars[0] == '\n') { lineStart = blockStart + 1; i = 1; }
+        endsWithCR = NO;
+
+        while (ok && (i = RKXNextLineTerminator(chars, blockLength, i, _unixLines)) < blockLength) {
+            ok = [self appendLine:NSMakeRange(lineStart, blockStart + i - lineStart)];
+
+            if (chars[i] == '\r') {
+                if (i + 1 == blockLength) { endsWithCR = YES; }
+                else if (chars[i + 1] == '\n') { i++; }
+            }
+
+            i++;
+            lineStart = blockStart + i;
+        }
+
+        if (ok && _lineCount && NSMaxRange(_lines[_lineCount - 1]) - _lines[0].location >= waveLength) { ok = [self matchAndReportWave]; }
+    }
+
+    // The text after the last terminator is a line of its own, unless there is none.
+    if (ok && !_finished && lineStart < end) { ok = [self appendLine:NSMakeRange(lineStart, end - lineStart)]; }
+    if (ok && !_finished && _lineCount) { ok = [self matchAndReportWave]; }
+
+    free(chars);
+    return (ok) ? [_results copy] : nil;
+}
+
+- (BOOL)appendLine:(NSRange)line
+{
+    if (_lineCount == _lineCapacity) {
+        NSUInteger capacity = MAX(_lineCapacity * 2, 1024UL);
+        NSRange *lines = realloc(_lines, capacity * sizeof(NSRange));
+        if (!lines) { return NO; }
+        _lines = lines;
+        NSUInteger *counts = realloc(_counts, capacity * sizeof(NSUInteger));
+        if (!counts) { return NO; }
+        _counts = counts;
+        _lineCapacity = capacity;
+    }
+
+    _lines[_lineCount++] = line;
+    return YES;
+}
+
+- (BOOL)matchAndReportWave
+{
+    NSUInteger *batchStarts = malloc((_lineCount + 1) * sizeof(NSUInteger)), batchCount = 0;
+    if (!batchStarts) { return NO; }
+
+    for (NSUInteger i = 0; i < _lineCount; i++) {
+        if (!batchCount || NSMaxRange(_lines[i]) - _lines[batchStarts[batchCount - 1]].location > RKXLineBatchLength) { batchStarts[batchCount++] = i; }
+    }
+
+    batchStarts[batchCount] = _lineCount;
+    while (_buffers.count < batchCount) { [_buffers addObject:[[RKXMatchBuffer alloc] init]]; }
+
+    if (batchCount == 1) {
+        [self matchLinesFromIndex:0 toIndex:_lineCount buffer:_buffers[0]];
+    }
+    else {
+        dispatch_apply(batchCount, DISPATCH_APPLY_AUTO, ^(size_t batch) {
+            [self matchLinesFromIndex:batchStarts[batch] toIndex:batchStarts[batch + 1] buffer:self->_buffers[batch]];
+        });
+    }
+
+    for (NSUInteger batch = 0; batch < batchCount && !_finished; batch++) {
+        RKXMatchBuffer *buffer = _buffers[batch];
+        NSUInteger nextMatch = 0;
+
+        for (NSUInteger i = batchStarts[batch]; i < batchStarts[batch + 1] && !_finished; i++) {
+            NSUInteger count = (_inverted) ? 0 : _counts[i];
+            [self reportLine:_lines[i] matched:(_counts[i] > 0) ranges:(count) ? [buffer rangesOfMatchAtIndex:nextMatch] : NULL count:count];
+            nextMatch += count;
+        }
+    }
+
+    free(batchStarts);
+    _lineCount = 0;
+    return YES;
+}
+
+/// Counts the matches in the lines from @c first up to @c last of the wave and keeps their ranges in @c buffer. Only whether a line matches is needed when the search is inverted. Runs on a worker thread.
+- (void)matchLinesFromIndex:(NSUInteger)first toIndex:(NSUInteger)last buffer:(RKXMatchBuffer *)buffer
+{
+    NSUInteger limit = (_inverted) ? 1 : NSUIntegerMax;
+    [buffer resetWithRangesPerMatch:1];
+
+    if (_regex.numberOfCaptureGroups == 0 && [_linearProgram countOfMatchesInLines:_lines + first count:last - first ofString:_string limit:limit counts:_counts + first buffer:buffer]) { return; }
+
+    for (NSUInteger i = first; i < last; i++) {
+        // Patterns a backtracking engine could take super-linear time on stay on the linear-time engine.
+        NSArray<NSTextCheckingResult *> *linearMatches = (_linearProgram.prefersLinearEngine) ? [_linearProgram matchesInString:_string range:_lines[i] matchOptions:kNilOptions regularExpression:_regex] : nil;
+        __block NSUInteger count = 0;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+        void (^addMatch)(NSTextCheckingResult *, NSMatchingFlags, BOOL *) = ^(NSTextCheckingResult * _Nullable result, NSMatchingFlags flags, BOOL * _Nonnull stop) {
+            if (!result) { return; }
+
+            if (limit != 1) {
+                NSRange *slot = [buffer appendMatch];
+                if (!slot) { *stop = YES; return; }
+                *slot = result.range;
+            }
+
+            if (++count == limit) { *stop = YES; }
+        };
+#pragma clang diagnostic pop
+
+        if (linearMatches) {
+            BOOL stop = NO;
+            for (NSUInteger j = 0; j < linearMatches.count && !stop; j++) { addMatch(linearMatches[j], 0, &stop); }
+        }
+        else {
+            [_regex enumerateMatchesInString:_string options:kNilOptions range:_lines[i] usingBlock:addMatch];
+        }
+
+        _counts[i] = count;
+    }
+}
+
+- (void)addResultForLine:(NSRange)line number:(NSUInteger)lineNumber matchRanges:(const NSRange *)ranges count:(NSUInteger)count contextLine:(BOOL)contextLine
+{
+    NSMutableArray<NSValue *> *matchRanges = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) { [matchRanges addRange:ranges[i]]; }
+    [_results addObject:[[RKXLineMatch alloc] initWithLineNumber:lineNumber lineRange:line matchRanges:matchRanges contextLine:contextLine]];
+}
+
+/// Reports the next line: as a selected line, as context after an earlier one, or not yet, in case the context before a later one needs it.
+- (void)reportLine:(NSRange)line matched:(BOOL)matched ranges:(const NSRange *)ranges count:(NSUInteger)count
+{
+    NSUInteger lineNumber = ++_lineNumber;
+    BOOL limitReached = (_limit && _selectedCount >= _limit);
+    BOOL selected = (matched != _inverted) && !limitReached;
+
+    if (selected) {
+        NSUInteger oldest = (_ringNext + _linesBefore - _ringCount) % MAX(_linesBefore, 1UL);
+
+        for (NSUInteger i = 0; i < _ringCount; i++) {
+            [self addResultForLine:_linesBeforeRing[(oldest + i) % _linesBefore] number:lineNumber - _ringCount + i matchRanges:NULL count:0 contextLine:YES];
+        }
+
+        _ringCount = 0;
+        [self addResultForLine:line number:lineNumber matchRanges:ranges count:count contextLine:NO];
+        _selectedCount++;
+        _pendingLinesAfter = _linesAfter;
+    }
+    else if (_pendingLinesAfter) {
+        [self addResultForLine:line number:lineNumber matchRanges:NULL count:0 contextLine:YES];
+        _pendingLinesAfter--;
+    }
+    else if (_linesBefore && !limitReached) {
+        _linesBeforeRing[_ringNext] = line;
+        _ringNext = (_ringNext + 1) % _linesBefore;
+        _ringCount = MIN(_ringCount + 1, _linesBefore);
+    }
+
+    if (_limit && _selectedCount >= _limit && !_pendingLinesAfter) { _finished = YES; }
+}
+
+@end
+
+/// YES if a search range of length characters is worth splitting for regex, and splitting it into pieces that
+/// start just after line terminators finds the same matches as one search over the whole range. That needs
+/// matches that cannot contain a line terminator, ICU rather than the linear-time engine, and match options
+/// that leave the search bounds alone.
+static BOOL RKXRegexCanBePartitioned(NSRegularExpression *regex, RKXMatchOptions matchOptions, NSUInteger length)
+{
+    if (length < 2 * RKXReplacementPartitionLength) { return NO; }
+    if (matchOptions & (RKXReportProgress | RKXAnchored | RKXWithTransparentBounds | RKXWithoutAnchoringBounds)) { return NO; }
+    if (OptionsHasValue(regex.options, RKXUseUnixLineSeparators)) { return NO; }
+    if ([RKXLinearProgram linearProgramForRegex:regex].prefersLinearEngine) { return NO; }
+    RKXSyntaxTree *tree = [RKXSyntaxTree syntaxTreeForRegex:regex];
+    return tree && !RKXNodeCanSpanLines(tree.syntax, tree.syntax->root);
+}
+
+/// YES if the last match of regex can be found by searching windows that start at a line, from the end of the
+/// search range back. Matches that cannot contain a line terminator or look before their line are found the same
+/// from any line on, so the last match in the first window that has one is the last match of the whole range.
+static BOOL RKXRegexCanSearchBackward(NSRegularExpression *regex, RKXMatchOptions matchOptions)
+{
+    if (matchOptions & (RKXReportProgress | RKXAnchored | RKXWithTransparentBounds | RKXWithoutAnchoringBounds)) { return NO; }
+    if (OptionsHasValue(regex.options, RKXUseUnixLineSeparators)) { return NO; }
+    if ([RKXLinearProgram linearProgramForRegex:regex].prefersLinearEngine) { return NO; }
+    RKXSyntaxTree *tree = [RKXSyntaxTree syntaxTreeForRegex:regex];
+    return tree && !RKXNodeCanSpanLines(tree.syntax, tree.syntax->root) && !RKXNodeLooksBeforeLine(tree.syntax, tree.syntax->root);
+}
+
+/// Runs consume for the items produce submits, a wave of batches at a time. Each wave runs concurrently while
+/// produce fills the next one, so no more than two waves are ever held. A batch stops at the first item whose
+/// consume sets stop and the other batches of its wave run to completion, so consume has run for every item
+/// before the earliest one that stopped. No wave starts after that, and submit returns NO to tell produce so.
+/// Returns YES if consume set stop.
+static BOOL RKXEnumerateInWaves(void (NS_NOESCAPE ^produce)(BOOL (^submit)(id item)), void (NS_NOESCAPE ^consume)(id item, BOOL *stop))
+{
+    NSUInteger maxBatchCount = NSProcessInfo.processInfo.activeProcessorCount * 4, waveLength = RKXEnumerationBatchLength * maxBatchCount;
+    BOOL *stops = malloc(maxBatchCount * sizeof(BOOL));
+
+    if (!stops) {
+        __block BOOL stopped = NO;
+        produce(^BOOL(id item) { consume(item, &stopped); return !stopped; });
+        return stopped;
+    }
+
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(qos_class_self(), 0);
+    NSMutableArray *wave = [NSMutableArray arrayWithCapacity:waveLength];
+    __block BOOL stopped = NO;   // written by the running wave, so only read once the group is idle
+
+    BOOL (^startWave)(void) = ^BOOL{
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+        if (stopped) { return NO; }
+        if (!wave.count) { return YES; }
+        NSArray *items = [wave copy];
+        [wave removeAllObjects];
+        NSUInteger count = items.count, batchCount = (count + RKXEnumerationBatchLength - 1) / RKXEnumerationBatchLength;
+        memset(stops, 0, batchCount * sizeof(BOOL));
+
+        // The wave is waited for before this function returns, so it cannot outlive consume.
+        dispatch_group_async(group, queue, ^{
+            dispatch_apply(batchCount, DISPATCH_APPLY_AUTO, ^(size_t b) {
+                @autoreleasepool {
+                    NSUInteger end = MIN((b + 1) * RKXEnumerationBatchLength, count);
+                    for (NSUInteger i = b * RKXEnumerationBatchLength; i < end && !stops[b]; i++) { consume(items[i], &stops[b]); }
+                }
+            });
+
+            for (NSUInteger b = 0; b < batchCount; b++) { stopped = stopped || stops[b]; }
+        });
+
+        return YES;
+    };
+
+    produce(^BOOL(id item) {
+        [wave addObject:item];
+        return (wave.count < waveLength) ? YES : startWave();
+    });
+
+    startWave();
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    free(stops);
+    return stopped;
+}
+
+#pragma mark -
+
+// The match cache is opt-in. Each thread keeps its own in its thread dictionary, next to its regex cache, so
+// lookups never wait on another thread. The caches are also listed in RKXMatchCaches so that a new byte limit
+// reaches all of them; that is the only time a cache is used off its own thread.
+
+static NSString *const RKXMatchCacheKey = @"RKXMatchCache";
+static NSString *const RKXRegexCompileCountKey = @"RKXRegexCompileCount";
+static _Atomic(NSUInteger) RKXMatchCacheByteLimit = 0;
+
+/// The ranges of the whole matches of one search, stored compactly, with the text they were found in.
+@interface RKXMatchCacheEntry : NSObject
+@property (nonatomic, readonly) NSString *text;
+@property (nonatomic, readonly) BOOL comparesText;
+@property (nonatomic, readonly) const NSRange *ranges;
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic) NSUInteger cost;
+- (instancetype)initWithText:(NSString *)text comparesText:(BOOL)comparesText ranges:(NSArray<NSValue *> *)ranges;
+@end
+
+@implementation RKXMatchCacheEntry
+{
+    NSRange *_ranges;
+}
+
+/// @c text is the immutable string the ranges were found in, which keeps its address from being reused while the entry lives, or a copy of the contents of a mutable string, which @c comparesText says the string must still equal.
+- (instancetype)initWithText:(NSString *)text comparesText:(BOOL)comparesText ranges:(NSArray<NSValue *> *)ranges
+{
+    if ((self = [super init])) {
+        _count = ranges.count;
+        _ranges = malloc(MAX(_count, 1UL) * sizeof(NSRange));
+        if (!_ranges) { return nil; }
+        for (NSUInteger i = 0; i < _count; i++) { _ranges[i] = [ranges rangeAtIndex:i]; }
+        _text = text;
+        _comparesText = comparesText;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_ranges);
+}
+
+- (const NSRange *)ranges
+{
+    return _ranges;
+}
+
+@end
+
+/// One thread's match cache. Entries are dropped least recently used first once their cost passes the byte limit.
+/// The cache is only locked against @c +trimAllToByteLimit:, so the lock is almost never contended.
+@interface RKXMatchCache : NSObject
+@property (nonatomic, readonly) RKXMatchCacheStatistics statistics;
++ (instancetype)currentCache;
++ (void)trimAllToByteLimit:(NSUInteger)byteLimit;
+- (RKXMatchCacheEntry *)entryForKey:(NSString *)key string:(NSString *)string;
+- (void)setEntry:(RKXMatchCacheEntry *)entry forKey:(NSString *)key byteLimit:(NSUInteger)byteLimit;
+@end
+
+@implementation RKXMatchCache
+{
+    NSMutableDictionary<NSString *, RKXMatchCacheEntry *> *_entries;
+    NSMutableOrderedSet<NSString *> *_order;   // least recently used first
+    RKXMatchCacheStatistics _statistics;
+}
+
+static NSHashTable<RKXMatchCache *> *RKXMatchCaches;   // every thread's cache, weakly, under @synchronized(RKXMatchCaches)
+
++ (instancetype)currentCache
+{
+    NSMutableDictionary *threadDict = NSThread.currentThread.threadDictionary;
+    RKXMatchCache *cache = threadDict[RKXMatchCacheKey];
+
+    if (!cache) {
+        static dispatch_once_t onceToken;
+        dispatch_once(&onceToken, ^{
+            RKXMatchCaches = [NSHashTable weakObjectsHashTable];
+        });
+
+        cache = [[RKXMatchCache alloc] init];
+        threadDict[RKXMatchCacheKey] = cache;
+        @synchronized (RKXMatchCaches) { [RKXMatchCaches addObject:cache]; }
+    }
+
+    return cache;
+}
+
++ (void)trimAllToByteLimit:(NSUInteger)byteLimit
+{
+    if (!RKXMatchCaches) { return; }
+    NSArray<RKXMatchCache *> *caches;
+    @synchronized (RKXMatchCaches) { caches = RKXMatchCaches.allObjects; }
+
+    for (RKXMatchCache *cache in caches) {
+        @synchronized (cache) { [cache evictToByteLimit:byteLimit]; }
+    }
+}
+
+- (instancetype)init
+{
+    if ((self = [super init])) {
+        _entries = [NSMutableDictionary dictionary];
+        _order = [NSMutableOrderedSet orderedSet];
+    }
+
+    return self;
+}
+
+- (RKXMatchCacheStatistics)statistics
+{
+    @synchronized (self) {
+        RKXMatchCacheStatistics statistics = _statistics;
+        statistics.count = _entries.count;
+        return statistics;
+    }
+}
+
+- (void)removeEntryForKey:(NSString *)key
+{
+    _statistics.bytes -= _entries[key].cost;
+    [_entries removeObjectForKey:key];
+    [_order removeObject:key];
+}
+
+- (void)evictToByteLimit:(NSUInteger)byteLimit
+{
+    while (_order.count && _statistics.bytes > byteLimit) {
+        [self removeEntryForKey:_order.firstObject];
+        _statistics.evictions++;
+    }
+}
+
+/// Returns the entry for @c key, or @c nil if there is none or if @c string has changed since the entry was stored.
+- (RKXMatchCacheEntry *)entryForKey:(NSString *)key string:(NSString *)string
+{
+    @synchronized (self) {
+        RKXMatchCacheEntry *entry = _entries[key];
+
+        if (entry.comparesText && ![entry.text isEqualToString:string]) {
+            [self removeEntryForKey:key];
+            _statistics.invalidations++;
+            entry = nil;
+        }
+
+        if (!entry) {
+            _statistics.misses++;
+            return nil;
+        }
+
+        _statistics.hits++;
+        [_order removeObject:key];
+        [_order addObject:key];
+        return entry;
+    }
+}
+
+/// Stores @c entry, whose cost counts the text it keeps alive as well as its ranges and key.
+- (void)setEntry:(RKXMatchCacheEntry *)entry forKey:(NSString *)key byteLimit:(NSUInteger)byteLimit
+{
+    entry.cost = entry.count * sizeof(NSRange) + (key.length + entry.text.length) * sizeof(unichar);
+    if (entry.cost > byteLimit) { return; }
+
+    @synchronized (self) {
+        if (_entries[key]) { [self removeEntryForKey:key]; }
+        [self evictToByteLimit:byteLimit - entry.cost];
+        _entries[key] = entry;
+        [_order addObject:key];
+        _statistics.bytes += entry.cost;
+    }
+}
+
+@end
+
+#pragma mark -
+@implementation NSString (RegexKitX)
+
+#pragma mark - Caching Methods
+
+/**
+ Returns a key string to be used to access the stored @c NSRegularExpression object.
+
+ @param pattern The pattern to match.
+ @param options The options used for the @c NSRegularExpression.
+ @return The cache key representation of the regex pattern with options.
+ */
++ (NSString *)cacheKeyForRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    NSString *key = [NSString stringWithFormat:@"%@_%lu", pattern, options];
+    return key;
+}
+
+/**
+ Creates and/or returns the canonical @c NSRegularExpression object from the current thread dictionary for a given pattern. This is utilized to cut down on excessive @c NSRegularExpression object creation for each API call.
+
+ @param pattern The regex pattern to be matched against.
+ @param options The regex options used for matching.
+ @param error The error object indirectly returned if instantiation of the @c NSRegularExpression fails.
+ @return The @c NSRegularExpression object created and stored in the current thread's dictionary.
+ */
++ (NSRegularExpression *)cachedRegexForPattern:(NSString *)pattern options:(RKXRegexOptions)options error:(NSError **)error
+{
+    NSString *patternKey = [NSString cacheKeyForRegex:pattern options:options];
+    NSRegularExpression *regex = NSThread.currentThread.threadDictionary[patternKey];
+
+    if (!regex) {
+        NSRegularExpressionOptions regexOptions = (NSRegularExpressionOptions)options;
+        regex = [NSRegularExpression regularExpressionWithPattern:pattern options:regexOptions error:error];
+        if (!regex) { return nil; }
+        NSMutableDictionary *threadDict = NSThread.currentThread.threadDictionary;
+        threadDict[patternKey] = regex;
+        threadDict[RKXRegexCompileCountKey] = @([threadDict[RKXRegexCompileCountKey] unsignedIntegerValue] + 1);
+    }
+    
+    return regex;
+}
+
+#pragma mark - DRY Utility Methods
+
+/// The fundamental matching method of RegexKitX. It invokes @c -enumerateMatchesInString:options:range:usingBlock: or @c -matchesInString:options:range: on @c NSRegularExpression. The default timeout interval is 1.0 seconds.
+/// @discussion If a timeout occurs and @c error is not @c NULL, a @c NSError object is returned with the timeout information.
+/// @discussion Patterns that the linear-time engine can run and that @c -regexComplexityWithOptions:hazards:riskScore:error: scores 50 or more, such as @c (a+)+b, are matched by it instead of ICU. All other patterns stay on ICU, even when it times out.
+/// @discussion If something deeper-in-the-weeds regarding the use of @c -enumerateMatchesInString:options:range:usingBlock: comes up, it is *strongly* recommended that the developer use THAT API DIRECTLY or consider changing her course of matching action.
+/// @param pattern A @c NSString containing a regular expression.
+/// @param searchRange The range of the receiver to search.
+/// @param options A bit mask that specifies the options for regular expression matching. See @c RKXRegexOptions for details. Either @c 0 or @c RKXNoOptions may be used if no options are required.
+/// @param matchOptions A bit mask that specifies the options for reporting, completion, and matching rules. See @c RKXMatchOptions for details.
+/// @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. This may be set to @c NULL if information about any errors is not required.
+/// @return Returns an array of @c NSTextCheckingResult objects indicating where matches occurred.
+/// @return Will return @c nil if an error occurs and indirectly returns a @c NSError object if @c error is not @c NULL.
+- (NSArray<NSTextCheckingResult *> *)_matchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSCParameterAssert(pattern);
+    NSCAssert(searchRange.length <= self.length, @"searchRange.length (%lu) is greater than string length (%lu)", searchRange.length, self.length);
+    NSCAssert(searchRange.location <= (self.length - 1), @"searchRange.location (%lu) is invalid and past the string length", searchRange.location);
+    
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!regex) { return nil; }
+    return [self _matchesForRegularExpression:regex range:searchRange matchOptions:matchOptions error:error];
+}
+
+/// The counterpart of @c -_matchesForRegex:range:options:matchOptions:error: for callers that only read the range of each whole match. It matches with the capture-free copy of the regex, so the results have no group ranges.
+- (NSArray<NSTextCheckingResult *> *)_wholeMatchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSCParameterAssert(pattern);
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!regex) { return nil; }
+    return [self _matchesForRegularExpression:RKXCaptureFreeRegex(regex) range:searchRange matchOptions:matchOptions error:error];
+}
+
+/// The body of @c -_matchesForRegex:range:options:matchOptions:error: for a regex that was already looked up, used by callers that keep their @c NSRegularExpression, such as @c RKXExtractionSchema.
+- (NSArray<NSTextCheckingResult *> *)_matchesForRegularExpression:(NSRegularExpression *)regex range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSMatchingOptions matchOpts = (NSMatchingOptions)matchOptions;
+    RKXLinearProgram *linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+
+    if (linearProgram.prefersLinearEngine) {
+        NSArray *linearMatches = [linearProgram matchesInString:self range:searchRange matchOptions:matchOptions regularExpression:regex];
+        if (linearMatches) { return linearMatches; }
+    }
+
+    if (OptionsHasValue(matchOpts, NSMatchingReportProgress)) {
+        NSMutableArray *matches = [NSMutableArray array];
+        NSDate *start = [NSDate date];
+        __block NSTimeInterval delta = 0.0;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+        [regex enumerateMatchesInString:self options:matchOpts range:searchRange usingBlock:^(NSTextCheckingResult * _Nullable result, NSMatchingFlags flags, BOOL * _Nonnull stop) {
+            NSDate *now = [NSDate date];
+            delta = [now timeIntervalSinceDate:start];
+            if (result && ![matches containsObject:result]) { [matches addObject:result]; }
+            if (delta > RKXTimeoutInterval) { *stop = YES; }
+        }];
+#pragma clang diagostic pop
+
+        if (delta > RKXTimeoutInterval) {
+            if (error != NULL) { *error = NSRegularExpression.timeoutError; }
+        }
+
+        return [matches copy];
+    }
+
+    NSArray *matches = [regex matchesInString:self options:matchOpts range:searchRange];
+    return matches;
+}
+
+/// The cancellable counterpart of @c -_matchesForRegex:range:options:matchOptions:error: used by the asynchronous API. Matches are handed to @c block as the engine finds them instead of being collected first.
+/// @discussion The enumeration always runs with @c NSMatchingReportProgress so that cancelling @c progress stops the engine at its next progress callback, not at its next match. @c progress.completedUnitCount tracks the end of the latest match relative to @c searchRange.location and is set to @c progress.totalUnitCount once the scan finishes. As in the synchronous API, the @c RKXTimeoutInterval timeout only applies if @c matchOptions contains @c RKXReportProgress.
+/// @discussion Patterns that @c -_matchesForRegex:range:options:matchOptions:error: hands to the linear-time engine are matched by it up front here too; their matches are then delivered one by one with the same cancellation checks.
+/// @param pattern A @c NSString containing a regular expression.
+/// @param searchRange The range of the receiver to search.
+/// @param options A bit mask that specifies the options for regular expression matching. See @c RKXRegexOptions for details.
+/// @param matchOptions A bit mask that specifies the options for reporting, completion, and matching rules. See @c RKXMatchOptions for details.
+/// @param progress The progress object that receives the scanned fraction of @c searchRange and whose cancellation stops the scan.
+/// @param error An optional parameter that if set and an error occurs, will contain a @c NSError object that describes the problem. Cancellation is reported as @c NSUserCancelledError in @c NSCocoaErrorDomain.
+/// @param block The block executed for each match. Setting @c stop to @c YES ends the scan without an error.
+/// @return Returns @c YES if the scan finished or was stopped by @c block, otherwise returns @c NO and indirectly returns a @c NSError object if @c error is not @c NULL.
+- (BOOL)_enumerateMatchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions progress:(NSProgress *)progress error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSTextCheckingResult *match, BOOL *stop))block
+{
+    NSCParameterAssert(pattern);
+    NSCParameterAssert(progress);
+    NSCAssert(NSMaxRange(searchRange) <= self.length, @"searchRange (%@) is past the string length (%lu)", NSStringFromRange(searchRange), self.length);
+
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!regex) { return NO; }
+    BOOL timesOut = OptionsHasValue(matchOptions, RKXReportProgress);
+    NSMatchingOptions matchOpts = (NSMatchingOptions)(matchOptions | RKXReportProgress);
+    NSDate *start = [NSDate date];
+    __block BOOL timedOut = NO;
+    RKXLinearProgram *linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+    NSArray *linearMatches = (linearProgram.prefersLinearEngine) ? [linearProgram matchesInString:self range:searchRange matchOptions:matchOptions regularExpression:regex] : nil;
+
+    if (linearMatches) {
+        BOOL stop = NO;
+
+        for (NSTextCheckingResult *result in linearMatches) {
+            if (progress.isCancelled) { break; }
+            progress.completedUnitCount = (int64_t)(NSMaxRange(result.range) - searchRange.location);
+            block(result, &stop);
+            if (stop) { break; }
+        }
+    }
+    else if (!progress.isCancelled) {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+        [regex enumerateMatchesInString:self options:matchOpts range:searchRange usingBlock:^(NSTextCheckingResult * _Nullable result, NSMatchingFlags flags, BOOL * _Nonnull stop) {
+            if (progress.isCancelled) { *stop = YES; return; }
+            if (timesOut && [[NSDate date] timeIntervalSinceDate:start] > RKXTimeoutInterval) { timedOut = YES; *stop = YES; return; }
+            if (!result) { return; }
+            progress.completedUnitCount = (int64_t)(NSMaxRange(result.range) - searchRange.location);
+            block(result, stop);
+        }];
+#pragma clang diagnostic pop
+    }
+
+    if (progress.isCancelled) {
+        if (error != NULL) { *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil]; }
+        return NO;
+    }
+
+    if (timedOut) {
+        if (error != NULL) { *error = NSRegularExpression.timeoutError; }
+        return NO;
+    }
+
+    progress.completedUnitCount = progress.totalUnitCount;
+    return YES;
+}
+
+/// The capture-free counterpart of @c -_matchesForRegex:range:options:matchOptions:error:. Patterns the linear-time engine can run are scanned with its lazy DFA, which only finds where each whole match starts and ends but does so without building @c NSTextCheckingResult objects or running ICU.
+/// @discussion The scan stops once @c limit matches have been found. If @c ranges is not @c nil, the range of each match is added to it; if it is @c nil and the pattern cannot match the empty string, only the ends of the matches are looked for.
+/// @param pattern A @c NSString containing a regular expression.
+/// @param searchRange The range of the receiver to search.
+/// @param options A bit mask that specifies the options for regular expression matching. See @c RKXRegexOptions for details.
+/// @param matchOptions A bit mask that specifies the options for reporting, completion, and matching rules. See @c RKXMatchOptions for details.
+/// @param limit The maximum number of matches to find.
+/// @param ranges An optional array that receives the range of each match as a @c NSValue.
+/// @return Returns the number of matches found, or @c NSNotFound if the pattern is invalid, is not eligible for the linear-time engine or outgrew the DFA's state cache, in which case the caller should fall back to @c -_matchesForRegex:range:options:matchOptions:error:.
+- (NSUInteger)_countOfMatchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions limit:(NSUInteger)limit ranges:(NSMutableArray<NSValue *> *)ranges
+{
+    NSCParameterAssert(pattern);
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:NULL];
+    if (!regex) { return NSNotFound; }
+    RKXLinearProgram *linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+    if (!linearProgram) { return NSNotFound; }
+    return [linearProgram countOfMatchesInString:self range:searchRange matchOptions:matchOptions limit:limit ranges:ranges];
+}
+
+/// Returns the ranges of the whole matches of @c pattern within @c searchRange from the current thread's match cache, finding and storing all of them if the cache has none for the call.
+/// @discussion Returns @c nil if the cache is off, if @c matchOptions contains @c RKXReportProgress, or if the search fails, in which case the caller searches as it would without the cache and reports any error.
+- (RKXMatchCacheEntry *)_cachedWholeMatchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions
+{
+    NSUInteger byteLimit = atomic_load_explicit(&RKXMatchCacheByteLimit, memory_order_relaxed);
+    if (!byteLimit || OptionsHasValue(matchOptions, RKXReportProgress)) { return nil; }
+    RKXMatchCache *cache = [RKXMatchCache currentCache];
+    NSString *key = [NSString stringWithFormat:@"%p_%lu_%lu_%lu_%lu_%@", self, options, matchOptions, searchRange.location, searchRange.length, pattern];
+    RKXMatchCacheEntry *entry = [cache entryForKey:key string:self];
+    if (entry) { return entry; }
+
+    NSMutableArray<NSValue *> *ranges = [NSMutableArray array];
+
+    if ([self _countOfMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions limit:NSUIntegerMax ranges:ranges] == NSNotFound) {
+        NSArray<NSTextCheckingResult *> *matches = [self _wholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:NULL];
+        if (!matches) { return nil; }
+        [ranges removeAllObjects];
+        for (NSTextCheckingResult *match in matches) { [ranges addRange:match.range]; }
+    }
+
+    // Copying an immutable string returns the same instance, so only the contents of mutable strings are copied.
+    NSString *text = [self copy];
+    entry = [[RKXMatchCacheEntry alloc] initWithText:text comparesText:(text != self) ranges:ranges];
+    if (entry) { [cache setEntry:entry forKey:key byteLimit:byteLimit]; }
+    return entry;
+}
+
+/// Snapshots the receiver and schedules @c work on @c queue with a fresh, unparented progress object, which is returned to the caller as the cancellation token.
+- (NSProgress *)_progressForAsyncWorkInRange:(NSRange)searchRange queue:(dispatch_queue_t)queue work:(void (^)(NSString *snapshot, NSProgress *progress))work
+{
+    NSCParameterAssert(queue);
+    NSString *snapshot = [self copy];
+    NSProgress *progress = [NSProgress discreteProgressWithTotalUnitCount:(int64_t)MAX(searchRange.length, 1UL)];
+
+    dispatch_async(queue, ^{
+        @autoreleasepool {
+            work(snapshot, progress);
+        }
+    });
+
+    return progress;
+}
+
+/// Returns the @c ${name} references in the receiver, a replacement template, that name capture groups defined in @c pattern, or @c nil if either side has no names at all. NSRegularExpression does not expand these itself (rdar://46309223).
+- (NSArray<NSString *> *)_namedReferencesForPattern:(NSString *)pattern
+{
+    NSArray *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
+    NSArray *backreferenceNames = [self _captureNamesWithMetaPattern:RKXNamedReferencePattern];
+    if (!captureNames || !backreferenceNames) { return nil; }
+
+    NSSet *captureNameSet = [NSSet setWithArray:captureNames];
+    NSMutableSet *backreferenceNameSetM = [NSMutableSet setWithArray:backreferenceNames];
+    [backreferenceNameSetM intersectSet:captureNameSet];
+    return [backreferenceNameSetM allObjects];
+}
+
+/// Returns @c templ with each @c ${name} reference listed in @c names replaced by the receiver's text captured under that name by @c match.
+- (NSString *)_template:(NSString *)templ byExpandingNamedReferences:(NSArray<NSString *> *)names forMatch:(NSTextCheckingResult *)match API_AVAILABLE(macos(10.13))
+{
+    NSMutableString *templateM = [templ mutableCopy];
+
+    for (NSString *groupName in names) {
+        // (?<name>...) <- define a named capture group named "name"
+        // ${name} <- captured named group reference
+        NSRange namedGroupRange = [match rangeWithName:groupName];
+        NSString *namedGroupCapture = [self substringWithRange:namedGroupRange];
+        NSString *templateCapturePattern = [NSString stringWithFormat:@"\\$\\{%@\\}", groupName];
+        NSArray<NSValue *> *templateRanges = [templateM rangesOfRegex:templateCapturePattern];
+
+        for (NSValue *range in [templateRanges reverseObjectEnumerator]) {
+            [templateM replaceCharactersInRange:range.rangeValue withString:namedGroupCapture];
+        }
+    }
+
+    return [templateM copy];
+}
+
+- (NSArray<NSString *> *)_captureNamesWithMetaPattern:(NSString *)metaPattern
+{
+    NSArray *nameCaptureMatches = [self _matchesForRegex:metaPattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (!nameCaptureMatches || !nameCaptureMatches.count) { return nil; }
+    NSMutableArray *nameMatchesM = [NSMutableArray array];
+
+    for (NSTextCheckingResult *match in nameCaptureMatches) {
+        NSRange nameRange = [match rangeAtIndex:1];
+        NSString *name = [self substringWithRange:nameRange];
+        [nameMatchesM addObject:name];
+    }
+
+    return [nameMatchesM copy];
+}
+
+/// The concurrent replacement behind the replacement methods that take @c NSEnumerationConcurrent. @c searchRange is split into pieces of about @c RKXReplacementPartitionLength characters that each start just after a line terminator; each piece is matched and rebuilt with its replacements on its own thread, and the rebuilt pieces are joined with a single copy.
+/// @discussion @c swapBlock is given each match relative to @c text, the characters within @c searchRange, and runs concurrently for matches in different pieces. Within a piece it runs from the last match to the first, as the serial methods do over the whole range, and setting @c stop leaves the earlier matches of the piece alone. Because the serial methods would never have reached the pieces before the last one that stopped, their replacements are discarded.
+/// @return Returns the characters within @c searchRange with the matches replaced, or @c nil if @c RKXRegexCanBePartitioned() rules the split out, in which case the caller replaces serially.
+- (NSString *)_stringByConcurrentlyReplacingMatchesOfRegularExpression:(NSRegularExpression *)regex range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions usingBlock:(NSString *(NS_NOESCAPE ^)(NSString *text, NSTextCheckingResult *match, BOOL *stop))swapBlock
+{
+    if (!RKXRegexCanBePartitioned(regex, matchOptions, searchRange.length)) { return nil; }
+
+    // A copy of the range keeps its ends the ends of the text, so ^, $ and lookbehind see what they would in a
+    // single search, while transparent, non-anchoring bounds let each piece see the text around it.
+    NSString *text = (NSEqualRanges(searchRange, self.stringRange)) ? self : [self substringWithRange:searchRange];
+    NSMatchingOptions matchOpts = (NSMatchingOptions)matchOptions | NSMatchingWithTransparentBounds | NSMatchingWithoutAnchoringBounds;
+    NSUInteger length = text.length, maxCount = length / RKXReplacementPartitionLength, count = 1;
+    NSUInteger *starts = malloc((maxCount + 1) * sizeof(NSUInteger));
+    if (!starts) { return nil; }
+    starts[0] = 0;
+
+    while (count < maxCount) {
+        NSUInteger from = MAX(count * RKXReplacementPartitionLength, starts[count - 1]);
+        NSRange terminator = [text rangeOfCharacterFromSet:NSCharacterSet.newlineCharacterSet options:NSLiteralSearch range:NSMakeRange(from, length - from)];
+        if (terminator.location == NSNotFound || NSMaxRange(terminator) >= length) { break; }
+        starts[count++] = NSMaxRange(terminator);
+    }
+
+    BOOL *rebuilt = calloc(count, sizeof(BOOL)), *stopped = calloc(count, sizeof(BOOL));
+    if (count < 2 || !rebuilt || !stopped) { free(starts); free(rebuilt); free(stopped); return nil; }
+    starts[count] = length;
+    NSMutableArray<NSMutableString *> *segments = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) { [segments addObject:[NSMutableString string]]; }
+
+    dispatch_apply(count, DISPATCH_APPLY_AUTO, ^(size_t i) {
+        @autoreleasepool {
+            NSRange piece = NSMakeRange(starts[i], starts[i + 1] - starts[i]);
+            NSArray<NSTextCheckingResult *> *matches = [regex matchesInString:text options:matchOpts range:piece];
+            NSUInteger kept = matches.count;
+            // An empty match at the end of a piece is found again at the start of the next one, which keeps it.
+            while (kept && matches[kept - 1].range.location >= NSMaxRange(piece)) { kept--; }
+            if (!kept) { return; }
+            NSMutableArray<NSString *> *swaps = [NSMutableArray arrayWithCapacity:kept];
+            NSUInteger first = kept;
+            BOOL stop = NO;
+
+            while (first > 0 && !stop) {
+                first--;
+                [swaps addObject:swapBlock(text, matches[first], &stop)];
+            }
+
+            NSMutableString *segment = segments[i];
+            NSUInteger pos = piece.location;
+
+            for (NSUInteger m = first; m < kept; m++) {
+                NSRange range = matches[m].range;
+                [segment appendString:[text substringWithRange:NSMakeRange(pos, range.location - pos)]];
+                [segment appendString:swaps[kept - 1 - m]];
+                pos = NSMaxRange(range);
+            }
+
+            [segment appendString:[text substringWithRange:NSMakeRange(pos, NSMaxRange(piece) - pos)]];
+            rebuilt[i] = YES;
+            stopped[i] = stop;
+        }
+    });
+
+    // The serial methods never reach the pieces before the last one that stopped, so those keep their text.
+    NSUInteger firstReplaced = 0;
+
+    for (NSUInteger i = count; i > 0; i--) {
+        if (stopped[i - 1]) { firstReplaced = i - 1; break; }
+    }
+
+    NSUInteger resultLength = starts[firstReplaced];
+    BOOL anyRebuilt = NO;
+
+    for (NSUInteger i = firstReplaced; i < count; i++) {
+        if (rebuilt[i]) { anyRebuilt = YES; }
+        resultLength += (rebuilt[i]) ? segments[i].length : starts[i + 1] - starts[i];
+    }
+
+    NSString *result = (text == self) ? [self copy] : text;
+
+    if (anyRebuilt) {
+        unichar *chars = malloc(MAX(resultLength, 1UL) * sizeof(unichar));
+        result = nil;
+
+        if (chars) {
+            [text getCharacters:chars range:NSMakeRange(0, starts[firstReplaced])];
+            NSUInteger offset = starts[firstReplaced];
+
+            for (NSUInteger i = firstReplaced; i < count; i++) {
+                NSString *source = (rebuilt[i]) ? segments[i] : text;
+                NSRange sourceRange = (rebuilt[i]) ? segments[i].stringRange : NSMakeRange(starts[i], starts[i + 1] - starts[i]);
+                [source getCharacters:chars + offset range:sourceRange];
+                offset += sourceRange.length;
+            }
+
+            result = [[NSString alloc] initWithCharactersNoCopy:chars length:resultLength freeWhenDone:YES];
+        }
+    }
+
+    free(starts);
+    free(rebuilt);
+    free(stopped);
+    return result;
+}
+
+#pragma mark - arrayOfCaptureSubstringsMatchedByRegex:
+
+- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern
+{
+    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self arrayOfCaptureSubstringsMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSArray *> *)arrayOfCaptureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[]; }
+    NSMutableArray *matchCaptures = [NSMutableArray array];
+
+    for (NSTextCheckingResult *match in matches) {
+        [matchCaptures addObject:[match substringsFromString:self]];
+    }
+
+    return [matchCaptures copy];
+}
+
+#pragma mark - arrayOfDictionariesMatchedByRegex:
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return dictArray;
+}
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return dictArray;
+}
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:NULL];
+    return dictArray;
+}
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:error];
+    return dictArray;
+}
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSArray *dictArray = [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:matchOptions error:error];
+    return dictArray;
+}
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self arrayOfDictionariesMatchedByRegex:pattern range:searchRange withKeys:keys forCaptures:captures options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSDictionary *> *)arrayOfDictionariesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError * __autoreleasing *)error
+{
+    RKXExtractionSchema *schema = [[RKXExtractionSchema alloc] initWithRegex:pattern options:options keys:keys forCaptures:captures error:error];
+    return [schema arrayOfDictionariesMatchedInString:self range:searchRange matchOptions:matchOptions error:error];
+}
+
+#pragma mark - captureCount:
+
+- (NSUInteger)captureCount
+{
+    NSError *error;
+    return [self captureCountWithOptions:RKXNoOptions error:&error];
+}
+
+- (NSUInteger)captureCountWithOptions:(RKXRegexOptions)options error:(NSError **)error
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:error];
+    if (!regex) { return NSNotFound; }
+    return regex.numberOfCaptureGroups;
+}
+
+#pragma mark - captureSubstringsMatchedByRegex:
+
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern
+{
+    return [self captureSubstringsMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self captureSubstringsMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self captureSubstringsMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self captureSubstringsMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[]; }
+    return [matches.firstObject substringsFromString:self];
+}
+
+- (NSArray<NSString *> *)captureSubstringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions internTable:(RKXInternTable *)internTable error:(NSError **)error
+{
+    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[]; }
+    if (!internTable) { internTable = [[RKXInternTable alloc] init]; }
+    NSTextCheckingResult *match = matches.firstObject;
+    NSMutableArray *substrings = [NSMutableArray arrayWithCapacity:match.numberOfRanges];
+
+    for (NSUInteger i = 0; i < match.numberOfRanges; i++) {
+        NSRange captureRange = [match rangeAtIndex:i];
+        [substrings addObject:(captureRange.location != NSNotFound) ? [internTable internedSubstringOfString:self range:captureRange] : RKXEmptyStringKey];
+    }
+
+    return [substrings copy];
+}
+
+#pragma mark - dictionaryMatchedByRegex:
+
+- (NSArray *)_keysForVarArgsList:(va_list)varArgsList withFirstKey:(id)firstKey indexes:(NSArray **)captureIndexes
+{
+    NSMutableArray *captureKeys = [NSMutableArray array];
+    NSMutableArray *captureKeyIndexes = [NSMutableArray array];
+    NSUInteger captureKeysCount = 0UL;
+
+    if (varArgsList != NULL) {
+        while (captureKeysCount < 32UL) {
+            id  thisCaptureKey = (captureKeysCount == 0) ? firstKey : va_arg(varArgsList, id);
+            if (RKX_EXPECTED(thisCaptureKey == NULL, 0L)) { break; }
+            int thisCaptureKeyIndex = va_arg(varArgsList, int);
+            [captureKeys addObject:thisCaptureKey];
+            [captureKeyIndexes addObject:@(thisCaptureKeyIndex)];
+            captureKeysCount++;
+        }
+    }
+
+    *captureIndexes = [captureKeyIndexes copy];
+    return [captureKeys copy];
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL ];
+    return dict;
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *keys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern  range:searchRange withKeys:keys forCaptures:captureKeyIndexes options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return dict;
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:self.stringRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:NULL];
+    return dict;
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:kNilOptions error:error];
+    return dict;
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error withKeysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
+{
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [self _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    NSDictionary *dict = [self dictionaryMatchedByRegex:pattern range:searchRange withKeys:captureKeys forCaptures:captureKeyIndexes options:options matchOptions:matchOptions error:error];
+    return dict;
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self dictionaryMatchedByRegex:pattern range:searchRange withKeys:keys forCaptures:captures options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange withKeys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    RKXExtractionSchema *schema = [[RKXExtractionSchema alloc] initWithRegex:pattern options:options keys:keys forCaptures:captures error:error];
+    return [schema dictionaryMatchedInString:self range:searchRange matchOptions:matchOptions error:error];
+}
+
+#pragma mark - dictionaryWithNamedCaptureKeysMatchedByRegex:
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern
+{
+    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self dictionaryWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSDictionary<NSString *, NSString *> *)dictionaryWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    // One match serves every name, where looking each name up with rangeOfRegex: would match the pattern again.
+    RKXQuery *query = [RKXQuery queryWithRegex:pattern options:options outputs:RKXQueryNamedCaptures error:error];
+    if (!query) { return nil; }
+    return [query resultInString:self range:searchRange matchOptions:matchOptions error:error].namedCaptures;
+}
+
+#pragma mark - isMatchedByRegex:
+
+- (BOOL)isMatchedByRegex:(NSString *)pattern
+{
+    return [self isMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (BOOL)isMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self isMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (BOOL)isMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self isMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (BOOL)isMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self isMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (BOOL)isMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    RKXMatchCacheEntry *cached = [self _cachedWholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions];
+    if (cached) { return (cached.count > 0); }
+    NSUInteger count = [self _countOfMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions limit:1 ranges:nil];
+    if (count != NSNotFound) { return (count > 0); }
+    NSArray<NSTextCheckingResult *> *matches = [self _wholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches || matches.count == 0) { return NO; }
+    return YES;
+}
+
+#pragma mark - isRegexValid
+
+- (BOOL)isRegexValid
+{
+    return [self isRegexValidWithOptions:RKXNoOptions error:NULL];
+}
+
+- (BOOL)isRegexValidWithOptions:(RKXRegexOptions)options error:(NSError **)error
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:error];
+    if (!regex) { return NO; }
+    return YES;
+}
+
+- (BOOL)isRegexLinearTimeEligibleWithOptions:(RKXRegexOptions)options
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:NULL];
+    if (!regex) { return NO; }
+    return ([RKXLinearProgram linearProgramForRegex:regex] != nil);
+}
+
+- (RKXRegexComplexity)regexComplexityWithOptions:(RKXRegexOptions)options hazards:(RKXRegexHazards *)hazards riskScore:(NSUInteger *)riskScore error:(NSError **)error
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:error];
+    RKXRegexAnalysis *analysis = (regex) ? [RKXRegexAnalysis analysisForRegex:regex] : nil;
+    if (hazards) { *hazards = (analysis) ? analysis.hazards : RKXRegexHazardNone; }
+    if (riskScore) { *riskScore = (analysis) ? analysis.riskScore : RKXUnknownRiskScore; }
+    return (analysis) ? analysis.complexity : RKXRegexComplexityUnknown;
+}
+
+- (BOOL)isRegexSafeWithOptions:(RKXRegexOptions)options error:(NSError **)error
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:error];
+    if (!regex) { return NO; }
+    RKXRegexAnalysis *analysis = [RKXRegexAnalysis analysisForRegex:regex];
+    if (analysis.riskScore < RKXLinearEngineRiskScore) { return YES; }
+
+    // A risky pattern is still safe if the linear-time engine takes every match away from ICU.
+    RKXLinearProgram *linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+    if (linearProgram.prefersLinearEngine && !linearProgram.requiresASCIIInput && !linearProgram.excludesCaselessFolds) { return YES; }
+
+    if (error != NULL) {
+        NSString *reason = (analysis.complexity == RKXRegexComplexityUnknown) ? @"The pattern uses syntax the complexity analysis does not model." : [NSString stringWithFormat:@"The pattern has %@ (risk score %lu).", RKXDescriptionOfHazards(analysis.hazards), (unsigned long)analysis.riskScore];
+        NSDictionary *info = @{ NSLocalizedDescriptionKey : NSLocalizedString(@"The regular expression can take super-linear time to match.", nil),
+                                NSLocalizedFailureReasonErrorKey : reason };
+        *error = [NSError errorWithDomain:RKXRegexComplexityErrorDomain code:RKXRegexHazardError userInfo:info];
+    }
+
+    return NO;
+}
+
+#pragma mark - rangeOfRegex:
+
+- (NSRange)rangeOfRegex:(NSString *)pattern
+{
+    return [self rangeOfRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern capture:(NSUInteger)capture
+{
+    return [self rangeOfRegex:pattern range:self.stringRange capture:capture namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern namedCapture:(NSString *)captureName
+{
+    return [self rangeOfRegex:pattern range:self.stringRange capture:NSNotFound namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName
+{
+    return [self rangeOfRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self rangeOfRegex:pattern range:searchRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self rangeOfRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self rangeOfRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSRange)rangeOfRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSRange captureRange = NSNotFoundRange;
+    NSRange captureNameRange = NSNotFoundRange;
+    NSRange finalRange;
+
+    NSTextCheckingResult *firstMatch = nil;
+
+    if (capture == 0 && !captureName) {
+        RKXMatchCacheEntry *cached = [self _cachedWholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions];
+        if (cached) { return (cached.count > 0) ? cached.ranges[0] : NSNotFoundRange; }
+    }
+
+    // The capture and the named capture both come from the first match, so the pattern is only matched once.
+    if (capture != NSNotFound || captureName) {
+        NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+        if (!matches || matches.count == 0) { return NSNotFoundRange; }
+        firstMatch = matches.firstObject;
+    }
+
+    if (capture != NSNotFound) {
+        captureRange = [firstMatch rangeAtIndex:capture];
+    }
+
+    if (captureName) {
+        NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+        NSUInteger index = [captureNames indexOfObjectPassingTest:^BOOL(NSString * _Nonnull name, NSUInteger idx, BOOL * _Nonnull stop) {
+            return [name isEqualToString:captureName];
+        }];
+#pragma clang diagnostic pop
+
+        if (@available(macOS 10.13, *)) {
+            captureNameRange = (index != NSNotFound) ? [firstMatch rangeWithName:captureName] : NSNotFoundRange;
+        }
+        else {
+            // Fallback on earlier versions
+            captureNameRange = NSNotFoundRange;
+        }
+    }
+
+    finalRange = [self _earliestRangeForCaptureRange:captureRange namedCaptureRange:captureNameRange];
+    return finalRange;
+}
+
+- (NSRange)_earliestRangeForCaptureRange:(NSRange)captureRange namedCaptureRange:(NSRange)captureNameRange
+{
+    BOOL shouldConsiderCaptureRange = (!NSEqualRanges(captureRange, NSNotFoundRange));
+    BOOL shouldConsiderCaptureNameRange = (!NSEqualRanges(captureNameRange, NSNotFoundRange));
+    NSRange finalRange;
+
+    if (shouldConsiderCaptureRange && !shouldConsiderCaptureNameRange) {
+        return captureRange;
+    }
+    else if (!shouldConsiderCaptureRange && shouldConsiderCaptureNameRange) {
+        return captureNameRange;
+    }
+
+    if (captureRange.location < captureNameRange.location) {
+        finalRange = captureRange;
+    }
+    else if (captureNameRange.location < captureRange.location) {
+        finalRange = captureNameRange;
+    }
+    else {
+        // OK, so **WHY** the longest length if there's a location tie?
+        // Basically, even though NSRegularExpression is based on ICU
+        // (which is an NFA regex engine), I'm choosing to return longest length because it's
+        // not entirely clear what the "return match range" should be in an NFA. There's a whole
+        // notion of the NFA working through its matches before exiting and THEN reporting back
+        // the first match. The DFA idea of "same location, longest match wins" is
+        // simpler to implement and understand. At least this is what my understanding is
+        // based on the MRE3 book at the end of chapter 4.
+        
+        if (captureRange.length > captureNameRange.length) {
+            finalRange = captureRange;
+        }
+        else if (captureNameRange.length > captureRange.length) {
+            finalRange = captureNameRange;
+        }
+        else {
+            finalRange = captureRange;
+        }
+    }
+
+    return finalRange;
+}
+
+#pragma mark - rangesOfRegex:
+
+- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern
+{
+    return [self rangesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self rangesOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self rangesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self rangesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    if ([pattern captureCountWithOptions:options error:NULL] == 0) {
+        RKXMatchCacheEntry *cached = [self _cachedWholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions];
+
+        if (cached) {
+            NSMutableArray<NSValue *> *cachedRanges = [NSMutableArray arrayWithCapacity:cached.count];
+            for (NSUInteger i = 0; i < cached.count; i++) { [cachedRanges addRange:cached.ranges[i]]; }
+            return [cachedRanges copy];
+        }
+
+        NSMutableArray<NSValue *> *wholeMatchRanges = [NSMutableArray array];
+        NSUInteger count = [self _countOfMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions limit:NSUIntegerMax ranges:wholeMatchRanges];
+        if (count != NSNotFound) { return [wholeMatchRanges copy]; }
+    }
+
+    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[]; }
+    NSMutableArray *ranges = [NSMutableArray array];
+
+    for (NSTextCheckingResult *match in matches) {
+        [ranges addObjectsFromArray:match.ranges];
+    }
+
+    return [ranges copy];
+}
+
+#pragma mark - stringByReplacincOccurrencesOfRegex:withTemplate:
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ options:(RKXRegexOptions)options
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSMutableString *target = [self mutableCopy];
+    NSUInteger swapCount = [target replaceOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:matchOptions error:error];
+    if (swapCount == NSNotFound) { return [self substringWithRange:searchRange]; }
+    return [target copy];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error
+{
+    if (OptionsHasValue(enumOpts, NSEnumerationConcurrent)) {
+        NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+        if (!regex) { return nil; }
+        NSArray<NSString *> *backreferenceNames = [templ _namedReferencesForPattern:pattern];
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+        NSString *result = [self _stringByConcurrentlyReplacingMatchesOfRegularExpression:regex range:searchRange matchOptions:matchOptions usingBlock:^NSString *(NSString *text, NSTextCheckingResult *match, BOOL *stop) {
+            NSString *matchTemplate = templ;
+
+            if (@available(macOS 10.13, *)) {
+                if (backreferenceNames) { matchTemplate = [text _template:templ byExpandingNamedReferences:backreferenceNames forMatch:match]; }
+            }
+
+            return [regex replacementStringForResult:match inString:text offset:0 template:matchTemplate];
+        }];
+#pragma clang diagnostic pop
+
+        if (result) { return result; }
+    }
+
+    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:matchOptions error:error];
+}
+
+#pragma mark - stringMatchedByRegex:
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern
+{
+    return [self stringMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture
+{
+    return [self stringMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern namedCapture:(NSString *)captureName
+{
+    return [self stringMatchedByRegex:pattern range:self.stringRange capture:NSNotFound namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName
+{
+    return [self stringMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options
+{
+    return [self stringMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self stringMatchedByRegex:pattern range:searchRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self stringMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self stringMatchedByRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSString *)stringMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSRange range = [self rangeOfRegex:pattern range:searchRange capture:capture namedCapture:captureName options:options matchOptions:matchOptions error:error];
+    if (NSEqualRanges(range, NSNotFoundRange)) { return nil; }
+    NSString *result = [self substringWithRange:range];
+    return result;
+}
+
+#pragma mark - substringsMatchedByRegex:
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern
+{
+    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture
+{
+    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName
+{
+    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern namedCapture:(NSString *)captureName
+{
+    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:NSNotFound namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self substringsMatchedByRegex:pattern range:searchRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self substringsMatchedByRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    BOOL wholeMatchesOnly = (capture == 0 && !captureName);
+
+    if (wholeMatchesOnly) {
+        RKXMatchCacheEntry *cached = [self _cachedWholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions];
+
+        if (cached) {
+            NSMutableArray *substrings = [NSMutableArray arrayWithCapacity:cached.count];
+            for (NSUInteger i = 0; i < cached.count; i++) { [substrings addObject:[self substringWithRange:cached.ranges[i]]]; }
+            return [substrings copy];
+        }
+
+        NSMutableArray<NSValue *> *matchRanges = [NSMutableArray array];
+        NSUInteger count = [self _countOfMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions limit:NSUIntegerMax ranges:matchRanges];
+
+        if (count != NSNotFound) {
+            NSMutableArray *substrings = [NSMutableArray arrayWithCapacity:count];
+            for (NSValue *matchRange in matchRanges) { [substrings addObject:[self substringWithRange:matchRange.rangeValue]]; }
+            return [substrings copy];
+        }
+    }
+
+    NSArray *matches = (wholeMatchesOnly) ? [self _wholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error] : [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[]; }
+    NSMutableArray *captures = [NSMutableArray array];
+
+    if (capture != NSNotFound) {
+        for (NSTextCheckingResult *match in matches) {
+            NSRange matchRange = [match rangeAtIndex:capture];
+            NSString *matchString = (matchRange.location != NSNotFound) ? [self substringWithRange:matchRange] : RKXEmptyStringKey;
+            [captures addObject:matchString];
+        }
+    }
+
+    if (!captureName) { return [captures copy]; }
+    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
+    if (!captureNames) { return [captures copy]; }
+    NSUInteger index = NSNotFound;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+    index = [captureNames indexOfObjectPassingTest:^BOOL(NSString * _Nonnull name, NSUInteger idx, BOOL * _Nonnull stop) {
+        return [name isEqualToString:captureName];
+    }];
+#pragma clang diagnostic pop
+
+    if (index == NSNotFound) { return [captures copy]; }
+
+    for (NSTextCheckingResult *match in matches) {
+        if (@available(macOS 10.13, *)) {
+            NSRange captureNameMatchRange = [match rangeWithName:captureName];
+            NSString *captureNameMatchString = [self substringWithRange:captureNameMatchRange];
+            [captures addObject:captureNameMatchString];
+        }
+        else {
+            return [captures copy];
+        }
+    }
+
+    return [captures copy];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern internTable:(RKXInternTable *)internTable
+{
+    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:0 options:RKXNoOptions matchOptions:kNilOptions internTable:internTable error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions internTable:(RKXInternTable *)internTable error:(NSError **)error
+{
+    RKXMatchBuffer *buffer = [[RKXMatchBuffer alloc] init];
+    NSUInteger count = [self getMatchesOfRegex:pattern range:searchRange options:options matchOptions:matchOptions buffer:buffer error:error];
+    if (count == NSNotFound) { return nil; }
+    if (!internTable) { internTable = [[RKXInternTable alloc] init]; }
+    NSMutableArray *substrings = [NSMutableArray arrayWithCapacity:count];
+
+    for (NSUInteger i = 0; i < count; i++) {
+        NSRange captureRange = [buffer rangeOfMatchAtIndex:i captureIndex:capture];
+        [substrings addObject:(captureRange.location != NSNotFound) ? [internTable internedSubstringOfString:self range:captureRange] : RKXEmptyStringKey];
+    }
+
+    return [substrings copy];
+}
+
+#pragma mark - substringsSeparatedByRegex:
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern
+{
+    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self substringsSeparatedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self substringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSArray<NSTextCheckingResult *> *matches = [self _wholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[ self ]; }
+    NSMutableArray *components = [NSMutableArray array];
+    NSUInteger pos = 0;
+
+    for (NSTextCheckingResult *match in matches) {
+        NSRange subrange = NSMakeRange(pos, match.range.location - pos);
+        [components addObject:[self substringWithRange:subrange]];
+        pos = match.range.location + match.range.length;
+    }
+
+    if (pos < searchRange.length) {
+        [components addObject:[self substringFromIndex:pos]];
+    }
+
+    return [components copy];
+}
+
+#pragma mark - Blocks-based API
+
+#pragma mark - enumerateStringsMatchedByRegex:usingBlock:
+
+- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self enumerateStringsMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self enumerateStringsMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self enumerateStringsMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:error usingBlock:block];
+}
+
+- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    if (OptionsHasValue(enumOpts, NSEnumerationConcurrent)) {
+        NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+        if (!regex) { return NO; }
+        __block BOOL matched = NO;
+        __block NSError *matchError = nil;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+        RKXEnumerateInWaves(^(BOOL (^submit)(id item)) {
+            // Matches that have to be timed or come from the linear-time engine are collected first; ICU hands over the rest as it finds them.
+            if (OptionsHasValue(matchOptions, RKXReportProgress) || [RKXLinearProgram linearProgramForRegex:regex].prefersLinearEngine) {
+                NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegularExpression:regex range:searchRange matchOptions:matchOptions error:&matchError];
+                matched = (matches.count > 0);
+                for (NSTextCheckingResult *match in matches) { if (!submit(match)) { break; } }
+                return;
+            }
+
+            [regex enumerateMatchesInString:self options:(NSMatchingOptions)matchOptions range:searchRange usingBlock:^(NSTextCheckingResult *match, NSMatchingFlags flags, BOOL *stop) {
+                if (!match) { return; }
+                matched = YES;
+                *stop = !submit(match);
+            }];
+        }, ^(NSTextCheckingResult *match, BOOL *stop) {
+            block([match substringsFromString:self], match.ranges, stop);
+        });
+#pragma clang diagnostic pop
+
+        if (matchError && error != NULL) { *error = matchError; }
+        return matched;
+    }
+
+    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches || matches.count == 0) { return NO; }
+    __block BOOL blockStop = NO;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+    [matches enumerateObjectsWithOptions:enumOpts usingBlock:^(NSTextCheckingResult *match, NSUInteger idx, BOOL * _Nonnull stop) {
+        block([match substringsFromString:self], match.ranges, &blockStop);
+        *stop = blockStop;
+    }];
+#pragma clang diagnostic pop
+
+    return YES;
+}
+
+#pragma mark - enumerateStringsSeparatedByRegex:usingBlock:
+
+- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self enumerateStringsSeparatedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self enumerateStringsSeparatedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self enumerateStringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:error usingBlock:block];
+}
+
+- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    if (OptionsHasValue(enumOpts, NSEnumerationConcurrent)) {
+        // Each divided string is found from where the one before it ended, so they are found serially and only the blocks run concurrently.
+        __block BOOL separated = NO;
+        __block NSError *separateError = nil;
+        RKXEnumerateInWaves(^(BOOL (^submit)(id item)) {
+            separated = [self enumerateStringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:matchOptions enumerationOptions:(enumOpts & ~NSEnumerationConcurrent) error:&separateError usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+                *stop = !submit(@[ capturedStrings, capturedRanges ]);
+            }];
+        }, ^(NSArray *arguments, BOOL *stop) {
+            block(arguments[0], arguments[1], stop);
+        });
+
+        if (separateError && error != NULL) { *error = separateError; }
+        return separated;
+    }
+
+    NSString *target = [self substringWithRange:searchRange];
+    NSRange targetRange = target.stringRange;
+    NSArray<NSTextCheckingResult *> *matches = [target _matchesForRegex:pattern range:targetRange options:options matchOptions:matchOptions error:error];
+    if (!matches || matches.count == 0) { return NO; }
+    NSArray *strings = [target substringsSeparatedByRegex:pattern range:targetRange options:options matchOptions:matchOptions error:error];
+    NSUInteger lastStringIndex = [strings indexOfObject:strings.lastObject];
+    __block NSRange remainderRange = targetRange;
+    __block BOOL blockStop = NO;
+
+    [strings enumerateObjectsWithOptions:enumOpts usingBlock:^(NSString *topString, NSUInteger idx, BOOL * _Nonnull stop) {
+        NSRange topStringRange = [target rangeOfString:topString options:NSBackwardsSearch range:remainderRange];
+        NSTextCheckingResult *match = (idx < lastStringIndex) ? matches[idx] : nil;
+
+        if (match) {
+            NSMutableArray *captures = [NSMutableArray array];
+            NSMutableArray<NSValue *> *rangeCaptures = [@[ [NSValue valueWithRange:topStringRange] ] mutableCopy];
+            [captures addObject:topString];
+            [rangeCaptures addObjectsFromArray:match.ranges];
+            [captures addObjectsFromArray:[match substringsFromString:self]];
+            remainderRange = rangeCaptures.lastObject.rangeValue;
+            remainderRange = (enumOpts == 0) ? [target rangeFromLocation:remainderRange.location] : [target rangeToLocation:remainderRange.location];
+            block([captures copy], [rangeCaptures copy], &blockStop);
+        }
+        else {
+            NSRange lastRange = [target rangeOfString:topString options:NSBackwardsSearch range:remainderRange];
+            block(@[ topString ], @[ [NSValue valueWithRange:lastRange] ], &blockStop);
+        }
+
+        if (blockStop) { *stop = YES; }
+    }];
+
+    return YES;
+}
+
+#pragma mark - stringByReplacingOccurrencesOfRegex:usingBlock:
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error usingBlock:block];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return [self substringWithRange:searchRange]; }
+    NSMutableString *target = [self mutableCopy];
+    BOOL stop = NO;
+    
+    if (!matches.count) {
+        return [NSString stringWithString:self];
+    }
+    
+    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
+        NSString *swap = block([match substringsFromString:self], match.ranges, &stop);
+        [target replaceCharactersInRange:match.range withString:swap];
+        if (stop) { break; }
+    }
+    
+    return [target copy];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    if (OptionsHasValue(enumOpts, NSEnumerationConcurrent)) {
+        NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+        if (!regex) { return nil; }
+
+        NSString *result = [self _stringByConcurrentlyReplacingMatchesOfRegularExpression:regex range:searchRange matchOptions:matchOptions usingBlock:^NSString *(NSString *text, NSTextCheckingResult *match, BOOL *stop) {
+            return block([match substringsFromString:text], [match rangesWithOffset:searchRange.location], stop);
+        }];
+
+        if (result) { return result; }
+    }
+
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error usingBlock:block];
+}
+
+#pragma mark - countOfRegex:
+
+- (NSUInteger)countOfRegex:(NSString *)pattern
+{
+    return [self countOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSUInteger)countOfRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self countOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSUInteger)countOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self countOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSUInteger)countOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    RKXMatchCacheEntry *cached = [self _cachedWholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions];
+    if (cached) { return cached.count; }
+    NSUInteger count = [self _countOfMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions limit:NSUIntegerMax ranges:nil];
+    if (count != NSNotFound) { return count; }
+    NSArray *matches = [self _wholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return 0; }
+    return matches.count;
+}
+
+#pragma mark - firstMatchOfRegex:
+
+- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern
+{
+    return [self firstMatchOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self firstMatchOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self firstMatchOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    return matches.firstObject;
+}
+
+#pragma mark - lastMatchOfRegex:
+
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern
+{
+    return [self lastMatchOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self lastMatchOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self lastMatchOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSTextCheckingResult *)lastMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!regex) { return nil; }
+
+    if (!searchRange.length || !RKXRegexCanSearchBackward(regex, matchOptions)) {
+        return [self _matchesForRegularExpression:regex range:searchRange matchOptions:matchOptions error:error].lastObject;
+    }
+
+    NSUInteger end = NSMaxRange(searchRange), windowStart = end, windowLength = RKXBackwardWindowLength;
+
+    while (windowStart > searchRange.location) {
+        NSUInteger target = (end - searchRange.location > windowLength) ? end - windowLength : searchRange.location;
+        NSUInteger start = searchRange.location;
+        windowLength *= 2;
+
+        if (target > searchRange.location) {
+            NSRange terminator = [self rangeOfCharacterFromSet:NSCharacterSet.newlineCharacterSet options:NSBackwardsSearch | NSLiteralSearch range:NSMakeRange(searchRange.location, target - searchRange.location)];
+
+            if (terminator.location != NSNotFound) {
+                start = NSMaxRange(terminator);
+                // A window never starts inside a CRLF, where ^ does not match, or at the very end, where it does not either.
+                if ([self characterAtIndex:terminator.location] == '\r' && start < end && [self characterAtIndex:start] == '\n') { start++; }
+                if (start >= end) { continue; }
+            }
+        }
+
+        if (start >= windowStart) { continue; }
+        NSTextCheckingResult *last = [regex matchesInString:self options:(NSMatchingOptions)matchOptions range:NSMakeRange(start, end - start)].lastObject;
+        if (last) { return last; }
+        windowStart = start;
+    }
+
+    return nil;
+}
+
+#pragma mark - lastRangeOfRegex:
+
+- (NSRange)lastRangeOfRegex:(NSString *)pattern
+{
+    return [self lastRangeOfRegex:pattern range:self.stringRange capture:0 options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)lastRangeOfRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self lastRangeOfRegex:pattern range:searchRange capture:0 options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)lastRangeOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self lastRangeOfRegex:pattern range:self.stringRange capture:0 options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSRange)lastRangeOfRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSTextCheckingResult *match = [self lastMatchOfRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    return (match) ? [match rangeAtIndex:capture] : NSNotFoundRange;
+}
+
+#pragma mark - linearTimeMatchesOfRegex:
+
+- (NSArray<NSTextCheckingResult *> *)linearTimeMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!regex) { return nil; }
+    RKXLinearProgram *linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+    NSArray *matches = [linearProgram matchesInString:self range:searchRange matchOptions:matchOptions regularExpression:regex];
+
+    if (!matches && error != NULL) {
+        NSString *reason = (linearProgram) ? @"The match options or the non-ASCII text in the search range are not supported for this pattern." : @"The pattern uses constructs that need a backtracking engine, such as backreferences, lookaround, atomic groups or Unicode properties.";
+        NSDictionary *info = @{ NSLocalizedDescriptionKey : NSLocalizedString(@"Linear-time matching is unavailable.", nil),
+                                NSLocalizedFailureReasonErrorKey : NSLocalizedString(reason, nil) };
+        *error = [NSError errorWithDomain:RKXLinearTimeMatchingErrorDomain code:RKXLinearTimeMatchingUnsupportedError userInfo:info];
+    }
+
+    return matches;
+}
+
+#pragma mark - getMatchesOfRegex:buffer:
+
+- (NSUInteger)getMatchesOfRegex:(NSString *)pattern buffer:(RKXMatchBuffer *)buffer
+{
+    return [self getMatchesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions buffer:buffer error:NULL];
+}
+
+- (NSUInteger)getMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer error:(NSError **)error
+{
+    NSCParameterAssert(pattern);
+    NSCParameterAssert(buffer);
+    NSCAssert(NSMaxRange(searchRange) <= self.length, @"searchRange (%@) is past the string length (%lu)", NSStringFromRange(searchRange), self.length);
+
+    NSRegularExpression *regex = [buffer regexForPattern:pattern options:options error:error];
+    NSUInteger rangesPerMatch = regex.numberOfCaptureGroups + 1;
+    [buffer resetWithRangesPerMatch:rangesPerMatch];
+    if (!regex) { return NSNotFound; }
+    RKXLinearProgram *linearProgram = [RKXLinearProgram linearProgramForRegex:regex];
+
+    if (linearProgram) {
+        NSUInteger count = (rangesPerMatch == 1) ? [linearProgram countOfMatchesInString:self range:searchRange matchOptions:matchOptions buffer:buffer] : NSNotFound;
+        if (count != NSNotFound) { return count; }
+        if (linearProgram.prefersLinearEngine && [linearProgram getMatchesInString:self range:searchRange matchOptions:matchOptions buffer:buffer]) { return buffer.count; }
+    }
+
+    BOOL timesOut = OptionsHasValue(matchOptions, RKXReportProgress);
+    NSTimeInterval start = NSDate.timeIntervalSinceReferenceDate;
+    __block BOOL timedOut = NO, complete = YES;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+    [regex enumerateMatchesInString:self options:(NSMatchingOptions)matchOptions range:searchRange usingBlock:^(NSTextCheckingResult * _Nullable result, NSMatchingFlags flags, BOOL * _Nonnull stop) {
+        if (timesOut && NSDate.timeIntervalSinceReferenceDate - start > RKXTimeoutInterval) { timedOut = YES; *stop = YES; return; }
+        if (!result) { return; }
+        NSRange *ranges = [buffer appendMatch];
+        if (!ranges) { complete = NO; *stop = YES; return; }
+
+        for (NSUInteger i = 0; i < rangesPerMatch; i++) {
+            ranges[i] = [result rangeAtIndex:i];
+        }
+    }];
+#pragma clang diagnostic pop
+
+    if (!complete) {
+        [buffer removeAllMatches];
+        return NSNotFound;
+    }
+
+    if (timedOut && error != NULL) { *error = NSRegularExpression.timeoutError; }
+
+    return buffer.count;
+}
+
+#pragma mark - linesMatchedByRegex:
+
+- (NSArray<RKXLineMatch *> *)linesMatchedByRegex:(NSString *)pattern
+{
+    return [self linesMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions lineOptions:RKXLineNoOptions limit:0 linesBefore:0 linesAfter:0 error:NULL];
+}
+
+- (NSArray<RKXLineMatch *> *)linesMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self linesMatchedByRegex:pattern range:self.stringRange options:options lineOptions:RKXLineNoOptions limit:0 linesBefore:0 linesAfter:0 error:NULL];
+}
+
+- (NSArray<RKXLineMatch *> *)linesMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options lineOptions:(RKXLineOptions)lineOptions limit:(NSUInteger)limit linesBefore:(NSUInteger)linesBefore linesAfter:(NSUInteger)linesAfter error:(NSError **)error
+{
+    NSCParameterAssert(pattern);
+    NSCAssert(NSMaxRange(searchRange) <= self.length, @"searchRange (%@) is past the string length (%lu)", NSStringFromRange(searchRange), self.length);
+
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!regex) { return nil; }
+    RKXLineSearch *search = [[RKXLineSearch alloc] initWithString:self regularExpression:regex lineOptions:lineOptions limit:limit linesBefore:linesBefore linesAfter:linesAfter];
+    return [search linesInRange:searchRange];
+}
+
+#pragma mark - Regex Cache Management
+
++ (void)clearRegexCache
+{
+    NSMutableDictionary *threadDict = NSThread.currentThread.threadDictionary;
+    NSArray *keys = [threadDict.allKeys copy];
+
+    for (NSString *key in keys) {
+        if ([threadDict[key] isKindOfClass:[NSRegularExpression class]]) {
+            [threadDict removeObjectForKey:key];
+        }
+    }
+}
+
++ (NSUInteger)regexCacheCount
+{
+    NSMutableDictionary *threadDict = NSThread.currentThread.threadDictionary;
+    NSUInteger count = 0;
+
+    for (NSString *key in threadDict) {
+        if ([threadDict[key] isKindOfClass:[NSRegularExpression class]]) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
++ (NSUInteger)regexCompileCount
+{
+    return [NSThread.currentThread.threadDictionary[RKXRegexCompileCountKey] unsignedIntegerValue];
+}
+
++ (void)setMatchCacheByteLimit:(NSUInteger)byteLimit
+{
+    atomic_store_explicit(&RKXMatchCacheByteLimit, byteLimit, memory_order_relaxed);
+    [RKXMatchCache trimAllToByteLimit:byteLimit];
+}
+
++ (NSUInteger)matchCacheByteLimit
+{
+    return atomic_load_explicit(&RKXMatchCacheByteLimit, memory_order_relaxed);
+}
+
++ (void)clearMatchCache
+{
+    [NSThread.currentThread.threadDictionary removeObjectForKey:RKXMatchCacheKey];
+}
+
++ (RKXMatchCacheStatistics)matchCacheStatistics
+{
+    RKXMatchCache *cache = NSThread.currentThread.threadDictionary[RKXMatchCacheKey];
+    return (cache) ? cache.statistics : (RKXMatchCacheStatistics){ 0 };
+}
+
+#pragma mark - regexValidationError
+
+- (NSError *)regexValidationError
+{
+    return [self regexValidationErrorWithOptions:RKXNoOptions];
+}
+
+- (NSError *)regexValidationErrorWithOptions:(RKXRegexOptions)options
+{
+    NSError *error = nil;
+    NSRegularExpressionOptions regexOptions = (NSRegularExpressionOptions)options;
+    [NSRegularExpression regularExpressionWithPattern:self options:regexOptions error:&error];
+    return error;
+}
+
+#pragma mark - arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:
+
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern
+{
+    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+{
+    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+{
+    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    if (![pattern isRegexValidWithOptions:options error:error]) { return nil; }
+    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
+    if (!captureNames || !captureNames.count) { return @[]; }
+
+    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[]; }
+    NSMutableArray *results = [NSMutableArray array];
+
+    for (NSTextCheckingResult *match in matches) {
+        NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+
+        for (NSString *captureName in captureNames) {
+            if (@available(macOS 10.13, *)) {
+                NSRange nameRange = [match rangeWithName:captureName];
+                if (nameRange.location != NSNotFound) {
+                    dict[captureName] = [self substringWithRange:nameRange];
+                }
+                else {
+                    dict[captureName] = RKXEmptyStringKey;
+                }
+            }
+        }
+
+        [results addObject:[dict copy]];
+    }
+
+    return [results copy];
+}
+
+#pragma mark - substringsSeparatedByRegex:limit:
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern limit:(NSUInteger)limit
+{
+    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions limit:limit error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange limit:(NSUInteger)limit
+{
+    return [self substringsSeparatedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions limit:limit error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern options:(RKXRegexOptions)options limit:(NSUInteger)limit
+{
+    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions limit:limit error:NULL];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options limit:(NSUInteger)limit error:(NSError **)error
+{
+    return [self substringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions limit:limit error:error];
+}
+
+- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions limit:(NSUInteger)limit error:(NSError **)error
+{
+    if (limit == 0) {
+        return [self substringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    }
+    if (limit == 1) {
+        return @[ [self substringWithRange:searchRange] ];
+    }
+
+    NSArray<NSTextCheckingResult *> *matches = [self _wholeMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return @[ self ]; }
+    NSMutableArray *components = [NSMutableArray array];
+    NSUInteger pos = searchRange.location;
+    NSUInteger splitCount = 0;
+    NSUInteger maxSplits = limit - 1;
+
+    for (NSTextCheckingResult *match in matches) {
+        if (splitCount >= maxSplits) { break; }
+        NSRange subrange = NSMakeRange(pos, match.range.location - pos);
+        [components addObject:[self substringWithRange:subrange]];
+        pos = match.range.location + match.range.length;
+        splitCount++;
+    }
+
+    // Append the remainder
+    NSRange remainderRange = NSMakeRange(pos, NSMaxRange(searchRange) - pos);
+    [components addObject:[self substringWithRange:remainderRange]];
+
+    return [components copy];
+}
+
+#pragma mark - stringByReplacingOccurrencesOfRegex:usingBlockWithNamedCaptures:
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlockWithNamedCaptures:block];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL usingBlockWithNamedCaptures:block];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+{
+    return [self stringByReplacingOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error usingBlockWithNamedCaptures:block];
+}
+
+- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+{
+    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches) { return nil; }
+    if (!matches.count) { return [self substringWithRange:searchRange]; }
+
+    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
+    NSMutableString *target = [self mutableCopy];
+    BOOL stop = NO;
+
+    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
+        NSMutableDictionary *namedCaptures = [NSMutableDictionary dictionary];
+
+        if (captureNames) {
+            for (NSString *captureName in captureNames) {
+                if (@available(macOS 10.13, *)) {
+                    NSRange nameRange = [match rangeWithName:captureName];
+                    if (nameRange.location != NSNotFound) {
+                        namedCaptures[captureName] = [self substringWithRange:nameRange];
+                    }
+                    else {
+                        namedCaptures[captureName] = RKXEmptyStringKey;
+                    }
+                }
+            }
+        }
+
+        NSString *swap = block([namedCaptures copy], &stop);
+        [target replaceCharactersInRange:match.range withString:swap];
+        if (stop) { break; }
+    }
+
+    return [target copy];
+}
+
+#pragma mark - Asynchronous API
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+
+- (NSProgress *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSArray<NSValue *> *ranges, NSError *error))completionHandler
+{
+    return [self _progressForAsyncWorkInRange:searchRange queue:queue work:^(NSString *snapshot, NSProgress *progress) {
+        NSMutableArray *ranges = [NSMutableArray array];
+        NSError *matchError = nil;
+        BOOL finished = [snapshot _enumerateMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions progress:progress error:&matchError usingBlock:^(NSTextCheckingResult *match, BOOL *stop) {
+            [ranges addObjectsFromArray:match.ranges];
+        }];
+
+        completionHandler(finished ? [ranges copy] : nil, matchError);
+    }];
+}
+
+- (NSProgress *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSArray<NSString *> *substrings, NSError *error))completionHandler
+{
+    return [self _progressForAsyncWorkInRange:searchRange queue:queue work:^(NSString *snapshot, NSProgress *progress) {
+        NSMutableArray *captures = [NSMutableArray array];
+        NSError *matchError = nil;
+        BOOL finished = [snapshot _enumerateMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions progress:progress error:&matchError usingBlock:^(NSTextCheckingResult *match, BOOL *stop) {
+            NSRange matchRange = [match rangeAtIndex:capture];
+            NSString *matchString = (matchRange.location != NSNotFound) ? [snapshot substringWithRange:matchRange] : RKXEmptyStringKey;
+            [captures addObject:matchString];
+        }];
+
+        completionHandler(finished ? [captures copy] : nil, matchError);
+    }];
+}
+
+- (NSProgress *)countOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSUInteger count, NSError *error))completionHandler
+{
+    return [self _progressForAsyncWorkInRange:searchRange queue:queue work:^(NSString *snapshot, NSProgress *progress) {
+        __block NSUInteger count = 0;
+        NSError *matchError = nil;
+        BOOL finished = [snapshot _enumerateMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions progress:progress error:&matchError usingBlock:^(NSTextCheckingResult *match, BOOL *stop) {
+            count++;
+        }];
+
+        completionHandler(finished ? count : 0, matchError);
+    }];
+}
+
+- (NSProgress *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue completionHandler:(void (^)(NSString *result, NSError *error))completionHandler
+{
+    return [self _progressForAsyncWorkInRange:searchRange queue:queue work:^(NSString *snapshot, NSProgress *progress) {
+        NSMutableArray<NSTextCheckingResult *> *matches = [NSMutableArray array];
+        NSError *matchError = nil;
+        BOOL finished = [snapshot _enumerateMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions progress:progress error:&matchError usingBlock:^(NSTextCheckingResult *match, BOOL *stop) {
+            [matches addObject:match];
+        }];
+
+        if (!finished) { completionHandler(nil, matchError); return; }
+        if (!matches.count) { completionHandler([snapshot substringWithRange:searchRange], nil); return; }
+
+        // Same result as the synchronous API, but built front to back in a single pass.
+        NSRegularExpression *regex = matches.firstObject.regularExpression;
+        NSArray<NSString *> *backreferenceNames = [templ _namedReferencesForPattern:pattern];
+        NSMutableString *target = [NSMutableString stringWithCapacity:snapshot.length];
+        NSUInteger pos = 0;
+
+        for (NSTextCheckingResult *match in matches) {
+            NSString *matchTemplate = templ;
+
+            if (@available(macOS 10.13, *)) {
+                if (backreferenceNames) { matchTemplate = [snapshot _template:templ byExpandingNamedReferences:backreferenceNames forMatch:match]; }
+            }
+
+            [target appendString:[snapshot substringWithRange:NSMakeRange(pos, match.range.location - pos)]];
+            [target appendString:[regex replacementStringForResult:match inString:snapshot offset:0 template:matchTemplate]];
+            pos = NSMaxRange(match.range);
+        }
+
+        [target appendString:[snapshot substringFromIndex:pos]];
+        completionHandler([target copy], nil);
+    }];
+}
+
+- (NSProgress *)enumerateStringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions queue:(dispatch_queue_t)queue usingBlock:(void (^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block completionHandler:(void (^)(NSError *error))completionHandler
+{
+    return [self _progressForAsyncWorkInRange:searchRange queue:queue work:^(NSString *snapshot, NSProgress *progress) {
+        NSError *matchError = nil;
+        [snapshot _enumerateMatchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions progress:progress error:&matchError usingBlock:^(NSTextCheckingResult *match, BOOL *stop) {
+            block([match substringsFromString:snapshot], match.ranges, stop);
+        }];
+
+        completionHandler(matchError);
+    }];
+}
+
+#pragma clang diagnostic pop
+
+@end
+
+@implementation NSMutableString (RegexKitX)
+
+#pragma mark - replaceOccurrencesOfRegex:withTemplate:
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ
+{
+    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange
+{
+    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ options:(RKXRegexOptions)options
+{
+    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:kNilOptions error:error];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches || matches.count == 0) { return NSNotFound; }
+    NSUInteger count = 0;
+    NSRegularExpression *regex = matches.firstObject.regularExpression;
+    NSArray *backreferenceNames = nil;
+    if (@available(macOS 10.13, *)) { backreferenceNames = [templ _namedReferencesForPattern:pattern]; }
+
+    // The matches found above are replaced directly rather than searched for again by the regex, so patterns
+    // that were matched by the linear-time engine never reach ICU here.
+    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
+        NSString *matchTemplate = templ;
+
+        if (backreferenceNames) {
+            if (@available(macOS 10.13, *)) { matchTemplate = [self _template:templ byExpandingNamedReferences:backreferenceNames forMatch:match]; }
+            count += backreferenceNames.count;
+        }
+        else {
+            count++;
+        }
+
+        NSString *swap = [regex replacementStringForResult:match inString:self offset:0 template:matchTemplate];
+        [self replaceCharactersInRange:match.range withString:swap];
+    }
+
+    return count;
+}
+
+#pragma mark - Blocks-based API
+
+#pragma mark - replaceOccurrencesOfRegex:usingBlock:
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self replaceOccurrencesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self replaceOccurrencesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    return [self replaceOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error usingBlock:block];
+}
+
+- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    if (!matches || matches.count == 0) { return NSNotFound; }
+    NSUInteger count = 0;
+    BOOL stop = NO;
+    
+    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
+        NSString *replacement = block([match substringsFromString:self], match.ranges, &stop);
+        [self replaceCharactersInRange:match.range withString:replacement];
+        count++;
+        if (stop) { break; }
+    }
+
+    return count;
+}
+
+@end
+
+#pragma mark -
+@implementation NSAttributedString (RegexKitX)
+
+- (NSAttributedString *)attributedStringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ
+{
+    return [self attributedStringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.string.stringRange options:RKXNoOptions error:NULL];
+}
+
+- (NSAttributedString *)attributedStringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ options:(RKXRegexOptions)options
+{
+    return [self attributedStringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.string.stringRange options:options error:NULL];
+}
+
+- (NSAttributedString *)attributedStringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    NSArray<NSTextCheckingResult *> *matches = [self.string _matchesForRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    if (!matches || !matches.count) { return [self copy]; }
+    NSRegularExpression *regex = matches.firstObject.regularExpression;
+    NSString *string = self.string;
+
+    return [self _attributedStringByReplacingMatches:matches usingBlock:^NSString *(NSTextCheckingResult *match) {
+        return [regex replacementStringForResult:match inString:string offset:0 template:templ];
+    }];
+}
+
+/// Builds the replaced attributed string in a single forward pass: the untouched spans between matches are appended with their attributes intact, and each replacement is appended with the attributes returned by @c -_replacementAttributesForRange:. Unlike replacing each match in place, no characters or attribute runs are ever shifted, so the cost is linear in the size of the result.
+/// @param matches The matches to replace, in ascending order.
+/// @param block Returns the replacement string for a match.
+- (NSAttributedString *)_attributedStringByReplacingMatches:(NSArray<NSTextCheckingResult *> *)matches usingBlock:(NSString *(NS_NOESCAPE ^)(NSTextCheckingResult *match))block
+{
+    NSMutableAttributedString *result = [[NSMutableAttributedString alloc] init];
+    NSUInteger pos = 0;
+    [result beginEditing];
+
+    for (NSTextCheckingResult *match in matches) {
+        NSRange matchRange = match.range;
+
+        if (matchRange.location > pos) {
+            [result appendAttributedString:[self attributedSubstringFromRange:NSMakeRange(pos, matchRange.location - pos)]];
+        }
+
+        NSString *replacement = block(match);
+
+        if (replacement.length) {
+            NSDictionary *attrs = [self _replacementAttributesForRange:matchRange];
+            [result appendAttributedString:[[NSAttributedString alloc] initWithString:replacement attributes:attrs]];
+        }
+
+        pos = NSMaxRange(matchRange);
+    }
+
+    if (pos < self.length) {
+        [result appendAttributedString:[self attributedSubstringFromRange:NSMakeRange(pos, self.length - pos)]];
+    }
+
+    [result endEditing];
+    return [result copy];
+}
+
+/// The attributes a replacement for @c range inherits. These are the attributes of the first replaced character, or for an empty match, of the character in front of it (or after it at the very start). This is the same rule @c -replaceCharactersInRange:withString: uses.
+- (NSDictionary<NSAttributedStringKey, id> *)_replacementAttributesForRange:(NSRange)range
+{
+    if (!self.length) { return @{}; }
+    NSUInteger index = range.location;
+    if (!range.length && index > 0) { index--; }
+    index = MIN(index, self.length - 1);
+    return [self attributesAtIndex:index effectiveRange:NULL];
+}
+
+- (void)enumerateMatchesForRegex:(NSString *)pattern usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    [self enumerateMatchesForRegex:pattern range:self.string.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:block];
+}
+
+- (void)enumerateMatchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+{
+    [self.string enumerateStringsMatchedByRegex:pattern range:searchRange options:options matchOptions:matchOptions enumerationOptions:kNilOptions error:error usingBlock:block];
+}
+
+@end
+
+#pragma mark -
+@implementation NSMutableAttributedString (RegexKitX)
+
+- (void)addAttributes:(NSDictionary<NSAttributedStringKey, id> *)attrs forMatchesOfRegex:(NSString *)pattern
+{
+    [self addAttributes:attrs forMatchesOfRegex:pattern range:self.string.stringRange options:RKXNoOptions error:NULL];
+}
+
+- (void)addAttributes:(NSDictionary<NSAttributedStringKey, id> *)attrs forMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+{
+    NSArray<NSTextCheckingResult *> *matches = [self.string _matchesForRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    if (!matches || !matches.count) { return; }
+    [self beginEditing];
+
+    for (NSTextCheckingResult *match in matches) {
+        [self addAttributes:attrs range:match.range];
+    }
+
+    [self endEditing];
+}
+
+@end
+
+#pragma mark -
 
-- (BOOL)isRegexValid
+/// Returns @c YES if no match of @c pattern can contain a line terminator or depend on text outside its line, so that a match can only be changed by an edit of the line it sits on. The answer comes from the syntax tree; patterns the parser does not model, such as those using @c RKXIgnoreWhitespace, are scanned as text instead. The check is conservative: anything that might match a line terminator returns @c NO.
+static BOOL RKXRegexIsLineBounded(NSString *pattern, RKXRegexOptions options)
 {
-    return [self isRegexValidWithOptions:RKXNoOptions error:NULL];
-}
+    if (OptionsHasValue(options, RKXDotAll) || OptionsHasValue(options, RKXUseUnixLineSeparators)) { return NO; }
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:NULL];
+    RKXSyntaxTree *tree = (regex) ? [RKXSyntaxTree syntaxTreeForRegex:regex] : nil;
 
-- (BOOL)isRegexValidWithOptions:(RKXRegexOptions)options error:(NSError **)error
-{
-    NSRegularExpression *regex = [NSString cachedRegexForPattern:self options:options error:error];
-    if (!regex) { return NO; }
+    if (tree) {
+        const RKXSyntax *syntax = tree.syntax;
+        return !RKXNodeCanSpanLines(syntax, syntax->root) && !RKXNodeLooksBeforeLine(syntax, syntax->root) && !RKXNodeLooksAfterLine(syntax, syntax->root);
+    }
+
+    if ([pattern rangeOfCharacterFromSet:NSCharacterSet.newlineCharacterSet].location != NSNotFound) { return NO; }
+    if (OptionsHasValue(options, RKXIgnoreMetacharacters)) { return YES; }
+
+    // Escapes that can match a line terminator (or that are opaque to this check), negated classes, POSIX-style
+    // classes such as [[:space:]] or [[:Zl:]], and inline flags that turn on dot-all or turn anything off.
+    NSString *spanningPattern = @"\\\\[nrsvfRWDHVXNpPxuUc0-9zZG]|\\[\\^|\\[:|\\(\\?[a-zA-Z]*s|\\(\\?[a-zA-Z]*-";
+    if ([pattern isMatchedByRegex:spanningPattern]) { return NO; }
+    if (!OptionsHasValue(options, RKXMultiline) && [pattern rangeOfString:@"$"].location != NSNotFound) { return NO; }
     return YES;
 }
 
-#pragma mark - rangeOfRegex:
+static inline NSUInteger RKXRangeCount(NSData *ranges) { return ranges.length / sizeof(NSRange); }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern
+/// Returns the index of the first range in the sorted, non-overlapping @c ranges that ends after @c location.
+static NSUInteger RKXFirstRangeIndexEndingAfter(const NSRange *ranges, NSUInteger count, NSUInteger location)
 {
-    return [self rangeOfRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+    NSUInteger low = 0, high = count;
 
-- (NSRange)rangeOfRegex:(NSString *)pattern capture:(NSUInteger)capture
-{
-    return [self rangeOfRegex:pattern range:self.stringRange capture:capture namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    while (low < high) {
+        NSUInteger mid = low + (high - low) / 2;
+        if (NSMaxRange(ranges[mid]) <= location) { low = mid + 1; }
+        else { high = mid; }
+    }
+
+    return low;
 }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern namedCapture:(NSString *)captureName
+@interface RKXHighlightRule : NSObject
+@property (nonatomic, readonly, copy) NSString *pattern;
+@property (nonatomic, readonly) RKXRegexOptions options;
+@property (nonatomic, readonly, copy) NSDictionary<NSAttributedStringKey, id> *attributes;
+@property (nonatomic, readonly) BOOL isLineBounded;
+@property (nonatomic, readwrite, strong) NSMutableData *matchRanges;
+@end
+
+@implementation RKXHighlightRule
+
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options attributes:(NSDictionary<NSAttributedStringKey, id> *)attrs
 {
-    return [self rangeOfRegex:pattern range:self.stringRange capture:NSNotFound namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if ((self = [super init])) {
+        _pattern = [pattern copy];
+        _options = options;
+        _attributes = [attrs copy];
+        _isLineBounded = RKXRegexIsLineBounded(pattern, options);
+        _matchRanges = [NSMutableData data];
+    }
+
+    return self;
 }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName
+@end
+
+@interface RKXIncrementalHighlighter ()
+@property (nonatomic, readwrite, strong) NSMutableAttributedString *attributedString;
+@property (nonatomic, readwrite, strong) NSMutableArray<RKXHighlightRule *> *rules;
+@property (nonatomic, readonly, copy) NSSet<NSAttributedStringKey> *managedKeys;
+@end
+
+@implementation RKXIncrementalHighlighter
+
+- (instancetype)initWithAttributedString:(NSMutableAttributedString *)attributedString
 {
-    return [self rangeOfRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    NSCParameterAssert(attributedString);
+
+    if ((self = [super init])) {
+        _attributedString = attributedString;
+        _rules = [NSMutableArray array];
+    }
+
+    return self;
 }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern range:(NSRange)searchRange
+- (BOOL)addRuleForRegex:(NSString *)pattern options:(RKXRegexOptions)options attributes:(NSDictionary<NSAttributedStringKey, id> *)attrs error:(NSError **)error
 {
-    return [self rangeOfRegex:pattern range:searchRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (![pattern isRegexValidWithOptions:options error:error]) { return NO; }
+    RKXHighlightRule *rule = [[RKXHighlightRule alloc] initWithRegex:pattern options:options attributes:attrs];
+    [self.rules addObject:rule];
+    NSMutableIndexSet *dirtyIndexes = [NSMutableIndexSet indexSet];
+    [self _rescanRule:rule inRange:self.attributedString.string.stringRange dirtyIndexes:dirtyIndexes];
+    [self _applyRulesToDirtyIndexes:dirtyIndexes managedKeys:self.managedKeys];
+    return YES;
 }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+- (void)removeAllRules
 {
-    return [self rangeOfRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:options matchOptions:kNilOptions error:NULL];
+    NSMutableIndexSet *dirtyIndexes = [NSMutableIndexSet indexSet];
+
+    NSSet<NSAttributedStringKey> *managedKeys = self.managedKeys;
+
+    for (RKXHighlightRule *rule in self.rules) {
+        const NSRange *ranges = rule.matchRanges.bytes;
+        for (NSUInteger i = 0; i < RKXRangeCount(rule.matchRanges); i++) { [dirtyIndexes addIndexesInRange:ranges[i]]; }
+    }
+
+    [self.rules removeAllObjects];
+    [self _applyRulesToDirtyIndexes:dirtyIndexes managedKeys:managedKeys];
 }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options error:(NSError **)error
+- (void)rehighlight
 {
-    return [self rangeOfRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:kNilOptions error:error];
+    NSMutableIndexSet *dirtyIndexes = [NSMutableIndexSet indexSet];
+
+    for (RKXHighlightRule *rule in self.rules) {
+        [self _rescanRule:rule inRange:self.attributedString.string.stringRange dirtyIndexes:dirtyIndexes];
+    }
+
+    [self _applyRulesToDirtyIndexes:dirtyIndexes managedKeys:self.managedKeys];
 }
 
-- (NSRange)rangeOfRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (void)processEditInRange:(NSRange)editedRange changeInLength:(NSInteger)delta
 {
-    NSRange captureRange = NSNotFoundRange;
-    NSRange captureNameRange = NSNotFoundRange;
-    NSRange finalRange;
+    NSString *string = self.attributedString.string;
+    NSCAssert(NSMaxRange(editedRange) <= string.length, @"editedRange (%@) is past the string length (%lu)", NSStringFromRange(editedRange), string.length);
+    NSCAssert((NSInteger)editedRange.length - delta >= 0, @"delta (%ld) is larger than the edited range length (%lu)", delta, editedRange.length);
+    NSUInteger oldEditEnd = (NSUInteger)((NSInteger)NSMaxRange(editedRange) - delta);
 
-    if (capture != NSNotFound) {
-        NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-        if (!matches || matches.count == 0) { return NSNotFoundRange; }
-        captureRange = [matches.firstObject rangeAtIndex:capture];
+    for (RKXHighlightRule *rule in self.rules) {
+        [self _shiftMatchRangesOfRule:rule editLocation:editedRange.location oldEditEnd:oldEditEnd newEditEnd:NSMaxRange(editedRange) delta:delta];
     }
 
-    if (captureName) {
-        NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-        if (!matches || matches.count == 0) { return NSNotFoundRange; }
-        NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-parameter"
-        NSUInteger index = [captureNames indexOfObjectPassingTest:^BOOL(NSString * _Nonnull name, NSUInteger idx, BOOL * _Nonnull stop) {
-            return [name isEqualToString:captureName];
-        }];
-#pragma clang diagnostic pop
+    NSMutableIndexSet *dirtyIndexes = [NSMutableIndexSet indexSetWithIndexesInRange:editedRange];
+    NSRange lineWindow = [string lineRangeForRange:editedRange];
 
-        if (@available(macOS 10.13, *)) {
-            captureNameRange = (index != NSNotFound) ? [matches.firstObject rangeWithName:captureName] : NSNotFoundRange;
-        }
-        else {
-            // Fallback on earlier versions
-            captureNameRange = NSNotFoundRange;
-        }
+    for (RKXHighlightRule *rule in self.rules) {
+        NSRange window = (rule.isLineBounded) ? lineWindow : string.stringRange;
+        [self _rescanRule:rule inRange:window dirtyIndexes:dirtyIndexes];
     }
 
-    finalRange = [self _earliestRangeForCaptureRange:captureRange namedCaptureRange:captureNameRange];
-    return finalRange;
+    [self _applyRulesToDirtyIndexes:dirtyIndexes managedKeys:self.managedKeys];
 }
 
-- (NSRange)_earliestRangeForCaptureRange:(NSRange)captureRange namedCaptureRange:(NSRange)captureNameRange
+#pragma mark - Private Methods
+
+/// Moves the recorded matches that follow an edit by @c delta. Matches touched by the edit are stretched to cover everything they used to cover, so the diff against the rescan reports all of their characters as changed.
+- (void)_shiftMatchRangesOfRule:(RKXHighlightRule *)rule editLocation:(NSUInteger)editLocation oldEditEnd:(NSUInteger)oldEditEnd newEditEnd:(NSUInteger)newEditEnd delta:(NSInteger)delta
 {
-    BOOL shouldConsiderCaptureRange = (!NSEqualRanges(captureRange, NSNotFoundRange));
-    BOOL shouldConsiderCaptureNameRange = (!NSEqualRanges(captureNameRange, NSNotFoundRange));
-    NSRange finalRange;
+    NSRange *ranges = rule.matchRanges.mutableBytes;
+    NSUInteger count = RKXRangeCount(rule.matchRanges);
 
-    if (shouldConsiderCaptureRange && !shouldConsiderCaptureNameRange) {
-        return captureRange;
-    }
-    else if (!shouldConsiderCaptureRange && shouldConsiderCaptureNameRange) {
-        return captureNameRange;
+    for (NSUInteger i = RKXFirstRangeIndexEndingAfter(ranges, count, editLocation); i < count; i++) {
+        NSUInteger start = ranges[i].location;
+        NSUInteger end = NSMaxRange(ranges[i]);
+
+        if (start >= oldEditEnd) {
+            ranges[i].location = (NSUInteger)((NSInteger)start + delta);
+            continue;
+        }
+
+        NSUInteger newStart = MIN(start, editLocation);
+        NSUInteger newEnd = (end >= oldEditEnd) ? (NSUInteger)((NSInteger)end + delta) : newEditEnd;
+        ranges[i] = NSMakeRange(newStart, MAX(newEnd, newEditEnd) - newStart);
     }
+}
 
-    if (captureRange.location < captureNameRange.location) {
-        finalRange = captureRange;
+/// Replaces the recorded matches of @c rule inside @c window with a fresh scan, adding the ranges that differ between the two to @c dirtyIndexes.
+- (void)_rescanRule:(RKXHighlightRule *)rule inRange:(NSRange)window dirtyIndexes:(NSMutableIndexSet *)dirtyIndexes
+{
+    NSMutableData *freshRanges = [NSMutableData data];
+
+    if (window.length > 0) {
+        NSArray<NSTextCheckingResult *> *matches = [self.attributedString.string _matchesForRegex:rule.pattern range:window options:rule.options matchOptions:(RKXWithTransparentBounds | RKXWithoutAnchoringBounds) error:NULL];
+
+        for (NSTextCheckingResult *match in matches) {
+            NSRange matchRange = match.range;
+            if (matchRange.length == 0) { continue; }
+            [freshRanges appendBytes:&matchRange length:sizeof(NSRange)];
+        }
     }
-    else if (captureNameRange.location < captureRange.location) {
-        finalRange = captureNameRange;
+
+    const NSRange *oldRanges = rule.matchRanges.bytes;
+    NSUInteger oldCount = RKXRangeCount(rule.matchRanges);
+    NSMutableData *merged = [NSMutableData dataWithCapacity:rule.matchRanges.length + freshRanges.length];
+    NSMutableData *staleRanges = [NSMutableData data];
+    NSUInteger oldIndex = 0;
+
+    // Keep the old matches in front of the window and set aside the ones inside it.
+    for (; oldIndex < oldCount && oldRanges[oldIndex].location < NSMaxRange(window); oldIndex++) {
+        if (!oldRanges[oldIndex].length) { continue; }
+        NSMutableData *destination = (NSMaxRange(oldRanges[oldIndex]) <= window.location) ? merged : staleRanges;
+        [destination appendBytes:&oldRanges[oldIndex] length:sizeof(NSRange)];
     }
-    else {
-        // OK, so **WHY** the longest length if there's a location tie?
-        // Basically, even though NSRegularExpression is based on ICU
-        // (which is an NFA regex engine), I'm choosing to return longest length because it's
-        // not entirely clear what the "return match range" should be in an NFA. There's a whole
-        // notion of the NFA working through its matches before exiting and THEN reporting back
-        // the first match. The DFA idea of "same location, longest match wins" is
-        // simpler to implement and understand. At least this is what my understanding is
-        // based on the MRE3 book at the end of chapter 4.
-        
-        if (captureRange.length > captureNameRange.length) {
-            finalRange = captureRange;
+
+    // Diff the old matches inside the window against the fresh ones.
+    const NSRange *staleBytes = staleRanges.bytes;
+    const NSRange *freshBytes = freshRanges.bytes;
+    NSUInteger staleCount = RKXRangeCount(staleRanges), freshCount = RKXRangeCount(freshRanges);
+    NSUInteger staleIndex = 0, freshIndex = 0;
+
+    while (staleIndex < staleCount || freshIndex < freshCount) {
+        if (staleIndex < staleCount && freshIndex < freshCount && NSEqualRanges(staleBytes[staleIndex], freshBytes[freshIndex])) {
+            staleIndex++;
+            freshIndex++;
         }
-        else if (captureNameRange.length > captureRange.length) {
-            finalRange = captureNameRange;
+        else if (freshIndex >= freshCount || (staleIndex < staleCount && staleBytes[staleIndex].location <= freshBytes[freshIndex].location)) {
+            [dirtyIndexes addIndexesInRange:staleBytes[staleIndex++]];
         }
         else {
-            finalRange = captureRange;
+            [dirtyIndexes addIndexesInRange:freshBytes[freshIndex++]];
         }
     }
 
-    return finalRange;
-}
+    [merged appendData:freshRanges];
 
-#pragma mark - rangesOfRegex:
+    // Keep the old matches behind the window.
+    if (oldIndex < oldCount) {
+        [merged appendBytes:&oldRanges[oldIndex] length:(oldCount - oldIndex) * sizeof(NSRange)];
+    }
 
-- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern
-{
-    return [self rangesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    rule.matchRanges = merged;
 }
 
-- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange
+/// The union of the attribute keys of every rule.
+- (NSSet<NSAttributedStringKey> *)managedKeys
 {
-    return [self rangesOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+    NSMutableSet<NSAttributedStringKey> *managedKeys = [NSMutableSet set];
 
-- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
-{
-    return [self rangesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
-}
+    for (RKXHighlightRule *rule in self.rules) {
+        [managedKeys addObjectsFromArray:rule.attributes.allKeys];
+    }
 
-- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
-{
-    return [self rangesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    return [managedKeys copy];
 }
 
-- (NSArray<NSValue *> *)rangesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+/// Clears @c managedKeys inside @c dirtyIndexes and re-applies the rules there, in rule order, inside one editing transaction.
+- (void)_applyRulesToDirtyIndexes:(NSIndexSet *)dirtyIndexes managedKeys:(NSSet<NSAttributedStringKey> *)managedKeys
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return @[]; }
-    NSMutableArray *ranges = [NSMutableArray array];
+    if (!dirtyIndexes.count) { return; }
+    NSMutableAttributedString *target = self.attributedString;
+    NSUInteger targetLength = target.length;
+    [target beginEditing];
 
-    for (NSTextCheckingResult *match in matches) {
-        [ranges addObjectsFromArray:match.ranges];
-    }
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+    [dirtyIndexes enumerateRangesUsingBlock:^(NSRange dirtyRange, BOOL *stop) {
+        if (dirtyRange.location >= targetLength) { return; }
+        dirtyRange.length = MIN(dirtyRange.length, targetLength - dirtyRange.location);
 
-    return [ranges copy];
+        for (NSAttributedStringKey key in managedKeys) {
+            [target removeAttribute:key range:dirtyRange];
+        }
+
+        for (RKXHighlightRule *rule in self.rules) {
+            const NSRange *ranges = rule.matchRanges.bytes;
+            NSUInteger count = RKXRangeCount(rule.matchRanges);
+
+            for (NSUInteger i = RKXFirstRangeIndexEndingAfter(ranges, count, dirtyRange.location); i < count && ranges[i].location < NSMaxRange(dirtyRange); i++) {
+                NSRange overlap = NSIntersectionRange(ranges[i], dirtyRange);
+                if (overlap.length) { [target addAttributes:rule.attributes range:overlap]; }
+            }
+        }
+    }];
+#pragma clang diagnostic pop
+
+    [target endEditing];
 }
 
-#pragma mark - stringByReplacincOccurrencesOfRegex:withTemplate:
+@end
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ
+#pragma mark -
+
+@implementation RKXMatchBuffer
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    NSRange *_ranges;
+    NSUInteger _capacity;
+    unichar *_characters;
+    NSUInteger _characterCapacity;
+    NSString *_pattern;
+    RKXRegexOptions _options;
+    NSRegularExpression *_regex;
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange
+- (instancetype)init
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return [self initWithCapacity:0];
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ options:(RKXRegexOptions)options
+- (instancetype)initWithCapacity:(NSUInteger)capacity
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    if ((self = [super init])) {
+        _rangesPerMatch = 1;
+        if (capacity && !(_ranges = malloc(capacity * sizeof(NSRange)))) { return nil; }
+        _capacity = capacity;
+    }
+
+    return self;
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+- (void)dealloc
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:kNilOptions error:error];
+    free(_ranges);
+    free(_characters);
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (NSRange)rangeOfMatchAtIndex:(NSUInteger)index
 {
-    NSMutableString *target = [self mutableCopy];
-    NSUInteger swapCount = [target replaceOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:matchOptions error:error];
-    if (swapCount == NSNotFound) { return [self substringWithRange:searchRange]; }
-    return [target copy];
+    return [self rangesOfMatchAtIndex:index][0];
 }
 
-#pragma mark - stringMatchedByRegex:
-
-- (NSString *)stringMatchedByRegex:(NSString *)pattern
+- (NSRange)rangeOfMatchAtIndex:(NSUInteger)index captureIndex:(NSUInteger)captureIndex
 {
-    return [self stringMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (captureIndex >= _rangesPerMatch) { [NSException raise:NSRangeException format:@"captureIndex %lu beyond bounds [0 .. %lu]", captureIndex, _rangesPerMatch - 1]; }
+    return [self rangesOfMatchAtIndex:index][captureIndex];
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture
+- (const NSRange *)rangesOfMatchAtIndex:(NSUInteger)index
 {
-    return [self stringMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (index >= _count) { [NSException raise:NSRangeException format:@"index %lu beyond bounds for %lu matches", index, _count]; }
+    return _ranges + index * _rangesPerMatch;
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern namedCapture:(NSString *)captureName
+- (void)removeAllMatches
 {
-    return [self stringMatchedByRegex:pattern range:self.stringRange capture:NSNotFound namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    _count = 0;
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName
+/// Returns the regex for @c pattern and @c options, reusing the one the buffer was last filled with instead of building a cache key when they are unchanged.
+- (NSRegularExpression *)regexForPattern:(NSString *)pattern options:(RKXRegexOptions)options error:(NSError **)error
 {
-    return [self stringMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (_regex && _options == options && (_pattern == pattern || [_pattern isEqualToString:pattern])) { return _regex; }
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+
+    if (regex) {
+        _pattern = [pattern copy];
+        _options = options;
+        _regex = regex;
+    }
+
+    return regex;
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options
+- (void)resetWithRangesPerMatch:(NSUInteger)rangesPerMatch
 {
-    return [self stringMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:options matchOptions:kNilOptions error:NULL];
+    _count = 0;
+    _rangesPerMatch = rangesPerMatch;
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+/// Grows the storage to hold at least @c needed ranges. Returns @c NO if it could not grow.
+- (BOOL)reserveRanges:(NSUInteger)needed
 {
-    return [self stringMatchedByRegex:pattern range:searchRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if (needed <= _capacity) { return YES; }
+    NSUInteger capacity = MAX(_capacity * 2, MAX(needed, 16UL));
+    NSRange *grown = realloc(_ranges, capacity * sizeof(NSRange));
+    if (!grown) { return NO; }
+    _ranges = grown;
+    _capacity = capacity;
+    return YES;
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+/// Makes room for one more match and returns its @c rangesPerMatch ranges to fill in, or @c NULL if the storage could not grow.
+- (NSRange *)appendMatch
 {
-    return [self stringMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:options matchOptions:kNilOptions error:NULL];
+    if (![self reserveRanges:(_count + 1) * _rangesPerMatch]) { return NULL; }
+    return _ranges + (_count++) * _rangesPerMatch;
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options error:(NSError **)error
+- (void)truncateToCount:(NSUInteger)count
 {
-    return [self stringMatchedByRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:kNilOptions error:error];
+    _count = MIN(_count, count);
 }
 
-- (NSString *)stringMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+/// Replaces the ranges of each match with its ranges at @c indexes, in that order, so that every match keeps @c count ranges.
+/// The selected ranges are gathered past the stored ones and then moved to the front, so no index can read a range that was
+/// already overwritten. Returns @c NO if the storage could not grow.
+- (BOOL)selectRangesAtIndexes:(const NSUInteger *)indexes count:(NSUInteger)count
 {
-    NSRange range = [self rangeOfRegex:pattern range:searchRange capture:capture namedCapture:captureName options:options matchOptions:matchOptions error:error];
-    if (NSEqualRanges(range, NSNotFoundRange)) { return nil; }
-    NSString *result = [self substringWithRange:range];
-    return result;
-}
+    NSUInteger stored = _count * _rangesPerMatch;
+    if (!_count) { _rangesPerMatch = count; return YES; }
+    if (![self reserveRanges:stored + _count * count]) { return NO; }
+    NSRange *selected = _ranges + stored;
 
-#pragma mark - substringsMatchedByRegex:
+    for (NSUInteger i = 0; i < _count; i++) {
+        const NSRange *match = _ranges + i * _rangesPerMatch;
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern
-{
-    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+        for (NSUInteger j = 0; j < count; j++) {
+            selected[i * count + j] = match[indexes[j]];
+        }
+    }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture
-{
-    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    memmove(_ranges, selected, _count * count * sizeof(NSRange));
+    _rangesPerMatch = count;
+    return YES;
 }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern capture:(NSUInteger)capture namedCapture:(NSString *)captureName
+/// Returns scratch storage for @c length characters that stays valid until the next call.
+- (unichar *)characterStorageOfLength:(NSUInteger)length
 {
-    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:capture namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+    if (length > _characterCapacity || !_characters) {
+        NSUInteger capacity = MAX(length, 64UL);
+        unichar *grown = realloc(_characters, capacity * sizeof(unichar));
+        if (!grown) { return NULL; }
+        _characters = grown;
+        _characterCapacity = capacity;
+    }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern namedCapture:(NSString *)captureName
-{
-    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:NSNotFound namedCapture:captureName options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return _characters;
 }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
+@end
+
+#pragma mark -
+
+@implementation RKXLineMatch
+
+- (instancetype)initWithLineNumber:(NSUInteger)lineNumber lineRange:(NSRange)lineRange matchRanges:(NSArray<NSValue *> *)matchRanges contextLine:(BOOL)contextLine
 {
-    return [self substringsMatchedByRegex:pattern range:searchRange capture:0 namedCapture:nil options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    if ((self = [super init])) {
+        _lineNumber = lineNumber;
+        _lineRange = lineRange;
+        _matchRanges = [matchRanges copy];
+        _contextLine = contextLine;
+    }
+
+    return self;
 }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+@end
+
+#pragma mark -
+
+@implementation RKXExtractionSchema
 {
-    return [self substringsMatchedByRegex:pattern range:self.stringRange capture:0 namedCapture:nil options:options matchOptions:kNilOptions error:NULL];
+    NSRegularExpression *_regex;
+    RKXLinearProgram *_linearProgram;
+    NSUInteger *_captureIndexes;
 }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture options:(RKXRegexOptions)options error:(NSError **)error
++ (instancetype)schemaWithRegex:(NSString *)pattern options:(RKXRegexOptions)options error:(NSError **)error keysAndCaptures:(id)firstKey, ... NS_REQUIRES_NIL_TERMINATION
 {
-    return [self substringsMatchedByRegex:pattern range:searchRange capture:capture namedCapture:nil options:options matchOptions:kNilOptions error:error];
+    va_list varArgsList;
+    va_start(varArgsList, firstKey);
+    NSArray *captureKeyIndexes;
+    NSArray *captureKeys = [pattern _keysForVarArgsList:varArgsList withFirstKey:firstKey indexes:&captureKeyIndexes];
+    va_end(varArgsList);
+    return [[self alloc] initWithRegex:pattern options:options keys:captureKeys forCaptures:captureKeyIndexes error:error];
 }
 
-- (NSArray<NSString *> *)substringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange capture:(NSUInteger)capture namedCapture:(NSString *)captureName options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options keys:(NSArray<NSString *> *)keys forCaptures:(NSArray<NSNumber *> *)captures error:(NSError **)error
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return @[]; }
-    NSMutableArray *captures = [NSMutableArray array];
-
-    if (capture != NSNotFound) {
-        for (NSTextCheckingResult *match in matches) {
-            NSRange matchRange = [match rangeAtIndex:capture];
-            NSString *matchString = (matchRange.location != NSNotFound) ? [self substringWithRange:matchRange] : RKXEmptyStringKey;
-            [captures addObject:matchString];
-        }
+    NSCParameterAssert(pattern);
+    if (!(self = [super init])) { return nil; }
+    _regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!_regex) { return nil; }
+    NSUInteger captureCount = _regex.numberOfCaptureGroups;
+    NSString *reason = nil;
+
+    if (keys.count != captures.count) {
+        reason = [NSString stringWithFormat:@"%lu keys were given for %lu captures.", keys.count, captures.count];
+    }
+    else if (!keys.count) {
+        reason = @"No keys were given.";
+    }
+    else if (!(_captureIndexes = malloc(keys.count * sizeof(NSUInteger)))) {
+        return nil;
     }
 
-    if (!captureName) { return [captures copy]; }
-    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
-    if (!captureNames) { return [captures copy]; }
-    NSUInteger index = NSNotFound;
+    for (NSUInteger i = 0; !reason && i < captures.count; i++) {
+        NSInteger capture = captures[i].integerValue;
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-parameter"
-    index = [captureNames indexOfObjectPassingTest:^BOOL(NSString * _Nonnull name, NSUInteger idx, BOOL * _Nonnull stop) {
-        return [name isEqualToString:captureName];
-    }];
-#pragma clang diagnostic pop
+        if (capture < 0 || (NSUInteger)capture > captureCount) {
+            reason = [NSString stringWithFormat:@"Capture %ld of key \"%@\" is not one of the %lu capture groups of the pattern.", capture, keys[i], captureCount];
+        }
 
-    if (index == NSNotFound) { return [captures copy]; }
+        _captureIndexes[i] = (NSUInteger)capture;
+    }
 
-    for (NSTextCheckingResult *match in matches) {
-        if (@available(macOS 10.13, *)) {
-            NSRange captureNameMatchRange = [match rangeWithName:captureName];
-            NSString *captureNameMatchString = [self substringWithRange:captureNameMatchRange];
-            [captures addObject:captureNameMatchString];
-        }
-        else {
-            return [captures copy];
+    if (reason) {
+        if (error != NULL) {
+            NSDictionary *info = @{ NSLocalizedDescriptionKey : NSLocalizedString(@"The keys and captures do not fit the pattern.", nil),
+                                    NSLocalizedFailureReasonErrorKey : reason };
+            *error = [NSError errorWithDomain:RKXExtractionSchemaErrorDomain code:RKXExtractionSchemaInvalidCaptureError userInfo:info];
         }
+
+        return nil;
     }
 
-    return [captures copy];
+    _pattern = [pattern copy];
+    _options = options;
+    _keys = [keys copy];
+    _captures = [captures copy];
+    _linearProgram = [RKXLinearProgram linearProgramForRegex:_regex];
+    return self;
 }
 
-#pragma mark - substringsSeparatedByRegex:
-
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern
+- (void)dealloc
 {
-    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    free(_captureIndexes);
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedInString:(NSString *)string
 {
-    return [self substringsSeparatedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return [self dictionaryMatchedInString:string range:string.stringRange matchOptions:kNilOptions error:NULL];
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+- (NSDictionary<NSString *, NSString *> *)dictionaryMatchedInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
 {
-    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    NSTextCheckingResult *match;
+
+    // ICU can stop at the first match unless the matching has to be timed or routed to the linear-time engine.
+    if (!OptionsHasValue(matchOptions, RKXReportProgress) && !_linearProgram.prefersLinearEngine) {
+        match = [_regex firstMatchInString:string options:(NSMatchingOptions)matchOptions range:searchRange];
+    }
+    else {
+        match = [string _matchesForRegularExpression:_regex range:searchRange matchOptions:matchOptions error:error].firstObject;
+    }
+
+    return [self dictionaryForMatch:match inString:string];
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesMatchedInString:(NSString *)string
 {
-    return [self substringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    return [self arrayOfDictionariesMatchedInString:string range:string.stringRange matchOptions:kNilOptions error:NULL];
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesMatchedInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
 {
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
+    NSArray<NSTextCheckingResult *> *matches = [string _matchesForRegularExpression:_regex range:searchRange matchOptions:matchOptions error:error];
     if (!matches) { return nil; }
-    if (!matches.count) { return @[ self ]; }
-    NSMutableArray *components = [NSMutableArray array];
-    NSUInteger pos = 0;
+    NSMutableArray *dictArray = [NSMutableArray arrayWithCapacity:matches.count];
 
     for (NSTextCheckingResult *match in matches) {
-        NSRange subrange = NSMakeRange(pos, match.range.location - pos);
-        [components addObject:[self substringWithRange:subrange]];
-        pos = match.range.location + match.range.length;
+        [dictArray addObject:[self dictionaryForMatch:match inString:string]];
     }
 
-    if (pos < searchRange.length) {
-        [components addObject:[self substringFromIndex:pos]];
-    }
-
-    return [components copy];
+    return [dictArray copy];
 }
 
-#pragma mark - Blocks-based API
+- (NSUInteger)getRecordsInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions buffer:(RKXMatchBuffer *)buffer error:(NSError **)error
+{
+    NSUInteger count = [string getMatchesOfRegex:_pattern range:searchRange options:_options matchOptions:matchOptions buffer:buffer error:error];
+    if (count == NSNotFound) { return NSNotFound; }
 
-#pragma mark - enumerateStringsMatchedByRegex:usingBlock:
+    if (![buffer selectRangesAtIndexes:_captureIndexes count:_keys.count]) {
+        [buffer removeAllMatches];
+        return NSNotFound;
+    }
 
-- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
-{
-    return [self enumerateStringsMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+    return count;
 }
 
-- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+/// Builds the dictionary for @c match, or the one of empty strings the @c withKeys:forCaptures: methods have always returned when there is no match.
+- (NSDictionary<NSString *, NSString *> *)dictionaryForMatch:(NSTextCheckingResult *)match inString:(NSString *)string
 {
-    return [self enumerateStringsMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
-}
+    NSUInteger keyCount = _keys.count;
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:keyCount];
 
-- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
-{
-    return [self enumerateStringsMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:error usingBlock:block];
+    for (NSUInteger i = 0; i < keyCount; i++) {
+        NSRange captureRange = (match) ? [match rangeAtIndex:_captureIndexes[i]] : NSNotFoundRange;
+        [values addObject:(captureRange.length > 0) ? [string substringWithRange:captureRange] : RKXEmptyStringKey];
+    }
+
+    return [NSDictionary dictionaryWithObjects:values forKeys:_keys];
 }
 
-- (BOOL)enumerateStringsMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+@end
+
+#pragma mark -
+
+/// One distinct string of a @c RKXInternTable: the hash of its characters, where they start in the table's character store
+/// and how many there are. @c index is one more than the string's index in the table's array, so @c 0 marks an empty slot.
+typedef struct {
+    NSUInteger hash;
+    NSUInteger offset;
+    NSUInteger length;
+    NSUInteger index;
+} RKXInternEntry;
+
+/// 64-bit FNV-1a over UTF-16 code units.
+static inline NSUInteger RKXHashCharacters(const unichar *chars, NSUInteger length)
 {
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches || matches.count == 0) { return NO; }
-    __block BOOL blockStop = NO;
+    uint64_t hash = 14695981039346656037ULL;
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-parameter"
-    [matches enumerateObjectsWithOptions:enumOpts usingBlock:^(NSTextCheckingResult *match, NSUInteger idx, BOOL * _Nonnull stop) {
-        block([match substringsFromString:self], match.ranges, &blockStop);
-        *stop = blockStop;
-    }];
-#pragma clang diagnostic pop
+    for (NSUInteger i = 0; i < length; i++) {
+        hash = (hash ^ (uint64_t)chars[i]) * 1099511628211ULL;
+    }
 
-    return YES;
+    return (NSUInteger)hash;
 }
 
-#pragma mark - enumerateStringsSeparatedByRegex:usingBlock:
-
-- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+@implementation RKXInternTable
 {
-    return [self enumerateStringsSeparatedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+    NSMutableArray<NSString *> *_strings;
+    RKXInternEntry *_entries;
+    NSUInteger _slotCount;
+    unichar *_store;
+    NSUInteger _storeLength;
+    NSUInteger _storeCapacity;
+    unichar *_scratch;
+    NSUInteger _scratchCapacity;
 }
 
-- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (instancetype)init
 {
-    return [self enumerateStringsSeparatedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:NULL usingBlock:block];
+    if ((self = [super init])) {
+        _strings = [NSMutableArray array];
+    }
+
+    return self;
 }
 
-- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (void)dealloc
 {
-    return [self enumerateStringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions enumerationOptions:kNilOptions error:error usingBlock:block];
+    free(_entries);
+    free(_store);
+    free(_scratch);
 }
 
-- (BOOL)enumerateStringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions enumerationOptions:(NSEnumerationOptions)enumOpts error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (NSUInteger)count
 {
-    NSString *target = [self substringWithRange:searchRange];
-    NSRange targetRange = target.stringRange;
-    NSArray<NSTextCheckingResult *> *matches = [target _matchesForRegex:pattern range:targetRange options:options matchOptions:matchOptions error:error];
-    if (!matches || matches.count == 0) { return NO; }
-    NSArray *strings = [target substringsSeparatedByRegex:pattern range:targetRange options:options matchOptions:matchOptions error:error];
-    NSUInteger lastStringIndex = [strings indexOfObject:strings.lastObject];
-    __block NSRange remainderRange = targetRange;
-    __block BOOL blockStop = NO;
+    return _strings.count;
+}
 
-    [strings enumerateObjectsWithOptions:enumOpts usingBlock:^(NSString *topString, NSUInteger idx, BOOL * _Nonnull stop) {
-        NSRange topStringRange = [target rangeOfString:topString options:NSBackwardsSearch range:remainderRange];
-        NSTextCheckingResult *match = (idx < lastStringIndex) ? matches[idx] : nil;
+- (NSString *)internedSubstringOfString:(NSString *)string range:(NSRange)range
+{
+    if (NSMaxRange(range) > string.length) { [NSException raise:NSRangeException format:@"range %@ beyond bounds for length %lu", NSStringFromRange(range), string.length]; }
+    if (!range.length) { return RKXEmptyStringKey; }
+    const unichar *chars = CFStringGetCharactersPtr((__bridge CFStringRef)string);
 
-        if (match) {
-            NSMutableArray *captures = [NSMutableArray array];
-            NSMutableArray<NSValue *> *rangeCaptures = [@[ [NSValue valueWithRange:topStringRange] ] mutableCopy];
-            [captures addObject:topString];
-            [rangeCaptures addObjectsFromArray:match.ranges];
-            [captures addObjectsFromArray:[match substringsFromString:self]];
-            remainderRange = rangeCaptures.lastObject.rangeValue;
-            remainderRange = (enumOpts == 0) ? [target rangeFromLocation:remainderRange.location] : [target rangeToLocation:remainderRange.location];
-            block([captures copy], [rangeCaptures copy], &blockStop);
-        }
-        else {
-            NSRange lastRange = [target rangeOfString:topString options:NSBackwardsSearch range:remainderRange];
-            block(@[ topString ], @[ [NSValue valueWithRange:lastRange] ], &blockStop);
+    if (chars) {
+        chars += range.location;
+    }
+    else {
+        if (range.length > _scratchCapacity) {
+            unichar *grown = realloc(_scratch, range.length * sizeof(unichar));
+            if (!grown) { return [string substringWithRange:range]; }
+            _scratch = grown;
+            _scratchCapacity = range.length;
         }
 
-        if (blockStop) { *stop = YES; }
-    }];
+        [string getCharacters:_scratch range:range];
+        chars = _scratch;
+    }
 
-    return YES;
-}
+    if ((_strings.count + 1) * 2 > _slotCount && ![self growSlots]) { return [string substringWithRange:range]; }
+    NSUInteger hash = RKXHashCharacters(chars, range.length);
+    NSUInteger slot = hash & (_slotCount - 1);
 
-#pragma mark - stringByReplacingOccurrencesOfRegex:usingBlock:
+    for (; _entries[slot].index; slot = (slot + 1) & (_slotCount - 1)) {
+        RKXInternEntry entry = _entries[slot];
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
-{
-    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:block];
-}
+        if (entry.hash == hash && entry.length == range.length && !memcmp(_store + entry.offset, chars, range.length * sizeof(unichar))) {
+            return _strings[entry.index - 1];
+        }
+    }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
-{
-    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL usingBlock:block];
+    if (_storeLength + range.length > _storeCapacity) {
+        NSUInteger capacity = MAX(_storeCapacity * 2, MAX(_storeLength + range.length, 256UL));
+        unichar *grown = realloc(_store, capacity * sizeof(unichar));
+        if (!grown) { return [string substringWithRange:range]; }
+        _store = grown;
+        _storeCapacity = capacity;
+    }
+
+    NSString *interned = [[NSString alloc] initWithCharacters:chars length:range.length];
+    [_strings addObject:interned];
+    memcpy(_store + _storeLength, chars, range.length * sizeof(unichar));
+    _entries[slot] = (RKXInternEntry){ .hash = hash, .offset = _storeLength, .length = range.length, .index = _strings.count };
+    _storeLength += range.length;
+    return interned;
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (void)removeAllStrings
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error usingBlock:block];
+    [_strings removeAllObjects];
+    if (_entries) { memset(_entries, 0, _slotCount * sizeof(RKXInternEntry)); }
+    _storeLength = 0;
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+/// Doubles the number of hash slots, which are kept at least twice the number of strings so that probes stay short.
+- (BOOL)growSlots
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return [self substringWithRange:searchRange]; }
-    NSMutableString *target = [self mutableCopy];
-    BOOL stop = NO;
-    
-    if (!matches.count) {
-        return [NSString stringWithString:self];
-    }
-    
-    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
-        NSString *swap = block([match substringsFromString:self], match.ranges, &stop);
-        [target replaceCharactersInRange:match.range withString:swap];
-        if (stop) { break; }
+    NSUInteger slotCount = MAX(_slotCount * 2, 16UL);
+    RKXInternEntry *entries = calloc(slotCount, sizeof(RKXInternEntry));
+    if (!entries) { return NO; }
+
+    for (NSUInteger i = 0; i < _slotCount; i++) {
+        if (!_entries[i].index) { continue; }
+        NSUInteger slot = _entries[i].hash & (slotCount - 1);
+        while (entries[slot].index) { slot = (slot + 1) & (slotCount - 1); }
+        entries[slot] = _entries[i];
     }
-    
-    return [target copy];
+
+    free(_entries);
+    _entries = entries;
+    _slotCount = slotCount;
+    return YES;
 }
 
-#pragma mark - countOfRegex:
+@end
 
-- (NSUInteger)countOfRegex:(NSString *)pattern
-{
-    return [self countOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+#pragma mark -
 
-- (NSUInteger)countOfRegex:(NSString *)pattern range:(NSRange)searchRange
-{
-    return [self countOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+@interface RKXQueryResult ()
+- (instancetype)initWithMatched:(BOOL)matched firstRange:(NSRange)firstRange captureSubstrings:(NSArray<NSString *> *)captureSubstrings namedCaptures:(NSDictionary<NSString *, NSString *> *)namedCaptures count:(NSUInteger)count ranges:(NSArray<NSValue *> *)ranges substrings:(NSArray<NSString *> *)substrings;
+@end
 
-- (NSUInteger)countOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
-{
-    return [self countOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
-}
+@implementation RKXQueryResult
 
-- (NSUInteger)countOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (instancetype)initWithMatched:(BOOL)matched firstRange:(NSRange)firstRange captureSubstrings:(NSArray<NSString *> *)captureSubstrings namedCaptures:(NSDictionary<NSString *, NSString *> *)namedCaptures count:(NSUInteger)count ranges:(NSArray<NSValue *> *)ranges substrings:(NSArray<NSString *> *)substrings
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return 0; }
-    return matches.count;
+    if ((self = [super init])) {
+        _matched = matched;
+        _firstRange = firstRange;
+        _captureSubstrings = [captureSubstrings copy];
+        _namedCaptures = [namedCaptures copy];
+        _count = count;
+        _ranges = [ranges copy];
+        _substrings = [substrings copy];
+    }
+
+    return self;
 }
 
-#pragma mark - firstMatchOfRegex:
+@end
 
-- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern
+@implementation RKXQuery
 {
-    return [self firstMatchOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    NSRegularExpression *_regex;
+    RKXLinearProgram *_linearProgram;
+    NSArray<NSString *> *_captureNames;
 }
 
-- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange
++ (instancetype)queryWithRegex:(NSString *)pattern options:(RKXRegexOptions)options outputs:(RKXQueryOutputs)outputs error:(NSError **)error
 {
-    return [self firstMatchOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return [[self alloc] initWithRegex:pattern options:options outputs:outputs error:error];
 }
 
-- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern options:(RKXRegexOptions)options
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options outputs:(RKXQueryOutputs)outputs error:(NSError **)error
 {
-    return [self firstMatchOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    NSCParameterAssert(pattern);
+    if (!(self = [super init])) { return nil; }
+    _regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!_regex) { return nil; }
+    _pattern = [pattern copy];
+    _options = options;
+    _outputs = outputs;
+    _linearProgram = [RKXLinearProgram linearProgramForRegex:_regex];
+    if (outputs & RKXQueryNamedCaptures) { _captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern]; }
+    return self;
 }
 
-- (NSTextCheckingResult *)firstMatchOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (RKXQueryResult *)resultInString:(NSString *)string
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    return matches.firstObject;
+    return [self resultInString:string range:string.stringRange matchOptions:kNilOptions error:NULL];
 }
 
-#pragma mark - Regex Cache Management
-
-+ (void)clearRegexCache
+- (RKXQueryResult *)resultInString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
 {
-    NSMutableDictionary *threadDict = NSThread.currentThread.threadDictionary;
-    NSArray *keys = [threadDict.allKeys copy];
+    RKXQueryOutputs everyMatch = RKXQueryCount | RKXQueryRanges | RKXQuerySubstrings;
+    BOOL needsCaptures = (_outputs & (RKXQueryCaptureSubstrings | RKXQueryNamedCaptures)) || ((_outputs & RKXQueryRanges) && _regex.numberOfCaptureGroups > 0);
+    NSArray<NSTextCheckingResult *> *matches = nil;
+    NSTextCheckingResult *firstMatch = nil;
+    NSMutableArray<NSValue *> *wholeMatchRanges = nil;
+    NSUInteger count = NSNotFound;
 
-    for (NSString *key in keys) {
-        if ([threadDict[key] isKindOfClass:[NSRegularExpression class]]) {
-            [threadDict removeObjectForKey:key];
+    // Without capture groups to report, the lazy DFA can find every match without building results.
+    if ((_outputs & everyMatch) && !needsCaptures && _linearProgram) {
+        wholeMatchRanges = (_outputs & (RKXQueryFirstRange | RKXQueryRanges | RKXQuerySubstrings)) ? [NSMutableArray array] : nil;
+        count = [_linearProgram countOfMatchesInString:string range:searchRange matchOptions:matchOptions limit:NSUIntegerMax ranges:wholeMatchRanges];
+        if (count == NSNotFound) { wholeMatchRanges = nil; }
+    }
+
+    if (count == NSNotFound) {
+        // Only the first match is needed, so ICU can stop there unless the matching has to be timed or routed to the linear-time engine.
+        if (!(_outputs & everyMatch) && !OptionsHasValue(matchOptions, RKXReportProgress) && !_linearProgram.prefersLinearEngine) {
+            firstMatch = [_regex firstMatchInString:string options:(NSMatchingOptions)matchOptions range:searchRange];
+        }
+        else {
+            matches = [string _matchesForRegularExpression:_regex range:searchRange matchOptions:matchOptions error:error];
+            if (!matches) { return nil; }
+            firstMatch = matches.firstObject;
+            count = matches.count;
         }
     }
-}
 
-+ (NSUInteger)regexCacheCount
-{
-    NSMutableDictionary *threadDict = NSThread.currentThread.threadDictionary;
-    NSUInteger count = 0;
+    NSRange firstRange = NSNotFoundRange;
+    NSArray<NSString *> *captureSubstrings = nil;
+    NSMutableDictionary<NSString *, NSString *> *namedCaptures = nil;
+    NSMutableArray<NSValue *> *ranges = nil;
+    NSMutableArray<NSString *> *substrings = nil;
 
-    for (NSString *key in threadDict) {
-        if ([threadDict[key] isKindOfClass:[NSRegularExpression class]]) {
-            count++;
+    if (_outputs & RKXQueryFirstRange) {
+        if (firstMatch) { firstRange = firstMatch.range; }
+        else if (wholeMatchRanges.count) { firstRange = wholeMatchRanges.firstObject.rangeValue; }
+    }
+
+    if (_outputs & RKXQueryCaptureSubstrings) {
+        captureSubstrings = (firstMatch) ? [firstMatch substringsFromString:string] : @[];
+    }
+
+    if (_outputs & RKXQueryNamedCaptures) {
+        namedCaptures = [NSMutableDictionary dictionary];
+
+        for (NSString *captureName in _captureNames) {
+            if (!firstMatch) { break; }
+
+            if (@available(macOS 10.13, *)) {
+                NSRange captureNameRange = [firstMatch rangeWithName:captureName];
+                if (captureNameRange.location != NSNotFound) { namedCaptures[captureName] = [string substringWithRange:captureNameRange]; }
+            }
         }
     }
 
-    return count;
-}
+    if (_outputs & RKXQueryRanges) {
+        ranges = (wholeMatchRanges) ? wholeMatchRanges : [NSMutableArray array];
+        for (NSTextCheckingResult *match in matches) { [ranges addObjectsFromArray:match.ranges]; }
+    }
 
-#pragma mark - regexValidationError
+    if (_outputs & RKXQuerySubstrings) {
+        substrings = [NSMutableArray arrayWithCapacity:count];
+        for (NSValue *matchRange in wholeMatchRanges) { [substrings addObject:[string substringWithRange:matchRange.rangeValue]]; }
+        for (NSTextCheckingResult *match in matches) { [substrings addObject:[string substringWithRange:match.range]]; }
+    }
 
-- (NSError *)regexValidationError
-{
-    return [self regexValidationErrorWithOptions:RKXNoOptions];
+    BOOL matched = (firstMatch != nil) || (count != NSNotFound && count > 0);
+    NSUInteger reportedCount = (_outputs & RKXQueryCount) ? count : NSNotFound;
+    return [[RKXQueryResult alloc] initWithMatched:matched firstRange:firstRange captureSubstrings:captureSubstrings namedCaptures:namedCaptures count:reportedCount ranges:ranges substrings:substrings];
 }
 
-- (NSError *)regexValidationErrorWithOptions:(RKXRegexOptions)options
-{
-    NSError *error = nil;
-    NSRegularExpressionOptions regexOptions = (NSRegularExpressionOptions)options;
-    [NSRegularExpression regularExpressionWithPattern:self options:regexOptions error:&error];
-    return error;
-}
+@end
 
-#pragma mark - arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:
+#pragma mark -
 
-- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern
-{
-    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
-}
+/// The fields of a @c RKXMatchCursor resume token, stored little-endian in this order and followed by the pattern in UTF-8.
+typedef NS_ENUM(NSUInteger, RKXMatchCursorTokenField) {
+    RKXMatchCursorTokenVersion,
+    RKXMatchCursorTokenOptions,
+    RKXMatchCursorTokenMatchOptions,
+    RKXMatchCursorTokenRangeLocation,
+    RKXMatchCursorTokenRangeLength,
+    RKXMatchCursorTokenPosition,
+    RKXMatchCursorTokenMatchCount,
+    RKXMatchCursorTokenStringLength,
+    RKXMatchCursorTokenStringDigest,
+    RKXMatchCursorTokenFieldCount
+};
+
+static uint64_t const RKXMatchCursorTokenCurrentVersion = 2;
+
+/// 64-bit FNV-1a over every UTF-16 code unit of @c string, so that a token notices a change anywhere in it. @c -hash
+/// only looks at a few characters of a long string.
+static uint64_t RKXMatchCursorDigestOfString(NSString *string)
+{
+    unichar chars[1024];
+    uint64_t digest = 14695981039346656037ULL;
+    NSUInteger length = string.length;
+
+    for (NSUInteger location = 0; location < length; location += 1024) {
+        NSRange chunk = NSMakeRange(location, MIN((NSUInteger)1024, length - location));
+        [string getCharacters:chars range:chunk];
+        for (NSUInteger i = 0; i < chunk.length; i++) { digest = (digest ^ (uint64_t)chars[i]) * 1099511628211ULL; }
+    }
 
-- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange
-{
-    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    return digest;
 }
 
-- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern options:(RKXRegexOptions)options
+@implementation RKXMatchCursor
 {
-    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    NSRegularExpression *_regex;
+    NSString *_text;        // the characters within searchRange, which the searches run over
+    NSUInteger _position;   // where the next search starts, relative to _text; past its end once finished
+    NSArray<NSTextCheckingResult *> *_page;  // keeps the matches handed to fast enumeration alive
+    unsigned long _mutations;
+    uint64_t _stringDigest; // RKXMatchCursorDigestOfString(_string), once a token has needed it
+    BOOL _hasStringDigest;
 }
 
-- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
++ (instancetype)cursorWithRegex:(NSString *)pattern inString:(NSString *)string
 {
-    return [self arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
+    return [[self alloc] initWithRegex:pattern options:RKXNoOptions string:string range:string.stringRange matchOptions:kNilOptions error:NULL];
 }
 
-- (NSArray<NSDictionary<NSString *, NSString *> *> *)arrayOfDictionariesWithNamedCaptureKeysMatchedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+- (instancetype)initWithRegex:(NSString *)pattern options:(RKXRegexOptions)options string:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
 {
-    if (![pattern isRegexValidWithOptions:options error:error]) { return nil; }
-    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
-    if (!captureNames || !captureNames.count) { return @[]; }
-
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return @[]; }
-    NSMutableArray *results = [NSMutableArray array];
-
-    for (NSTextCheckingResult *match in matches) {
-        NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    NSCParameterAssert(pattern);
+    NSCParameterAssert(string);
+    if (!(self = [super init])) { return nil; }
+    _regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+    if (!_regex) { return nil; }
+    _pattern = [pattern copy];
+    _options = options;
+    _matchOptions = matchOptions;
+    _string = [string copy];
+    _searchRange = searchRange;
+    // As with the concurrent replacement, a copy of the range keeps its ends the ends of the text, so every
+    // search can use transparent, non-anchoring bounds and still see what one search over the range would.
+    _text = (NSEqualRanges(searchRange, _string.stringRange)) ? _string : [_string substringWithRange:searchRange];
+    return self;
+}
+
+- (instancetype)initWithResumeToken:(NSData *)token string:(NSString *)string error:(NSError **)error
+{
+    NSCParameterAssert(token);
+    NSCParameterAssert(string);
+    NSUInteger headerLength = RKXMatchCursorTokenFieldCount * sizeof(uint64_t);
+    uint64_t fields[RKXMatchCursorTokenFieldCount];
+    NSString *reason = nil;
+    NSString *pattern = nil;
+
+    if (token.length <= headerLength) {
+        reason = @"The token is too short to hold a cursor.";
+    }
+    else {
+        [token getBytes:fields length:headerLength];
+        for (NSUInteger i = 0; i < RKXMatchCursorTokenFieldCount; i++) { fields[i] = CFSwapInt64LittleToHost(fields[i]); }
+        pattern = [[NSString alloc] initWithData:[token subdataWithRange:NSMakeRange(headerLength, token.length - headerLength)] encoding:NSUTF8StringEncoding];
+        uint64_t rangeEnd = fields[RKXMatchCursorTokenRangeLocation] + fields[RKXMatchCursorTokenRangeLength];
 
-        for (NSString *captureName in captureNames) {
-            if (@available(macOS 10.13, *)) {
-                NSRange nameRange = [match rangeWithName:captureName];
-                if (nameRange.location != NSNotFound) {
-                    dict[captureName] = [self substringWithRange:nameRange];
-                }
-                else {
-                    dict[captureName] = RKXEmptyStringKey;
-                }
-            }
+        if (fields[RKXMatchCursorTokenVersion] != RKXMatchCursorTokenCurrentVersion || !pattern) {
+            reason = @"The token is damaged or was made by another version of RegexKitX.";
+        }
+        else if (fields[RKXMatchCursorTokenStringLength] != string.length || fields[RKXMatchCursorTokenStringDigest] != RKXMatchCursorDigestOfString(string)) {
+            reason = @"The token was made for another string.";
         }
+        else if (rangeEnd < fields[RKXMatchCursorTokenRangeLocation] || rangeEnd > string.length || fields[RKXMatchCursorTokenPosition] > fields[RKXMatchCursorTokenRangeLength] + 1) {
+            reason = @"The token is damaged or was made by another version of RegexKitX.";
+        }
+    }
 
-        [results addObject:[dict copy]];
+    if (reason) {
+        if (error) {
+            NSDictionary *userInfo = @{ NSLocalizedDescriptionKey : @"The match cursor could not be resumed.",
+                                        NSLocalizedFailureReasonErrorKey : reason };
+            *error = [NSError errorWithDomain:RKXMatchCursorErrorDomain code:RKXMatchCursorInvalidTokenError userInfo:userInfo];
+        }
+        return nil;
     }
 
-    return [results copy];
+    NSRange searchRange = NSMakeRange((NSUInteger)fields[RKXMatchCursorTokenRangeLocation], (NSUInteger)fields[RKXMatchCursorTokenRangeLength]);
+    self = [self initWithRegex:pattern options:(RKXRegexOptions)fields[RKXMatchCursorTokenOptions] string:string range:searchRange matchOptions:(RKXMatchOptions)fields[RKXMatchCursorTokenMatchOptions] error:error];
+    if (!self) { return nil; }
+    _position = (NSUInteger)fields[RKXMatchCursorTokenPosition];
+    _matchCount = (NSUInteger)fields[RKXMatchCursorTokenMatchCount];
+    _stringDigest = fields[RKXMatchCursorTokenStringDigest];
+    _hasStringDigest = YES;
+    return self;
 }
 
-#pragma mark - substringsSeparatedByRegex:limit:
-
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern limit:(NSUInteger)limit
+- (NSUInteger)location
 {
-    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions limit:limit error:NULL];
+    return _searchRange.location + MIN(_position, _text.length);
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange limit:(NSUInteger)limit
+- (BOOL)isFinished
 {
-    return [self substringsSeparatedByRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions limit:limit error:NULL];
+    return _position > _text.length;
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern options:(RKXRegexOptions)options limit:(NSUInteger)limit
+- (NSData *)resumeToken
 {
-    return [self substringsSeparatedByRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions limit:limit error:NULL];
+    if (!_hasStringDigest) {
+        _stringDigest = RKXMatchCursorDigestOfString(_string);
+        _hasStringDigest = YES;
+    }
+
+    uint64_t fields[RKXMatchCursorTokenFieldCount];
+    fields[RKXMatchCursorTokenVersion] = RKXMatchCursorTokenCurrentVersion;
+    fields[RKXMatchCursorTokenOptions] = _options;
+    fields[RKXMatchCursorTokenMatchOptions] = _matchOptions;
+    fields[RKXMatchCursorTokenRangeLocation] = _searchRange.location;
+    fields[RKXMatchCursorTokenRangeLength] = _searchRange.length;
+    fields[RKXMatchCursorTokenPosition] = _position;
+    fields[RKXMatchCursorTokenMatchCount] = _matchCount;
+    fields[RKXMatchCursorTokenStringLength] = _string.length;
+    fields[RKXMatchCursorTokenStringDigest] = _stringDigest;
+    for (NSUInteger i = 0; i < RKXMatchCursorTokenFieldCount; i++) { fields[i] = CFSwapInt64HostToLittle(fields[i]); }
+
+    NSMutableData *token = [NSMutableData dataWithBytes:fields length:sizeof(fields)];
+    [token appendData:[_pattern dataUsingEncoding:NSUTF8StringEncoding]];
+    return [token copy];
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options limit:(NSUInteger)limit error:(NSError **)error
+- (NSTextCheckingResult *)nextMatch
 {
-    return [self substringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions limit:limit error:error];
+    return [self nextMatches:1].firstObject;
 }
 
-- (NSArray<NSString *> *)substringsSeparatedByRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions limit:(NSUInteger)limit error:(NSError **)error
+- (NSArray<NSTextCheckingResult *> *)nextMatches:(NSUInteger)count
 {
-    if (limit == 0) {
-        return [self substringsSeparatedByRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    }
-    if (limit == 1) {
-        return @[ [self substringWithRange:searchRange] ];
-    }
+    NSUInteger length = _text.length;
+    if (!count || _position > length) { return @[]; }
 
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return @[ self ]; }
-    NSMutableArray *components = [NSMutableArray array];
-    NSUInteger pos = searchRange.location;
-    NSUInteger splitCount = 0;
-    NSUInteger maxSplits = limit - 1;
+    // Progress callbacks are not matches, and the time limit belongs to the methods that collect every match.
+    NSMatchingOptions matchOpts = ((NSMatchingOptions)_matchOptions & ~NSMatchingReportProgress) | NSMatchingWithTransparentBounds | NSMatchingWithoutAnchoringBounds;
+    NSMutableArray<NSTextCheckingResult *> *matches = [NSMutableArray arrayWithCapacity:MIN(count, (NSUInteger)64)];
+    __block NSUInteger position = length + 1;
 
-    for (NSTextCheckingResult *match in matches) {
-        if (splitCount >= maxSplits) { break; }
-        NSRange subrange = NSMakeRange(pos, match.range.location - pos);
-        [components addObject:[self substringWithRange:subrange]];
-        pos = match.range.location + match.range.length;
-        splitCount++;
-    }
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+    [_regex enumerateMatchesInString:_text options:matchOpts range:NSMakeRange(_position, length - _position) usingBlock:^(NSTextCheckingResult *match, NSMatchingFlags flags, BOOL *stop) {
+        if (!match) { return; }
+        [matches addObject:match];
+        if (matches.count < count) { return; }
+        *stop = YES;
+        NSRange range = match.range;
+
+        if (range.length) {
+            position = NSMaxRange(range);
+        }
+        else {
+            // ICU moves past an empty match by one code point before it searches again.
+            position = range.location + 1;
+            if (position < length && CFStringIsSurrogateHighCharacter([self->_text characterAtIndex:range.location]) && CFStringIsSurrogateLowCharacter([self->_text characterAtIndex:position])) { position++; }
+        }
+    }];
+#pragma clang diagnostic pop
 
-    // Append the remainder
-    NSRange remainderRange = NSMakeRange(pos, NSMaxRange(searchRange) - pos);
-    [components addObject:[self substringWithRange:remainderRange]];
+    // A search that ran out of matches leaves the cursor past the end, so the next page does not search again.
+    _position = position;
+    _matchCount += matches.count;
 
-    return [components copy];
-}
+    if (_searchRange.location) {
+        for (NSUInteger i = 0; i < matches.count; i++) {
+            NSTextCheckingResult *match = matches[i];
+            NSUInteger rangeCount = match.numberOfRanges;
+            NSRange *ranges = malloc(rangeCount * sizeof(NSRange));
+            if (!ranges) { break; }
 
-#pragma mark - stringByReplacingOccurrencesOfRegex:usingBlockWithNamedCaptures:
+            for (NSUInteger r = 0; r < rangeCount; r++) {
+                ranges[r] = [match rangeAtIndex:r];
+                if (ranges[r].location != NSNotFound) { ranges[r].location += _searchRange.location; }
+            }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
-{
-    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlockWithNamedCaptures:block];
+            matches[i] = [NSTextCheckingResult regularExpressionCheckingResultWithRanges:ranges count:rangeCount regularExpression:_regex];
+            free(ranges);
+        }
+    }
+
+    return [matches copy];
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+- (NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState *)state objects:(id __unsafe_unretained [])buffer count:(NSUInteger)len
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL usingBlockWithNamedCaptures:block];
+    state->mutationsPtr = &_mutations;
+    _page = [self nextMatches:len];
+    NSUInteger count = _page.count;
+    for (NSUInteger i = 0; i < count; i++) { buffer[i] = _page[i]; }
+    state->itemsPtr = buffer;
+    state->state++;
+    return count;
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+@end
+
+#pragma mark -
+
+/// YES if pattern refers back to a group with \1-style or \k<name> references, for patterns RKXSyntaxParse cannot
+/// build a tree for. Text quoted between \Q and \E is skipped; anything else that reads as a reference, even in a
+/// comment, is counted as one.
+static BOOL RKXPatternHasBackreference(NSString *pattern)
 {
-    return [self stringByReplacingOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error usingBlockWithNamedCaptures:block];
+    NSUInteger length = pattern.length;
+
+    for (NSUInteger i = 0; i + 1 < length; i++) {
+        if ([pattern characterAtIndex:i] != '\\') { continue; }
+        unichar c = [pattern characterAtIndex:++i];
+
+        if (c == 'Q') {
+            NSRange end = [pattern rangeOfString:@"\\E" options:NSLiteralSearch range:NSMakeRange(i, length - i)];
+            if (end.location == NSNotFound) { return NO; }
+            i = NSMaxRange(end) - 1;
+        }
+        else if ((c >= '1' && c <= '9') || (c == 'k' && i + 1 < length && [pattern characterAtIndex:i + 1] == '<')) {
+            return YES;
+        }
+    }
+
+    return NO;
 }
 
-- (NSString *)stringByReplacingOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlockWithNamedCaptures:(NSString *(NS_NOESCAPE ^)(NSDictionary<NSString *, NSString *> *namedCaptures, BOOL *stop))block
+/// Returns the regex that alternates patterns in order, each wrapped in a capture group whose number is stored in
+/// groupIndexes, so ICU tries them in order at each point and the group that matched tells which one won. regexes
+/// are the patterns compiled on their own with options. Literal patterns are escaped, since the alternation itself
+/// cannot be literal. Returns nil and sets reason if a pattern uses backreferences, which would refer to the wrong
+/// groups once the patterns are numbered together, or if the alternation does not compile.
+static NSRegularExpression *RKXAlternationOfRegexes(NSArray<NSString *> *patterns, NSArray<NSRegularExpression *> *regexes, RKXRegexOptions options, NSUInteger *groupIndexes, NSString **reason)
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches) { return nil; }
-    if (!matches.count) { return [self substringWithRange:searchRange]; }
-
-    NSArray<NSString *> *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
-    NSMutableString *target = [self mutableCopy];
-    BOOL stop = NO;
+    BOOL literal = OptionsHasValue(options, RKXIgnoreMetacharacters);
+    NSMutableString *combinedPattern = [NSMutableString string];
+    NSUInteger groupIndex = 1;
 
-    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
-        NSMutableDictionary *namedCaptures = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < patterns.count; i++) {
+        NSString *pattern = (literal) ? [NSRegularExpression escapedPatternForString:patterns[i]] : patterns[i];
+        RKXSyntaxTree *tree = (literal) ? nil : [RKXSyntaxTree syntaxTreeForRegex:regexes[i]];
+        BOOL backreferences = (tree) ? (tree.syntax->features & RKXSyntaxBackreference) != 0 : (!literal && RKXPatternHasBackreference(pattern));
 
-        if (captureNames) {
-            for (NSString *captureName in captureNames) {
-                if (@available(macOS 10.13, *)) {
-                    NSRange nameRange = [match rangeWithName:captureName];
-                    if (nameRange.location != NSNotFound) {
-                        namedCaptures[captureName] = [self substringWithRange:nameRange];
-                    }
-                    else {
-                        namedCaptures[captureName] = RKXEmptyStringKey;
-                    }
-                }
-            }
+        if (backreferences) {
+            *reason = [NSString stringWithFormat:@"Pattern %lu (%@) uses backreferences, which cannot be matched together with other patterns.", i, pattern];
+            return nil;
         }
 
-        NSString *swap = block([namedCaptures copy], &stop);
-        [target replaceCharactersInRange:match.range withString:swap];
-        if (stop) { break; }
+        // A comment under RKXIgnoreWhitespace runs to the end of the line, so the group is closed on a new one.
+        [combinedPattern appendFormat:(OptionsHasValue(options, RKXIgnoreWhitespace)) ? @"%@(%@\n)" : @"%@(%@)", (i) ? @"|" : @"", pattern];
+        groupIndexes[i] = groupIndex;
+        groupIndex += 1 + regexes[i].numberOfCaptureGroups;
     }
 
-    return [target copy];
+    NSError *combineError = nil;
+    NSRegularExpression *regex = [NSString cachedRegexForPattern:combinedPattern options:(options & ~RKXIgnoreMetacharacters) error:&combineError];
+    if (!regex) { *reason = [NSString stringWithFormat:@"The patterns cannot be matched together: %@", combineError.localizedFailureReason ?: combineError.localizedDescription]; }
+    return regex;
 }
 
+@interface RKXRewriteRule ()
+- (instancetype)initWithRegex:(NSString *)pattern template:(NSString *)templ block:(NSString *(^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block;
 @end
 
-@implementation NSMutableString (RegexKitX)
-
-#pragma mark - replaceOccurrencesOfRegex:withTemplate:
+@implementation RKXRewriteRule
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ
++ (instancetype)ruleWithRegex:(NSString *)pattern template:(NSString *)templ
 {
-    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    NSCParameterAssert(templ);
+    return [[self alloc] initWithRegex:pattern template:templ block:nil];
 }
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange
++ (instancetype)ruleWithRegex:(NSString *)pattern usingBlock:(NSString *(^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
 {
-    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+    NSCParameterAssert(block);
+    return [[self alloc] initWithRegex:pattern template:nil block:block];
 }
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ options:(RKXRegexOptions)options
+- (instancetype)initWithRegex:(NSString *)pattern template:(NSString *)templ block:(NSString *(^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
 {
-    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:self.stringRange options:options matchOptions:kNilOptions error:NULL];
+    NSCParameterAssert(pattern);
+    if (!(self = [super init])) { return nil; }
+    _pattern = [pattern copy];
+    _templ = [templ copy];
+    _block = [block copy];
+    return self;
 }
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+@end
+
+@implementation RKXRewriteRuleSet
 {
-    return [self replaceOccurrencesOfRegex:pattern withTemplate:templ range:searchRange options:options matchOptions:kNilOptions error:error];
+    NSRegularExpression *_combinedRegex;                 // (rule 0)|(rule 1)|..., single pass only
+    NSArray<NSRegularExpression *> *_regexes;            // each rule on its own, to expand its template against
+    NSArray<NSArray<NSString *> *> *_backreferenceNames; // the ${name} references of each template, or NSNull
+    NSUInteger *_groupIndexes;                           // the capture group of _combinedRegex that wraps each rule
 }
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
++ (instancetype)ruleSetWithRules:(NSArray<RKXRewriteRule *> *)rules options:(RKXRegexOptions)options mode:(RKXRewriteMode)mode error:(NSError **)error
 {
-    NSArray<NSTextCheckingResult *> *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches || matches.count == 0) { return NSNotFound; }
-    __block NSUInteger count = 0;
-    NSRegularExpression *regex = matches.firstObject.regularExpression;
-
-    if (@available(macOS 10.13, *)) {
-        NSArray *captureNames = [pattern _captureNamesWithMetaPattern:RKXNamedCapturePattern];
-        NSArray *backreferenceNames = [templ _captureNamesWithMetaPattern:RKXNamedReferencePattern];
-
-        if (!captureNames || !backreferenceNames) {
-            count = [regex replaceMatchesInString:self options:(NSMatchingOptions)matchOptions range:searchRange withTemplate:templ];
-            return count;
-        }
+    return [[self alloc] initWithRules:rules options:options mode:mode error:error];
+}
 
-        NSSet *captureNameSet = [NSSet setWithArray:captureNames];
-        NSMutableSet *backreferenceNameSetM = [NSMutableSet setWithArray:backreferenceNames];
-        [backreferenceNameSetM intersectSet:captureNameSet];
-        backreferenceNames = [backreferenceNameSetM allObjects];
+- (instancetype)initWithRules:(NSArray<RKXRewriteRule *> *)rules options:(RKXRegexOptions)options mode:(RKXRewriteMode)mode error:(NSError **)error
+{
+    NSCParameterAssert(rules);
+    if (!(self = [super init])) { return nil; }
+    NSMutableArray<NSRegularExpression *> *regexes = [NSMutableArray arrayWithCapacity:rules.count];
+    NSMutableArray *backreferenceNames = [NSMutableArray arrayWithCapacity:rules.count];
 
-        for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
-            NSMutableString *templateM = [templ mutableCopy];
+    for (RKXRewriteRule *rule in rules) {
+        NSRegularExpression *regex = [NSString cachedRegexForPattern:rule.pattern options:options error:error];
+        if (!regex) { return nil; }
+        [regexes addObject:regex];
+        [backreferenceNames addObject:[rule.templ _namedReferencesForPattern:rule.pattern] ?: (id)NSNull.null];
+    }
 
-            for (NSString *groupName in backreferenceNames) {
-                // (?<name>...) <- define a named capture group named "name"
-                // ${name} <- captured named group reference
-                NSRange namedGroupRange = [match rangeWithName:groupName];
-                NSString *namedGroupCapture = [self substringWithRange:namedGroupRange];
-                NSString *templateCapturePattern = [NSString stringWithFormat:@"\\$\\{%@\\}", groupName];
-                NSArray<NSValue *> *templateRanges = [templateM rangesOfRegex:templateCapturePattern];
+    _rules = [rules copy];
+    _options = options;
+    _mode = mode;
+    _regexes = [regexes copy];
+    _backreferenceNames = [backreferenceNames copy];
+    if (mode == RKXRewriteSinglePass && ![self combineRulesWithError:error]) { return nil; }
+    return self;
+}
 
-                for (NSValue *range in [templateRanges reverseObjectEnumerator]) {
-                    [templateM replaceCharactersInRange:range.rangeValue withString:namedGroupCapture];
-                }
+- (void)dealloc
+{
+    free(_groupIndexes);
+}
 
-                count++;
-            }
+/// Builds @c _combinedRegex from the patterns of the rules, reporting a failure as @c RKXRewriteRuleSetIncompatibleRuleError.
+- (BOOL)combineRulesWithError:(NSError **)error
+{
+    NSString *reason = nil;
+    if (!(_groupIndexes = malloc(MAX(_rules.count, 1UL) * sizeof(NSUInteger)))) { return NO; }
+    _combinedRegex = RKXAlternationOfRegexes([_rules valueForKey:@"pattern"], _regexes, _options, _groupIndexes, &reason);
 
-            NSString *swap = [regex replacementStringForResult:match inString:self offset:0 template:[templateM copy]];
-            [self replaceCharactersInRange:match.range withString:swap];
+    if (!_combinedRegex) {
+        if (error != NULL) {
+            NSDictionary *info = @{ NSLocalizedDescriptionKey : NSLocalizedString(@"The rules cannot be applied in a single pass.", nil),
+                                    NSLocalizedFailureReasonErrorKey : reason };
+            *error = [NSError errorWithDomain:RKXRewriteRuleSetErrorDomain code:RKXRewriteRuleSetIncompatibleRuleError userInfo:info];
         }
-    }
-    else {
-        count = [regex replaceMatchesInString:self options:(NSMatchingOptions)matchOptions range:searchRange withTemplate:templ];
+
+        return NO;
     }
 
-    return count;
+    return YES;
 }
 
-#pragma mark - Blocks-based API
-
-#pragma mark - replaceOccurrencesOfRegex:usingBlock:
-
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (NSString *)stringByRewritingString:(NSString *)string
 {
-    return [self replaceOccurrencesOfRegex:pattern range:self.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:block];
+    return [self stringByRewritingString:string range:string.stringRange matchOptions:kNilOptions error:NULL];
 }
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern options:(RKXRegexOptions)options usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (NSString *)stringByRewritingString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
 {
-    return [self replaceOccurrencesOfRegex:pattern range:self.stringRange options:options matchOptions:kNilOptions error:NULL usingBlock:block];
+    NSCParameterAssert(string);
+    if (!_rules.count) { return [string copy]; }
+    return (_mode == RKXRewriteSequential) ? [self sequentiallyRewrittenString:string range:searchRange matchOptions:matchOptions error:error] : [self singlePassRewrittenString:string range:searchRange matchOptions:matchOptions error:error];
 }
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
-{
-    return [self replaceOccurrencesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error usingBlock:block];
-}
+#pragma mark - Private Methods
 
-- (NSUInteger)replaceOccurrencesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(NSString *(NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (NSString *)singlePassRewrittenString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
 {
-    NSArray *matches = [self _matchesForRegex:pattern range:searchRange options:options matchOptions:matchOptions error:error];
-    if (!matches || matches.count == 0) { return NSNotFound; }
-    NSUInteger count = 0;
+    NSError *matchError = nil;
+    NSArray<NSTextCheckingResult *> *matches = [string _matchesForRegularExpression:_combinedRegex range:searchRange matchOptions:matchOptions error:&matchError];
+
+    if (matchError) {
+        if (error != NULL) { *error = matchError; }
+        return nil;
+    }
+
+    if (!matches.count) { return [string copy]; }
+    NSMutableString *target = [NSMutableString stringWithCapacity:string.length];
+    NSUInteger pos = 0, ruleCount = _rules.count;
     BOOL stop = NO;
-    
-    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
-        NSString *replacement = block([match substringsFromString:self], match.ranges, &stop);
-        [self replaceCharactersInRange:match.range withString:replacement];
-        count++;
+
+    for (NSTextCheckingResult *match in matches) {
+        NSUInteger r = 0;
+        while (r + 1 < ruleCount && [match rangeAtIndex:_groupIndexes[r]].location == NSNotFound) { r++; }
+
+        // The groups of the winning rule, renumbered from 0 as if the rule had matched on its own.
+        NSRegularExpression *regex = _regexes[r];
+        NSUInteger rangeCount = regex.numberOfCaptureGroups + 1;
+        NSRange *ranges = malloc(rangeCount * sizeof(NSRange));
+        if (!ranges) { return nil; }
+        for (NSUInteger g = 0; g < rangeCount; g++) { ranges[g] = [match rangeAtIndex:_groupIndexes[r] + g]; }
+        NSTextCheckingResult *ruleMatch = [NSTextCheckingResult regularExpressionCheckingResultWithRanges:ranges count:rangeCount regularExpression:regex];
+        free(ranges);
+
+        RKXRewriteRule *rule = _rules[r];
+        NSString *swap;
+
+        if (rule.block) {
+            swap = rule.block([ruleMatch substringsFromString:string], ruleMatch.ranges, &stop);
+        }
+        else {
+            NSString *matchTemplate = rule.templ;
+            NSArray<NSString *> *backreferenceNames = _backreferenceNames[r];
+
+            if (@available(macOS 10.13, *)) {
+                if ((id)backreferenceNames != NSNull.null) { matchTemplate = [string _template:matchTemplate byExpandingNamedReferences:backreferenceNames forMatch:ruleMatch]; }
+            }
+
+            swap = [regex replacementStringForResult:ruleMatch inString:string offset:0 template:matchTemplate];
+        }
+
+        [target appendString:[string substringWithRange:NSMakeRange(pos, match.range.location - pos)]];
+        [target appendString:swap];
+        pos = NSMaxRange(match.range);
         if (stop) { break; }
     }
 
-    return count;
+    [target appendString:[string substringFromIndex:pos]];
+    return [target copy];
+}
+
+- (NSString *)sequentiallyRewrittenString:(NSString *)string range:(NSRange)searchRange matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error
+{
+    NSMutableString *target = [string mutableCopy];
+    __block BOOL stopped = NO;
+
+    for (RKXRewriteRule *rule in _rules) {
+        NSUInteger length = target.length;
+        NSError *replaceError = nil;
+
+        if (rule.block) {
+            [target replaceOccurrencesOfRegex:rule.pattern range:searchRange options:_options matchOptions:matchOptions error:&replaceError usingBlock:^NSString *(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+                NSString *swap = rule.block(capturedStrings, capturedRanges, stop);
+                stopped = *stop;
+                return swap;
+            }];
+        }
+        else {
+            [target replaceOccurrencesOfRegex:rule.pattern withTemplate:rule.templ range:searchRange options:_options matchOptions:matchOptions error:&replaceError];
+        }
+
+        if (replaceError) {
+            if (error != NULL) { *error = replaceError; }
+            return nil;
+        }
+
+        // The range keeps its start and grows or shrinks with the text rewritten within it.
+        searchRange.length = searchRange.length + target.length - length;
+        if (stopped) { break; }
+    }
+
+    return [target copy];
 }
 
 @end
 
 #pragma mark -
-@implementation NSAttributedString (RegexKitX)
 
-- (NSAttributedString *)attributedStringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ
+@implementation RKXLexer
 {
-    return [self attributedStringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.string.stringRange options:RKXNoOptions error:NULL];
+    NSRegularExpression *_regex;   // \G(?:(pattern 0)|(pattern 1)|...)
+    NSUInteger *_groupIndexes;     // the capture group of _regex that wraps each pattern
+    BOOL *_skipped;                // whether each kind is consumed without being reported
 }
 
-- (NSAttributedString *)attributedStringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ options:(RKXRegexOptions)options
++ (instancetype)lexerWithTokenNames:(NSArray<NSString *> *)names patterns:(NSArray<NSString *> *)patterns options:(RKXRegexOptions)options error:(NSError **)error
 {
-    return [self attributedStringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:self.string.stringRange options:options error:NULL];
+    return [[self alloc] initWithTokenNames:names patterns:patterns skippingTokenNames:nil options:options error:error];
 }
 
-- (NSAttributedString *)attributedStringByReplacingOccurrencesOfRegex:(NSString *)pattern withTemplate:(NSString *)templ range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+- (instancetype)initWithTokenNames:(NSArray<NSString *> *)names patterns:(NSArray<NSString *> *)patterns skippingTokenNames:(NSSet<NSString *> *)skippedNames options:(RKXRegexOptions)options error:(NSError **)error
 {
-    NSArray<NSTextCheckingResult *> *matches = [self.string _matchesForRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
-    if (!matches || !matches.count) { return [self copy]; }
-    NSMutableAttributedString *result = [self mutableCopy];
-    NSRegularExpression *regex = matches.firstObject.regularExpression;
+    NSCParameterAssert(names);
+    NSCParameterAssert(patterns);
+    NSCAssert(names.count == patterns.count, @"%lu token names were given for %lu patterns", names.count, patterns.count);
+    if (!(self = [super init])) { return nil; }
+    NSMutableArray<NSRegularExpression *> *regexes = [NSMutableArray arrayWithCapacity:patterns.count];
 
-    for (NSTextCheckingResult *match in [matches reverseObjectEnumerator]) {
-        NSString *replacement = [regex replacementStringForResult:match inString:self.string offset:0 template:templ];
-        [result replaceCharactersInRange:match.range withString:replacement];
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSString cachedRegexForPattern:pattern options:options error:error];
+        if (!regex) { return nil; }
+        [regexes addObject:regex];
     }
 
-    return [result copy];
+    NSUInteger kindCount = MAX(patterns.count, 1UL);
+    if (!(_groupIndexes = malloc(kindCount * sizeof(NSUInteger))) || !(_skipped = calloc(kindCount, sizeof(BOOL)))) { return nil; }
+    NSString *reason = nil;
+    NSRegularExpression *alternation = (patterns.count) ? RKXAlternationOfRegexes(patterns, regexes, options, _groupIndexes, &reason) : nil;
+
+    // \G holds each token to the end of the one before it, so one enumeration yields the tokens in a row.
+    if (alternation) {
+        _regex = [NSString cachedRegexForPattern:[NSString stringWithFormat:@"\\G(?:%@)", alternation.pattern] options:(RKXRegexOptions)alternation.options error:NULL];
+    }
+
+    if (!_regex) {
+        if (error != NULL) {
+            NSDictionary *info = @{ NSLocalizedDescriptionKey : NSLocalizedString(@"The token patterns cannot be matched together.", nil),
+                                    NSLocalizedFailureReasonErrorKey : reason ?: @"No token patterns were given." };
+            *error = [NSError errorWithDomain:RKXLexerErrorDomain code:RKXLexerIncompatibleTokenError userInfo:info];
+        }
+
+        return nil;
+    }
+
+    for (NSUInteger i = 0; i < names.count; i++) { _skipped[i] = [skippedNames containsObject:names[i]]; }
+    _tokenNames = [names copy];
+    _tokenPatterns = [patterns copy];
+    _skippedTokenNames = [skippedNames copy] ?: [NSSet set];
+    _options = options;
+    return self;
 }
 
-- (void)enumerateMatchesForRegex:(NSString *)pattern usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (void)dealloc
 {
-    [self enumerateMatchesForRegex:pattern range:self.string.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:block];
+    free(_groupIndexes);
+    free(_skipped);
 }
 
-- (void)enumerateMatchesForRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options matchOptions:(RKXMatchOptions)matchOptions error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop))block
+- (NSUInteger)getTokens:(RKXToken *)tokens maxCount:(NSUInteger)maxCount inString:(NSString *)string range:(NSRange)searchRange final:(BOOL)final nextLocation:(NSUInteger *)nextLocation
 {
-    [self.string enumerateStringsMatchedByRegex:pattern range:searchRange options:options matchOptions:matchOptions enumerationOptions:kNilOptions error:error usingBlock:block];
-}
+    NSCParameterAssert(string);
+    NSCParameterAssert(nextLocation);
+    __block NSUInteger count = 0, pos = searchRange.location;
+    NSUInteger kindCount = _tokenNames.count;
+    NSUInteger *groupIndexes = _groupIndexes;
+    BOOL *skipped = _skipped;
 
-@end
+    if (maxCount) {
+        // Transparent, non-anchoring bounds let a range that continues earlier input see the text before it.
+        NSMatchingOptions matchOpts = NSMatchingWithTransparentBounds | NSMatchingWithoutAnchoringBounds;
 
-#pragma mark -
-@implementation NSMutableAttributedString (RegexKitX)
+        [_regex enumerateMatchesInString:string options:matchOpts range:searchRange usingBlock:^(NSTextCheckingResult *match, NSMatchingFlags flags, BOOL *stop) {
+            // Once \G fails, the search past it finds nothing, so it ends at the first gap rather than skipping it.
+            NSRange range = match.range;
+            if (!match || range.location != pos || !range.length) { *stop = YES; return; }
+            if (!final && (flags & NSMatchingHitEnd)) { *stop = YES; return; }
+            NSUInteger kind = 0;
+            while (kind + 1 < kindCount && [match rangeAtIndex:groupIndexes[kind]].location == NSNotFound) { kind++; }
+            pos = NSMaxRange(range);
+            if (skipped[kind]) { return; }
+            tokens[count++] = (RKXToken){ .kind = kind, .range = range };
+            if (count == maxCount) { *stop = YES; }
+        }];
+    }
 
-- (void)addAttributes:(NSDictionary<NSAttributedStringKey, id> *)attrs forMatchesOfRegex:(NSString *)pattern
-{
-    [self addAttributes:attrs forMatchesOfRegex:pattern range:self.string.stringRange options:RKXNoOptions error:NULL];
+    *nextLocation = pos;
+    return count;
 }
 
-- (void)addAttributes:(NSDictionary<NSAttributedStringKey, id> *)attrs forMatchesOfRegex:(NSString *)pattern range:(NSRange)searchRange options:(RKXRegexOptions)options error:(NSError **)error
+- (BOOL)enumerateTokensInString:(NSString *)string range:(NSRange)searchRange error:(NSError **)error usingBlock:(void (NS_NOESCAPE ^)(RKXToken token, BOOL *stop))block
 {
-    NSArray<NSTextCheckingResult *> *matches = [self.string _matchesForRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:error];
-    if (!matches) { return; }
+    RKXToken *tokens = malloc(RKXLexerTokenBatchCount * sizeof(RKXToken));
+    if (!tokens) { return NO; }
+    NSUInteger pos = searchRange.location, end = NSMaxRange(searchRange), count;
+    BOOL stop = NO;
 
-    for (NSTextCheckingResult *match in matches) {
-        [self addAttributes:attrs range:match.range];
+    do {
+        count = [self getTokens:tokens maxCount:RKXLexerTokenBatchCount inString:string range:NSMakeRange(pos, end - pos) final:YES nextLocation:&pos];
+        for (NSUInteger i = 0; i < count && !stop; i++) { block(tokens[i], &stop); }
+    } while (count == RKXLexerTokenBatchCount && !stop);
+
+    free(tokens);
+    if (stop || pos == end) { return YES; }
+
+    if (error != NULL) {
+        NSDictionary *info = @{ NSLocalizedDescriptionKey : NSLocalizedString(@"The input could not be tokenized.", nil),
+                                NSLocalizedFailureReasonErrorKey : [NSString stringWithFormat:@"No token pattern matches the text at location %lu.", pos] };
+        *error = [NSError errorWithDomain:RKXLexerErrorDomain code:RKXLexerUnexpectedInputError userInfo:info];
     }
+
+    return NO;
 }
 
 @end
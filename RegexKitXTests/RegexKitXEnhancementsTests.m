@@ -34,10 +34,25 @@
 #import <XCTest/XCTest.h>
 
 @interface RegexKitXEnhancementsTests : XCTestCase
+@property (nonatomic, readonly, strong) NSString *testCorpus;
 @end
 
 @implementation RegexKitXEnhancementsTests
 
+- (NSString *)testCorpus
+{
+    static dispatch_once_t onceToken;
+    static NSString *_testCorpus;
+
+    dispatch_once(&onceToken, ^{
+        NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:@"sherlock-utf-8" ofType:@"txt"];
+        _testCorpus = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+    });
+
+    NSAssert(_testCorpus, @"There was a failure in loading the test corpus!");
+    return _testCorpus;
+}
+
 #pragma mark - countOfRegex:
 
 - (void)testCountOfRegexZeroMatches
@@ -177,6 +192,22 @@
     XCTAssertEqual([NSString regexCacheCount], 1UL);
 }
 
+- (void)testRegexCompileCountCountsMisses
+{
+    [NSString clearRegexCache];
+    NSUInteger initialCount = [NSString regexCompileCount];
+
+    [@"hello" isMatchedByRegex:@"compile_count_pattern"];
+    [@"world" isMatchedByRegex:@"compile_count_pattern"];
+    XCTAssertEqual([NSString regexCompileCount], initialCount + 1);
+
+    // Clearing the cache keeps the count, and the pattern is compiled again on its next use.
+    [NSString clearRegexCache];
+    [@"hello" isMatchedByRegex:@"compile_count_pattern"];
+    XCTAssertEqual([NSString regexCompileCount], initialCount + 2);
+    XCTAssertEqual([NSString regexCacheCount], 1UL);
+}
+
 #pragma mark - regexValidationError
 
 - (void)testRegexValidationErrorValidPattern
@@ -491,6 +522,1505 @@
     XCTAssertNotNil(resultAttrs[NSFontAttributeName]);
 }
 
+- (void)testAttributedStringReplacementInheritsMatchAttributes
+{
+    NSMutableAttributedString *mutableAttr = [[NSMutableAttributedString alloc] initWithString:@"a 12 b 34 c"];
+    [mutableAttr addAttribute:NSForegroundColorAttributeName value:[NSColor redColor] range:NSMakeRange(2, 2)];
+    [mutableAttr addAttribute:NSUnderlineStyleAttributeName value:@(NSUnderlineStyleSingle) range:NSMakeRange(10, 1)];
+
+    NSAttributedString *result = [mutableAttr attributedStringByReplacingOccurrencesOfRegex:@"(\\d)(\\d)" withTemplate:@"$2$1$2"];
+    XCTAssertEqualObjects(result.string, @"a 212 b 434 c");
+
+    // The replacement of "12" takes the red color of "1"; the one for "34" takes no color.
+    NSRange colorRange;
+    XCTAssertNotNil([result attribute:NSForegroundColorAttributeName atIndex:2 longestEffectiveRange:&colorRange inRange:result.string.stringRange]);
+    XCTAssertTrue(NSEqualRanges(colorRange, NSMakeRange(2, 3)));
+    XCTAssertNil([result attribute:NSForegroundColorAttributeName atIndex:8 effectiveRange:NULL]);
+    XCTAssertNotNil([result attribute:NSUnderlineStyleAttributeName atIndex:12 effectiveRange:NULL]);
+}
+
+- (void)testAttributedStringReplacementManyMatches
+{
+    NSMutableString *source = [NSMutableString string];
+    for (NSUInteger i = 0; i < 5000; i++) { [source appendString:@"word 42 "]; }
+    NSMutableAttributedString *mutableAttr = [[NSMutableAttributedString alloc] initWithString:source];
+    [mutableAttr addAttribute:NSUnderlineStyleAttributeName value:@(NSUnderlineStyleSingle) range:NSMakeRange(0, 4)];
+
+    NSAttributedString *result = [mutableAttr attributedStringByReplacingOccurrencesOfRegex:@"\\d+" withTemplate:@"#"];
+    XCTAssertEqualObjects(result.string, [source stringByReplacingOccurrencesOfRegex:@"\\d+" withTemplate:@"#"]);
+    XCTAssertNotNil([result attribute:NSUnderlineStyleAttributeName atIndex:0 effectiveRange:NULL]);
+    XCTAssertNil([result attribute:NSUnderlineStyleAttributeName atIndex:5 effectiveRange:NULL]);
+}
+
+#pragma mark - RKXIncrementalHighlighter
+
+- (void)testIncrementalHighlighterAppliesRule
+{
+    NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:@"let x = 1\nlet y = 2\n"];
+    RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+    NSError *error;
+    BOOL added = [highlighter addRuleForRegex:@"\\blet\\b" options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor redColor] } error:&error];
+    XCTAssertTrue(added);
+    XCTAssertNil(error);
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL]);
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL]);
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:4 effectiveRange:NULL]);
+}
+
+- (void)testIncrementalHighlighterInvalidRule
+{
+    NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:@"abc"];
+    RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+    NSError *error;
+    BOOL added = [highlighter addRuleForRegex:@"(abc" options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor redColor] } error:&error];
+    XCTAssertFalse(added);
+    XCTAssertNotNil(error);
+}
+
+- (void)testIncrementalHighlighterTracksInsertions
+{
+    NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:@"let x = 1\nvar y = 2\n"];
+    RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+    [highlighter addRuleForRegex:@"\\blet\\b" options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor redColor] } error:NULL];
+
+    // Turn "var" into "let" on the second line and prepend a line above everything.
+    [attrStr replaceCharactersInRange:NSMakeRange(10, 3) withString:@"let"];
+    [highlighter processEditInRange:NSMakeRange(10, 3) changeInLength:0];
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:11 effectiveRange:NULL]);
+
+    [attrStr replaceCharactersInRange:NSMakeRange(0, 0) withString:@"// header\n"];
+    [highlighter processEditInRange:NSMakeRange(0, 10) changeInLength:10];
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:3 effectiveRange:NULL]);
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL]);
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:21 effectiveRange:NULL]);
+}
+
+- (void)testIncrementalHighlighterClearsBrokenMatches
+{
+    NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:@"let x = 1\n"];
+    RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+    [highlighter addRuleForRegex:@"\\blet\\b" options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor redColor] } error:NULL];
+
+    // Typing right after the keyword turns "let" into "lets", which no longer matches.
+    [attrStr replaceCharactersInRange:NSMakeRange(3, 0) withString:@"s"];
+    [highlighter processEditInRange:NSMakeRange(3, 1) changeInLength:1];
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL]);
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:3 effectiveRange:NULL]);
+}
+
+- (void)testIncrementalHighlighterMultilineRule
+{
+    NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:@"a /* one\ntwo\nthree"];
+    RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+    [highlighter addRuleForRegex:@"/\\*[\\s\\S]*?\\*/" options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor greenColor] } error:NULL];
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL]);
+
+    // Closing the comment on the last line highlights the lines above it as well.
+    [attrStr replaceCharactersInRange:NSMakeRange(attrStr.length, 0) withString:@" */"];
+    [highlighter processEditInRange:NSMakeRange(attrStr.length - 3, 3) changeInLength:3];
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:2 effectiveRange:NULL]);
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL]);
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL]);
+}
+
+- (void)testIncrementalHighlighterPropertyClassesSpanLines
+{
+    // POSIX and property classes, and ranges that run across \n, can match line terminators, so these rules have
+    // to be rematched beyond the edited line.
+    NSDictionary<NSString *, NSString *> *rules = @{ @"/\\*[[:space:][:alpha:]]*?\\*/" : @"a /* one\ntwo\nthree",
+                                                     @"/\\*[\\p{Zl}\\p{Zs}\\p{L}]*?\\*/" : @"a /* one\u2028two\u2028three",
+                                                     @"/\\*[\\t-~]*?\\*/" : @"a /* one\ntwo\nthree" };
+
+    for (NSString *pattern in rules) {
+        NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:rules[pattern]];
+        RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+        [highlighter addRuleForRegex:pattern options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor greenColor] } error:NULL];
+        XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL], @"%@", pattern);
+
+        [attrStr replaceCharactersInRange:NSMakeRange(attrStr.length, 0) withString:@" */"];
+        [highlighter processEditInRange:NSMakeRange(attrStr.length - 3, 3) changeInLength:3];
+        XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:2 effectiveRange:NULL], @"%@", pattern);
+        XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL], @"%@", pattern);
+    }
+}
+
+- (void)testIncrementalHighlighterRemoveAllRules
+{
+    NSMutableAttributedString *attrStr = [[NSMutableAttributedString alloc] initWithString:@"one 1 two 2"];
+    RKXIncrementalHighlighter *highlighter = [[RKXIncrementalHighlighter alloc] initWithAttributedString:attrStr];
+    [highlighter addRuleForRegex:@"\\d" options:RKXNoOptions attributes:@{ NSForegroundColorAttributeName: [NSColor redColor] } error:NULL];
+    XCTAssertNotNil([attrStr attribute:NSForegroundColorAttributeName atIndex:4 effectiveRange:NULL]);
+
+    [highlighter removeAllRules];
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:4 effectiveRange:NULL]);
+    XCTAssertNil([attrStr attribute:NSForegroundColorAttributeName atIndex:10 effectiveRange:NULL]);
+}
+
+#pragma mark - Asynchronous API
+
+- (void)testAsyncRangesAndCountMatchSynchronousResults
+{
+    NSString *string = @"one 1 two 22 three 333";
+    dispatch_queue_t queue = dispatch_queue_create("com.regexkitx.tests.async", DISPATCH_QUEUE_SERIAL);
+    XCTestExpectation *rangesDone = [self expectationWithDescription:@"ranges"];
+    XCTestExpectation *countDone = [self expectationWithDescription:@"count"];
+
+    [string rangesOfRegex:@"(\\d)\\d*" range:string.stringRange options:RKXNoOptions matchOptions:kNilOptions queue:queue completionHandler:^(NSArray<NSValue *> *ranges, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(ranges, [string rangesOfRegex:@"(\\d)\\d*"]);
+        [rangesDone fulfill];
+    }];
+
+    NSProgress *progress = [string countOfRegex:@"\\d+" range:string.stringRange options:RKXNoOptions matchOptions:kNilOptions queue:queue completionHandler:^(NSUInteger count, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqual(count, 3UL);
+        [countDone fulfill];
+    }];
+
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+    XCTAssertEqualWithAccuracy(progress.fractionCompleted, 1.0, 0.0001);
+}
+
+- (void)testAsyncSubstringsAndReplacement
+{
+    NSString *string = @"310-555-1212 and 415-555-0000";
+    NSString *pattern = @"(?<area>\\d{3})-(?<exch>\\d{3})-(?<num>\\d{4})";
+    dispatch_queue_t queue = dispatch_queue_create("com.regexkitx.tests.async", DISPATCH_QUEUE_SERIAL);
+    XCTestExpectation *substringsDone = [self expectationWithDescription:@"substrings"];
+    XCTestExpectation *replaceDone = [self expectationWithDescription:@"replace"];
+
+    [string substringsMatchedByRegex:pattern range:string.stringRange capture:1 options:RKXNoOptions matchOptions:kNilOptions queue:queue completionHandler:^(NSArray<NSString *> *substrings, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(substrings, (@[ @"310", @"415" ]));
+        [substringsDone fulfill];
+    }];
+
+    [string stringByReplacingOccurrencesOfRegex:pattern withTemplate:@"${num}-$2-${area}" range:string.stringRange options:RKXNoOptions matchOptions:kNilOptions queue:queue completionHandler:^(NSString *result, NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(result, @"1212-555-310 and 0000-555-415");
+        XCTAssertEqualObjects(result, [string stringByReplacingOccurrencesOfRegex:pattern withTemplate:@"${num}-$2-${area}"]);
+        [replaceDone fulfill];
+    }];
+
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testAsyncEnumerationStops
+{
+    NSString *string = @"a1 b2 c3 d4";
+    dispatch_queue_t queue = dispatch_queue_create("com.regexkitx.tests.async", DISPATCH_QUEUE_SERIAL);
+    XCTestExpectation *done = [self expectationWithDescription:@"enumerate"];
+    NSMutableArray *seen = [NSMutableArray array];
+
+    [string enumerateStringsMatchedByRegex:@"([a-z])(\\d)" range:string.stringRange options:RKXNoOptions matchOptions:kNilOptions queue:queue usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+        [seen addObject:capturedStrings[1]];
+        if (seen.count == 2) { *stop = YES; }
+    } completionHandler:^(NSError *error) {
+        XCTAssertNil(error);
+        XCTAssertEqualObjects(seen, (@[ @"a", @"b" ]));
+        [done fulfill];
+    }];
+
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testAsyncCancelledBeforeStart
+{
+    NSString *string = @"one 1 two 2";
+    dispatch_queue_t queue = dispatch_queue_create("com.regexkitx.tests.async", DISPATCH_QUEUE_SERIAL);
+    XCTestExpectation *done = [self expectationWithDescription:@"cancelled"];
+
+    dispatch_suspend(queue);
+    NSProgress *progress = [string substringsMatchedByRegex:@"\\d" range:string.stringRange capture:0 options:RKXNoOptions matchOptions:kNilOptions queue:queue completionHandler:^(NSArray<NSString *> *substrings, NSError *error) {
+        XCTAssertNil(substrings);
+        XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+        XCTAssertEqual(error.code, NSUserCancelledError);
+        [done fulfill];
+    }];
+    [progress cancel];
+    dispatch_resume(queue);
+
+    [self waitForExpectationsWithTimeout:5.0 handler:nil];
+}
+
+- (void)testAsyncCancellationStopsCatastrophicPattern
+{
+    // No RKXReportProgress, so the timeout never fires: only cancellation can end this scan.
+    NSString *equalString = [@"=XX" stringByPaddingToLength:200 withString:@"=" startingAtIndex:0];
+    dispatch_queue_t queue = dispatch_queue_create("com.regexkitx.tests.async", DISPATCH_QUEUE_SERIAL);
+    XCTestExpectation *done = [self expectationWithDescription:@"cancelled"];
+
+    NSProgress *progress = [equalString countOfRegex:@"X(.+)+X\\1" range:equalString.stringRange options:RKXNoOptions matchOptions:kNilOptions queue:queue completionHandler:^(NSUInteger count, NSError *error) {
+        XCTAssertEqual(count, 0UL);
+        XCTAssertEqual(error.code, NSUserCancelledError);
+        [done fulfill];
+    }];
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.1 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_DEFAULT, 0), ^{
+        [progress cancel];
+    });
+
+    [self waitForExpectationsWithTimeout:2.0 handler:nil];
+}
+
+#pragma mark - Linear-Time Engine
+
+- (NSArray<NSString *> *)rangeDescriptionsOfMatches:(NSArray<NSTextCheckingResult *> *)matches
+{
+    NSMutableArray *descriptions = [NSMutableArray array];
+
+    for (NSTextCheckingResult *match in matches) {
+        for (NSUInteger i = 0; i < match.numberOfRanges; i++) {
+            [descriptions addObject:NSStringFromRange([match rangeAtIndex:i])];
+        }
+        [descriptions addObject:@"|"];
+    }
+
+    return [descriptions copy];
+}
+
+- (void)testLinearTimeMatchesAgreeWithNSRegularExpression
+{
+    // Patterns from the Regex Cookbook and Mastering Regular Expressions tests, all of which the linear-time engine runs.
+    NSArray<NSString *> *patterns = @[ @"\\bgr[ea]y\\b", @"[^aeiouAEIOU\\s\\d\\W]", @"\\b(?:first|1st)\\b", @"^\\w{4,6}$", @"\\w+$", @"\\Bcat\\B", @"<.*?>",
+                                       @"\\$([a-zA-Z_]\\w*)", @"\\$[0-9]+(?:\\.[0-9]+)?", @"\"[^\"\\\\]*(\\\\.[^\"\\\\]*)*\"", @"\\b(?:\\d{1,3}\\.){3}\\d{1,3}\\b",
+                                       @"(?i)hello(?-i)WORLD", @"(?m)^\\w+$", @"(?i:abc)DEF", @"(a|ab)b", @"\\A\\w+", @"\\n\\z", @"third\\Z",
+                                       @"\\d+(?# match one or more digits)\\.(?# a literal dot)\\d+", @"ab|a", @"ex|export", @"(\\w+)(\\d+)", @"(.+?)(\\d+)",
+                                       @"(a+)+b", @"^a{1,3}ab$", @"(a+)(b+)b(c+)", @"^.*?$", @"\\([^()]*(?:\\([^()]*\\)[^()]*)*\\)",
+                                       @"<(\\w+)(?:\\s+\\w+(?:\\s*=\\s*(?:\"[^\"]*\"|'[^']*'|[^'\">\\s]+))?)*\\s*/?>",
+                                       @"<a\\b[^>]*\\bhref\\s*=\\s*(?:\"([^\"]*)\"|'([^']*)')", @"\\b(?:[a-z0-9](?:[-a-z0-9]*[a-z0-9])?\\.)+[a-z]{2,}\\b",
+                                       @"/\\*[^*]*\\*+(?:[^/*][^*]*\\*+)*/", @"<b>(.*?)</b>", @".*<end>(.*?)</end>", @"^([^:]*):", @"\"[^\"]*\"|[^,]+",
+                                       @"^a{2,4}?", @"a{2,4}?a", @"(\\d{4})-(\\d{2})-(\\d{2})", @"\\w+\\s?", @"\\b(?<keyword>table|row|cell)\\b",
+                                       @"^[A-Z0-9+_.-]+@[A-Z0-9.-]+$", @"^.*\\bverbose\\b.*$", @"\\s+$", @"([+-] *)?\\b[0-9]+\\b", @"\\b0[xX][0-9A-Fa-f]+\\b",
+                                       @"&[hH][0-9A-Fa-f]+\\b", @"\\b[0-9A-Fa-f]+H\\b", @"\\b(?:[0-9A-Fa-f]{2})+\\b", @"\\b0*([1-9][0-9]*|0)\\b",
+                                       @"^(25[0-5]|2[0-4][0-9]|1[0-9]{2}|[1-9]?[0-9])$", @"\\b([0-9]+(_+[0-9]+)*|0[xX][0-9A-F]+(_+[0-9A-F]+)*|0b[01]+(_+[01]+)*)\\b",
+                                       @"[-+]?(\\b[0-9]+(\\.[0-9]*)?|\\.[0-9]+)([eE][-+]?[0-9]+\\b)?", @"\\b[0-9]{1,3}(,[0-9]{3})*(\\.[0-9]+)?\\b|\\.[0-9]+\\b",
+                                       @"(?i)\\b[a-z_][0-9a-z_]{0,31}\\b", @"[-+*/=<>%&^|!~?]", @"//.*", @"/\\*.*?\\*/",
+                                       @"\\b(?:(?:https?|ftp|file)://|(www|ftp)\\.)[-A-Z0-9+&@#/%?=~_|$!:,.;]*[-A-Z0-9+&@#/%=~_|$]",
+                                       @"^[a-z][a-z0-9+\\-.]*://([a-z0-9\\-._~%!$&'()*+,;=]+@)?", @"#(.+)", @"^(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\\.){3}",
+                                       @"^(?:[A-F0-9]{1,4}:){7}[A-F0-9]{1,4}$", @"[^\\\\/:*?\"<>|\\r\\n]+$", @"&(?:#([0-9]+)|#x([0-9a-fA-F]+)|([0-9a-zA-Z]+));",
+                                       @"<!--.*?-->", @"(,|\\r?\\n|^)([^\",\\r\\n]+|\"(?:[^\"]|\"\")*\")?", @"^\\[[^\\]\\r\\n]+](?:\\r?\\n(?:[^\\[\\r\\n].*)?)*",
+                                       @"^([^#=;\\r\\n]+)=([^;\\r\\n]*)", @"\\w+=.+", @"^$", @"$", @"\\b", @"a*", @"(?m)^[ \\t]*", @"(?m)^\\s*" ];
+    NSArray<NSString *> *subjects = @[ @"The quick brown fox jumps over the lazy dog. Gray grey greyhound; first 1st.\nSherlock Holmes met Dr. Watson\r\nat 221B Baker Street.\r\n",
+                                       @"aaab ab abc abcabc aabbbcc export ex $var $19.99 cat concatenate\n<b>bold</b> <i>it</i> <a href=\"x.html\">link</a> <br/>\n",
+                                       @"0x1F 0XFF &hA0 7FH 0b1010 017 1_000 +42 - 7 3.14 -2.5e10 1,234,567.89 .5 255 256 2001-09-11\n192.168.0.1 FE80:0000:0000:0000:0202:B3FF:FE1E:8329",
+                                       @"\"quoted \\\"text\\\"\" 'single' /* a ** comment */ // line\n[section]\r\nname=RegexKitX ; comment\r\nkey = \"a, b\",c\n<!-- note -->&amp;&#169;&#xA9;",
+                                       @"user@EXAMPLE.COM http://www.example.com/path?q=1#frag ftp://user@files.example.org hello WORLD HelloWORLD abcDEF\n(a (nested) pair) <end>one</end><end>two</end>",
+                                       @"caf\u00e9 na\u00efve\u2028second line\rthird line\u2029fourth \U0001F600 end 12",
+                                       @"this is verbose\nthird\n",
+                                       @"a\r\n  b\r\n", @"a\r\n\r\nb",
+                                       @"x" ];
+    NSArray<NSNumber *> *optionSets = @[ @(RKXNoOptions), @(RKXCaseless), @(RKXMultiline), @(RKXCaseless | RKXMultiline) ];
+    NSUInteger compared = 0;
+
+    for (NSString *pattern in patterns) {
+        XCTAssertTrue([pattern isRegexLinearTimeEligibleWithOptions:RKXNoOptions], @"%@", pattern);
+
+        for (NSNumber *optionSet in optionSets) {
+            RKXRegexOptions options = optionSet.unsignedIntegerValue;
+            NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:(NSRegularExpressionOptions)options error:NULL];
+            XCTAssertNotNil(regex, @"%@", pattern);
+
+            for (NSString *subject in subjects) {
+                for (NSValue *rangeValue in @[ [NSValue valueWithRange:subject.stringRange], [NSValue valueWithRange:NSMakeRange(1, subject.length - 1)] ]) {
+                    NSRange searchRange = rangeValue.rangeValue;
+                    NSArray *linearMatches = [subject linearTimeMatchesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL];
+                    if (!linearMatches) { continue; }
+                    NSArray *icuMatches = [regex matchesInString:subject options:kNilOptions range:searchRange];
+                    XCTAssertEqualObjects([self rangeDescriptionsOfMatches:linearMatches], [self rangeDescriptionsOfMatches:icuMatches], @"%@ (options %lu) in %@", pattern, options, NSStringFromRange(searchRange));
+                    compared++;
+                }
+            }
+        }
+    }
+
+    // The non-ASCII subject is declined for patterns using \w, \d, \s, \b or caseless letters.
+    XCTAssertGreaterThan(compared, patterns.count * optionSets.count * 8);
+}
+
+- (void)testLinearTimeEngineDeclinesUnsupportedMatching
+{
+    NSError *error;
+    XCTAssertFalse([@"(\\w)\\1" isRegexLinearTimeEligibleWithOptions:RKXNoOptions]);
+    XCTAssertFalse([@"foo(?=bar)" isRegexLinearTimeEligibleWithOptions:RKXNoOptions]);
+    XCTAssertFalse([@"\\p{Lu}+" isRegexLinearTimeEligibleWithOptions:RKXNoOptions]);
+    XCTAssertFalse([@"a.+f" isRegexLinearTimeEligibleWithOptions:RKXDotAll]);
+    XCTAssertTrue([@"a.+f" isRegexLinearTimeEligibleWithOptions:RKXNoOptions]);
+
+    NSString *doubled = @"the the cat";
+    XCTAssertNil([doubled linearTimeMatchesOfRegex:@"\\b(\\w+)\\s+\\1\\b" range:doubled.stringRange options:RKXNoOptions matchOptions:kNilOptions error:&error]);
+    XCTAssertEqualObjects(error.domain, RKXLinearTimeMatchingErrorDomain);
+    XCTAssertEqual(error.code, RKXLinearTimeMatchingUnsupportedError);
+    XCTAssertNotNil(error.userInfo[NSLocalizedFailureReasonErrorKey]);
+
+    error = nil;
+    NSString *accented = @"caf\u00e9 au lait";
+    XCTAssertNil([accented linearTimeMatchesOfRegex:@"\\w+" range:accented.stringRange options:RKXNoOptions matchOptions:kNilOptions error:&error]);
+    XCTAssertEqual(error.code, RKXLinearTimeMatchingUnsupportedError);
+    XCTAssertEqual([accented linearTimeMatchesOfRegex:@"[a-z]+" range:accented.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL].count, 3UL);
+    XCTAssertNil([accented linearTimeMatchesOfRegex:@"[a-z]+" range:accented.stringRange options:RKXNoOptions matchOptions:RKXAnchored error:NULL]);
+    XCTAssertEqual([accented linearTimeMatchesOfRegex:@"CAF" range:accented.stringRange options:RKXCaseless matchOptions:kNilOptions error:NULL].count, 1UL);
+
+    NSString *kelvin = @"273 \u212A";
+    XCTAssertNil([kelvin linearTimeMatchesOfRegex:@"k" range:kelvin.stringRange options:RKXCaseless matchOptions:kNilOptions error:NULL]);
+}
+
+- (void)testLinearTimeWhitespaceClassMatchesICU
+{
+    NSString *spaces = @"a\tb\nc\vd\fe\rf g";
+
+    for (NSString *pattern in @[ @"\\s", @"\\S", @"[\\s]", @"[^\\s]", @"\\s+" ]) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:NULL];
+        NSArray *linearMatches = [spaces linearTimeMatchesOfRegex:pattern range:spaces.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+        XCTAssertNotNil(linearMatches, @"%@", pattern);
+        XCTAssertEqualObjects([self rangeDescriptionsOfMatches:linearMatches], [self rangeDescriptionsOfMatches:[regex matchesInString:spaces options:kNilOptions range:spaces.stringRange]], @"%@", pattern);
+        XCTAssertEqual([spaces countOfRegex:pattern], [regex numberOfMatchesInString:spaces options:kNilOptions range:spaces.stringRange], @"%@", pattern);
+    }
+}
+
+- (void)testNestedQuantifiersAreMatchedInLinearTime
+{
+    NSString *equalString = [@"=XX" stringByPaddingToLength:10000 withString:@"=" startingAtIndex:0];
+    NSError *error;
+    NSDate *start = [NSDate date];
+    BOOL result = [equalString isMatchedByRegex:@"X(.+)+X" range:equalString.stringRange options:RKXNoOptions matchOptions:(RKXReportProgress | RKXReportCompletion) error:&error];
+    XCTAssertFalse(result);
+    XCTAssertNil(error);
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate:start], 1.0);
+
+    NSString *runs = @"xaab aaab ab";
+    XCTAssertEqualObjects([runs stringByReplacingOccurrencesOfRegex:@"(a+)+b" withTemplate:@"<$1>"], @"x<aa> <aaa> <a>");
+    XCTAssertEqualObjects([self rangeDescriptionsOfMatches:[runs linearTimeMatchesOfRegex:@"(a+)+b" range:runs.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL]],
+                          [self rangeDescriptionsOfMatches:[[NSRegularExpression regularExpressionWithPattern:@"(a+)+b" options:0 error:NULL] matchesInString:runs options:0 range:runs.stringRange]]);
+}
+
+- (void)testLazyDFAQueriesAgreeWithNSRegularExpression
+{
+    // Capture-free patterns, including ones that match the empty string and ones that only match at assertions.
+    NSArray<NSString *> *patterns = @[ @"Sherlock", @"a[^x]{5}b", @"[a-zA-Z]+ing$", @"^[a-zA-Z ]{5,}$", @"(?:Holmes|Watson)", @"\\bgr[ea]y\\b", @"\\Bcat\\B",
+                                       @"<.*?>", @"(?:ab|a)(?:bc|b)", @"(?i)hello(?-i)WORLD", @"\\w+\\s?", @"^", @"$", @"^$", @"\\b", @"a*", @"x*?", @"\\s+$",
+                                       @"(?:\\r?\\n)+", @"third\\Z", @"\\A\\w+", @"[^\\r\\n]{3}\\z", @".{2,}?e", @"\\d{1,3}(?:,\\d{3})*",
+                                       @"^[ \\t]*", @"^\\s*" ];
+    NSArray<NSString *> *subjects = @[ @"Sherlock Holmes met Dr. Watson\r\nat 221B Baker Street. Gray grey greyhound concatenate\n\nsinging and ringing\n",
+                                       @"aaab a12345b axxxxb <b>bold</b> abc ab 1,234,567 12 hello WORLD HelloWORLD\r\nthird\r\n",
+                                       @"café naïve second line\rthird line fourth \U0001F600 end 12",
+                                       @"x", @"\n", @"a\r\n  b\r\n", @"a\r\n\r\nb" ];
+    NSArray<NSNumber *> *optionSets = @[ @(RKXNoOptions), @(RKXCaseless), @(RKXMultiline) ];
+
+    for (NSString *pattern in patterns) {
+        for (NSNumber *optionSet in optionSets) {
+            RKXRegexOptions options = optionSet.unsignedIntegerValue;
+            NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:(NSRegularExpressionOptions)options error:NULL];
+
+            for (NSString *subject in subjects) {
+                NSRange searchRange = (subject.length > 2) ? NSMakeRange(1, subject.length - 2) : subject.stringRange;
+                NSArray<NSTextCheckingResult *> *icuMatches = [regex matchesInString:subject options:kNilOptions range:searchRange];
+                NSMutableArray *icuRanges = [NSMutableArray array];
+                for (NSTextCheckingResult *match in icuMatches) { [icuRanges addObject:[NSValue valueWithRange:match.range]]; }
+
+                XCTAssertEqual([subject countOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL], icuMatches.count, @"%@ (options %lu) in %@", pattern, options, subject);
+                XCTAssertEqual([subject isMatchedByRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL], icuMatches.count > 0, @"%@ (options %lu) in %@", pattern, options, subject);
+                XCTAssertEqualObjects([subject rangesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL], icuRanges, @"%@ (options %lu) in %@", pattern, options, subject);
+            }
+        }
+    }
+}
+
+- (void)testLazyDFAFallsBackWhenStateCacheOverflows
+{
+    // Telling whether the 17th character from the end of each run was an a takes a DFA state per combination
+    // of the last 17 characters, which is far more than the state cache holds.
+    NSMutableString *subject = [NSMutableString string];
+    uint32_t seed = 7;
+
+    for (NSUInteger i = 0; i < 20000; i++) {
+        seed = seed * 1103515245U + 12345U;
+        [subject appendString:((seed >> 16) & 1U) ? @"a" : @"b"];
+        if (i % 1000 == 999) { [subject appendString:@"c"]; }
+    }
+
+    NSString *pattern = @"[ab]*a[ab]{16}c";
+    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:NULL];
+    NSUInteger expected = [regex numberOfMatchesInString:subject options:0 range:subject.stringRange];
+    XCTAssertEqual([subject countOfRegex:pattern], expected);
+    XCTAssertEqual([subject rangesOfRegex:pattern].count, expected);
+    XCTAssertEqual([subject isMatchedByRegex:pattern], expected > 0);
+}
+
+- (void)testMatchBufferAgreesWithNSRegularExpression
+{
+    NSString *text = @"Sherlock Holmes and Dr. Watson met on 1881-03-04; Holmes said \"ing\" at 221B.\nSinging, ringing, 12-34";
+    NSArray<NSString *> *patterns = @[ @"Holmes|Watson", @"[a-zA-Z]+ing", @"(\\d{2,4})-(\\d{2})(?:-(\\d{2}))?", @"(H)?olmes|(W)atson", @"\\b", @"(?<=Dr\\. )\\w+", @"(a+)+b" ];
+    RKXMatchBuffer *buffer = [[RKXMatchBuffer alloc] init];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:NULL];
+        NSArray<NSTextCheckingResult *> *expected = [regex matchesInString:text options:0 range:text.stringRange];
+        NSUInteger count = [text getMatchesOfRegex:pattern buffer:buffer];
+        XCTAssertEqual(count, expected.count, @"%@", pattern);
+        XCTAssertEqual(buffer.count, expected.count, @"%@", pattern);
+        XCTAssertEqual(buffer.rangesPerMatch, regex.numberOfCaptureGroups + 1, @"%@", pattern);
+
+        for (NSUInteger i = 0; i < MIN(count, expected.count); i++) {
+            XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:i], expected[i].range), @"%@ match %lu", pattern, i);
+
+            for (NSUInteger group = 0; group < buffer.rangesPerMatch; group++) {
+                XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:i captureIndex:group], [expected[i] rangeAtIndex:group]), @"%@ match %lu group %lu", pattern, i, group);
+            }
+        }
+    }
+
+    NSRange searchRange = NSMakeRange(10, 40);
+    NSArray *expected = [[NSRegularExpression regularExpressionWithPattern:@"[a-z]+" options:NSRegularExpressionCaseInsensitive error:NULL] matchesInString:text options:0 range:searchRange];
+    XCTAssertEqual([text getMatchesOfRegex:@"[a-z]+" range:searchRange options:RKXCaseless matchOptions:kNilOptions buffer:buffer error:NULL], expected.count);
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:0], [expected.firstObject range]));
+}
+
+- (void)testMatchBufferReusesStorage
+{
+    NSString *text = [@"" stringByPaddingToLength:2000 withString:@"ab12 " startingAtIndex:0];
+    RKXMatchBuffer *buffer = [[RKXMatchBuffer alloc] initWithCapacity:4];
+
+    XCTAssertEqual([text getMatchesOfRegex:@"([a-z]+)(\\d+)" buffer:buffer], 400UL);
+    XCTAssertEqual(buffer.rangesPerMatch, 3UL);
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:399 captureIndex:2], NSMakeRange(1997, 2)));
+    const NSRange *storage = [buffer rangesOfMatchAtIndex:0];
+
+    // A smaller result fits in the storage the first one grew.
+    XCTAssertEqual([text getMatchesOfRegex:@"\\d+" buffer:buffer], 400UL);
+    XCTAssertEqual(buffer.rangesPerMatch, 1UL);
+    XCTAssertEqual([buffer rangesOfMatchAtIndex:0], storage);
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:1], NSMakeRange(7, 2)));
+
+    [buffer removeAllMatches];
+    XCTAssertEqual(buffer.count, 0UL);
+    XCTAssertThrowsSpecificNamed([buffer rangeOfMatchAtIndex:0], NSException, NSRangeException);
+}
+
+- (void)testMatchBufferInvalidRegex
+{
+    RKXMatchBuffer *buffer = [[RKXMatchBuffer alloc] init];
+    XCTAssertEqual([@"abc" getMatchesOfRegex:@"b" buffer:buffer], 1UL);
+
+    NSError *error;
+    XCTAssertEqual([@"abc" getMatchesOfRegex:@"(b" range:NSMakeRange(0, 3) options:RKXNoOptions matchOptions:kNilOptions buffer:buffer error:&error], (NSUInteger)NSNotFound);
+    XCTAssertNotNil(error);
+    XCTAssertEqual(buffer.count, 0UL);
+}
+
+- (void)testCaselessLiteralSearchAgreesWithNSRegularExpression
+{
+    // The Kelvin sign, the long s and the sharp s fold onto ASCII letters, so text with them has to be left to ICU.
+    NSArray<NSString *> *texts = @[ @"SHERLOCK Holmes met sherlock and Dr. WATSON; holmesholmes at 221B Baker St.",
+                                    @"Café owner sHeRlOcK and the général watched Watson \U0001F600x",
+                                    @"\u212Aelvin met sherloc\u212A; Wat\u017Fon and Holme\u017F, Stra\u00DFe strasse",
+                                    @"no candidates here at all, none", @"", @"holmeS" ];
+    NSArray<NSString *> *patterns = @[ @"sherlock", @"Holmes|Watson", @"holmes|holm|watson|sherlock|dr\\.", @"k", @"ss", @"\U0001F600X", @"221b|St\\." ];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionCaseInsensitive error:NULL];
+
+        for (NSString *text in texts) {
+            NSArray<NSTextCheckingResult *> *expected = [regex matchesInString:text options:0 range:text.stringRange];
+            NSArray<NSValue *> *ranges = [text rangesOfRegex:pattern options:RKXCaseless];
+            XCTAssertEqual(ranges.count, expected.count, @"%@ in %@", pattern, text);
+            XCTAssertEqual([text countOfRegex:pattern options:RKXCaseless], expected.count, @"%@ in %@", pattern, text);
+            XCTAssertEqual([text isMatchedByRegex:pattern options:RKXCaseless], expected.count > 0, @"%@ in %@", pattern, text);
+
+            for (NSUInteger i = 0; i < MIN(ranges.count, expected.count); i++) {
+                XCTAssertTrue(NSEqualRanges(ranges[i].rangeValue, expected[i].range), @"%@ in %@ match %lu", pattern, text, i);
+            }
+        }
+    }
+}
+
+#pragma mark - Line Search
+
+- (void)testLinesMatchedByRegexReportsLineNumbersAndRanges
+{
+    NSString *text = @"alpha one\r\nbeta\rgamma one one\n\ndelta one";
+    NSArray<RKXLineMatch *> *lines = [text linesMatchedByRegex:@"one"];
+    XCTAssertEqual(lines.count, 3UL);
+
+    XCTAssertEqual(lines[0].lineNumber, 1UL);
+    XCTAssertTrue(NSEqualRanges(lines[0].lineRange, NSMakeRange(0, 9)));
+    XCTAssertEqualObjects(lines[0].matchRanges, @[ [NSValue valueWithRange:NSMakeRange(6, 3)] ]);
+    XCTAssertFalse(lines[0].isContextLine);
+
+    XCTAssertEqual(lines[1].lineNumber, 3UL);
+    XCTAssertEqualObjects([text substringWithRange:lines[1].lineRange], @"gamma one one");
+    XCTAssertEqual(lines[1].matchRanges.count, 2UL);
+
+    XCTAssertEqual(lines[2].lineNumber, 5UL);
+    XCTAssertEqualObjects([text substringWithRange:lines[2].lineRange], @"delta one");
+
+    // Each line is matched on its own, so anchors hold at its ends without RKXMultiline.
+    XCTAssertEqual([text linesMatchedByRegex:@"one$"].count, 3UL);
+    XCTAssertEqual([text linesMatchedByRegex:@"^beta$"].firstObject.lineNumber, 2UL);
+    XCTAssertEqual([text linesMatchedByRegex:@"^$"].firstObject.lineNumber, 4UL);
+    XCTAssertEqual([@"" linesMatchedByRegex:@"^"].count, 0UL);
+    XCTAssertEqual([@"a\n" linesMatchedByRegex:@"^"].count, 1UL);
+    XCTAssertEqual([text linesMatchedByRegex:@"ONE" options:RKXCaseless].count, 3UL);
+}
+
+- (void)testLinesMatchedByRegexInvertLimitAndContext
+{
+    NSString *text = @"1 keep\n2 drop\n3 drop\n4 keep\n5 drop\n6 drop\n7 drop\n8 keep\n9 drop\n";
+    NSArray<RKXLineMatch *> *inverted = [text linesMatchedByRegex:@"keep" range:text.stringRange options:RKXNoOptions lineOptions:RKXLineInvertMatch limit:0 linesBefore:0 linesAfter:0 error:NULL];
+    XCTAssertEqualObjects([inverted valueForKey:@"lineNumber"], (@[ @2, @3, @5, @6, @7, @9 ]));
+    XCTAssertEqual(inverted.firstObject.matchRanges.count, 0UL);
+
+    NSArray<RKXLineMatch *> *limited = [text linesMatchedByRegex:@"keep" range:text.stringRange options:RKXNoOptions lineOptions:RKXLineNoOptions limit:2 linesBefore:0 linesAfter:0 error:NULL];
+    XCTAssertEqualObjects([limited valueForKey:@"lineNumber"], (@[ @1, @4 ]));
+
+    NSArray<RKXLineMatch *> *context = [text linesMatchedByRegex:@"keep" range:text.stringRange options:RKXNoOptions lineOptions:RKXLineNoOptions limit:0 linesBefore:1 linesAfter:1 error:NULL];
+    XCTAssertEqualObjects([context valueForKey:@"lineNumber"], (@[ @1, @2, @3, @4, @5, @7, @8, @9 ]));
+    XCTAssertEqualObjects([context valueForKey:@"contextLine"], (@[ @NO, @YES, @YES, @NO, @YES, @YES, @NO, @YES ]));
+    XCTAssertEqual(context[1].matchRanges.count, 0UL);
+
+    // The context after the last selected line is still reported once the limit is reached.
+    NSArray<RKXLineMatch *> *trailing = [text linesMatchedByRegex:@"keep" range:text.stringRange options:RKXNoOptions lineOptions:RKXLineNoOptions limit:1 linesBefore:2 linesAfter:2 error:NULL];
+    XCTAssertEqualObjects([trailing valueForKey:@"lineNumber"], (@[ @1, @2, @3 ]));
+
+    NSRange searchRange = NSMakeRange(14, 21);
+    NSArray<RKXLineMatch *> *ranged = [text linesMatchedByRegex:@"keep" range:searchRange options:RKXNoOptions lineOptions:RKXLineNoOptions limit:0 linesBefore:0 linesAfter:0 error:NULL];
+    XCTAssertEqual(ranged.count, 1UL);
+    XCTAssertEqual(ranged.firstObject.lineNumber, 2UL);
+    XCTAssertTrue(NSEqualRanges(ranged.firstObject.lineRange, NSMakeRange(21, 6)));
+
+    NSError *error;
+    XCTAssertNil([text linesMatchedByRegex:@"(keep" range:text.stringRange options:RKXNoOptions lineOptions:RKXLineNoOptions limit:0 linesBefore:0 linesAfter:0 error:&error]);
+    XCTAssertNotNil(error);
+}
+
+- (void)testLinesMatchedByRegexAgreesWithPerLineMatching
+{
+    // Large enough to be matched in several parallel batches.
+    NSMutableString *text = [NSMutableString string];
+    NSArray<NSString *> *terminators = @[ @"\n", @"\r\n", @"\r", @" " ];
+
+    for (NSUInteger i = 0; i < 20000; i++) {
+        [text appendFormat:@"line %lu %@ w%lu-%lu%@", i, (i % 7 == 0) ? @"Sherlock" : @"holmes", i % 13, i % 5, terminators[i % terminators.count]];
+    }
+
+    NSArray<NSString *> *patterns = @[ @"Sherlock", @"sherlock|holmes", @"w(\\d+)-4", @"\\d+$", @"^line 1\\d* " ];
+    NSArray<NSNumber *> *optionSets = @[ @(RKXNoOptions), @(RKXCaseless) ];
+    NSArray<NSString *> *lineStrings = [text componentsSeparatedByCharactersInSet:NSCharacterSet.newlineCharacterSet];
+
+    for (NSString *pattern in patterns) {
+        for (NSNumber *optionSet in optionSets) {
+            RKXRegexOptions options = optionSet.unsignedIntegerValue;
+            NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:(NSRegularExpressionOptions)options error:NULL];
+            NSArray<RKXLineMatch *> *lines = [text linesMatchedByRegex:pattern options:options];
+            NSUInteger expectedCount = 0, lineIndex = 0;
+
+            // componentsSeparatedByCharactersInSet: splits \r\n in two, leaving an empty string that is skipped here.
+            for (NSUInteger i = 0; i < lineStrings.count && lineIndex < 20000; i++) {
+                NSString *lineString = lineStrings[i];
+                if (i > 0 && lineString.length == 0) { continue; }
+                NSUInteger matchCount = [regex numberOfMatchesInString:lineString options:0 range:lineString.stringRange];
+
+                if (matchCount) {
+                    XCTAssertLessThan(expectedCount, lines.count, @"%@", pattern);
+                    if (expectedCount >= lines.count) { break; }
+                    XCTAssertEqual(lines[expectedCount].lineNumber, lineIndex + 1, @"%@", pattern);
+                    XCTAssertEqual(lines[expectedCount].matchRanges.count, matchCount, @"%@ line %lu", pattern, lineIndex + 1);
+                    XCTAssertEqualObjects([text substringWithRange:lines[expectedCount].lineRange], lineString, @"%@", pattern);
+                    expectedCount++;
+                }
+
+                lineIndex++;
+            }
+
+            XCTAssertEqual(lines.count, expectedCount, @"%@", pattern);
+        }
+    }
+}
+
+#pragma mark - Extraction Schema
+
+- (void)testExtractionSchemaBuildsDictionariesAndRecords
+{
+    NSString *text = @"2024-01-15 ok, 1999-12 partial, 2001-07-04 ok";
+    RKXExtractionSchema *schema = [RKXExtractionSchema schemaWithRegex:@"(\\d{4})-(\\d{2})(?:-(\\d{2}))?" options:RKXNoOptions error:NULL keysAndCaptures:@"day", 3, @"year", 1, @"date", 0, @"month", 2, nil];
+    XCTAssertNotNil(schema);
+    XCTAssertEqualObjects(schema.keys, (@[ @"day", @"year", @"date", @"month" ]));
+    XCTAssertEqualObjects(schema.captures, (@[ @3, @1, @0, @2 ]));
+
+    NSDictionary *first = [schema dictionaryMatchedInString:text];
+    XCTAssertEqualObjects(first, (@{ @"year" : @"2024", @"month" : @"01", @"day" : @"15", @"date" : @"2024-01-15" }));
+    XCTAssertEqualObjects([schema dictionaryMatchedInString:text], [text dictionaryMatchedByRegex:schema.pattern withKeysAndCaptures:@"day", 3, @"year", 1, @"date", 0, @"month", 2, nil]);
+
+    // A capture that did not participate and a failed match both give empty strings, as with the NSString methods.
+    NSArray<NSDictionary *> *dicts = [schema arrayOfDictionariesMatchedInString:text];
+    XCTAssertEqual(dicts.count, 3UL);
+    XCTAssertEqualObjects(dicts[1][@"day"], RKXEmptyStringKey);
+    XCTAssertEqualObjects(dicts[2][@"date"], @"2001-07-04");
+    XCTAssertEqualObjects([schema dictionaryMatchedInString:@"no dates"][@"year"], RKXEmptyStringKey);
+    XCTAssertEqual([schema arrayOfDictionariesMatchedInString:@"no dates"].count, 0UL);
+
+    RKXMatchBuffer *buffer = [[RKXMatchBuffer alloc] initWithCapacity:2];
+    XCTAssertEqual([schema getRecordsInString:text range:text.stringRange matchOptions:kNilOptions buffer:buffer error:NULL], 3UL);
+    XCTAssertEqual(buffer.rangesPerMatch, 4UL);
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:0], NSMakeRange(8, 2)));
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:1 captureIndex:0], NSNotFoundRange));
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:1 captureIndex:2], NSMakeRange(15, 7)));
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:2 captureIndex:3], NSMakeRange(37, 2)));
+
+    // Fewer keys than capture groups leave each record shorter than the match it came from.
+    RKXExtractionSchema *years = [[RKXExtractionSchema alloc] initWithRegex:schema.pattern options:RKXNoOptions keys:@[ @"year" ] forCaptures:@[ @1 ] error:NULL];
+    XCTAssertEqual([years getRecordsInString:text range:text.stringRange matchOptions:kNilOptions buffer:buffer error:NULL], 3UL);
+    XCTAssertEqual(buffer.rangesPerMatch, 1UL);
+    XCTAssertTrue(NSEqualRanges([buffer rangeOfMatchAtIndex:2], NSMakeRange(32, 4)));
+}
+
+- (void)testExtractionSchemaValidatesCaptures
+{
+    NSError *error;
+    XCTAssertNil([RKXExtractionSchema schemaWithRegex:@"(a)(b)" options:RKXNoOptions error:&error keysAndCaptures:@"a", 1, @"c", 3, nil]);
+    XCTAssertEqualObjects(error.domain, RKXExtractionSchemaErrorDomain);
+    XCTAssertEqual(error.code, RKXExtractionSchemaInvalidCaptureError);
+
+    error = nil;
+    XCTAssertNil([[RKXExtractionSchema alloc] initWithRegex:@"(a)" options:RKXNoOptions keys:@[ @"a", @"b" ] forCaptures:@[ @1 ] error:&error]);
+    XCTAssertEqual(error.code, RKXExtractionSchemaInvalidCaptureError);
+
+    error = nil;
+    XCTAssertNil([RKXExtractionSchema schemaWithRegex:@"(a" options:RKXNoOptions error:&error keysAndCaptures:@"a", 1, nil]);
+    XCTAssertNotNil(error);
+    XCTAssertNotEqualObjects(error.domain, RKXExtractionSchemaErrorDomain);
+
+    // The NSString methods report a capture beyond the pattern the same way instead of raising.
+    error = nil;
+    XCTAssertNil([@"ab" dictionaryMatchedByRegex:@"(a)(b)" range:NSMakeRange(0, 2) options:RKXNoOptions error:&error withKeysAndCaptures:@"x", 5, nil]);
+    XCTAssertEqual(error.code, RKXExtractionSchemaInvalidCaptureError);
+}
+
+#pragma mark - Substring Interning
+
+- (void)testInternedSubstringsShareInstances
+{
+    NSString *log = @"INFO start\nWARN disk\nINFO ready\nERROR fail\nINFO done\nWARN disk\n";
+    NSArray<NSString *> *levels = [log substringsMatchedByRegex:@"(?m)^[A-Z]+" internTable:nil];
+    XCTAssertEqualObjects(levels, [log substringsMatchedByRegex:@"(?m)^[A-Z]+"]);
+    XCTAssertEqual(levels[0], levels[2]);
+    XCTAssertEqual(levels[1], levels[5]);
+    XCTAssertNotEqual(levels[0], levels[1]);
+
+    // A table passed to several calls shares its strings across them.
+    RKXInternTable *table = [[RKXInternTable alloc] init];
+    NSArray<NSString *> *words = [log substringsMatchedByRegex:@"(?m)^([A-Z]+) (\\w+)" range:log.stringRange capture:2 options:RKXNoOptions matchOptions:kNilOptions internTable:table error:NULL];
+    XCTAssertEqualObjects(words, (@[ @"start", @"disk", @"ready", @"fail", @"done", @"disk" ]));
+    XCTAssertEqual(table.count, 5UL);
+    NSArray<NSString *> *captures = [@"WARN disk" captureSubstringsMatchedByRegex:@"([A-Z]+) (\\w+)" range:NSMakeRange(0, 9) options:RKXNoOptions matchOptions:kNilOptions internTable:table error:NULL];
+    XCTAssertEqualObjects(captures, (@[ @"WARN disk", @"WARN", @"disk" ]));
+    XCTAssertEqual(captures[2], words[1]);
+    XCTAssertEqual(table.count, 7UL);
+
+    // Capture groups that did not participate give the empty string, which is not added to the table.
+    NSArray<NSString *> *optional = [@"a1 b a2" substringsMatchedByRegex:@"[ab](\\d)?" range:NSMakeRange(0, 7) capture:1 options:RKXNoOptions matchOptions:kNilOptions internTable:table error:NULL];
+    XCTAssertEqualObjects(optional, (@[ @"1", RKXEmptyStringKey, @"2" ]));
+
+    [table removeAllStrings];
+    XCTAssertEqual(table.count, 0UL);
+    XCTAssertEqualObjects([table internedSubstringOfString:@"xdiskx" range:NSMakeRange(1, 4)], @"disk");
+    XCTAssertNotEqual([table internedSubstringOfString:@"disk" range:NSMakeRange(0, 4)], words[1]);
+    XCTAssertThrowsSpecificNamed([table internedSubstringOfString:@"disk" range:NSMakeRange(2, 3)], NSException, NSRangeException);
+
+    NSError *error;
+    XCTAssertNil([log substringsMatchedByRegex:@"(INFO" range:log.stringRange capture:0 options:RKXNoOptions matchOptions:kNilOptions internTable:table error:&error]);
+    XCTAssertNotNil(error);
+}
+
+- (void)testInternTableAgreesWithSubstrings
+{
+    // Enough distinct values to grow the table several times, read from a string without a UTF-16 buffer of its own.
+    NSMutableString *text = [NSMutableString string];
+    for (NSUInteger i = 0; i < 5000; i++) { [text appendFormat:@"k%lu=\u00E9%lu ", i % 700, (i * 7) % 300]; }
+    NSString *source = [[NSString alloc] initWithData:[text dataUsingEncoding:NSUTF8StringEncoding] encoding:NSUTF8StringEncoding];
+    RKXInternTable *table = [[RKXInternTable alloc] init];
+
+    NSArray<NSString *> *interned = [source substringsMatchedByRegex:@"\\S+=(\\S+)" range:source.stringRange capture:0 options:RKXNoOptions matchOptions:kNilOptions internTable:table error:NULL];
+    NSArray<NSString *> *plain = [source substringsMatchedByRegex:@"\\S+=(\\S+)"];
+    XCTAssertEqualObjects(interned, plain);
+    XCTAssertEqual(table.count, [NSSet setWithArray:plain].count);
+}
+
+#pragma mark - Concurrent Replacement
+
+- (NSString *)concurrentReplacementText
+{
+    // Large enough to be split into several pieces, with every kind of line terminator at the piece boundaries.
+    NSMutableString *text = [NSMutableString string];
+    NSArray<NSString *> *terminators = @[ @"\n", @"\r\n", @"\r", @" " ];
+
+    for (NSUInteger i = 0; i < 30000; i++) {
+        [text appendFormat:@"line %lu user%lu@example.com id=%lu%@", i, i % 97, i * 7, terminators[i % terminators.count]];
+    }
+
+    return [text copy];
+}
+
+- (void)testConcurrentReplacementAgreesWithSerial
+{
+    NSString *text = [self concurrentReplacementText];
+    NSArray<NSString *> *patterns = @[ @"(?<user>user\\d+)@(\\w+)\\.com", @"(?m)^line (\\d+)", @"(?<=id=)(\\d+)", @"(?m)$", @"\\bline\\b" ];
+    NSArray<NSValue *> *ranges = @[ [NSValue valueWithRange:text.stringRange], [NSValue valueWithRange:NSMakeRange(1001, text.length - 2003)] ];
+
+    for (NSString *pattern in patterns) {
+        for (NSValue *range in ranges) {
+            NSString *templ = ([pattern containsString:@"<user>"]) ? @"${user} at $2" : @"<$0>";
+            NSString *serial = [text stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:range.rangeValue options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+            NSString *concurrent = [text stringByReplacingOccurrencesOfRegex:pattern withTemplate:templ range:range.rangeValue options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL];
+            XCTAssertNotNil(concurrent, @"%@", pattern);
+            XCTAssertEqualObjects(concurrent, serial, @"%@", pattern);
+        }
+    }
+
+    // Patterns whose matches can cross a line are replaced serially with the same result.
+    NSString *spanning = [text stringByReplacingOccurrencesOfRegex:@"\\d+\\s+line" withTemplate:@"-" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL];
+    XCTAssertEqualObjects(spanning, [text stringByReplacingOccurrencesOfRegex:@"\\d+\\s+line" withTemplate:@"-"]);
+
+    NSError *error;
+    XCTAssertNil([text stringByReplacingOccurrencesOfRegex:@"(line" withTemplate:@"" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:&error]);
+    XCTAssertNotNil(error);
+}
+
+- (void)testConcurrentBlockReplacementStopsInOrder
+{
+    NSString *text = [self concurrentReplacementText];
+    NSRange searchRange = NSMakeRange(17, text.length - 17);
+    NSUInteger stopLocation = [text rangeOfString:@"line 200 "].location;
+    NSUInteger laterStopLocation = [text rangeOfString:@"line 25000 "].location;
+
+    NSString *(^swap)(NSArray<NSString *> *, NSArray<NSValue *> *, BOOL *) = ^NSString *(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+        NSUInteger location = capturedRanges[0].rangeValue.location;
+        if (location == stopLocation || location == laterStopLocation) { *stop = YES; }
+        return [NSString stringWithFormat:@"L%@", capturedStrings[1]];
+    };
+
+    NSString *serial = [text stringByReplacingOccurrencesOfRegex:@"line (\\d+)" range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL usingBlock:swap];
+    NSString *concurrent = [text stringByReplacingOccurrencesOfRegex:@"line (\\d+)" range:searchRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL usingBlock:swap];
+    XCTAssertEqualObjects(concurrent, serial);
+
+    // Replacement runs from the last match back, so stopping at line 25000 leaves every earlier line alone.
+    XCTAssertTrue([concurrent containsString:@"line 24999 "]);
+    XCTAssertTrue([concurrent containsString:@"L25000 "]);
+    XCTAssertFalse([concurrent containsString:@"line 25001 "]);
+    XCTAssertTrue([concurrent containsString:@"line 200 "]);
+}
+
+#pragma mark - Concurrent Enumeration
+
+- (void)testConcurrentEnumerationDeliversEveryMatch
+{
+    NSString *text = self.testCorpus;
+    NSArray<NSValue *> *expected = [text rangesOfRegex:@"(Holmes|Watson)"];
+    NSMutableArray<NSValue *> *delivered = [NSMutableArray array];
+
+    BOOL matched = [text enumerateStringsMatchedByRegex:@"(Holmes|Watson)" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+        XCTAssertEqualObjects(capturedStrings[0], capturedStrings[1]);
+        @synchronized (delivered) { [delivered addObject:capturedRanges[0]]; }
+    }];
+
+    XCTAssertTrue(matched);
+    [delivered sortUsingComparator:^NSComparisonResult(NSValue *a, NSValue *b) { return [@(a.rangeValue.location) compare:@(b.rangeValue.location)]; }];
+    XCTAssertEqualObjects(delivered, expected);
+
+    NSArray<NSString *> *separated = [text substringsSeparatedByRegex:@"\\n\\n"];
+    NSMutableArray<NSString *> *pieces = [NSMutableArray array];
+    [text enumerateStringsSeparatedByRegex:@"\\n\\n" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+        @synchronized (pieces) { [pieces addObject:capturedStrings[0]]; }
+    }];
+    XCTAssertEqualObjects([NSCountedSet setWithArray:pieces], [NSCountedSet setWithArray:separated]);
+
+    NSError *error;
+    XCTAssertFalse([text enumerateStringsMatchedByRegex:@"(Holmes" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:&error usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {}]);
+    XCTAssertNotNil(error);
+    XCTAssertFalse([text enumerateStringsMatchedByRegex:@"nomatch" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {}]);
+}
+
+- (void)testConcurrentEnumerationStopsAfterEarlierMatches
+{
+    // Every match before the one that stops must have been delivered, however the batches were scheduled.
+    NSString *text = self.testCorpus;
+    NSArray<NSValue *> *expected = [text rangesOfRegex:@"\\w+"];
+    NSUInteger stopLocation = expected[expected.count / 2].rangeValue.location;
+    NSMutableIndexSet *delivered = [NSMutableIndexSet indexSet];
+
+    [text enumerateStringsMatchedByRegex:@"\\w+" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+        NSUInteger location = capturedRanges[0].rangeValue.location;
+        @synchronized (delivered) { [delivered addIndex:location]; }
+        if (location == stopLocation) { *stop = YES; }
+    }];
+
+    for (NSValue *range in expected) {
+        if (range.rangeValue.location > stopLocation) { break; }
+        XCTAssertTrue([delivered containsIndex:range.rangeValue.location]);
+    }
+}
+
+#pragma mark - Composite Query
+
+- (void)testQueryAgreesWithSeparateCalls
+{
+    NSString *text = @"GET /a 200, POST /b 404, GET /c 500, HEAD /d";
+    NSString *pattern = @"(?<method>[A-Z]+) (?<path>/\\w+)(?: (\\d+))?";
+    RKXQueryOutputs everything = RKXQueryFirstRange | RKXQueryCaptureSubstrings | RKXQueryNamedCaptures | RKXQueryCount | RKXQueryRanges | RKXQuerySubstrings;
+    RKXQuery *query = [RKXQuery queryWithRegex:pattern options:RKXNoOptions outputs:everything error:NULL];
+    XCTAssertEqual(query.outputs, everything);
+
+    RKXQueryResult *result = [query resultInString:text];
+    XCTAssertTrue(result.isMatched);
+    XCTAssertTrue(NSEqualRanges(result.firstRange, [text rangeOfRegex:pattern]));
+    XCTAssertEqualObjects(result.captureSubstrings, [text captureSubstringsMatchedByRegex:pattern]);
+    XCTAssertEqualObjects(result.namedCaptures, [text dictionaryWithNamedCaptureKeysMatchedByRegex:pattern]);
+    XCTAssertEqualObjects(result.namedCaptures, (@{ @"method" : @"GET", @"path" : @"/a" }));
+    XCTAssertEqual(result.count, [text countOfRegex:pattern]);
+    XCTAssertEqualObjects(result.ranges, [text rangesOfRegex:pattern]);
+    XCTAssertEqualObjects(result.substrings, [text substringsMatchedByRegex:pattern]);
+
+    // Results that were not asked for are left out, and a query without capture groups agrees too.
+    RKXQuery *words = [RKXQuery queryWithRegex:@"\\b[a-z]\\b" options:RKXNoOptions outputs:RKXQueryCount | RKXQueryRanges | RKXQueryFirstRange error:NULL];
+    RKXQueryResult *wordResult = [words resultInString:text];
+    XCTAssertEqual(wordResult.count, 4UL);
+    XCTAssertEqualObjects(wordResult.ranges, [text rangesOfRegex:@"\\b[a-z]\\b"]);
+    XCTAssertTrue(NSEqualRanges(wordResult.firstRange, NSMakeRange(5, 1)));
+    XCTAssertNil(wordResult.substrings);
+    XCTAssertNil(wordResult.captureSubstrings);
+
+    RKXQueryResult *missing = [query resultInString:@"nothing here"];
+    XCTAssertFalse(missing.isMatched);
+    XCTAssertEqual(missing.count, 0UL);
+    XCTAssertTrue(NSEqualRanges(missing.firstRange, NSNotFoundRange));
+    XCTAssertEqualObjects(missing.captureSubstrings, @[]);
+    XCTAssertEqualObjects(missing.namedCaptures, @{});
+
+    RKXQueryResult *firstOnly = [[RKXQuery queryWithRegex:pattern options:RKXNoOptions outputs:RKXQueryNamedCaptures error:NULL] resultInString:text range:NSMakeRange(12, 20) matchOptions:kNilOptions error:NULL];
+    XCTAssertEqualObjects(firstOnly.namedCaptures, (@{ @"method" : @"POST", @"path" : @"/b" }));
+    XCTAssertEqual(firstOnly.count, (NSUInteger)NSNotFound);
+
+    NSError *error;
+    XCTAssertNil([RKXQuery queryWithRegex:@"(GET" options:RKXNoOptions outputs:RKXQueryCount error:&error]);
+    XCTAssertNotNil(error);
+}
+
+#pragma mark - Backward Search
+
+- (void)testLastMatchAgreesWithForwardSearch
+{
+    // Long enough for several windows, with matches growing rarer toward the end and every kind of line terminator.
+    NSMutableString *text = [NSMutableString string];
+    NSArray<NSString *> *terminators = @[ @"\n", @"\r\n", @"\r", @" " ];
+
+    for (NSUInteger i = 0; i < 3000; i++) {
+        [text appendFormat:@"%@ %lu id=%lu%@", (i < 1500 || i % 500 == 0) ? @"ERROR" : @"ok", i, i * 3, terminators[i % terminators.count]];
+    }
+
+    NSArray<NSString *> *patterns = @[ @"ERROR (\\d+)", @"(?m)^ERROR", @"(?m)$", @"(?<=id=)\\d+", @"\\bok\\b", @"\\AERROR", @"ERROR\\s+\\d+\\s+id", @"x*", @"nomatch" ];
+    NSArray<NSValue *> *ranges = @[ [NSValue valueWithRange:text.stringRange], [NSValue valueWithRange:NSMakeRange(7, text.length - 20)], [NSValue valueWithRange:NSMakeRange(text.length - 5, 5)] ];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:NULL];
+
+        for (NSValue *range in ranges) {
+            NSTextCheckingResult *expected = [regex matchesInString:text options:0 range:range.rangeValue].lastObject;
+            NSTextCheckingResult *last = [text lastMatchOfRegex:pattern range:range.rangeValue options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+            XCTAssertEqual(last == nil, expected == nil, @"%@", pattern);
+            XCTAssertTrue(NSEqualRanges(last.range, expected.range), @"%@ %@", pattern, range);
+        }
+    }
+
+    XCTAssertTrue(NSEqualRanges([text lastRangeOfRegex:@"ERROR (\\d+)" range:text.stringRange capture:1 options:RKXNoOptions matchOptions:kNilOptions error:NULL], [[text rangesOfRegex:@"ERROR (\\d+)"].lastObject rangeValue]));
+    XCTAssertEqualObjects([text substringWithRange:[text lastRangeOfRegex:@"ERROR \\d+"]], @"ERROR 2500");
+    XCTAssertTrue(NSEqualRanges([text lastRangeOfRegex:@"nomatch"], NSNotFoundRange));
+    XCTAssertTrue(NSEqualRanges([@"a\nb\n" lastRangeOfRegex:@"^" options:RKXMultiline], NSMakeRange(2, 0)));
+
+    NSError *error;
+    XCTAssertNil([text lastMatchOfRegex:@"(ERROR" range:text.stringRange options:RKXNoOptions matchOptions:kNilOptions error:&error]);
+    XCTAssertNotNil(error);
+}
+
+#pragma mark - Match Cursor
+
+- (void)testMatchCursorPagesAgreeWithAllMatches
+{
+    NSString *text = @"a1 b22 \U0001F600 c333\nd4444 e\r\nf55555";
+    NSArray<NSString *> *patterns = @[ @"[a-z](\\d+)", @"(?<=[a-z])\\d", @"\\b\\w", @"(?m)^", @"x*", @"\\G\\w", @"nomatch" ];
+    NSArray<NSValue *> *ranges = @[ [NSValue valueWithRange:text.stringRange], [NSValue valueWithRange:NSMakeRange(4, text.length - 9)] ];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:0 error:NULL];
+
+        for (NSValue *range in ranges) {
+            NSArray<NSTextCheckingResult *> *expected = [regex matchesInString:text options:0 range:range.rangeValue];
+
+            for (NSUInteger pageSize = 1; pageSize <= 3; pageSize++) {
+                RKXMatchCursor *cursor = [[RKXMatchCursor alloc] initWithRegex:pattern options:RKXNoOptions string:text range:range.rangeValue matchOptions:kNilOptions error:NULL];
+                NSMutableArray<NSTextCheckingResult *> *paged = [NSMutableArray array];
+                NSArray<NSTextCheckingResult *> *page;
+
+                while ((page = [cursor nextMatches:pageSize]).count) {
+                    XCTAssertLessThanOrEqual(page.count, pageSize);
+                    [paged addObjectsFromArray:page];
+                }
+
+                XCTAssertTrue(cursor.isFinished);
+                XCTAssertEqual(cursor.matchCount, expected.count, @"%@ %@", pattern, range);
+                XCTAssertEqual(paged.count, expected.count, @"%@ %@", pattern, range);
+
+                for (NSUInteger i = 0; i < MIN(paged.count, expected.count); i++) {
+                    XCTAssertEqual(paged[i].numberOfRanges, expected[i].numberOfRanges);
+                    for (NSUInteger r = 0; r < expected[i].numberOfRanges; r++) {
+                        XCTAssertTrue(NSEqualRanges([paged[i] rangeAtIndex:r], [expected[i] rangeAtIndex:r]), @"%@ %@ %lu", pattern, range, i);
+                    }
+                }
+            }
+        }
+    }
+}
+
+- (void)testMatchCursorResumesFromToken
+{
+    NSString *text = self.testCorpus;
+    NSArray<NSValue *> *expected = [text rangesOfRegex:@"Holmes|Watson"];
+    RKXMatchCursor *cursor = [RKXMatchCursor cursorWithRegex:@"Holmes|Watson" inString:text];
+    NSMutableArray<NSValue *> *paged = [NSMutableArray array];
+
+    while (!cursor.isFinished) {
+        for (NSTextCheckingResult *match in [cursor nextMatches:50]) { [paged addObject:[NSValue valueWithRange:match.range]]; }
+        NSError *error;
+        cursor = [[RKXMatchCursor alloc] initWithResumeToken:cursor.resumeToken string:text error:&error];
+        XCTAssertNotNil(cursor, @"%@", error);
+        XCTAssertEqual(cursor.matchCount, paged.count);
+    }
+
+    XCTAssertEqualObjects(paged, expected);
+
+    NSError *error;
+    NSData *token = [RKXMatchCursor cursorWithRegex:@"Holmes" inString:text].resumeToken;
+    XCTAssertNil([[RKXMatchCursor alloc] initWithResumeToken:token string:@"Holmes" error:&error]);
+    XCTAssertEqualObjects(error.domain, RKXMatchCursorErrorDomain);
+    XCTAssertEqual(error.code, RKXMatchCursorInvalidTokenError);
+    XCTAssertNil([[RKXMatchCursor alloc] initWithResumeToken:[token subdataWithRange:NSMakeRange(0, 16)] string:text error:NULL]);
+
+    // One character changed away from the ends, where -hash does not look, still makes the token refuse the string.
+    NSMutableString *edited = [text mutableCopy];
+    NSRange middle = NSMakeRange(text.length / 3, 1);
+    [edited replaceCharactersInRange:middle withString:([[text substringWithRange:middle] isEqualToString:@"x"]) ? @"y" : @"x"];
+    XCTAssertNil([[RKXMatchCursor alloc] initWithResumeToken:token string:edited error:NULL]);
+    XCTAssertNotNil([[RKXMatchCursor alloc] initWithResumeToken:token string:[text mutableCopy] error:NULL]);
+    XCTAssertNil([RKXMatchCursor cursorWithRegex:@"(Holmes" inString:text]);
+}
+
+- (void)testMatchCursorFastEnumeration
+{
+    NSString *text = self.testCorpus;
+    NSMutableArray<NSValue *> *enumerated = [NSMutableArray array];
+    for (NSTextCheckingResult *match in [RKXMatchCursor cursorWithRegex:@"Holmes|Watson" inString:text]) { [enumerated addObject:[NSValue valueWithRange:match.range]]; }
+    XCTAssertEqualObjects(enumerated, [text rangesOfRegex:@"Holmes|Watson"]);
+
+    RKXMatchCursor *cursor = [RKXMatchCursor cursorWithRegex:@"\\d" inString:@"1a2b3"];
+    XCTAssertEqualObjects([@"1a2b3" substringWithRange:cursor.nextMatch.range], @"1");
+    XCTAssertEqual(cursor.location, 1UL);
+    NSMutableArray<NSString *> *rest = [NSMutableArray array];
+    for (NSTextCheckingResult *match in cursor) { [rest addObject:[@"1a2b3" substringWithRange:match.range]]; }
+    XCTAssertEqualObjects(rest, (@[ @"2", @"3" ]));
+    XCTAssertNil(cursor.nextMatch);
+}
+
+#pragma mark - Rewrite Rules
+
+- (void)testRewriteRuleSetAgreesWithChainedReplacement
+{
+    NSString *text = self.testCorpus;
+    NSArray<NSArray<NSString *> *> *pairs = @[ @[ @"Holmes", @"H." ], @[ @"(?<first>Dr)\\. (Watson)", @"${first} $2" ], @[ @"\\s{2,}", @" " ], @[ @"(\\d+)", @"<$1>" ], @[ @"Baker Street", @"Baker St" ] ];
+    NSMutableArray<RKXRewriteRule *> *rules = [NSMutableArray array];
+    NSString *chained = text;
+
+    for (NSArray<NSString *> *pair in pairs) {
+        [rules addObject:[RKXRewriteRule ruleWithRegex:pair[0] template:pair[1]]];
+        chained = [chained stringByReplacingOccurrencesOfRegex:pair[0] withTemplate:pair[1]];
+    }
+
+    RKXRewriteRuleSet *singlePass = [RKXRewriteRuleSet ruleSetWithRules:rules options:RKXNoOptions mode:RKXRewriteSinglePass error:NULL];
+    RKXRewriteRuleSet *sequential = [RKXRewriteRuleSet ruleSetWithRules:rules options:RKXNoOptions mode:RKXRewriteSequential error:NULL];
+    XCTAssertEqualObjects([singlePass stringByRewritingString:text], chained);
+    XCTAssertEqualObjects([sequential stringByRewritingString:text], chained);
+
+    NSRange range = NSMakeRange(100, 5000);
+    NSString *expected = [text stringByReplacingCharactersInRange:range withString:[[text substringWithRange:range] stringByReplacingOccurrencesOfRegex:@"Holmes" withTemplate:@"H."]];
+    RKXRewriteRuleSet *holmes = [RKXRewriteRuleSet ruleSetWithRules:@[ rules[0] ] options:RKXNoOptions mode:RKXRewriteSinglePass error:NULL];
+    XCTAssertEqualObjects([holmes stringByRewritingString:text range:range matchOptions:kNilOptions error:NULL], expected);
+}
+
+- (void)testRewriteRuleSetPriorityAndModes
+{
+    NSArray<RKXRewriteRule *> *rules = @[ [RKXRewriteRule ruleWithRegex:@"cat" template:@"dog"],
+                                          [RKXRewriteRule ruleWithRegex:@"catalog" template:@"list"],
+                                          [RKXRewriteRule ruleWithRegex:@"dog" template:@"wolf"],
+                                          [RKXRewriteRule ruleWithRegex:@"(\\d)" usingBlock:^NSString *(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+                                              XCTAssertEqual(capturedStrings.count, 2UL);
+                                              return [@(capturedStrings[1].integerValue * 2) stringValue];
+                                          }] ];
+
+    // The earlier rule wins where two rules match at the same point, and rewritten text is not matched again.
+    RKXRewriteRuleSet *singlePass = [RKXRewriteRuleSet ruleSetWithRules:rules options:RKXNoOptions mode:RKXRewriteSinglePass error:NULL];
+    XCTAssertEqualObjects([singlePass stringByRewritingString:@"catalog dog 3"], @"dogalog wolf 6");
+
+    RKXRewriteRuleSet *sequential = [RKXRewriteRuleSet ruleSetWithRules:rules options:RKXNoOptions mode:RKXRewriteSequential error:NULL];
+    XCTAssertEqualObjects([sequential stringByRewritingString:@"catalog dog 3"], @"wolfalog wolf 6");
+
+    RKXRewriteRuleSet *literal = [RKXRewriteRuleSet ruleSetWithRules:@[ [RKXRewriteRule ruleWithRegex:@"a.b" template:@"-"], [RKXRewriteRule ruleWithRegex:@"(" template:@"["] ] options:RKXIgnoreMetacharacters mode:RKXRewriteSinglePass error:NULL];
+    XCTAssertEqualObjects([literal stringByRewritingString:@"a.b axb ("], @"- axb [");
+
+    RKXRewriteRuleSet *stopping = [RKXRewriteRuleSet ruleSetWithRules:@[ [RKXRewriteRule ruleWithRegex:@"\\d" usingBlock:^NSString *(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+        *stop = [capturedStrings[0] isEqualToString:@"2"];
+        return @"#";
+    }] ] options:RKXNoOptions mode:RKXRewriteSinglePass error:NULL];
+    XCTAssertEqualObjects([stopping stringByRewritingString:@"1 2 3"], @"# # 3");
+
+    NSError *error;
+    XCTAssertNil([RKXRewriteRuleSet ruleSetWithRules:@[ [RKXRewriteRule ruleWithRegex:@"(a)\\1" template:@""] ] options:RKXNoOptions mode:RKXRewriteSinglePass error:&error]);
+    XCTAssertEqualObjects(error.domain, RKXRewriteRuleSetErrorDomain);
+    XCTAssertEqual(error.code, RKXRewriteRuleSetIncompatibleRuleError);
+    XCTAssertNotNil([RKXRewriteRuleSet ruleSetWithRules:@[ [RKXRewriteRule ruleWithRegex:@"(a)\\1" template:@""] ] options:RKXNoOptions mode:RKXRewriteSequential error:NULL]);
+    XCTAssertNil([RKXRewriteRuleSet ruleSetWithRules:@[ [RKXRewriteRule ruleWithRegex:@"(a" template:@""] ] options:RKXNoOptions mode:RKXRewriteSequential error:NULL]);
+}
+
+#pragma mark - Lexer
+
+- (RKXLexer *)iniLexer
+{
+    NSArray<NSString *> *names = @[ @"section", @"comment", @"value", @"key", @"equals", @"newline", @"space" ];
+    NSArray<NSString *> *patterns = @[ @"\\[[^\\]\\r\\n]*\\]", @"#[^\\r\\n]*", @"(?<==)[^\\r\\n]*", @"[A-Za-z_][\\w.]*", @"=", @"\\r?\\n|\\r", @"[ \\t]+" ];
+    return [[RKXLexer alloc] initWithTokenNames:names patterns:patterns skippingTokenNames:[NSSet setWithObjects:@"comment", @"newline", @"space", nil] options:RKXNoOptions error:NULL];
+}
+
+- (void)testLexerTokenizesConfigFile
+{
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:@"sample" ofType:@"ini"];
+    NSString *ini = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+    RKXLexer *lexer = [self iniLexer];
+    NSCountedSet<NSNumber *> *kinds = [NSCountedSet set];
+    NSMutableArray<NSString *> *keys = [NSMutableArray array];
+
+    NSError *error;
+    BOOL tokenized = [lexer enumerateTokensInString:ini range:ini.stringRange error:&error usingBlock:^(RKXToken token, BOOL *stop) {
+        [kinds addObject:@(token.kind)];
+        if (token.kind == 3) { [keys addObject:[ini substringWithRange:token.range]]; }
+    }];
+
+    XCTAssertTrue(tokenized, @"%@", error);
+    XCTAssertEqual([kinds countForObject:@0], [ini countOfRegex:@"(?m)^\\["]);
+    XCTAssertEqual([kinds countForObject:@1], 0UL);
+    XCTAssertEqual([kinds countForObject:@4], [ini countOfRegex:@"(?m)^[A-Za-z_][\\w.]*="]);
+    XCTAssertEqualObjects(keys, [ini substringsMatchedByRegex:@"(?m)^([A-Za-z_][\\w.]*)=" capture:1]);
+
+    // A token that may continue past the end of the input so far is held back until more arrives.
+    NSMutableArray<NSValue *> *whole = [NSMutableArray array];
+    [lexer enumerateTokensInString:ini range:ini.stringRange error:NULL usingBlock:^(RKXToken token, BOOL *stop) { [whole addObject:[NSValue valueWithRange:token.range]]; }];
+    NSMutableArray<NSValue *> *streamed = [NSMutableArray array];
+    RKXToken tokens[16];
+    NSUInteger location = 0;
+
+    for (NSUInteger available = 100; location < ini.length; available = MIN(available + 100, ini.length)) {
+        BOOL final = (available == ini.length);
+        NSUInteger count;
+
+        do {
+            count = [lexer getTokens:tokens maxCount:16 inString:[ini substringToIndex:available] range:NSMakeRange(location, available - location) final:final nextLocation:&location];
+            for (NSUInteger i = 0; i < count; i++) { [streamed addObject:[NSValue valueWithRange:tokens[i].range]]; }
+        } while (count == 16);
+
+        if (final) { break; }
+    }
+
+    XCTAssertEqual(location, ini.length);
+    XCTAssertEqualObjects(streamed, whole);
+}
+
+- (void)testLexerReportsUnexpectedInput
+{
+    RKXLexer *lexer = [self iniLexer];
+    NSString *text = @"[a]\nkey=1\n!oops\n";
+    NSMutableArray<NSString *> *tokens = [NSMutableArray array];
+
+    NSError *error;
+    XCTAssertFalse([lexer enumerateTokensInString:text range:text.stringRange error:&error usingBlock:^(RKXToken token, BOOL *stop) {
+        [tokens addObject:[text substringWithRange:token.range]];
+    }]);
+    XCTAssertEqualObjects(tokens, (@[ @"[a]", @"key", @"=", @"1" ]));
+    XCTAssertEqualObjects(error.domain, RKXLexerErrorDomain);
+    XCTAssertEqual(error.code, RKXLexerUnexpectedInputError);
+
+    RKXToken token;
+    NSUInteger location;
+    XCTAssertEqual([lexer getTokens:&token maxCount:1 inString:text range:text.stringRange final:YES nextLocation:&location], 1UL);
+    XCTAssertEqual(location, 3UL);
+
+    XCTAssertNil([RKXLexer lexerWithTokenNames:@[ @"double" ] patterns:@[ @"(a)\\1" ] options:RKXNoOptions error:&error]);
+    XCTAssertEqual(error.code, RKXLexerIncompatibleTokenError);
+}
+
+- (void)testRulesAndTokensCombineWithoutSyntaxTrees
+{
+    // Patterns the linear-time engine cannot parse are still combined unless they use backreferences.
+    NSArray<RKXRewriteRule *> *commented = @[ [RKXRewriteRule ruleWithRegex:@"cat  # the animal" template:@"dog"], [RKXRewriteRule ruleWithRegex:@"\\d +  # a number" template:@"#"] ];
+    RKXRewriteRuleSet *ruleSet = [RKXRewriteRuleSet ruleSetWithRules:commented options:RKXIgnoreWhitespace mode:RKXRewriteSinglePass error:NULL];
+    XCTAssertEqualObjects([ruleSet stringByRewritingString:@"cat 42 cats"], @"dog # dogs");
+
+    NSArray<RKXRewriteRule *> *quoted = @[ [RKXRewriteRule ruleWithRegex:@"\\Q(a)\\1\\E" template:@"x"], [RKXRewriteRule ruleWithRegex:@"b+" template:@"y"] ];
+    ruleSet = [RKXRewriteRuleSet ruleSetWithRules:quoted options:RKXNoOptions mode:RKXRewriteSinglePass error:NULL];
+    XCTAssertEqualObjects([ruleSet stringByRewritingString:@"(a)\\1 bb"], @"x y");
+
+    NSError *error;
+    XCTAssertNil([RKXRewriteRuleSet ruleSetWithRules:@[ [RKXRewriteRule ruleWithRegex:@"(a) \\1" template:@""] ] options:RKXIgnoreWhitespace mode:RKXRewriteSinglePass error:&error]);
+    XCTAssertEqual(error.code, RKXRewriteRuleSetIncompatibleRuleError);
+    XCTAssertNil([RKXLexer lexerWithTokenNames:@[ @"double" ] patterns:@[ @"(?<c>a) \\k<c>" ] options:RKXIgnoreWhitespace error:&error]);
+    XCTAssertEqual(error.code, RKXLexerIncompatibleTokenError);
+
+    RKXLexer *lexer = [RKXLexer lexerWithTokenNames:@[ @"word", @"number", @"space" ] patterns:@[ @"[a-z]+  # letters", @"\\d+  # digits", @"\\s+" ] options:RKXIgnoreWhitespace error:NULL];
+    NSString *text = @"abc 12";
+    NSMutableArray<NSNumber *> *kinds = [NSMutableArray array];
+    XCTAssertTrue([lexer enumerateTokensInString:text range:text.stringRange error:NULL usingBlock:^(RKXToken token, BOOL *stop) {
+        [kinds addObject:@(token.kind)];
+    }]);
+    XCTAssertEqualObjects(kinds, (@[ @0, @2, @1 ]));
+}
+
+#pragma mark - ASCII Storage
+
+- (void)testASCIIStorageAgreesWithUTF16Storage
+{
+    // The same text stored as ASCII bytes and, with one character more outside the search range, as UTF-16.
+    NSData *asciiData = [self.testCorpus dataUsingEncoding:NSASCIIStringEncoding allowLossyConversion:YES];
+    NSString *ascii = [[NSString alloc] initWithData:asciiData encoding:NSASCIIStringEncoding];
+    NSString *utf16 = [ascii stringByAppendingString:@"\u00E9"];
+    NSArray<NSString *> *patterns = @[ @"Holmes", @"(?i)holmes|watson", @"Sherlock|Mycroft|Lestrade", @"k", @"\u00E9t\u00E9", @"\\bHolmes\\b", @"[A-Z]\\w+" ];
+    NSArray<NSValue *> *ranges = @[ [NSValue valueWithRange:ascii.stringRange], [NSValue valueWithRange:NSMakeRange(1000, 50000)] ];
+    RKXMatchBuffer *asciiBuffer = [[RKXMatchBuffer alloc] initWithCapacity:0], *utf16Buffer = [[RKXMatchBuffer alloc] initWithCapacity:0];
+
+    for (NSString *pattern in patterns) {
+        for (NSValue *range in ranges) {
+            NSRange searchRange = range.rangeValue;
+            XCTAssertEqual([ascii countOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL], [utf16 countOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions error:NULL], @"%@", pattern);
+            XCTAssertEqualObjects([ascii rangesOfRegex:pattern range:searchRange], [utf16 rangesOfRegex:pattern range:searchRange], @"%@", pattern);
+
+            NSUInteger count = [ascii getMatchesOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions buffer:asciiBuffer error:NULL];
+            XCTAssertEqual(count, [utf16 getMatchesOfRegex:pattern range:searchRange options:RKXNoOptions matchOptions:kNilOptions buffer:utf16Buffer error:NULL], @"%@", pattern);
+            for (NSUInteger i = 0; i < MIN(count, utf16Buffer.count); i++) {
+                XCTAssertTrue(NSEqualRanges([asciiBuffer rangeOfMatchAtIndex:i], [utf16Buffer rangeOfMatchAtIndex:i]), @"%@ %lu", pattern, i);
+            }
+        }
+    }
+}
+
+#pragma mark - Line-Anchored Patterns
+
+/// Checks the Pike VM, the lazy DFA count and the lazy DFA ranges against ICU for one search.
+- (void)assertLinearEngineAgreesWithICUForRegex:(NSString *)pattern options:(RKXRegexOptions)options inString:(NSString *)subject range:(NSRange)searchRange
+{
+    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:(NSRegularExpressionOptions)options error:NULL];
+    NSArray<NSTextCheckingResult *> *icuMatches = [regex matchesInString:subject options:kNilOptions range:searchRange];
+    NSMutableArray *icuRanges = [NSMutableArray array];
+    for (NSTextCheckingResult *match in icuMatches) { [icuRanges addObject:[NSValue valueWithRange:match.range]]; }
+
+    NSArray *linearMatches = [subject linearTimeMatchesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL];
+    if (linearMatches) { XCTAssertEqualObjects([self rangeDescriptionsOfMatches:linearMatches], [self rangeDescriptionsOfMatches:icuMatches], @"%@ in %@", pattern, NSStringFromRange(searchRange)); }
+    XCTAssertEqual([subject countOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL], icuMatches.count, @"%@ in %@", pattern, NSStringFromRange(searchRange));
+    XCTAssertEqualObjects([subject rangesOfRegex:pattern range:searchRange options:options matchOptions:kNilOptions error:NULL], icuRanges, @"%@ in %@", pattern, NSStringFromRange(searchRange));
+}
+
+- (void)testLineAnchoredPatternsAgreeWithNSRegularExpression
+{
+    // Patterns that can only match at line starts, some also running to the end of the line, over lines of every
+    // length with each kind of line terminator, an empty line, a CR LF pair and a character outside the BMP.
+    NSArray<NSString *> *patterns = @[ @"^Sherlock", @"^([a-zA-Z]{0,4}ing)[^a-zA-Z]", @"^.{16,20}$", @"^[a-zA-Z ]{5,}$", @"^$", @"^.{1,2}$", @"^.$",
+                                       @"^(?:ab|abc)$", @"\\A.{3}$", @"^a|^b", @"(?:^x)+", @"^.*\\z", @"^.{2}\\Z", @"^(a)(b)?$" ];
+    NSString *lines = @"Sherlock\nsing, sing\r\nab\rabc \U0001F600 a\u2029b\fx\vxx\n\nSherlock Holmes, Watson\r\n0123456789abcdef\nab\n";
+    NSArray<NSString *> *subjects = @[ lines, [lines stringByAppendingString:@"ab"], self.testCorpus, @"", @"\n" ];
+
+    for (NSString *pattern in patterns) {
+        XCTAssertTrue([pattern isRegexLinearTimeEligibleWithOptions:RKXMultiline], @"%@", pattern);
+
+        for (NSString *subject in subjects) {
+            NSUInteger skipped = MIN(subject.length, 3UL);
+            [self assertLinearEngineAgreesWithICUForRegex:pattern options:RKXMultiline inString:subject range:subject.stringRange];
+            [self assertLinearEngineAgreesWithICUForRegex:pattern options:RKXMultiline inString:subject range:NSMakeRange(skipped, subject.length - skipped)];
+        }
+    }
+}
+
+#pragma mark - Required Literals
+
+- (void)testRequiredLiteralPatternsAgreeWithNSRegularExpression
+{
+    // Patterns that start with something broad but contain a literal every match has, over text where the literal
+    // turns up with and without a match around it, next to non-ASCII characters and at the very ends.
+    NSArray<NSString *> *patterns = @[ @"[a-zA-Z]+ing", @"[a-zA-Z]+ing$", @"([A-Za-z]olmes)|([A-Za-z]atson)", @"[a-z]{0,3}Holmes", @"(?i)[a-z]+ING",
+                                       @"\\d+px|[a-z]+em", @"x*abc", @"(?:ab|cd)xy", @"a.{2,5}cd", @".*ing", @"[^ ]+ing\\b", @"(\\w+)ing" ];
+    NSArray<NSString *> *subjects = @[ @"ing singing ring-ing caféing \U0001F600ing thing\nHolmes aHolmes abcdHolmes Watson wWatson 12px 3em em\n"
+                                       "abcxxabc cdxy abxy aXYcd a12cd a123456cd ingING sINGing\r\nending",
+                                       self.testCorpus, @"ing", @"" ];
+
+    for (NSString *pattern in patterns) {
+        XCTAssertTrue([pattern isRegexLinearTimeEligibleWithOptions:RKXMultiline], @"%@", pattern);
+
+        for (NSString *subject in subjects) {
+            NSUInteger skipped = MIN(subject.length, 2UL);
+            [self assertLinearEngineAgreesWithICUForRegex:pattern options:RKXMultiline inString:subject range:subject.stringRange];
+            [self assertLinearEngineAgreesWithICUForRegex:pattern options:RKXMultiline inString:subject range:NSMakeRange(skipped, subject.length - skipped)];
+        }
+    }
+}
+
+#pragma mark - First Characters
+
+- (void)testFirstCharacterPatternsAgreeWithNSRegularExpression
+{
+    // Patterns without a literal that can only start with a few code points, some of them non-ASCII, next to
+    // ones with too many first code points to scan for in ranges or at all.
+    NSArray<NSString *> *patterns = @[ @"a[^x]{20}b", @"([a-f](.[d-m].){0,2}[h-n]){2}", @"\"[^\"]{0,30}[?!\\.]\"", @"[0-9]+", @"\\d{3}-\\d{4}",
+                                       @"[é\U0001F600][a-z]", @"(?i)q[a-z]", @"[\\x00-\\x7f]{2}z", @"[aceg-ikmoq]x", @"\\bth[a-z]", @"(?:x|y)?[,;]",
+                                       @".{1,2}abc", @"[^a-z]{2}" ];
+    NSArray<NSString *> *subjects = @[ @"abcdefghijklmnopqrstuvwxyzb \"Is it?\" \"no\" 555-1234 cafés \U0001F600ok Quick quit, x; y,\n"
+                                       "\U0001F600\U0001F600xabc the theme\r\naex ghix mox",
+                                       self.testCorpus, @"q", @"" ];
+
+    for (NSString *pattern in patterns) {
+        XCTAssertTrue([pattern isRegexLinearTimeEligibleWithOptions:RKXNoOptions], @"%@", pattern);
+
+        for (NSString *subject in subjects) {
+            NSUInteger skipped = MIN(subject.length, 2UL);
+            [self assertLinearEngineAgreesWithICUForRegex:pattern options:RKXNoOptions inString:subject range:subject.stringRange];
+            [self assertLinearEngineAgreesWithICUForRegex:pattern options:RKXNoOptions inString:subject range:NSMakeRange(skipped, subject.length - skipped)];
+        }
+    }
+}
+
+#pragma mark - Capture-Free Matching
+
+- (void)testWholeMatchAPIsAgreeWithNSRegularExpressionWithoutGroups
+{
+    // Patterns ICU has to run, with groups that can be made non-capturing next to ones whose groups are kept
+    // because a backreference needs them, and parentheses that do not open a group at all.
+    NSArray<NSString *> *patterns = @[ @"(\\w+)(?=,)", @"(?<word>\\p{Lu}\\w*)", @"(\\()[^)]*(\\))", @"[(](\\d+)[)]", @"(a|b)\\1",
+                                       @"(?<l>[a-z])\\k<l>", @"(?i:(s)herlock)(?!x)", @"(?<!x)(y)", @"(?#c()(z)(?=[z,])", @"((?<n>x)|(y))+(?=;)" ];
+    NSArray<NSString *> *subjects = @[ @"Sherlock (1887), x,y; abby bab (42) Zed zz, yxy;", @"no groups here" ];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:kNilOptions error:NULL];
+        XCTAssertNotNil(regex, @"%@", pattern);
+
+        for (NSString *subject in subjects) {
+            NSArray<NSTextCheckingResult *> *expected = [regex matchesInString:subject options:kNilOptions range:subject.stringRange];
+            NSMutableArray<NSString *> *expectedSubstrings = [NSMutableArray array];
+            NSMutableArray<NSString *> *expectedGroups = [NSMutableArray array];
+            NSMutableArray<NSString *> *expectedComponents = [NSMutableArray array];
+            NSUInteger pos = 0;
+
+            for (NSTextCheckingResult *match in expected) {
+                NSRange group = [match rangeAtIndex:1];
+                [expectedSubstrings addObject:[subject substringWithRange:match.range]];
+                [expectedGroups addObject:(group.location != NSNotFound) ? [subject substringWithRange:group] : @""];
+                [expectedComponents addObject:[subject substringWithRange:NSMakeRange(pos, match.range.location - pos)]];
+                pos = NSMaxRange(match.range);
+            }
+
+            if (!expected.count || pos < subject.length) { [expectedComponents addObject:[subject substringFromIndex:pos]]; }
+
+            XCTAssertEqual([subject countOfRegex:pattern], expected.count, @"%@ in %@", pattern, subject);
+            XCTAssertEqual([subject isMatchedByRegex:pattern], (expected.count > 0), @"%@ in %@", pattern, subject);
+            XCTAssertEqualObjects([subject substringsMatchedByRegex:pattern], expectedSubstrings, @"%@ in %@", pattern, subject);
+            XCTAssertEqualObjects([subject substringsSeparatedByRegex:pattern], expectedComponents, @"%@ in %@", pattern, subject);
+            // The groups are still reported to callers that ask for them after the whole matches were looked up.
+            XCTAssertEqualObjects([subject substringsMatchedByRegex:pattern capture:1], expectedGroups, @"%@ in %@", pattern, subject);
+        }
+    }
+}
+
+#pragma mark - Match Cache
+
+- (void)testMatchCacheAnswersRepeatedQueries
+{
+    NSString *subject = [NSString stringWithFormat:@"%@ (%d) and %@ (%d)", @"Holmes", 1887, @"Watson", 1888];
+    NSString *pattern = @"\\w+(?= \\()";
+    NSArray<NSString *> *expected = [subject substringsMatchedByRegex:pattern];
+    NSRange expectedRange = [subject rangeOfRegex:pattern];
+
+    [NSString setMatchCacheByteLimit:1 << 16];
+    [NSString clearMatchCache];
+    XCTAssertTrue([subject isMatchedByRegex:pattern]);
+    XCTAssertTrue(NSEqualRanges([subject rangeOfRegex:pattern], expectedRange));
+    XCTAssertEqualObjects([subject substringsMatchedByRegex:pattern], expected);
+    XCTAssertEqual([subject countOfRegex:pattern], expected.count);
+    XCTAssertEqual([subject countOfRegex:pattern options:RKXCaseless], expected.count);
+    XCTAssertFalse([subject isMatchedByRegex:@"Moriarty"]);
+    XCTAssertFalse([subject isMatchedByRegex:@"Moriarty"]);
+
+    RKXMatchCacheStatistics statistics = [NSString matchCacheStatistics];
+    XCTAssertEqual(statistics.hits, 4UL);
+    XCTAssertEqual(statistics.misses, 3UL);
+    XCTAssertEqual(statistics.count, 3UL);
+    XCTAssertGreaterThan(statistics.bytes, 0UL);
+
+    [NSString clearMatchCache];
+    XCTAssertEqual([NSString matchCacheStatistics].count, 0UL);
+    [NSString setMatchCacheByteLimit:0];
+    XCTAssertEqual([NSString matchCacheByteLimit], 0UL);
+    XCTAssertTrue([subject isMatchedByRegex:pattern]);
+    XCTAssertEqual([NSString matchCacheStatistics].misses, 0UL);
+}
+
+- (void)testMatchCacheDropsResultsForChangedMutableStrings
+{
+    NSMutableString *subject = [NSMutableString stringWithString:@"one 1 two 2"];
+
+    [NSString setMatchCacheByteLimit:1 << 16];
+    [NSString clearMatchCache];
+    XCTAssertEqual([subject countOfRegex:@"\\d"], 2UL);
+    XCTAssertEqual([subject countOfRegex:@"\\d"], 2UL);
+    // The range the first two calls searched is looked up again once the string has grown, so its result is found again.
+    [subject appendString:@" 3"];
+    XCTAssertEqual([subject countOfRegex:@"\\d" range:NSMakeRange(0, 11)], 2UL);
+    XCTAssertEqual([subject countOfRegex:@"\\d"], 3UL);
+    [subject replaceCharactersInRange:NSMakeRange(4, 1) withString:@"x"];
+    XCTAssertEqual([subject countOfRegex:@"\\d"], 2UL);
+
+    RKXMatchCacheStatistics statistics = [NSString matchCacheStatistics];
+    XCTAssertEqual(statistics.hits, 1UL);
+    XCTAssertEqual(statistics.invalidations, 2UL);
+    XCTAssertEqual(statistics.misses, 4UL);
+    [NSString setMatchCacheByteLimit:0];
+}
+
+- (void)testMatchCacheStaysWithinItsByteLimit
+{
+    NSString *subject = [@"" stringByPaddingToLength:1000 withString:@"ab " startingAtIndex:0];
+
+    [NSString setMatchCacheByteLimit:20000];
+    [NSString clearMatchCache];
+
+    for (NSUInteger i = 0; i < 20; i++) {
+        NSString *pattern = [NSString stringWithFormat:@"a{1,%lu}b", i + 1];
+        XCTAssertEqual([subject countOfRegex:pattern], 333UL);
+        XCTAssertLessThanOrEqual([NSString matchCacheStatistics].bytes, 20000UL);
+    }
+
+    RKXMatchCacheStatistics statistics = [NSString matchCacheStatistics];
+    XCTAssertGreaterThan(statistics.evictions, 0UL);
+    XCTAssertEqual(statistics.count + statistics.evictions, 20UL);
+    // The most recent result is still there; the oldest one has been dropped.
+    XCTAssertEqual([subject countOfRegex:@"a{1,20}b"], 333UL);
+    XCTAssertEqual([NSString matchCacheStatistics].hits, 1UL);
+    XCTAssertEqual([subject countOfRegex:@"a{1,1}b"], 333UL);
+    XCTAssertEqual([NSString matchCacheStatistics].misses, 21UL);
+
+    // A string longer than the limit would be kept alive by its results, so they are not stored.
+    NSString *longSubject = [@"" stringByPaddingToLength:20000 withString:@"x" startingAtIndex:0];
+    XCTAssertFalse([longSubject isMatchedByRegex:@"y"]);
+    XCTAssertFalse([longSubject isMatchedByRegex:@"y"]);
+    XCTAssertEqual([NSString matchCacheStatistics].hits, 1UL);
+    XCTAssertLessThanOrEqual([NSString matchCacheStatistics].bytes, 20000UL);
+
+    // Lowering the limit drops results right away, and turning the cache off empties it.
+    [NSString setMatchCacheByteLimit:8000];
+    XCTAssertLessThanOrEqual([NSString matchCacheStatistics].bytes, 8000UL);
+    [NSString setMatchCacheByteLimit:0];
+    XCTAssertEqual([NSString matchCacheStatistics].count, 0UL);
+}
+
+#pragma mark - Pattern Analysis
+
+- (void)testRegexComplexityClassifiesHazards
+{
+    RKXRegexHazards hazards;
+    NSUInteger score;
+
+    XCTAssertEqual([@"(a+)+b" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityExponential);
+    XCTAssertTrue(hazards & RKXRegexHazardNestedQuantifier);
+    XCTAssertGreaterThanOrEqual(score, 95UL);
+
+    XCTAssertEqual([@"^(\\w+\\s?)+$" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityExponential);
+    XCTAssertEqual(hazards, RKXRegexHazardNestedQuantifier);
+
+    XCTAssertEqual([@"^(a|aa)+$" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityExponential);
+    XCTAssertEqual(hazards, RKXRegexHazardAmbiguousAlternation);
+
+    XCTAssertEqual([@"(.*a){12}b" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityPolynomial);
+    XCTAssertTrue(hazards & RKXRegexHazardNestedQuantifier);
+    XCTAssertGreaterThanOrEqual(score, 50UL);
+
+    XCTAssertEqual([@"^\\d+\\d+x$" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityPolynomial);
+    XCTAssertEqual(hazards, RKXRegexHazardOverlappingQuantifiers);
+
+    XCTAssertEqual([@"(?=.*\\d)\\w+" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:NULL error:NULL], RKXRegexComplexityPolynomial);
+    XCTAssertTrue(hazards & RKXRegexHazardUnboundedLookaround);
+
+    XCTAssertEqual([@"\\s+$" regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityPolynomial);
+    XCTAssertEqual(hazards, RKXRegexHazardUnanchoredQuantifier);
+    XCTAssertLessThan(score, 50UL);
+}
+
+- (void)testRegexComplexityOfSafePatterns
+{
+    NSArray<NSString *> *patterns = @[ @"Sherlock", @"Holmes.{10,60}Watson", @"^\\d+\\.\\d+$", @"^(?=.*\\d)\\w+$", @"^(a+b)+$", @"(?>a+)+", @"^\\s*,\\s*\\w+(?:\\s*,\\s*\\w+)*$", @"\\b(?:\\d{1,3}\\.){3}\\d{1,3}\\b" ];
+
+    for (NSString *pattern in patterns) {
+        RKXRegexHazards hazards = RKXRegexHazardNestedQuantifier;
+        NSUInteger score = NSNotFound;
+        XCTAssertEqual([pattern regexComplexityWithOptions:RKXNoOptions hazards:&hazards riskScore:&score error:NULL], RKXRegexComplexityLinear, @"%@", pattern);
+        XCTAssertEqual(hazards, RKXRegexHazardNone, @"%@", pattern);
+        XCTAssertEqual(score, 0UL, @"%@", pattern);
+        XCTAssertTrue([pattern isRegexSafeWithOptions:RKXNoOptions error:NULL], @"%@", pattern);
+    }
+}
+
+- (void)testRegexComplexityOfUnanalyzablePatterns
+{
+    NSError *error;
+    NSUInteger score = 0;
+    XCTAssertEqual([@"(a" regexComplexityWithOptions:RKXNoOptions hazards:NULL riskScore:&score error:&error], RKXRegexComplexityUnknown);
+    XCTAssertNotNil(error);
+    XCTAssertEqual(score, 100UL);
+
+    error = nil;
+    XCTAssertEqual([@"a b" regexComplexityWithOptions:RKXIgnoreWhitespace hazards:NULL riskScore:&score error:&error], RKXRegexComplexityUnknown);
+    XCTAssertNil(error);
+    XCTAssertFalse([@"a b" isRegexSafeWithOptions:RKXIgnoreWhitespace error:&error]);
+    XCTAssertEqualObjects(error.domain, RKXRegexComplexityErrorDomain);
+}
+
+- (void)testIsRegexSafeRejectsBacktrackingHazards
+{
+    NSError *error;
+    // Risky patterns the linear-time engine always runs are safe; ones that need ICU are not.
+    XCTAssertTrue([@"(a+)+b" isRegexSafeWithOptions:RKXNoOptions error:&error]);
+    XCTAssertTrue([@"^(([a-z])+.)+[A-Z]([a-z])+$" isRegexSafeWithOptions:RKXNoOptions error:&error]);
+    XCTAssertFalse([@"^(\\w+\\s?)+$" isRegexSafeWithOptions:RKXNoOptions error:&error]);
+    XCTAssertEqualObjects(error.domain, RKXRegexComplexityErrorDomain);
+    XCTAssertEqual(error.code, RKXRegexHazardError);
+    XCTAssertTrue([error.localizedFailureReason containsString:@"nested quantifiers"]);
+
+    error = nil;
+    XCTAssertFalse([@"(a+)+\\1" isRegexSafeWithOptions:RKXNoOptions error:&error]);
+    XCTAssertEqual(error.code, RKXRegexHazardError);
+
+    error = nil;
+    XCTAssertFalse([@"(a" isRegexSafeWithOptions:RKXNoOptions error:&error]);
+    XCTAssertNotEqualObjects(error.domain, RKXRegexComplexityErrorDomain);
+}
+
+- (void)testRiskyPatternsPreferLinearEngine
+{
+    // A bounded loop around an unbounded quantifier is polynomial, but risky enough to skip ICU.
+    NSString *text = [@"" stringByPaddingToLength:3000 withString:@"a" startingAtIndex:0];
+    NSDate *start = [NSDate date];
+    XCTAssertFalse([text isMatchedByRegex:@"(.*a){12}b"]);
+    XCTAssertLessThan([[NSDate date] timeIntervalSinceDate:start], 1.0);
+}
+
 #pragma mark - Thread Safety
 
 - (void)testConcurrentRegexOperations
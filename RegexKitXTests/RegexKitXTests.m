@@ -30,6 +30,7 @@
 */
 
 #import "RegexKitX.h"
+#import <malloc/malloc.h>
 @import XCTest;
 
 #define NFA_FAIL_TEST 0
@@ -960,8 +961,9 @@
 
 - (void)testCrazyNFAWithPunting
 {
+    // The backreference keeps this pattern on ICU, which has to give up on it.
     NSString *equalString = @"=XX=========================================";
-    NSString *regex = @"X(.+)+X";
+    NSString *regex = @"X(.+)+X\\1";
     NSError *error;
     BOOL result = [equalString isMatchedByRegex:regex
                                           range:equalString.stringRange
@@ -977,6 +979,22 @@
     XCTAssertNotNil(error.userInfo[NSLocalizedRecoverySuggestionErrorKey]);
 }
 
+- (void)testCrazyNFAWithLinearTimeEngine
+{
+    // Without the backreference the nested quantifier is routed to the linear-time engine, which finishes the scan.
+    NSString *equalString = @"=XX=========================================";
+    NSError *error;
+    BOOL result = [equalString isMatchedByRegex:@"X(.+)+X"
+                                          range:equalString.stringRange
+                                        options:RKXNoOptions
+                                   matchOptions:(RKXReportProgress | RKXReportCompletion)
+                                          error:&error];
+    XCTAssertFalse(result);
+    XCTAssertNil(error);
+    XCTAssertTrue([@"X(.+)+X" isRegexLinearTimeEligibleWithOptions:RKXNoOptions]);
+    XCTAssertFalse([@"X(.+)+X\\1" isRegexLinearTimeEligibleWithOptions:RKXNoOptions]);
+}
+
 - (void)testNormalNFAWithPuntingOptionThatSuccessfullyMatches
 {
     NSString *da = @"310-555-1212";
@@ -1193,6 +1211,547 @@
     }];
 }
 
+- (void)testLinearTimeEngineOnPerformancePatterns
+{
+    NSArray *patterns = @[ @"Sherlock", @"^Sherlock", @"Sherlock$", @"a[^x]{20}b", @"Holmes|Watson", @".{0,3}(Holmes|Watson)",
+                           @"[a-zA-Z]+ing", @"^([a-zA-Z]{0,4}ing)[^a-zA-Z]", @"[a-zA-Z]+ing$", @"^[a-zA-Z ]{5,}$", @"^.{16,20}$",
+                           @"([a-f](.[d-m].){0,2}[h-n]){2}", @"([A-Za-z]olmes)|([A-Za-z]atson)[^a-zA-Z]", @"\"[^\"]{0,30}[?!\\.]\"",
+                           @"Holmes.{10,60}Watson|Watson.{10,60}Holmes" ];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionAnchorsMatchLines error:NULL];
+        NSArray<NSTextCheckingResult *> *expected = [regex matchesInString:self.testCorpus options:kNilOptions range:self.testCorpus.stringRange];
+        NSArray<NSTextCheckingResult *> *matches = [self.testCorpus linearTimeMatchesOfRegex:pattern range:self.testCorpus.stringRange options:RKXMultiline matchOptions:kNilOptions error:NULL];
+        XCTAssertEqual(matches.count, expected.count, @"%@", pattern);
+
+        for (NSUInteger i = 0; i < MIN(matches.count, expected.count); i++) {
+            XCTAssertEqual(matches[i].numberOfRanges, expected[i].numberOfRanges, @"%@", pattern);
+            for (NSUInteger j = 0; j < expected[i].numberOfRanges; j++) {
+                XCTAssertTrue(NSEqualRanges([matches[i] rangeAtIndex:j], [expected[i] rangeAtIndex:j]), @"%@ match %lu group %lu", pattern, i, j);
+            }
+        }
+    }
+}
+
+- (void)testLazyDFAOnPerformancePatterns
+{
+    NSArray *patterns = @[ @"Sherlock", @"^Sherlock", @"Sherlock$", @"a[^x]{20}b", @"Holmes|Watson", @".{0,3}(Holmes|Watson)",
+                           @"[a-zA-Z]+ing", @"^([a-zA-Z]{0,4}ing)[^a-zA-Z]", @"[a-zA-Z]+ing$", @"^[a-zA-Z ]{5,}$", @"^.{16,20}$",
+                           @"([a-f](.[d-m].){0,2}[h-n]){2}", @"([A-Za-z]olmes)|([A-Za-z]atson)[^a-zA-Z]", @"\"[^\"]{0,30}[?!\\.]\"",
+                           @"Holmes.{10,60}Watson|Watson.{10,60}Holmes" ];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionAnchorsMatchLines error:NULL];
+        NSArray<NSTextCheckingResult *> *expected = [regex matchesInString:self.testCorpus options:kNilOptions range:self.testCorpus.stringRange];
+        NSMutableArray *expectedSubstrings = [NSMutableArray array];
+        for (NSTextCheckingResult *match in expected) { [expectedSubstrings addObject:[self.testCorpus substringWithRange:match.range]]; }
+
+        XCTAssertEqual([self.testCorpus countOfRegex:pattern options:RKXMultiline], expected.count, @"%@", pattern);
+        XCTAssertEqualObjects([self.testCorpus substringsMatchedByRegex:pattern options:RKXMultiline], expectedSubstrings, @"%@", pattern);
+        XCTAssertTrue([self.testCorpus isMatchedByRegex:pattern options:RKXMultiline], @"%@", pattern);
+    }
+}
+
+- (void)testPerformanceLazyDFARegex9
+{
+    [self measureBlock:^{
+        NSUInteger count = [self.testCorpus countOfRegex:@"[a-zA-Z]+ing$" options:RKXMultiline];
+        XCTAssertTrue(count > 0);
+    }];
+}
+
+- (void)testPerformanceLinearTimeRegex12
+{
+    [self measureBlock:^{
+        NSArray *matches = [self.testCorpus linearTimeMatchesOfRegex:@"([a-f](.[d-m].){0,2}[h-n]){2}" range:self.testCorpus.stringRange options:RKXMultiline matchOptions:kNilOptions error:NULL];
+        XCTAssertTrue(matches.count > 0);
+    }];
+}
+
+- (void)testPerformanceMatchBufferRegex12
+{
+    RKXMatchBuffer *buffer = [[RKXMatchBuffer alloc] init];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10; i++) {
+            NSUInteger count = [self.testCorpus getMatchesOfRegex:@"[a-zA-Z]+ing" range:self.testCorpus.stringRange options:RKXMultiline matchOptions:kNilOptions buffer:buffer error:NULL];
+            XCTAssertTrue(count > 0 && count == buffer.count);
+        }
+    }];
+}
+
+- (void)testPerformanceCaselessLiteralRegex01
+{
+    [self measureBlock:^{
+        NSUInteger count = [self.testCorpus countOfRegex:@"Sherlock" options:RKXCaseless];
+        XCTAssertEqual(count, 102UL);
+    }];
+}
+
+- (void)testPerformanceCaselessLiteralRegex05
+{
+    [self measureBlock:^{
+        NSUInteger count = [self.testCorpus countOfRegex:@"Holmes|Watson" options:RKXCaseless];
+        XCTAssertEqual(count, 548UL);
+    }];
+}
+
+- (void)testPerformanceCaselessLiteralRegex05WithICU
+{
+    // The same search as above run by NSRegularExpression, for comparison.
+    NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:@"Holmes|Watson" options:NSRegularExpressionCaseInsensitive error:NULL];
+
+    [self measureBlock:^{
+        NSUInteger count = [regex numberOfMatchesInString:self.testCorpus options:kNilOptions range:self.testCorpus.stringRange];
+        XCTAssertEqual(count, 548UL);
+    }];
+}
+
+- (void)testPerformanceExtractionSchema
+{
+    NSString *execRegex = @"(.*) EXECUTION_DATA: .* (\\w{3}.\\w{3}) .* orderId:(\\d+): clientId:(\\w+), execId:(.*.01), time:(\\d+\\s+\\d+:\\d+:\\d+), acctNumber:(\\w+).*, side:(\\w+), shares:(\\d+), price:(.*), permId:(\\d+).*";
+    RKXExtractionSchema *schema = [RKXExtractionSchema schemaWithRegex:execRegex options:RKXNoOptions error:NULL keysAndCaptures:
+                                   @"executionDate", 1, @"currencyPair", 2, @"orderID", 3, @"clientID", 4, @"executionID", 5, @"canonicalExecutionDate", 6,
+                                   @"accountID", 7, @"orderSide", 8, @"orderVolume", 9, @"executionPrice", 10, @"permanentID", 11, nil];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 1000; i++) {
+            NSDictionary *executionDict = [schema dictionaryMatchedInString:self.candidate];
+            XCTAssertEqualObjects(executionDict[@"permanentID"], @"825657452");
+        }
+    }];
+}
+
+- (void)testPerformanceInternedSubstringsRegex05
+{
+    RKXInternTable *table = [[RKXInternTable alloc] init];
+
+    [self measureBlock:^{
+        NSArray *matches = [self.testCorpus substringsMatchedByRegex:@"Holmes|Watson" range:self.testCorpus.stringRange capture:0 options:RKXMultiline matchOptions:kNilOptions internTable:table error:NULL];
+        XCTAssertEqual(matches.count, 542UL);
+        XCTAssertEqual(table.count, 2UL);
+    }];
+}
+
+- (void)testPerformanceEnumerationConcurrent
+{
+    // A callback that hashes each matched line stands in for parsing or hashing work that outweighs the matching.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 4 withString:self.testCorpus startingAtIndex:0];
+
+    [self measureBlock:^{
+        [corpus enumerateStringsMatchedByRegex:@"(?m)^.+$" range:corpus.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL usingBlock:^(NSArray<NSString *> *capturedStrings, NSArray<NSValue *> *capturedRanges, BOOL *stop) {
+            NSUInteger hash = 0;
+            for (NSUInteger i = 0; i < 50; i++) { hash ^= [[capturedStrings[0] stringByAppendingFormat:@"%lu", i] hash]; }
+            XCTAssertNotEqual(hash, NSNotFound);
+        }];
+    }];
+}
+
+- (void)testPerformanceQueryRegex05
+{
+    // The first range, count and substrings that would otherwise take three searches of the corpus.
+    RKXQuery *query = [RKXQuery queryWithRegex:@"Holmes|Watson" options:RKXNoOptions outputs:RKXQueryFirstRange | RKXQueryCount | RKXQuerySubstrings error:NULL];
+
+    [self measureBlock:^{
+        RKXQueryResult *result = [query resultInString:self.testCorpus];
+        XCTAssertEqual(result.count, 542UL);
+        XCTAssertEqual(result.substrings.count, 542UL);
+        XCTAssertNotEqual(result.firstRange.location, (NSUInteger)NSNotFound);
+    }];
+}
+
+- (void)testPerformanceLastRangeOfRegex
+{
+    // The last match near the end of the corpus repeated 16 times, found without scanning from the start.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+    NSRange expected = [[corpus rangesOfRegex:@"Holmes|Watson"].lastObject rangeValue];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++) {
+            XCTAssertTrue(NSEqualRanges([corpus lastRangeOfRegex:@"Holmes|Watson"], expected));
+        }
+    }];
+}
+
+- (void)testPerformanceMatchCursorPages
+{
+    // Pages of 20 matches deep into the corpus repeated 16 times, each resumed from a token as a paginated request would.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+    RKXMatchCursor *cursor = [RKXMatchCursor cursorWithRegex:@"Holmes|Watson" inString:corpus];
+    for (NSUInteger i = 0; i < 300; i++) { [cursor nextMatches:20]; }
+    NSData *token = cursor.resumeToken;
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++) {
+            RKXMatchCursor *resumed = [[RKXMatchCursor alloc] initWithResumeToken:token string:corpus error:NULL];
+            XCTAssertEqual([resumed nextMatches:20].count, 20UL);
+        }
+    }];
+}
+
+- (void)testPerformanceRewriteRuleSetSinglePass
+{
+    // Forty word replacements applied in one pass instead of forty.
+    NSMutableArray<RKXRewriteRule *> *rules = [NSMutableArray array];
+    for (NSString *word in [[self.testCorpus substringsMatchedByRegex:@"\\b[A-Z][a-z]{5,}\\b"] valueForKeyPath:@"@distinctUnionOfObjects.self"]) {
+        if (rules.count == 40) { break; }
+        [rules addObject:[RKXRewriteRule ruleWithRegex:[NSString stringWithFormat:@"\\b%@\\b", word] template:word.uppercaseString]];
+    }
+
+    RKXRewriteRuleSet *ruleSet = [RKXRewriteRuleSet ruleSetWithRules:rules options:RKXNoOptions mode:RKXRewriteSinglePass error:NULL];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10; i++) {
+            XCTAssertNotNil([ruleSet stringByRewritingString:self.testCorpus]);
+        }
+    }];
+}
+
+- (void)testPerformanceLexerWords
+{
+    // Every word, number, punctuation mark and run of whitespace of the corpus as a token, in one pass.
+    RKXLexer *lexer = [[RKXLexer alloc] initWithTokenNames:@[ @"word", @"number", @"space", @"other" ] patterns:@[ @"[A-Za-z]+", @"\\d+", @"\\s+", @"." ] skippingTokenNames:[NSSet setWithObject:@"space"] options:RKXNoOptions error:NULL];
+
+    [self measureBlock:^{
+        __block NSUInteger count = 0;
+        XCTAssertTrue([lexer enumerateTokensInString:self.testCorpus range:self.testCorpus.stringRange error:NULL usingBlock:^(RKXToken token, BOOL *stop) { count++; }]);
+        XCTAssertGreaterThan(count, 0UL);
+    }];
+}
+
+- (void)testPerformanceLineAnchoredCount
+{
+    // Only the starts of lines 16 to 40 units long are tried; compare with testPerformanceRegex11, which runs ICU.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+    NSUInteger expected = [[NSRegularExpression regularExpressionWithPattern:@"^.{16,20}$" options:NSRegularExpressionAnchorsMatchLines error:NULL] numberOfMatchesInString:corpus options:kNilOptions range:corpus.stringRange];
+
+    [self measureBlock:^{
+        XCTAssertEqual([corpus countOfRegex:@"^.{16,20}$" options:RKXMultiline], expected);
+        XCTAssertGreaterThan([corpus countOfRegex:@"^([a-zA-Z]{0,4}ing)[^a-zA-Z]" options:RKXMultiline], 0UL);
+    }];
+}
+
+- (void)testPerformanceRequiredLiteralCount
+{
+    // The patterns of testPerformanceRegex07, 09 and 13, counted by jumping to each "ing", "olmes" or "atson" and
+    // starting the scan at the run of letters before it.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+    NSArray<NSString *> *patterns = @[ @"[a-zA-Z]+ing", @"[a-zA-Z]+ing$", @"([A-Za-z]olmes)|([A-Za-z]atson)[^a-zA-Z]" ];
+    NSMutableArray<NSNumber *> *expected = [NSMutableArray array];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionAnchorsMatchLines error:NULL];
+        [expected addObject:@([regex numberOfMatchesInString:corpus options:kNilOptions range:corpus.stringRange])];
+    }
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < patterns.count; i++) {
+            XCTAssertEqual([corpus countOfRegex:patterns[i] options:RKXMultiline], expected[i].unsignedIntegerValue);
+        }
+    }];
+}
+
+- (void)testPerformanceFirstCharacterCount
+{
+    // The patterns of testPerformanceRegex04, 12 and 14, counted by jumping to each unit that can start a match.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+    NSArray<NSString *> *patterns = @[ @"a[^x]{20}b", @"([a-f](.[d-m].){0,2}[h-n]){2}", @"\"[^\"]{0,30}[?!\\.]\"" ];
+    NSMutableArray<NSNumber *> *expected = [NSMutableArray array];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionAnchorsMatchLines error:NULL];
+        [expected addObject:@([regex numberOfMatchesInString:corpus options:kNilOptions range:corpus.stringRange])];
+    }
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < patterns.count; i++) {
+            XCTAssertEqual([corpus countOfRegex:patterns[i] options:RKXMultiline], expected[i].unsignedIntegerValue);
+        }
+    }];
+}
+
+- (void)testPerformanceSeparatedByGroupPatterns
+{
+    // The patterns of testPerformanceRegex06, 08, 12 and 13 split the corpus through ICU with their groups made non-capturing.
+    NSArray<NSString *> *patterns = @[ @".{0,3}(Holmes|Watson)", @"^([a-zA-Z]{0,4}ing)[^a-zA-Z]", @"([a-f](.[d-m].){0,2}[h-n]){2}", @"([A-Za-z]olmes)|([A-Za-z]atson)[^a-zA-Z]" ];
+    NSMutableArray<NSNumber *> *expected = [NSMutableArray array];
+
+    for (NSString *pattern in patterns) {
+        NSRegularExpression *regex = [NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionAnchorsMatchLines error:NULL];
+        [expected addObject:@([regex numberOfMatchesInString:self.testCorpus options:kNilOptions range:self.testCorpus.stringRange])];
+    }
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < patterns.count; i++) {
+            NSArray *components = [self.testCorpus substringsSeparatedByRegex:patterns[i] options:RKXMultiline];
+            XCTAssertGreaterThanOrEqual(components.count, expected[i].unsignedIntegerValue);
+        }
+    }];
+}
+
+- (void)testPerformanceSeparatedByGroupPatternsWithICU
+{
+    // The same matches found by NSRegularExpression with the groups as written, for comparison.
+    NSArray<NSString *> *patterns = @[ @".{0,3}(Holmes|Watson)", @"^([a-zA-Z]{0,4}ing)[^a-zA-Z]", @"([a-f](.[d-m].){0,2}[h-n]){2}", @"([A-Za-z]olmes)|([A-Za-z]atson)[^a-zA-Z]" ];
+    NSMutableArray<NSRegularExpression *> *regexes = [NSMutableArray array];
+
+    for (NSString *pattern in patterns) {
+        [regexes addObject:[NSRegularExpression regularExpressionWithPattern:pattern options:NSRegularExpressionAnchorsMatchLines error:NULL]];
+    }
+
+    [self measureBlock:^{
+        for (NSRegularExpression *regex in regexes) {
+            NSArray *matches = [regex matchesInString:self.testCorpus options:kNilOptions range:self.testCorpus.stringRange];
+            XCTAssertGreaterThan(matches.count, 0UL);
+        }
+    }];
+}
+
+- (void)testPerformanceMatchCacheRepeatedQueries
+{
+    // A series of calls for the same pattern ICU has to run, answered from the match cache after the first call.
+    NSString *pattern = @"(Holmes|Watson)(?=[,.])";
+    NSUInteger expected = [self.testCorpus countOfRegex:pattern];
+    [NSString setMatchCacheByteLimit:1 << 20];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 10; i++) {
+            XCTAssertTrue([self.testCorpus isMatchedByRegex:pattern]);
+            XCTAssertNotEqual([self.testCorpus rangeOfRegex:pattern].location, (NSUInteger)NSNotFound);
+            XCTAssertEqual([self.testCorpus substringsMatchedByRegex:pattern].count, expected);
+            XCTAssertEqual([self.testCorpus countOfRegex:pattern], expected);
+        }
+    }];
+
+    [NSString setMatchCacheByteLimit:0];
+}
+
+- (NSString *)asciiCorpus
+{
+    NSData *asciiData = [self.testCorpus dataUsingEncoding:NSASCIIStringEncoding allowLossyConversion:YES];
+    return [[NSString alloc] initWithData:asciiData encoding:NSASCIIStringEncoding];
+}
+
+- (void)testPerformanceCountOfLiteralASCII
+{
+    // The corpus stored as ASCII bytes, which literal search reads in place.
+    NSString *corpus = [self asciiCorpus];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++) {
+            XCTAssertGreaterThan([corpus countOfRegex:@"Holmes|Watson"], 0UL);
+        }
+    }];
+}
+
+- (void)testPerformanceCountOfLiteralUTF16
+{
+    // The same text with one non-ASCII character, which makes it stored as UTF-16 and copied for every search.
+    NSString *corpus = [[self asciiCorpus] stringByAppendingString:@"\u00E9"];
+
+    [self measureBlock:^{
+        for (NSUInteger i = 0; i < 100; i++) {
+            XCTAssertGreaterThan([corpus countOfRegex:@"Holmes|Watson"], 0UL);
+        }
+    }];
+}
+
+- (void)testPerformanceReplacementSerial
+{
+    // The baseline for the concurrent replacement below: the corpus repeated 16 times, on one core.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+
+    [self measureBlock:^{
+        NSString *result = [corpus stringByReplacingOccurrencesOfRegex:@"(Holmes|Watson)" withTemplate:@"<$1>" range:corpus.stringRange options:RKXNoOptions matchOptions:kNilOptions error:NULL];
+        XCTAssertGreaterThan(result.length, corpus.length);
+    }];
+}
+
+- (void)testPerformanceReplacementConcurrent
+{
+    // Uses every available core; compare with testPerformanceReplacementSerial.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+    NSString *serial = [corpus stringByReplacingOccurrencesOfRegex:@"(Holmes|Watson)" withTemplate:@"<$1>"];
+
+    [self measureBlock:^{
+        NSString *result = [corpus stringByReplacingOccurrencesOfRegex:@"(Holmes|Watson)" withTemplate:@"<$1>" range:corpus.stringRange options:RKXNoOptions matchOptions:kNilOptions enumerationOptions:NSEnumerationConcurrent error:NULL];
+        XCTAssertEqualObjects(result, serial);
+    }];
+}
+
+- (void)testPerformanceLinesMatchedByRegex
+{
+    // grep -n over the corpus repeated 16 times.
+    NSString *corpus = [@"" stringByPaddingToLength:self.testCorpus.length * 16 withString:self.testCorpus startingAtIndex:0];
+
+    [self measureBlock:^{
+        NSArray<RKXLineMatch *> *lines = [corpus linesMatchedByRegex:@"Holmes|Watson"];
+        XCTAssertEqual(lines.count, 533UL * 16);
+        XCTAssertEqual(lines[533 * 15].lineNumber, 13052UL * 15 + lines[0].lineNumber);
+    }];
+}
+
+- (void)testPerformanceReDoSNestedQuantifiers
+{
+    // Each of these takes exponential or high-degree polynomial time on a backtracking engine when the text fails to match at its end.
+    NSString *run = [@"" stringByPaddingToLength:100000 withString:@"a" startingAtIndex:0];
+    NSString *words = [[@"" stringByPaddingToLength:60000 withString:@"word " startingAtIndex:0] stringByAppendingString:@"!"];
+
+    [self measureBlock:^{
+        NSError *error;
+        XCTAssertFalse([run isMatchedByRegex:@"(a+)+b" range:run.stringRange options:RKXNoOptions matchOptions:RKXReportProgress error:&error]);
+        XCTAssertFalse([run isMatchedByRegex:@"(.*a){12}b" range:run.stringRange options:RKXNoOptions matchOptions:RKXReportProgress error:&error]);
+        XCTAssertFalse([run isMatchedByRegex:@"^(([a-z])+.)+[A-Z]([a-z])+$" range:run.stringRange options:RKXNoOptions matchOptions:RKXReportProgress error:&error]);
+        XCTAssertFalse([words isMatchedByRegex:@"^(\\w+\\s?)+$" range:words.stringRange options:RKXNoOptions matchOptions:RKXReportProgress error:&error]);
+        XCTAssertNil(error);
+    }];
+}
+
+#pragma mark - Concurrency Benchmark
+// Many threads calling the NSString category at once, each with its own regex cache in its thread dictionary.
+// Every operation is one of: a hot pattern on a short input (70%), a hot pattern counted over a long input (10%),
+// or a pattern no thread has seen before on a short input (20%), which has to be compiled and cached.
+
+typedef struct {
+    NSUInteger threadCount;
+    NSUInteger operationCount;      // per thread
+    double throughput;              // operations per second, all threads together
+    uint64_t p50, p99, p999;        // latency of one operation in nanoseconds
+    NSUInteger compileCount;        // regexes compiled, all threads together
+    NSUInteger unexpectedCompiles;  // compiles beyond one per distinct pattern a thread used
+    int64_t cacheBytesPerThread;    // heap still held by the threads once their operations are done
+} RKXConcurrencyReport;
+
+static int RKXCompareLatencies(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t RKXHeapBytesInUse(void)
+{
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+    return (int64_t)statistics.size_in_use;
+}
+
+- (RKXConcurrencyReport)runMixedWorkloadOnThreads:(NSUInteger)threadCount operations:(NSUInteger)operationCount
+{
+    NSArray<NSString *> *hotPatterns = @[ @"Holmes|Watson", @"\\bS\\w+", @"(?i)sherlock", @"\\d+", @"[A-Z][a-z]+ [A-Z][a-z]+", @"\"[^\"]*\"", @"(\\w+)\\s+\\1", @"\\w+ly\\b" ];
+    NSString *corpus = self.testCorpus;
+    NSMutableArray<NSString *> *shortInputs = [NSMutableArray array], *longInputs = [NSMutableArray array];
+
+    for (NSUInteger location = 0; location + 16384 <= corpus.length; location += 4096) {
+        [shortInputs addObject:[corpus substringWithRange:NSMakeRange(location, 80)]];
+        [longInputs addObject:[corpus substringWithRange:NSMakeRange(location, 16384)]];
+    }
+
+    uint64_t *latencies = calloc(threadCount * operationCount, sizeof(uint64_t));
+    NSUInteger *compiles = calloc(threadCount, sizeof(NSUInteger)), *expectedCompiles = calloc(threadCount, sizeof(NSUInteger)), *matches = calloc(threadCount, sizeof(NSUInteger));
+    dispatch_semaphore_t start = dispatch_semaphore_create(0), finish = dispatch_semaphore_create(0);
+    dispatch_group_t group = dispatch_group_create();
+    int64_t heapBefore = RKXHeapBytesInUse();
+
+    for (NSUInteger t = 0; t < threadCount; t++) {
+        dispatch_group_enter(group);
+        NSThread *thread = [[NSThread alloc] initWithBlock:^{
+            @autoreleasepool {
+                NSUInteger hotCount = hotPatterns.count, coldCount = 0, found = 0;
+                dispatch_semaphore_wait(start, DISPATCH_TIME_FOREVER);
+
+                for (NSUInteger i = 0; i < operationCount; i++) {
+                    NSUInteger kind = (i * 7 + t) % 10;
+                    NSString *input = (kind == 7) ? longInputs[(i + t) % longInputs.count] : shortInputs[(i + t) % shortInputs.count];
+                    NSString *pattern = (kind < 8) ? hotPatterns[i % hotCount] : [NSString stringWithFormat:@"Holmes|Watson%lu", t * operationCount + i];
+                    uint64_t began = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+                    if (kind == 7) { found += [input countOfRegex:pattern]; }
+                    else { found += [input isMatchedByRegex:pattern]; }
+
+                    latencies[t * operationCount + i] = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - began;
+                    if (kind >= 8) { coldCount++; }
+                }
+
+                // A new thread starts with a count of 0, so every compile it reports happened in this run.
+                compiles[t] = NSString.regexCompileCount;
+                expectedCompiles[t] = MIN(hotCount, operationCount) + coldCount;
+                matches[t] = found;
+            }
+
+            dispatch_group_leave(group);
+            dispatch_semaphore_wait(finish, DISPATCH_TIME_FOREVER);
+        }];
+        [thread start];
+    }
+
+    uint64_t began = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    for (NSUInteger t = 0; t < threadCount; t++) { dispatch_semaphore_signal(start); }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - began;
+
+    // The caches are measured while the threads that own them are still alive.
+    int64_t heapAfter = RKXHeapBytesInUse();
+    for (NSUInteger t = 0; t < threadCount; t++) { dispatch_semaphore_signal(finish); }
+
+    NSUInteger latencyCount = threadCount * operationCount;
+    qsort(latencies, latencyCount, sizeof(uint64_t), RKXCompareLatencies);
+
+    RKXConcurrencyReport report = { .threadCount = threadCount, .operationCount = operationCount };
+    report.throughput = (double)latencyCount / ((double)elapsed / (double)NSEC_PER_SEC);
+    report.p50 = latencies[latencyCount / 2];
+    report.p99 = latencies[latencyCount * 99 / 100];
+    report.p999 = latencies[latencyCount * 999 / 1000];
+    report.cacheBytesPerThread = (heapAfter - heapBefore) / (int64_t)threadCount;
+
+    for (NSUInteger t = 0; t < threadCount; t++) {
+        XCTAssertGreaterThan(matches[t], 0UL);
+        report.compileCount += compiles[t];
+        if (compiles[t] > expectedCompiles[t]) { report.unexpectedCompiles += compiles[t] - expectedCompiles[t]; }
+    }
+
+    free(latencies);
+    free(compiles);
+    free(expectedCompiles);
+    free(matches);
+    return report;
+}
+
+- (void)testConcurrencyScalability
+{
+    // Runs the mixed workload on 1, 2, 4, ... threads up to one per core and logs a row per thread count. It fails if
+    // the cache compiles a pattern more than once per thread. Throughput depends on the machine, so it is only logged.
+    NSUInteger coreCount = NSProcessInfo.processInfo.activeProcessorCount;
+    RKXConcurrencyReport single = { 0 }, report = { 0 };
+
+    NSLog(@"threads  ops/s        p50 ns   p99 ns   p999 ns  compiles  cache bytes/thread");
+
+    NSMutableArray<NSNumber *> *threadCounts = [NSMutableArray array];
+    for (NSUInteger threadCount = 1; threadCount < coreCount; threadCount *= 2) { [threadCounts addObject:@(threadCount)]; }
+    [threadCounts addObject:@(coreCount)];
+
+    for (NSNumber *number in threadCounts) {
+        NSUInteger threadCount = number.unsignedIntegerValue;
+        report = [self runMixedWorkloadOnThreads:threadCount operations:2000];
+        if (threadCount == 1) { single = report; }
+
+        NSLog(@"%-7lu  %-11.0f  %-7llu  %-7llu  %-7llu  %-8lu  %lld", report.threadCount, report.throughput, report.p50, report.p99, report.p999, report.compileCount, report.cacheBytesPerThread);
+        XCTAssertEqual(report.unexpectedCompiles, 0UL, @"%lu threads", threadCount);
+    }
+
+    if (coreCount > 1) { NSLog(@"%lu threads: %.2fx the throughput of 1 thread", report.threadCount, report.throughput / single.throughput); }
+}
+
+- (void)testPerformanceConcurrentMixedWorkload
+{
+    // The mixed workload above with one thread per core.
+    NSUInteger coreCount = NSProcessInfo.processInfo.activeProcessorCount;
+
+    [self measureBlock:^{
+        RKXConcurrencyReport report = [self runMixedWorkloadOnThreads:coreCount operations:2000];
+        XCTAssertEqual(report.unexpectedCompiles, 0UL);
+    }];
+}
+
 #pragma mark - NSHipster
 
 - (void)testNSHipsterCluedoRegex